@@ -230,6 +230,15 @@ extern "C" {
     #endif
 #endif
 
+// Defined to 1 when VK_EXT_pageable_device_local_memory device extension is defined in Vulkan headers.
+#if !defined(VMA_PAGEABLE_DEVICE_LOCAL_MEMORY)
+    #if VK_EXT_pageable_device_local_memory
+        #define VMA_PAGEABLE_DEVICE_LOCAL_MEMORY 1
+    #else
+        #define VMA_PAGEABLE_DEVICE_LOCAL_MEMORY 0
+    #endif
+#endif
+
 // Defined to 1 when VK_KHR_maintenance4 device extension is defined in Vulkan headers.
 #if !defined(VMA_KHR_MAINTENANCE4)
     #if VK_KHR_maintenance4
@@ -494,6 +503,19 @@ typedef enum VmaAllocatorCreateFlagBits
     For more information, see \ref other_api_interop.
     */
     VMA_ALLOCATOR_CREATE_KHR_EXTERNAL_MEMORY_WIN32_BIT = 0x00000200,
+    /**
+    Enables usage of VK_EXT_pageable_device_local_memory extension in the library.
+
+    You may set this flag only if you found available and enabled this device extension,
+    along with `VkPhysicalDevicePageableDeviceLocalMemoryFeaturesEXT::pageableDeviceLocalMemory == VK_TRUE`,
+    while creating Vulkan device passed as VmaAllocatorCreateInfo::device.
+    The extension requires VK_EXT_memory_priority, so #VMA_ALLOCATOR_CREATE_EXT_MEMORY_PRIORITY_BIT must also be used.
+
+    When this flag is used, the library periodically changes priorities of its `VkDeviceMemory` blocks
+    in device-local memory types using `vkSetDeviceMemoryPriorityEXT`, based on how they are used.
+    For details, see \ref vk_ext_memory_priority_dynamic.
+    */
+    VMA_ALLOCATOR_CREATE_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_BIT = 0x00000400,
 
     VMA_ALLOCATOR_CREATE_FLAG_BITS_MAX_ENUM = 0x7FFFFFFF
 } VmaAllocatorCreateFlagBits;
@@ -621,6 +643,14 @@ typedef enum VmaAllocationCreateFlagBits
     support it (e.g. Intel GPU).
     */
     VMA_ALLOCATION_CREATE_MAPPED_BIT = 0x00000004,
+    /** \brief Set this flag to allow residency management to move the allocation to another memory type and back.
+
+    When usage of a `DEVICE_LOCAL` heap exceeds its budget, the context created by vmaBeginResidency() may move
+    the allocation to a `HOST_VISIBLE` memory type of another heap, among the ones allowed by its memory requirements,
+    VmaAllocationCreateInfo::memoryTypeBits, and VmaAllocationCreateInfo::requiredFlags, and back to the memory type preferred for it when there is space again. It is used only for allocations
+    in default pools, not created as dedicated. See \ref defragmentation_residency.
+    */
+    VMA_ALLOCATION_CREATE_EVICTABLE_BIT = 0x00000008,
     /** \deprecated Preserved for backward compatibility. Consider using vmaSetAllocationName() instead.
 
     Set this flag to treat VmaAllocationCreateInfo::pUserData as pointer to a
@@ -694,6 +724,25 @@ typedef enum VmaAllocationCreateFlagBits
     `VK_BUFFER_USAGE_TRANSFER_DST_BIT`, `VK_BUFFER_USAGE_TRANSFER_SRC_BIT` to the parameters of created buffer or image.
     */
     VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT = 0x00001000,
+    /** \brief Set this flag if the allocation must never be moved by defragmentation.
+
+    Defragmentation algorithms skip it instead of proposing moves that you would have to ignore
+    using #VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE, and prefer freeing other memory blocks.
+    It can be changed later using vmaSetAllocationImmovable().
+    */
+    VMA_ALLOCATION_CREATE_IMMOVABLE_BIT = 0x00002000,
+    /** \brief Set this flag if the allocation is used frequently, so the memory block containing it should stay resident.
+
+    Used only with #VMA_ALLOCATOR_CREATE_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_BIT. The block containing
+    the allocation gets the highest priority. See \ref vk_ext_memory_priority_dynamic.
+    */
+    VMA_ALLOCATION_CREATE_PRIORITY_HOT_BIT = 0x00004000,
+    /** \brief Set this flag if the allocation is used rarely, so the memory block containing it may be paged out first.
+
+    Used only with #VMA_ALLOCATOR_CREATE_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_BIT. A block containing
+    only such allocations gets the lowest priority. See \ref vk_ext_memory_priority_dynamic.
+    */
+    VMA_ALLOCATION_CREATE_PRIORITY_COLD_BIT = 0x00008000,
     /** Allocation strategy that chooses smallest possible free range for the allocation
     to minimize memory usage and fragmentation, possibly at the expense of allocation time.
     */
@@ -800,6 +849,15 @@ typedef enum VmaDefragmentationFlagBits
         VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT |
         VMA_DEFRAGMENTATION_FLAG_ALGORITHM_EXTENSIVE_BIT,
 
+    /** \brief Also move allocations that ended up in dedicated `VkDeviceMemory` only because they didn't fit into any block when created.
+
+    Such allocations are moved into free space of existing blocks of their pool or memory type, using the same passes and
+    #VmaDefragmentationMove entries as other allocations. No new blocks are created for them.
+    Their dedicated `VkDeviceMemory` is freed once the move is committed in vmaEndDefragmentationPass().
+    Allocations created with #VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT or preferring dedicated memory are never moved.
+    */
+    VMA_DEFRAGMENTATION_FLAG_PROMOTE_DEDICATED_BIT = 0x10,
+
     VMA_DEFRAGMENTATION_FLAG_BITS_MAX_ENUM = 0x7FFFFFFF
 } VmaDefragmentationFlagBits;
 /// See #VmaDefragmentationFlagBits.
@@ -980,6 +1038,24 @@ This object is not thread-safe - should not be used from multiple threads simult
 */
 VK_DEFINE_HANDLE(VmaVirtualBlock)
 
+/** \struct VmaVirtualBlockVector
+\brief Handle to a virtual block vector object that manages multiple virtual blocks of the same size, creating new ones as needed.
+
+Fill in #VmaVirtualBlockVectorCreateInfo structure and use vmaCreateVirtualBlockVector() to create it. Use vmaDestroyVirtualBlockVector() to destroy it.
+For more information, see documentation chapter \ref virtual_allocator.
+
+This object is not thread-safe - should not be used from multiple threads simultaneously, must be synchronized externally.
+*/
+VK_DEFINE_HANDLE(VmaVirtualBlockVector)
+
+/** \struct VmaVirtualDefragmentationContext
+\brief An opaque object that represents started defragmentation process of one or more virtual blocks.
+
+Fill structure #VmaVirtualDefragmentationInfo and call function vmaBeginVirtualDefragmentation() to create it.
+Call function vmaEndVirtualDefragmentation() to destroy it.
+*/
+VK_DEFINE_HANDLE(VmaVirtualDefragmentationContext)
+
 /** @} */
 
 /**
@@ -1020,6 +1096,93 @@ typedef struct VmaDeviceMemoryCallbacks
     void* VMA_NULLABLE pUserData;
 } VmaDeviceMemoryCallbacks;
 
+/** \brief Fragmentation of memory blocks of a custom pool or a default pool, tracked by the allocator.
+
+Passed to #PFN_vmaDefragmentationProposalFunction.
+*/
+typedef struct VmaFragmentationInfo
+{
+    /// Total size of free space in all memory blocks, in bytes.
+    VkDeviceSize freeSize;
+    /// Sum of sizes of the largest free region of each memory block, in bytes.
+    VkDeviceSize largestFreeRegionsSize;
+    /// Total number of free regions in all memory blocks.
+    uint32_t freeRegionCount;
+    /** \brief Part of the free space that is not in the largest free region of its memory block, in range 0..1.
+
+    Equal to `1 - largestFreeRegionsSize / freeSize`, or 0 if there is no free space.
+    */
+    float fragmentation;
+} VmaFragmentationInfo;
+
+/// Callback function called from vmaSetCurrentFrameIndex() when fragmentation of a pool exceeds VmaDefragmentationMonitor::fragmentationThreshold.
+typedef void (VKAPI_PTR* PFN_vmaDefragmentationProposalFunction)(
+    VmaAllocator VMA_NOT_NULL                    allocator,
+    VmaPool VMA_NULLABLE                         pool,
+    uint32_t                                     memoryTypeIndex,
+    const VmaFragmentationInfo* VMA_NOT_NULL     pFragmentationInfo,
+    void* VMA_NULLABLE                           pUserData);
+
+/** \brief Parameters of tracking fragmentation, used to propose defragmentation when needed.
+
+Used in VmaAllocatorCreateInfo::pDefragmentationMonitor.
+*/
+typedef struct VmaDefragmentationMonitor
+{
+    /** \brief Value of VmaFragmentationInfo::fragmentation above which a defragmentation is proposed.
+
+    Must be in range 0..1.
+    */
+    float fragmentationThreshold;
+    /** \brief Minimum size of free space outside of the largest free regions of memory blocks, in bytes, for a defragmentation to be proposed.
+
+    Prevents proposing defragmentation of pools where the fragmented free space is too small to matter.
+    Can be 0.
+    */
+    VkDeviceSize minFragmentedSize;
+    /// Function called to propose defragmentation. Must not be null.
+    PFN_vmaDefragmentationProposalFunction VMA_NOT_NULL pfnProposal;
+    /// Optional, can be null.
+    void* VMA_NULLABLE pUserData;
+} VmaDefragmentationMonitor;
+
+/** \brief Callback function called when memory usage of a heap crosses watermarks of VmaMemoryPressureMonitor.
+
+`underPressure` is `VK_TRUE` when usage has reached VmaMemoryPressureMonitor::highWatermark
+and `VK_FALSE` when it has dropped below VmaMemoryPressureMonitor::lowWatermark. `usage` and `budget` are
+as returned in #VmaBudget at that moment.
+*/
+typedef void (VKAPI_PTR* PFN_vmaMemoryPressureFunction)(
+    VmaAllocator VMA_NOT_NULL                    allocator,
+    uint32_t                                     heapIndex,
+    VkBool32                                     underPressure,
+    VkDeviceSize                                 usage,
+    VkDeviceSize                                 budget,
+    void* VMA_NULLABLE                           pUserData);
+
+/** \brief Parameters of notifications about memory pressure of heaps.
+
+Used in VmaAllocatorCreateInfo::pMemoryPressureMonitor.
+*/
+typedef struct VmaMemoryPressureMonitor
+{
+    /** \brief Ratio of VmaBudget::usage to VmaBudget::budget at or above which a heap enters the pressure state.
+
+    Must be greater than 0, e.g. 0.9.
+    */
+    float highWatermark;
+    /** \brief Ratio of VmaBudget::usage to VmaBudget::budget below which a heap under pressure leaves it.
+
+    Must be no greater than `highWatermark`, e.g. 0.8. The gap between the two watermarks
+    prevents repeated notifications while usage oscillates around a single value.
+    */
+    float lowWatermark;
+    /// Function called once on every transition of a heap into and out of the pressure state. Must not be null.
+    PFN_vmaMemoryPressureFunction VMA_NOT_NULL pfnPressure;
+    /// Optional, can be null.
+    void* VMA_NULLABLE pUserData;
+} VmaMemoryPressureMonitor;
+
 /** \brief Pointers to some Vulkan functions - a subset used by the library.
 
 Used in VmaAllocatorCreateInfo::pVulkanFunctions.
@@ -1078,6 +1241,10 @@ typedef struct VmaVulkanFunctions
     /// Fetch from "vkGetPhysicalDeviceProperties2" on Vulkan >= 1.1, but you can also fetch it from "vkGetPhysicalDeviceProperties2KHR" if you enabled extension VK_KHR_get_physical_device_properties2.
     PFN_vkGetPhysicalDeviceProperties2KHR VMA_NULLABLE vkGetPhysicalDeviceProperties2KHR;
 #endif
+#if VMA_PAGEABLE_DEVICE_LOCAL_MEMORY
+    /// Fetch from "vkSetDeviceMemoryPriorityEXT" if you enabled extension VK_EXT_pageable_device_local_memory.
+    PFN_vkSetDeviceMemoryPriorityEXT VMA_NULLABLE vkSetDeviceMemoryPriorityEXT;
+#endif
 } VmaVulkanFunctions;
 
 /// Description of a Allocator to be created.
@@ -1159,6 +1326,20 @@ typedef struct VmaAllocatorCreateInfo
     */
     const VkExternalMemoryHandleTypeFlagsKHR* VMA_NULLABLE VMA_LEN_IF_NOT_NULL("VkPhysicalDeviceMemoryProperties::memoryTypeCount") pTypeExternalMemoryHandleTypes;
 #endif // #if VMA_EXTERNAL_MEMORY
+    /** \brief Parameters for tracking fragmentation and proposing defragmentation. Optional.
+
+    Optional, can be null. When set, the allocator incrementally tracks fragmentation of default pools and custom pools
+    that don't use #VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT, and calls VmaDefragmentationMonitor::pfnProposal from vmaSetCurrentFrameIndex()
+    for the ones that exceed the threshold. For details see [Defragmentation monitor](@ref defragmentation_monitor).
+    */
+    const VmaDefragmentationMonitor* VMA_NULLABLE pDefragmentationMonitor;
+    /** \brief Parameters of notifications about memory usage of heaps approaching their budget. Optional.
+
+    Optional, can be null. When set, usage of a heap is compared with the watermarks every time `VkDeviceMemory`
+    is allocated or freed and when the budget is fetched from Vulkan, and VmaMemoryPressureMonitor::pfnPressure is called
+    when the heap enters or leaves the pressure state. For details see [Memory pressure notifications](@ref staying_within_budget_memory_pressure).
+    */
+    const VmaMemoryPressureMonitor* VMA_NULLABLE pMemoryPressureMonitor;
 } VmaAllocatorCreateInfo;
 
 /// Information about existing #VmaAllocator object.
@@ -1365,8 +1546,24 @@ typedef struct VmaAllocationCreateInfo
     or when doing interop with OpenGL.
     */
     VkDeviceSize minAlignment;
+    /** \brief Cost of moving this allocation by defragmentation, relative to other allocations of the same size. Can be 0.
+
+    0 (default) is treated as 1.
+    Set more than 1 for allocations that are expensive to recreate, e.g. images with many views referenced by descriptors,
+    or less than 1 for the ones that are cheap to move.
+    Defragmentation then prefers freeing memory blocks that contain less costly allocations.
+    It can be changed later using vmaSetAllocationMoveCost().
+    */
+    float moveCost;
 } VmaAllocationCreateInfo;
 
+/// Callback function called when `VkDeviceMemory` allocated by a custom pool exceeds VmaPoolCreateInfo::softMemoryLimit.
+typedef void (VKAPI_PTR* PFN_vmaPoolMemoryLimitFunction)(
+    VmaAllocator VMA_NOT_NULL                    allocator,
+    VmaPool VMA_NOT_NULL                         pool,
+    VkDeviceSize                                 memoryBytes,
+    void* VMA_NULLABLE                           pUserData);
+
 /// Describes parameter of created #VmaPool.
 typedef struct VmaPoolCreateInfo
 {
@@ -1428,8 +1625,72 @@ typedef struct VmaPoolCreateInfo
     can be attached automatically by this library when using other, more convenient of its features.
     */
     void* VMA_NULLABLE VMA_EXTENDS_VK_STRUCT(VkMemoryAllocateInfo) pMemoryAllocateNext;
+    /** \brief Size of `VkDeviceMemory` allocated by this pool, in bytes, above which VmaPoolCreateInfo::pfnSoftMemoryLimit is called. Optional.
+
+    Set to 0 to use default, which means no limit.
+
+    Memory is counted like VmaStatistics::blockBytes - whole memory blocks and dedicated allocations of this pool.
+    The callback is called once every time an allocation of new `VkDeviceMemory` makes the pool cross this limit,
+    so the subsystem owning the pool can evict some of its resources. The allocation itself succeeds.
+    */
+    VkDeviceSize softMemoryLimit;
+    /** \brief Maximum size of `VkDeviceMemory` allocated by this pool, in bytes. Optional.
+
+    Set to 0 to use default, which means no limit.
+
+    Memory is counted like for VmaPoolCreateInfo::softMemoryLimit.
+    An allocation that would need new `VkDeviceMemory` above this limit fails with `VK_ERROR_OUT_OF_DEVICE_MEMORY`
+    without calling `vkAllocateMemory`, while allocations fitting into free space of existing blocks still succeed.
+    If blocks preallocated due to VmaPoolCreateInfo::minBlockCount exceed it, vmaCreatePool() fails.
+    */
+    VkDeviceSize hardMemoryLimit;
+    /** \brief Function called when VmaPoolCreateInfo::softMemoryLimit is exceeded. Optional, can be null.
+
+    It is called during the allocation that exceeded the limit. For allocations placed in blocks of the pool
+    it is called while the pool is locked, so it must not allocate or free memory from this pool.
+    Dedicated allocations of the pool call it without the lock, possibly concurrently with other allocations.
+    In both cases, only note there that eviction is needed and perform it later.
+    */
+    PFN_vmaPoolMemoryLimitFunction VMA_NULLABLE pfnSoftMemoryLimit;
+    /// Optional, can be null. Passed to VmaPoolCreateInfo::pfnSoftMemoryLimit.
+    void* VMA_NULLABLE pSoftMemoryLimitUserData;
+    /** \brief Maximum number of empty blocks kept allocated for reuse after all allocations in them are freed. Optional.
+
+    Set to 0 to use default behavior of the library: at most one empty block is kept, and it may be freed
+    whenever another allocation is freed from the pool.
+
+    When not 0, up to this many empty blocks are kept, so an application that alternates between using
+    N and N + K blocks doesn't call `vkFreeMemory` and `vkAllocateMemory` repeatedly.
+    When the budget of the heap is exceeded, freeing an allocation from the pool also frees all its empty blocks.
+    Blocks preallocated due to VmaPoolCreateInfo::minBlockCount are never freed.
+    */
+    size_t maxEmptyBlockCount;
+    /** \brief Number of frames after which a block that stayed empty is freed. Optional.
+
+    Set to 0 to use default, which means empty blocks kept for reuse are not freed because of time.
+
+    When not 0, vmaSetCurrentFrameIndex() frees the empty blocks of this pool that haven't been used since
+    at least this many frames. See also VmaPoolCreateInfo::maxEmptyBlockCount and vmaGetPoolEmptyBlockStatistics().
+    */
+    uint32_t emptyBlockReleaseFrameCount;
 } VmaPoolCreateInfo;
 
+/// Statistics of empty blocks of a custom pool, returned by vmaGetPoolEmptyBlockStatistics().
+typedef struct VmaEmptyBlockStatistics
+{
+    /// Number of empty `VkDeviceMemory` blocks currently allocated by the pool.
+    uint32_t emptyBlockCount;
+    /// Total size of the blocks counted in `emptyBlockCount`, in bytes.
+    VkDeviceSize emptyBlockBytes;
+    /** \brief Number of times an allocation was placed in an empty block kept for reuse.
+
+    Each of them avoided a pair of `vkFreeMemory` and `vkAllocateMemory` calls.
+    */
+    uint64_t reusedBlockCount;
+    /// Number of empty blocks freed by vmaSetCurrentFrameIndex() after VmaPoolCreateInfo::emptyBlockReleaseFrameCount frames.
+    uint64_t releasedBlockCount;
+} VmaEmptyBlockStatistics;
+
 /** @} */
 
 /**
@@ -1528,6 +1789,21 @@ Should return true if the defragmentation needs to stop current pass.
 */
 typedef VkBool32 (VKAPI_PTR* PFN_vmaCheckDefragmentationBreakFunction)(void* VMA_NULLABLE pUserData);
 
+/// Single job to be executed by #PFN_vmaDispatchJobsFunction.
+typedef void (VKAPI_PTR* PFN_vmaJobFunction)(void* VMA_NULLABLE pJobData, uint32_t jobIndex);
+
+/** Callback function that lets the library execute independent jobs in parallel, e.g. using a thread pool of the application.
+
+Must call `pfnJob(pJobData, jobIndex)` exactly once for every `jobIndex` in range `[0, jobCount)`,
+in any order, possibly concurrently on multiple threads, and return only after all these calls have finished.
+Calling all of them sequentially on the current thread is also a valid implementation.
+*/
+typedef void (VKAPI_PTR* PFN_vmaDispatchJobsFunction)(
+    void* VMA_NULLABLE pUserData,
+    uint32_t jobCount,
+    PFN_vmaJobFunction VMA_NOT_NULL pfnJob,
+    void* VMA_NULLABLE pJobData);
+
 /** \brief Parameters for defragmentation.
 
 To be used with function vmaBeginDefragmentation().
@@ -1551,6 +1827,15 @@ typedef struct VmaDefragmentationInfo
     `0` means no limit.
     */
     uint32_t maxAllocationsPerPass;
+    /** \brief Maximum CPU time in nanoseconds that vmaBeginDefragmentationPass() can spend computing moves of single pass.
+
+    When exceeded, the pass ends with the moves found so far and the next pass resumes the computation where this one stopped.
+    The time is checked between allocations and only after at least one move has been found,
+    so every pass makes progress and the limit can be exceeded slightly.
+
+    `0` means no limit.
+    */
+    uint64_t maxPlanningTimePerPass;
     /** \brief Optional custom callback for stopping vmaBeginDefragmentation().
 
     Have to return true for breaking current defragmentation pass.
@@ -1558,6 +1843,21 @@ typedef struct VmaDefragmentationInfo
     PFN_vmaCheckDefragmentationBreakFunction VMA_NULLABLE pfnBreakCallback;
     /// \brief Optional data to pass to custom callback for stopping pass of defragmentation.
     void* VMA_NULLABLE pBreakCallbackUserData;
+    /** \brief Optional callback for computing moves of default pools in parallel.
+
+    When not null and `pool` is null, vmaBeginDefragmentationPass() computes moves of each memory type as a separate job
+    dispatched through this callback, holding only the lock of the memory type processed by the job.
+    The lock is held for the whole computation of the job, not only while the moves are committed,
+    because space for the destinations is reserved as the moves are found.
+    Results are merged into a single VmaDefragmentationPassMoveInfo in order of memory types,
+    respecting `maxBytesPerPass` and `maxAllocationsPerPass`, so the pass doesn't depend on order of completion of the jobs.
+    `pfnBreakCallback` can then be called from multiple threads at the same time.
+
+    It is also used by vmaExecuteDefragmentationPassOnHost() to copy the data in parallel, for any `pool`.
+    */
+    PFN_vmaDispatchJobsFunction VMA_NULLABLE pfnDispatchJobs;
+    /// \brief Optional data to pass to `pfnDispatchJobs`.
+    void* VMA_NULLABLE pDispatchJobsUserData;
 } VmaDefragmentationInfo;
 
 /// Single move of an allocation to be done for defragmentation.
@@ -1576,6 +1876,27 @@ typedef struct VmaDefragmentationMove
     VmaAllocation VMA_NOT_NULL dstTmpAllocation;
 } VmaDefragmentationMove;
 
+/** \brief Range of memory to be copied for defragmentation, covering moves of one or more neighboring allocations.
+
+Returned in VmaDefragmentationPassMoveInfo::pCopyRegions.
+*/
+typedef struct VmaDefragmentationCopyRegion
+{
+    /// Memory block where the data is copied from.
+    VkDeviceMemory VMA_NOT_NULL_NON_DISPATCHABLE srcMemory;
+    /** \brief Memory block where the data is copied to.
+
+    It can be the same as `srcMemory`. Source and destination ranges never overlap.
+    */
+    VkDeviceMemory VMA_NOT_NULL_NON_DISPATCHABLE dstMemory;
+    /// Offset of the source range in `srcMemory`, in bytes.
+    VkDeviceSize srcOffset;
+    /// Offset of the destination range in `dstMemory`, in bytes.
+    VkDeviceSize dstOffset;
+    /// Size of the range, in bytes.
+    VkDeviceSize size;
+} VmaDefragmentationCopyRegion;
+
 /** \brief Parameters for incremental defragmentation steps.
 
 To be used with function vmaBeginDefragmentationPass().
@@ -1608,6 +1929,18 @@ typedef struct VmaDefragmentationPassMoveInfo
     Then, after vmaEndDefragmentationPass() the allocation will be freed.
     */
     VmaDefragmentationMove* VMA_NULLABLE VMA_LEN_IF_NOT_NULL(moveCount) pMoves;
+    /// Number of elements in the `pCopyRegions` array.
+    uint32_t copyRegionCount;
+    /** \brief Array of data copies needed by the moves of the current pass, where moves of neighboring allocations by the same distance are merged.
+
+    Pointer to an array of `copyRegionCount` elements, owned by VMA, created in vmaBeginDefragmentationPass(), destroyed in vmaEndDefragmentationPass().
+
+    Regions are sorted by `srcMemory`, `dstMemory`, and `srcOffset`, so all regions between a pair of memory blocks can be copied
+    with a single `vkCmdCopyBuffer` using buffers bound to the whole blocks, instead of one copy per allocation.
+    They describe the moves as returned by vmaBeginDefragmentationPass().
+    If you change VmaDefragmentationMove::operation of some moves, perform the copies using `pMoves` instead.
+    */
+    VmaDefragmentationCopyRegion* VMA_NULLABLE VMA_LEN_IF_NOT_NULL(copyRegionCount) pCopyRegions;
 } VmaDefragmentationPassMoveInfo;
 
 /// Statistics returned for defragmentation process in function vmaEndDefragmentation().
@@ -1621,8 +1954,51 @@ typedef struct VmaDefragmentationStats
     uint32_t allocationsMoved;
     /// Number of empty `VkDeviceMemory` objects that have been released to the system.
     uint32_t deviceMemoryBlocksFreed;
+    /// Total CPU time in nanoseconds spent computing moves in vmaBeginDefragmentationPass().
+    uint64_t planningTime;
 } VmaDefragmentationStats;
 
+/// Predicted result of defragmentation returned by vmaEstimateDefragmentation().
+typedef struct VmaDefragmentationEstimate
+{
+    /** \brief Statistics expected from vmaEndDefragmentation() if all the proposed moves are performed.
+
+    `planningTime` is the CPU time spent simulating all the passes.
+    */
+    VmaDefragmentationStats stats;
+    /// Size of the largest free region in a single memory block remaining after defragmentation.
+    VkDeviceSize largestFreeRegionSize;
+} VmaDefragmentationEstimate;
+
+/** \brief Parameters for moving evictable allocations between memory types depending on budget.
+
+To be used with function vmaBeginResidency().
+*/
+typedef struct VmaResidencyInfo
+{
+    /** \brief Ratio of VmaBudget::usage to VmaBudget::budget of a `DEVICE_LOCAL` heap above which allocations are moved out of it.
+
+    Must be greater than 0, e.g. 0.95.
+    */
+    float evictionThreshold;
+    /** \brief Ratio of VmaBudget::usage to VmaBudget::budget of a heap below which allocations moved out of it are moved back.
+
+    Must be no greater than `evictionThreshold`, e.g. 0.8. The gap between the two thresholds
+    prevents moving the same allocations back and forth while usage oscillates around a single value.
+    */
+    float restoreThreshold;
+    /** \brief Maximum numbers of bytes that can be copied during single pass.
+
+    `0` means no limit.
+    */
+    VkDeviceSize maxBytesPerPass;
+    /** \brief Maximum number of allocations that can be moved during single pass.
+
+    `0` means no limit.
+    */
+    uint32_t maxAllocationsPerPass;
+} VmaResidencyInfo;
+
 /** @} */
 
 /**
@@ -1694,6 +2070,156 @@ typedef struct VmaVirtualAllocationInfo
     void* VMA_NULLABLE pUserData;
 } VmaVirtualAllocationInfo;
 
+/** \brief Callback function called by #VmaVirtualBlockVector when it needs a new block.
+
+It should create the resource that backs the range of `size` units identified by `blockIndex`, e.g. a `VkBuffer`.
+Return `VK_SUCCESS` to confirm, or an error code to make the allocation that triggered it fail with this code.
+*/
+typedef VkResult (VKAPI_PTR* PFN_vmaCreateVirtualBlockFunction)(
+    VmaVirtualBlockVector VMA_NOT_NULL virtualBlockVector,
+    uint32_t blockIndex,
+    VkDeviceSize size,
+    void* VMA_NULLABLE pUserData);
+
+/** \brief Callback function called by #VmaVirtualBlockVector when it releases an empty block.
+
+The resource backing block `blockIndex` can be destroyed. The index may be reused for a new block later.
+*/
+typedef void (VKAPI_PTR* PFN_vmaDestroyVirtualBlockFunction)(
+    VmaVirtualBlockVector VMA_NOT_NULL virtualBlockVector,
+    uint32_t blockIndex,
+    void* VMA_NULLABLE pUserData);
+
+/// Parameters of created #VmaVirtualBlockVector object to be passed to vmaCreateVirtualBlockVector().
+typedef struct VmaVirtualBlockVectorCreateInfo
+{
+    /** \brief Size of each virtual block.
+
+    Cannot be zero. Allocations larger than this size always fail.
+    */
+    VkDeviceSize blockSize;
+    /** \brief Use combination of #VmaVirtualBlockCreateFlagBits.
+
+    They are applied to every block of the vector.
+    */
+    VmaVirtualBlockCreateFlags flags;
+    /** \brief Minimum number of blocks to be always allocated in this vector, even if they stay empty.
+
+    They are created in vmaCreateVirtualBlockVector().
+    */
+    size_t minBlockCount;
+    /** \brief Maximum number of blocks that can be allocated in this vector. Optional.
+
+    Set to 0 to use default, which is `SIZE_MAX`, which means no limit.
+    */
+    size_t maxBlockCount;
+    /// Optional, can be null. Called when a new block is created.
+    PFN_vmaCreateVirtualBlockFunction VMA_NULLABLE pfnCreateBlock;
+    /// Optional, can be null. Called when an empty block is released.
+    PFN_vmaDestroyVirtualBlockFunction VMA_NULLABLE pfnDestroyBlock;
+    /// Custom pointer passed to `pfnCreateBlock` and `pfnDestroyBlock`.
+    void* VMA_NULLABLE pUserData;
+    /** \brief Custom CPU memory allocation callbacks. Optional.
+
+    Optional, can be null. When specified, they will be used for all CPU-side memory allocations.
+    */
+    const VkAllocationCallbacks* VMA_NULLABLE pAllocationCallbacks;
+} VmaVirtualBlockVectorCreateInfo;
+
+/** \brief Parameters for defragmentation of virtual blocks.
+
+To be used with function vmaBeginVirtualDefragmentation().
+*/
+typedef struct VmaVirtualDefragmentationInfo
+{
+    /** \brief Use combination of #VmaDefragmentationFlagBits.
+
+    #VMA_DEFRAGMENTATION_FLAG_ALGORITHM_EXTENSIVE_BIT behaves like #VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT,
+    as there are no buffer-image granularity conflicts in virtual blocks.
+    */
+    VmaDefragmentationFlags flags;
+    /// Number of elements in the `pBlocks` array.
+    uint32_t blockCount;
+    /** \brief Virtual blocks to be defragmented together.
+
+    Allocations can be moved within a block and between any of these blocks.
+    All of them must use the default (TLSF) algorithm.
+    */
+    const VmaVirtualBlock VMA_NOT_NULL* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(blockCount) pBlocks;
+    /** \brief Alignment required for the new offsets of moved allocations.
+
+    Virtual blocks don't remember alignment requested for each allocation, so it must be specified here.
+    Must be power of two. Special value 0 has the same meaning as 1.
+    */
+    VkDeviceSize alignment;
+    /** \brief Maximum number of bytes that can be copied during single pass, while moving allocations to different places.
+
+    `0` means no limit.
+    */
+    VkDeviceSize maxBytesPerPass;
+    /** \brief Maximum number of allocations that can be moved during single pass to a different place.
+
+    `0` means no limit.
+    */
+    uint32_t maxAllocationsPerPass;
+    /** \brief Optional custom callback for stopping vmaBeginVirtualDefragmentationPass().
+
+    Have to return true for breaking current defragmentation pass.
+    */
+    PFN_vmaCheckDefragmentationBreakFunction VMA_NULLABLE pfnBreakCallback;
+    /// \brief Optional data to pass to custom callback for stopping pass of defragmentation.
+    void* VMA_NULLABLE pBreakCallbackUserData;
+} VmaVirtualDefragmentationInfo;
+
+/// Single move of a virtual allocation to be done for defragmentation.
+typedef struct VmaVirtualDefragmentationMove
+{
+    /// Operation to be performed on the allocation by vmaEndVirtualDefragmentationPass(). Default value is #VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY. You can modify it.
+    VmaDefragmentationMoveOperation operation;
+    /// Virtual block containing the allocation that should be moved.
+    VmaVirtualBlock VMA_NOT_NULL srcBlock;
+    /// Allocation that should be moved.
+    VmaVirtualAllocation VMA_NOT_NULL_NON_DISPATCHABLE srcAllocation;
+    /// Current offset of the allocation in `srcBlock`.
+    VkDeviceSize srcOffset;
+    /// Virtual block where the allocation will be moved. Can be the same as `srcBlock`.
+    VmaVirtualBlock VMA_NOT_NULL dstBlock;
+    /** \brief Allocation reserving the destination range in `dstBlock`.
+
+    After vmaEndVirtualDefragmentationPass() with operation #VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY,
+    `srcAllocation` is freed and this handle becomes the allocation, keeping its `pUserData`.
+    You need to update your references to the allocation accordingly.
+    */
+    VmaVirtualAllocation VMA_NOT_NULL_NON_DISPATCHABLE dstAllocation;
+    /// Offset of the destination range in `dstBlock`.
+    VkDeviceSize dstOffset;
+    /// Size of the allocation, which is the number of bytes to copy.
+    VkDeviceSize size;
+} VmaVirtualDefragmentationMove;
+
+/** \brief Parameters for incremental defragmentation steps of virtual blocks.
+
+To be used with function vmaBeginVirtualDefragmentationPass().
+*/
+typedef struct VmaVirtualDefragmentationPassMoveInfo
+{
+    /// Number of elements in the `pMoves` array.
+    uint32_t moveCount;
+    /** \brief Array of moves to be performed by the user in the current defragmentation pass.
+
+    Pointer to an array of `moveCount` elements, owned by VMA, created in vmaBeginVirtualDefragmentationPass(), destroyed in vmaEndVirtualDefragmentationPass().
+
+    For each element, copy `size` bytes of your data from VmaVirtualDefragmentationMove::srcOffset in the resource represented by
+    VmaVirtualDefragmentationMove::srcBlock to VmaVirtualDefragmentationMove::dstOffset in the resource represented by
+    VmaVirtualDefragmentationMove::dstBlock, e.g. using `vkCmdCopyBuffer`, and make sure the copies finished.
+    Source and destination ranges never overlap.
+
+    Alternatively, you can set VmaVirtualDefragmentationMove::operation to #VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE
+    to keep the allocation in place, or to #VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY to free it.
+    */
+    VmaVirtualDefragmentationMove* VMA_NULLABLE VMA_LEN_IF_NOT_NULL(moveCount) pMoves;
+} VmaVirtualDefragmentationPassMoveInfo;
+
 /** @} */
 
 #endif // _VMA_DATA_TYPES_DECLARATIONS
@@ -1807,6 +2333,9 @@ VMA_CALL_PRE void VMA_CALL_POST vmaGetMemoryTypeProperties(
     VkMemoryPropertyFlags* VMA_NOT_NULL pFlags);
 
 /** \brief Sets index of the current frame.
+
+If VmaAllocatorCreateInfo::pDefragmentationMonitor was specified, this function also checks fragmentation of the pools
+and calls VmaDefragmentationMonitor::pfnProposal for those that need defragmentation.
 */
 VMA_CALL_PRE void VMA_CALL_POST vmaSetCurrentFrameIndex(
     VmaAllocator VMA_NOT_NULL allocator,
@@ -1950,6 +2479,19 @@ VMA_CALL_PRE void VMA_CALL_POST vmaCalculatePoolStatistics(
     VmaPool VMA_NOT_NULL pool,
     VmaDetailedStatistics* VMA_NOT_NULL pPoolStats);
 
+/** \brief Retrieves statistics of empty blocks kept by existing #VmaPool object.
+
+\param allocator Allocator object.
+\param pool Pool object.
+\param[out] pStats Statistics of empty blocks of specified pool.
+
+See VmaPoolCreateInfo::maxEmptyBlockCount, VmaPoolCreateInfo::emptyBlockReleaseFrameCount.
+*/
+VMA_CALL_PRE void VMA_CALL_POST vmaGetPoolEmptyBlockStatistics(
+    VmaAllocator VMA_NOT_NULL allocator,
+    VmaPool VMA_NOT_NULL pool,
+    VmaEmptyBlockStatistics* VMA_NOT_NULL pStats);
+
 /** @} */
 
 /**
@@ -2187,6 +2729,37 @@ VMA_CALL_PRE void VMA_CALL_POST vmaSetAllocationName(
     VmaAllocation VMA_NOT_NULL allocation,
     const char* VMA_NULLABLE pName);
 
+/** \brief Sets whether the allocation must never be moved by defragmentation.
+
+See #VMA_ALLOCATION_CREATE_IMMOVABLE_BIT.
+It takes effect in defragmentation passes computed after this call.
+*/
+VMA_CALL_PRE void VMA_CALL_POST vmaSetAllocationImmovable(
+    VmaAllocator VMA_NOT_NULL allocator,
+    VmaAllocation VMA_NOT_NULL allocation,
+    VkBool32 immovable);
+
+/** \brief Sets cost of moving the allocation by defragmentation.
+
+See VmaAllocationCreateInfo::moveCost.
+It takes effect in defragmentations begun after this call.
+*/
+VMA_CALL_PRE void VMA_CALL_POST vmaSetAllocationMoveCost(
+    VmaAllocator VMA_NOT_NULL allocator,
+    VmaAllocation VMA_NOT_NULL allocation,
+    float moveCost);
+
+/** \brief Informs the library that the allocation is used in the current frame.
+
+Used only with #VMA_ALLOCATOR_CREATE_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_BIT. The memory block containing
+the allocation is then considered recently used when its priority is updated.
+Calling vmaMapMemory() has the same effect. See \ref vk_ext_memory_priority_dynamic.
+This function is fast and can be called for many allocations every frame.
+*/
+VMA_CALL_PRE void VMA_CALL_POST vmaNotifyAllocationUsed(
+    VmaAllocator VMA_NOT_NULL allocator,
+    VmaAllocation VMA_NOT_NULL allocation);
+
 /**
 \brief Given an allocation, returns Property Flags of its memory type.
 
@@ -2408,6 +2981,7 @@ VMA_CALL_PRE VkResult VMA_CALL_POST vmaInvalidateAllocation(
 /** \brief Flushes memory of given set of allocations.
 
 Calls `vkFlushMappedMemoryRanges()` for memory associated with given ranges of given allocations.
+Overlapping and adjacent ranges in the same `VkDeviceMemory` block are merged into one before the call.
 For more information, see documentation of vmaFlushAllocation().
 
 \param allocator
@@ -2429,6 +3003,7 @@ VMA_CALL_PRE VkResult VMA_CALL_POST vmaFlushAllocations(
 /** \brief Invalidates memory of given set of allocations.
 
 Calls `vkInvalidateMappedMemoryRanges()` for memory associated with given ranges of given allocations.
+Overlapping and adjacent ranges in the same `VkDeviceMemory` block are merged into one before the call.
 For more information, see documentation of vmaInvalidateAllocation().
 
 \param allocator
@@ -2447,37 +3022,87 @@ VMA_CALL_PRE VkResult VMA_CALL_POST vmaInvalidateAllocations(
     const VkDeviceSize* VMA_NULLABLE VMA_LEN_IF_NOT_NULL(allocationCount) offsets,
     const VkDeviceSize* VMA_NULLABLE VMA_LEN_IF_NOT_NULL(allocationCount) sizes);
 
-/** \brief Maps the allocation temporarily if needed, copies data from specified host pointer to it, and flushes the memory from the host caches if needed.
+/** \brief Records a region of an allocation to be flushed later by vmaFlushDirty().
 
 \param allocator
-\param pSrcHostPointer Pointer to the host data that become source of the copy.
-\param dstAllocation   Handle to the allocation that becomes destination of the copy.
-\param dstAllocationLocalOffset  Offset within `dstAllocation` where to write copied data, in bytes.
-\param size            Number of bytes to copy.
-
-This is a convenience function that allows to copy data from a host pointer to an allocation easily.
-Same behavior can be achieved by calling vmaMapMemory(), `memcpy()`, vmaUnmapMemory(), vmaFlushAllocation().
+\param allocation
+\param offset Offset in memory, relative to the beginning of the allocation.
+\param size Size of the region, in bytes. Can be `VK_WHOLE_SIZE`, meaning until the end of the allocation.
 
-This function can be called only for allocations created in a memory type that has `VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT` flag.
-It can be ensured e.g. by using #VMA_MEMORY_USAGE_AUTO and #VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT or
-#VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT.
-Otherwise, the function will fail and generate a Validation Layers error.
+Use it instead of vmaFlushAllocation() after writes to a mapped allocation to flush all such regions
+with a single call to `vkFlushMappedMemoryRanges()`, e.g. once per frame before submitting work to the GPU.
+If the memory type of the allocation is `HOST_COHERENT`, this call is ignored.
 
-`dstAllocationLocalOffset` is relative to the contents of given `dstAllocation`.
-If you mean whole allocation, you should pass 0.
-Do not pass allocation's offset within device memory block this parameter!
+Regions are recorded in the allocator, not the allocation. Those in `VkDeviceMemory` freed in the meantime are dropped,
+but you must not free the allocation while vmaFlushDirty() is called in another thread.
 */
-VMA_CALL_PRE VkResult VMA_CALL_POST vmaCopyMemoryToAllocation(
+VMA_CALL_PRE void VMA_CALL_POST vmaMarkDirty(
     VmaAllocator VMA_NOT_NULL allocator,
-    const void* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(size) pSrcHostPointer,
-    VmaAllocation VMA_NOT_NULL dstAllocation,
-    VkDeviceSize dstAllocationLocalOffset,
+    VmaAllocation VMA_NOT_NULL allocation,
+    VkDeviceSize offset,
     VkDeviceSize size);
 
-/** \brief Invalidates memory in the host caches if needed, maps the allocation temporarily if needed, and copies data from it to a specified host pointer.
+/** \brief Flushes all regions recorded by vmaMarkDirty() since the previous call.
 
-\param allocator
-\param srcAllocation   Handle to the allocation that becomes source of the copy.
+Overlapping and adjacent regions in the same `VkDeviceMemory` block are merged.
+
+This function returns the `VkResult` from `vkFlushMappedMemoryRanges` if it is
+called, otherwise `VK_SUCCESS`.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaFlushDirty(VmaAllocator VMA_NOT_NULL allocator);
+
+/** \brief Records a region of an allocation to be invalidated later by vmaInvalidateStale().
+
+Counterpart of vmaMarkDirty() for readback: mark the regions the GPU is going to write,
+then call vmaInvalidateStale() once after waiting for it and before reading them through mapped pointers.
+If the memory type of the allocation is `HOST_COHERENT`, this call is ignored.
+*/
+VMA_CALL_PRE void VMA_CALL_POST vmaMarkStale(
+    VmaAllocator VMA_NOT_NULL allocator,
+    VmaAllocation VMA_NOT_NULL allocation,
+    VkDeviceSize offset,
+    VkDeviceSize size);
+
+/** \brief Invalidates all regions recorded by vmaMarkStale() since the previous call.
+
+Overlapping and adjacent regions in the same `VkDeviceMemory` block are merged.
+
+This function returns the `VkResult` from `vkInvalidateMappedMemoryRanges` if it is
+called, otherwise `VK_SUCCESS`.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaInvalidateStale(VmaAllocator VMA_NOT_NULL allocator);
+
+/** \brief Maps the allocation temporarily if needed, copies data from specified host pointer to it, and flushes the memory from the host caches if needed.
+
+\param allocator
+\param pSrcHostPointer Pointer to the host data that become source of the copy.
+\param dstAllocation   Handle to the allocation that becomes destination of the copy.
+\param dstAllocationLocalOffset  Offset within `dstAllocation` where to write copied data, in bytes.
+\param size            Number of bytes to copy.
+
+This is a convenience function that allows to copy data from a host pointer to an allocation easily.
+Same behavior can be achieved by calling vmaMapMemory(), `memcpy()`, vmaUnmapMemory(), vmaFlushAllocation().
+
+This function can be called only for allocations created in a memory type that has `VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT` flag.
+It can be ensured e.g. by using #VMA_MEMORY_USAGE_AUTO and #VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT or
+#VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT.
+Otherwise, the function will fail and generate a Validation Layers error.
+
+`dstAllocationLocalOffset` is relative to the contents of given `dstAllocation`.
+If you mean whole allocation, you should pass 0.
+Do not pass allocation's offset within device memory block this parameter!
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaCopyMemoryToAllocation(
+    VmaAllocator VMA_NOT_NULL allocator,
+    const void* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(size) pSrcHostPointer,
+    VmaAllocation VMA_NOT_NULL dstAllocation,
+    VkDeviceSize dstAllocationLocalOffset,
+    VkDeviceSize size);
+
+/** \brief Invalidates memory in the host caches if needed, maps the allocation temporarily if needed, and copies data from it to a specified host pointer.
+
+\param allocator
+\param srcAllocation   Handle to the allocation that becomes source of the copy.
 \param srcAllocationLocalOffset  Offset within `srcAllocation` where to read copied data, in bytes.
 \param pDstHostPointer Pointer to the host memory that become destination of the copy.
 \param size            Number of bytes to copy.
@@ -2502,6 +3127,61 @@ VMA_CALL_PRE VkResult VMA_CALL_POST vmaCopyAllocationToMemory(
     void* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(size) pDstHostPointer,
     VkDeviceSize size);
 
+/** \brief Copies data from multiple host pointers to multiple allocations, mapping each memory block once and flushing all the written ranges at once.
+
+\param allocator
+\param copyCount           Number of elements in the arrays.
+\param ppSrcHostPointers   Pointers to the host data that become sources of the copies.
+\param dstAllocations      Handles of the allocations that become destinations of the copies.
+\param dstAllocationLocalOffsets  Offsets within `dstAllocations` where to write copied data, in bytes. Optional - null means all offsets are 0.
+\param sizes               Numbers of bytes to copy.
+\param pfnDispatchJobs     Optional callback used to split the copies into jobs executed in parallel, e.g. on a thread pool of the application.
+\param pDispatchJobsUserData  Custom pointer passed to `pfnDispatchJobs`.
+
+This is a batched version of vmaCopyMemoryToAllocation().
+Allocations placed in the same `VkDeviceMemory` block share a single mapping, copies continuing each other
+in both source and destination are merged, and the written ranges are flushed with a single call to `vkFlushMappedMemoryRanges`,
+with adjacent ranges merged as in vmaFlushAllocations().
+If `pfnDispatchJobs` is not null and the total size of the copies exceeds #VMA_DEFRAGMENTATION_HOST_COPY_JOB_SIZE,
+the copies are split into jobs of that size, executed by the callback.
+
+The same allocation can appear multiple times in the arrays, but destination ranges must not overlap.
+All the allocations must meet the requirements of vmaCopyMemoryToAllocation().
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaCopyMemoryToAllocations(
+    VmaAllocator VMA_NOT_NULL allocator,
+    uint32_t copyCount,
+    const void* VMA_NOT_NULL const* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(copyCount) ppSrcHostPointers,
+    const VmaAllocation VMA_NOT_NULL* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(copyCount) dstAllocations,
+    const VkDeviceSize* VMA_NULLABLE VMA_LEN_IF_NOT_NULL(copyCount) dstAllocationLocalOffsets,
+    const VkDeviceSize* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(copyCount) sizes,
+    PFN_vmaDispatchJobsFunction VMA_NULLABLE pfnDispatchJobs,
+    void* VMA_NULLABLE pDispatchJobsUserData);
+
+/** \brief Copies data from multiple allocations to multiple host pointers, invalidating all the read ranges at once and mapping each memory block once.
+
+\param allocator
+\param copyCount           Number of elements in the arrays.
+\param srcAllocations      Handles of the allocations that become sources of the copies.
+\param srcAllocationLocalOffsets  Offsets within `srcAllocations` where to read copied data, in bytes. Optional - null means all offsets are 0.
+\param ppDstHostPointers   Pointers to the host memory that become destinations of the copies.
+\param sizes               Numbers of bytes to copy.
+\param pfnDispatchJobs     Optional callback used to split the copies into jobs executed in parallel, e.g. on a thread pool of the application.
+\param pDispatchJobsUserData  Custom pointer passed to `pfnDispatchJobs`.
+
+This is a batched version of vmaCopyAllocationToMemory(), working the same way as vmaCopyMemoryToAllocations(),
+except the read ranges are invalidated with a single call to `vkInvalidateMappedMemoryRanges` before copying.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaCopyAllocationsToMemory(
+    VmaAllocator VMA_NOT_NULL allocator,
+    uint32_t copyCount,
+    const VmaAllocation VMA_NOT_NULL* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(copyCount) srcAllocations,
+    const VkDeviceSize* VMA_NULLABLE VMA_LEN_IF_NOT_NULL(copyCount) srcAllocationLocalOffsets,
+    void* VMA_NOT_NULL const* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(copyCount) ppDstHostPointers,
+    const VkDeviceSize* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(copyCount) sizes,
+    PFN_vmaDispatchJobsFunction VMA_NULLABLE pfnDispatchJobs,
+    void* VMA_NULLABLE pDispatchJobsUserData);
+
 /** \brief Checks magic number in margins around all allocations in given memory types (in both default and custom pools) in search for corruptions.
 
 \param allocator
@@ -2568,6 +3248,61 @@ VMA_CALL_PRE VkResult VMA_CALL_POST vmaBeginDefragmentationPass(
     VmaDefragmentationContext VMA_NOT_NULL context,
     VmaDefragmentationPassMoveInfo* VMA_NOT_NULL pPassInfo);
 
+/** \brief Performs the copies of a defragmentation pass on the CPU, for memory types that are `HOST_VISIBLE`.
+
+\param allocator Allocator object.
+\param context Context object that has been created by vmaBeginDefragmentation().
+\param pPassInfo Moves of current pass returned by vmaBeginDefragmentationPass() and possibly modified by you.
+\returns
+- `VK_SUCCESS` if the data of all the moves have been copied.
+- `VK_ERROR_FEATURE_NOT_PRESENT` if some move is in memory that is not `HOST_VISIBLE`. Nothing is copied then.
+- Other error code if mapping or flushing memory failed.
+
+Copies the data of every move with VmaDefragmentationMove::operation equal to #VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY
+from `srcAllocation` to `dstTmpAllocation` using `memcpy`, through the pointers of memory blocks that are already mapped,
+mapping the others for the time of the call. The allocations don't need to be created with any of the
+`VMA_ALLOCATION_CREATE_HOST_ACCESS_*` flags, only their memory needs to be `HOST_VISIBLE`.
+Source ranges are invalidated before the copy and destination ranges are flushed after it, where the memory is not `HOST_COHERENT`.
+If VmaDefragmentationInfo::pfnDispatchJobs was specified, the copies are split into jobs of up to #VMA_DEFRAGMENTATION_HOST_COPY_JOB_SIZE bytes
+executed through it.
+
+Call it between vmaBeginDefragmentationPass() and vmaEndDefragmentationPass(), after changing operations of the moves if needed.
+You still need to recreate buffers and images bound to the moved allocations, as described in VmaDefragmentationPassMoveInfo::pMoves.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaExecuteDefragmentationPassOnHost(
+    VmaAllocator VMA_NOT_NULL allocator,
+    VmaDefragmentationContext VMA_NOT_NULL context,
+    const VmaDefragmentationPassMoveInfo* VMA_NOT_NULL pPassInfo);
+
+/** \brief Records the copies of a defragmentation pass into a command buffer, for allocations of buffers.
+
+\param allocator Allocator object.
+\param context Context object that has been created by vmaBeginDefragmentation().
+\param pPassInfo Moves of current pass returned by vmaBeginDefragmentationPass() and possibly modified by you.
+\param commandBuffer Command buffer in recording state, where the copies are recorded.
+\returns
+- `VK_SUCCESS` if the copies of all the moves have been recorded.
+- `VK_INCOMPLETE` if some moves were skipped, because their allocations were created for images,
+  their memory type doesn't support transfer buffers, or `srcAllocation` has its own dedicated `VkDeviceMemory`,
+  e.g. promoted with #VMA_DEFRAGMENTATION_FLAG_PROMOTE_DEDICATED_BIT. You need to copy these yourself.
+- Other error code if creating or binding a buffer failed. Nothing is recorded then.
+
+For every move with VmaDefragmentationMove::operation equal to #VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY,
+records a copy from `srcAllocation` to `dstTmpAllocation` using `vkCmdCopyBuffer`.
+Instead of a buffer per allocation, it uses a single buffer bound to the whole `VkDeviceMemory` block,
+created on first use and kept in the context for following passes, until the block is freed or vmaEndDefragmentation() is called.
+Moves between the same pair of blocks are recorded with one `vkCmdCopyBuffer`, with neighboring ranges merged.
+
+Only the copies are recorded. You need to record pipeline barriers before and after them,
+submit the command buffer and wait for it to finish before calling vmaEndDefragmentationPass().
+You still need to recreate buffers bound to the moved allocations, as described in VmaDefragmentationPassMoveInfo::pMoves.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaRecordDefragmentationPassCopies(
+    VmaAllocator VMA_NOT_NULL allocator,
+    VmaDefragmentationContext VMA_NOT_NULL context,
+    const VmaDefragmentationPassMoveInfo* VMA_NOT_NULL pPassInfo,
+    VkCommandBuffer VMA_NOT_NULL commandBuffer);
+
 /** \brief Ends single defragmentation pass.
 
 \param allocator Allocator object.
@@ -2591,6 +3326,47 @@ VMA_CALL_PRE VkResult VMA_CALL_POST vmaEndDefragmentationPass(
     VmaDefragmentationContext VMA_NOT_NULL context,
     VmaDefragmentationPassMoveInfo* VMA_NOT_NULL pPassInfo);
 
+/** \brief Predicts the result of defragmentation without moving any allocation.
+
+\param allocator Allocator object.
+\param pInfo Structure filled with parameters of defragmentation, as passed to vmaBeginDefragmentation().
+\param[out] pEstimate Predicted statistics of the whole defragmentation.
+\returns
+- `VK_SUCCESS` if the estimate has been computed.
+- `VK_ERROR_FEATURE_NOT_PRESENT` if defragmenting given pool is not supported.
+
+Runs the algorithm chosen in VmaDefragmentationInfo::flags over copies of the current state of memory blocks,
+assuming all proposed moves are performed, and leaves the blocks unchanged.
+It can be used to compare the algorithms or to decide whether defragmentation is worth its cost.
+See \ref defragmentation_estimate for limitations of the prediction.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaEstimateDefragmentation(
+    VmaAllocator VMA_NOT_NULL allocator,
+    const VmaDefragmentationInfo* VMA_NOT_NULL pInfo,
+    VmaDefragmentationEstimate* VMA_NOT_NULL pEstimate);
+
+/** \brief Begins moving evictable allocations between memory types depending on budget of the heaps.
+
+\param allocator Allocator object.
+\param pInfo Structure filled with parameters of residency management.
+\param[out] pContext Context object that must be passed to vmaEndDefragmentation() to finish the process.
+\returns `VK_SUCCESS`.
+
+The returned context is used like one created by vmaBeginDefragmentation(), with the same functions:
+vmaBeginDefragmentationPass(), vmaExecuteDefragmentationPassOnHost(), vmaRecordDefragmentationPassCopies(),
+vmaEndDefragmentationPass(), and vmaEndDefragmentation().
+Instead of compacting memory, each pass moves allocations created with #VMA_ALLOCATION_CREATE_EVICTABLE_BIT
+out of `DEVICE_LOCAL` heaps whose usage exceeds VmaResidencyInfo::evictionThreshold of the budget,
+and back to their preferred memory type when its heap is below VmaResidencyInfo::restoreThreshold.
+Only default pools are processed.
+
+For more information, see [Residency management](@ref defragmentation_residency).
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaBeginResidency(
+    VmaAllocator VMA_NOT_NULL allocator,
+    const VmaResidencyInfo* VMA_NOT_NULL pInfo,
+    VmaDefragmentationContext VMA_NULLABLE* VMA_NOT_NULL pContext);
+
 /** \brief Binds buffer to allocation.
 
 Binds specified buffer to region of memory represented by specified allocation.
@@ -2936,6 +3712,29 @@ VMA_CALL_PRE VkResult VMA_CALL_POST vmaVirtualAllocate(
     VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE* VMA_NOT_NULL pAllocation,
     VkDeviceSize* VMA_NULLABLE pOffset);
 
+/** \brief Allocates multiple virtual allocations inside given #VmaVirtualBlock at once.
+
+\param virtualBlock Virtual block
+\param allocationCount Number of allocations to make.
+\param pCreateInfos Parameters for each allocation.
+\param[out] pAllocations Pointer to array that will be filled with handles of the new allocations.
+\param[out] pOffsets Optional, can be null. Pointer to array that will be filled with offsets of the new allocations.
+
+It is equivalent to calling vmaVirtualAllocate() `allocationCount` times, but the parameters are validated
+and the call is debug-logged once per batch instead of once per allocation.
+
+Allocations are made in the order of the array. Failure of one allocation doesn't stop the following ones.
+For each allocation that failed due to not enough free space, `pAllocations[i]` is set to `VK_NULL_HANDLE`
+and `pOffsets[i]`, if not null, is set to `UINT64_MAX`. Function returns `VK_SUCCESS` only if all allocations succeeded,
+otherwise `VK_ERROR_OUT_OF_DEVICE_MEMORY` - allocations that succeeded are then left in place and must be freed as usual.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaVirtualAllocateMultiple(
+    VmaVirtualBlock VMA_NOT_NULL virtualBlock,
+    size_t allocationCount,
+    const VmaVirtualAllocationCreateInfo* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(allocationCount) pCreateInfos,
+    VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(allocationCount) pAllocations,
+    VkDeviceSize* VMA_NULLABLE VMA_LEN_IF_NOT_NULL(allocationCount) pOffsets);
+
 /** \brief Frees virtual allocation inside given #VmaVirtualBlock.
 
 It is correct to call this function with `allocation == VK_NULL_HANDLE` - it does nothing.
@@ -2944,6 +3743,18 @@ VMA_CALL_PRE void VMA_CALL_POST vmaVirtualFree(
     VmaVirtualBlock VMA_NOT_NULL virtualBlock,
     VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE allocation);
 
+/** \brief Frees multiple virtual allocations inside given #VmaVirtualBlock at once.
+
+It is equivalent to calling vmaVirtualFree() `allocationCount` times, but the parameters are validated
+and the call is debug-logged once per batch instead of once per allocation.
+Passing `VK_NULL_HANDLE` as elements of `pAllocations` array is valid. Such entries are just skipped,
+so the array filled by a partially failed vmaVirtualAllocateMultiple() can be passed here directly.
+*/
+VMA_CALL_PRE void VMA_CALL_POST vmaVirtualFreeMultiple(
+    VmaVirtualBlock VMA_NOT_NULL virtualBlock,
+    size_t allocationCount,
+    const VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE* VMA_NOT_NULL VMA_LEN_IF_NOT_NULL(allocationCount) pAllocations);
+
 /** \brief Frees all virtual allocations inside given #VmaVirtualBlock.
 
 You must either call this function or free each virtual allocation individually with vmaVirtualFree()
@@ -2955,6 +3766,121 @@ don't forget to free it as well.
 VMA_CALL_PRE void VMA_CALL_POST vmaClearVirtualBlock(
     VmaVirtualBlock VMA_NOT_NULL virtualBlock);
 
+/** \brief Changes size of given #VmaVirtualBlock, keeping all existing virtual allocations at their offsets.
+
+\param virtualBlock Virtual block
+\param newSize New size of the block. Must be greater than 0.
+
+The block can always grow. It can shrink only as long as the space being removed from its end is free -
+virtual allocations are never moved by this function. If `newSize` is less than the end of the last allocation,
+`VK_ERROR_OUT_OF_DEVICE_MEMORY` is returned and the block stays unchanged.
+
+A block created with #VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT cannot be resized while it is used as a double stack,
+i.e. while it contains allocations made with #VMA_VIRTUAL_ALLOCATION_CREATE_UPPER_ADDRESS_BIT.
+`VK_ERROR_FEATURE_NOT_PRESENT` is returned in that case.
+
+Existing #VmaVirtualAllocation handles stay valid.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaResizeVirtualBlock(
+    VmaVirtualBlock VMA_NOT_NULL virtualBlock,
+    VkDeviceSize newSize);
+
+/** \brief Saves the state of a virtual block into a compact binary snapshot.
+
+\param virtualBlock Virtual block.
+\param[in,out] pDataSize Size of the buffer pointed by `pData`, in bytes. On return, number of bytes written or required.
+\param[out] pData Buffer for the snapshot. Optional. When null, only the required size is returned in `*pDataSize`.
+\returns
+- `VK_SUCCESS` if the snapshot was written or the size was returned.
+- `VK_INCOMPLETE` if `*pDataSize` is too small to hold the snapshot. Nothing is written and `*pDataSize` is set to 0.
+
+The snapshot contains size and algorithm of the block, offsets and sizes of all allocations,
+and their `pUserData` pointers stored as integer values. It can be restored using vmaDeserializeVirtualBlock().
+The format is versioned and stored in native byte order, so it is intended to be restored on the same platform with the same version of the library.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaSerializeVirtualBlock(
+    VmaVirtualBlock VMA_NOT_NULL virtualBlock,
+    size_t* VMA_NOT_NULL pDataSize,
+    void* VMA_NULLABLE pData);
+
+/** \brief Creates new #VmaVirtualBlock object restored from a snapshot created by vmaSerializeVirtualBlock().
+
+\param pData Snapshot data.
+\param dataSize Size of `pData`, in bytes.
+\param pAllocationCallbacks Custom CPU memory allocation callbacks for the new block. Optional, can be null.
+\param allocationCount Number of elements in `pAllocations`. Ignored when `pAllocations` is null.
+\param[out] pAllocations Optional array that receives handles of the restored allocations, in order of increasing offsets.
+  `allocationCount` must be equal to the number of allocations in the block when it was serialized.
+\param[out] pVirtualBlock Returned virtual block object.
+\returns
+- `VK_SUCCESS` if the block was restored.
+- `VK_ERROR_FORMAT_NOT_SUPPORTED` if the data is not a valid snapshot, was created by an incompatible version of the library,
+  or `allocationCount` doesn't match it.
+
+The block is restored directly from the snapshot, without searching for a place for each allocation again,
+with the same offsets and `pUserData` pointers of allocations. Handles of the allocations are new.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaDeserializeVirtualBlock(
+    const void* VMA_NOT_NULL pData,
+    size_t dataSize,
+    const VkAllocationCallbacks* VMA_NULLABLE pAllocationCallbacks,
+    size_t allocationCount,
+    VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE* VMA_NULLABLE VMA_LEN_IF_NOT_NULL(allocationCount) pAllocations,
+    VmaVirtualBlock VMA_NULLABLE* VMA_NOT_NULL pVirtualBlock);
+
+/** \brief Begins defragmentation process of one or more virtual blocks.
+
+\param pInfo Structure filled with parameters of defragmentation.
+\param[out] pContext Context object that must be passed to vmaEndVirtualDefragmentation() to finish defragmentation.
+\returns
+- `VK_SUCCESS` if defragmentation can begin.
+- `VK_ERROR_FEATURE_NOT_PRESENT` if any of the blocks was created with #VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT.
+
+The blocks must not be used for any other allocations or deallocations until vmaEndVirtualDefragmentation() is called.
+For more information, see documentation chapter \ref virtual_allocator_defragmentation.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaBeginVirtualDefragmentation(
+    const VmaVirtualDefragmentationInfo* VMA_NOT_NULL pInfo,
+    VmaVirtualDefragmentationContext VMA_NULLABLE* VMA_NOT_NULL pContext);
+
+/** \brief Ends defragmentation process of virtual blocks.
+
+\param context Context object that has been created by vmaBeginVirtualDefragmentation().
+\param[out] pStats Optional stats for the defragmentation. Can be null.
+In it, `deviceMemoryBlocksFreed` and `bytesFreed` describe virtual blocks that became empty.
+*/
+VMA_CALL_PRE void VMA_CALL_POST vmaEndVirtualDefragmentation(
+    VmaVirtualDefragmentationContext VMA_NOT_NULL context,
+    VmaDefragmentationStats* VMA_NULLABLE pStats);
+
+/** \brief Starts single defragmentation pass of virtual blocks.
+
+\param context Context object that has been created by vmaBeginVirtualDefragmentation().
+\param[out] pPassInfo Computed information for current pass.
+\returns
+- `VK_SUCCESS` if no more moves are possible. Then you can omit call to vmaEndVirtualDefragmentationPass() and simply end whole defragmentation.
+- `VK_INCOMPLETE` if there are pending moves returned in `pPassInfo`. You need to perform them, call vmaEndVirtualDefragmentationPass(),
+  and then preferably try another pass with vmaBeginVirtualDefragmentationPass().
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaBeginVirtualDefragmentationPass(
+    VmaVirtualDefragmentationContext VMA_NOT_NULL context,
+    VmaVirtualDefragmentationPassMoveInfo* VMA_NOT_NULL pPassInfo);
+
+/** \brief Ends single defragmentation pass of virtual blocks.
+
+\param context Context object that has been created by vmaBeginVirtualDefragmentation().
+\param pPassInfo Computed information for current pass filled by vmaBeginVirtualDefragmentationPass() and possibly modified by you.
+
+Returns `VK_SUCCESS` if no more moves are possible or `VK_INCOMPLETE` if more defragmentations are possible.
+
+After this call, for each move with `operation ==` #VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY (which is the default),
+`srcAllocation` is freed and `dstAllocation` becomes the allocation. For #VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE,
+`dstAllocation` is freed. For #VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY, both are freed.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaEndVirtualDefragmentationPass(
+    VmaVirtualDefragmentationContext VMA_NOT_NULL context,
+    VmaVirtualDefragmentationPassMoveInfo* VMA_NOT_NULL pPassInfo);
+
 /** \brief Changes custom pointer associated with given virtual allocation.
 */
 VMA_CALL_PRE void VMA_CALL_POST vmaSetVirtualAllocationUserData(
@@ -2979,6 +3905,73 @@ VMA_CALL_PRE void VMA_CALL_POST vmaCalculateVirtualBlockStatistics(
     VmaVirtualBlock VMA_NOT_NULL virtualBlock,
     VmaDetailedStatistics* VMA_NOT_NULL pStats);
 
+/** \brief Creates new #VmaVirtualBlockVector object.
+
+\param pCreateInfo Parameters for creation.
+\param[out] pVirtualBlockVector Returned virtual block vector object.
+\returns `VK_SUCCESS`, or error returned by VmaVirtualBlockVectorCreateInfo::pfnCreateBlock when creating the minimum number of blocks.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaCreateVirtualBlockVector(
+    const VmaVirtualBlockVectorCreateInfo* VMA_NOT_NULL pCreateInfo,
+    VmaVirtualBlockVector VMA_NULLABLE* VMA_NOT_NULL pVirtualBlockVector);
+
+/** \brief Destroys #VmaVirtualBlockVector object.
+
+All its virtual allocations must be freed. VmaVirtualBlockVectorCreateInfo::pfnDestroyBlock is called for each remaining block.
+*/
+VMA_CALL_PRE void VMA_CALL_POST vmaDestroyVirtualBlockVector(
+    VmaVirtualBlockVector VMA_NULLABLE virtualBlockVector);
+
+/** \brief Allocates new virtual allocation inside given #VmaVirtualBlockVector.
+
+\param virtualBlockVector Virtual block vector.
+\param pCreateInfo Parameters for the allocation.
+\param[out] pAllocation Returned handle of the new allocation.
+\param[out] pBlockIndex Returned index of the block that contains the allocation.
+\param[out] pOffset Returned offset of the new allocation within its block. Optional, can be null.
+
+Existing blocks are tried first, preferring the ones with the smallest amount of free space
+(or the largest, with #VMA_VIRTUAL_ALLOCATION_CREATE_STRATEGY_MIN_TIME_BIT), the same way as for the real GPU memory.
+If none has enough space and `maxBlockCount` is not reached, a new block is created, calling VmaVirtualBlockVectorCreateInfo::pfnCreateBlock.
+
+If the allocation fails, `VK_ERROR_OUT_OF_DEVICE_MEMORY` is returned and `*pAllocation` is `VK_NULL_HANDLE`.
+#VMA_VIRTUAL_ALLOCATION_CREATE_UPPER_ADDRESS_BIT is supported only with linear algorithm and `maxBlockCount` = 1.
+*/
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaVirtualBlockVectorAllocate(
+    VmaVirtualBlockVector VMA_NOT_NULL virtualBlockVector,
+    const VmaVirtualAllocationCreateInfo* VMA_NOT_NULL pCreateInfo,
+    VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE* VMA_NOT_NULL pAllocation,
+    uint32_t* VMA_NOT_NULL pBlockIndex,
+    VkDeviceSize* VMA_NULLABLE pOffset);
+
+/** \brief Frees virtual allocation inside given #VmaVirtualBlockVector.
+
+It is correct to call this function with `allocation == VK_NULL_HANDLE` - it does nothing.
+If a block becomes empty while another empty block already exists, one of them is released,
+calling VmaVirtualBlockVectorCreateInfo::pfnDestroyBlock.
+*/
+VMA_CALL_PRE void VMA_CALL_POST vmaVirtualBlockVectorFree(
+    VmaVirtualBlockVector VMA_NOT_NULL virtualBlockVector,
+    uint32_t blockIndex,
+    VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE allocation);
+
+/** \brief Returns the virtual block with given index owned by #VmaVirtualBlockVector.
+
+Returns null in `*pVirtualBlock` if there is no block with such index. The block can be used to query information about its allocations,
+e.g. with vmaGetVirtualAllocationInfo(), or to change their `pUserData`.
+Don't allocate, free, resize, or destroy it directly.
+*/
+VMA_CALL_PRE void VMA_CALL_POST vmaGetVirtualBlockVectorBlock(
+    VmaVirtualBlockVector VMA_NOT_NULL virtualBlockVector,
+    uint32_t blockIndex,
+    VmaVirtualBlock VMA_NULLABLE* VMA_NOT_NULL pVirtualBlock);
+
+/** \brief Calculates and returns statistics about virtual allocations in all blocks of given #VmaVirtualBlockVector.
+*/
+VMA_CALL_PRE void VMA_CALL_POST vmaGetVirtualBlockVectorStatistics(
+    VmaVirtualBlockVector VMA_NOT_NULL virtualBlockVector,
+    VmaStatistics* VMA_NOT_NULL pStats);
+
 /** @} */
 
 #if VMA_STATS_STRING_ENABLED
@@ -3461,6 +4454,86 @@ If providing your own implementation, you need to implement a subset of std::ato
     #define VMA_ATOMIC_BOOL std::atomic<bool>
 #endif
 
+/*
+Returns current time in nanoseconds as `uint64_t`, used to limit and measure time spent computing defragmentation.
+If providing your own implementation, it needs to be monotonic.
+*/
+#ifndef VMA_GET_TIME_NANOSECONDS
+    #include <chrono>
+    #define VMA_GET_TIME_NANOSECONDS() ((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( \
+        std::chrono::steady_clock::now().time_since_epoch()).count())
+#endif
+
+#ifndef VMA_DEFRAGMENTATION_HOST_COPY_JOB_SIZE
+    /**
+    Maximum number of bytes copied by single job of vmaExecuteDefragmentationPassOnHost()
+    when VmaDefragmentationInfo::pfnDispatchJobs is used. Larger copies are split between multiple jobs.
+    */
+    #define VMA_DEFRAGMENTATION_HOST_COPY_JOB_SIZE (1024ull * 1024)
+#endif
+
+#ifndef VMA_MEMORY_PRIORITY_UPDATE_FRAME_COUNT
+    /**
+    Number of frames between updates of priorities of memory blocks done by vmaSetCurrentFrameIndex()
+    when #VMA_ALLOCATOR_CREATE_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_BIT is used.
+    */
+    #define VMA_MEMORY_PRIORITY_UPDATE_FRAME_COUNT (16)
+#endif
+
+#ifndef VMA_MEMORY_PRIORITY_RECENT_FRAME_COUNT
+    /**
+    Number of frames after its last use during which a memory block is treated as recently used
+    when updating its priority. See \ref vk_ext_memory_priority_dynamic.
+    */
+    #define VMA_MEMORY_PRIORITY_RECENT_FRAME_COUNT (64)
+#endif
+
+#ifndef VMA_CACHE_LINE_SIZE
+    /**
+    Size of CPU cache line, in bytes. Data updated frequently by different threads is kept this far apart
+    to avoid false sharing.
+    */
+    #define VMA_CACHE_LINE_SIZE (64)
+#endif
+
+#ifndef VMA_BUDGET_SHARD_COUNT
+    /**
+    Number of copies of the counters of allocations per heap updated on every allocation and free,
+    among which threads are distributed so they don't contend for the same cache line.
+    Define to 1 to use a single set of counters, e.g. on platforms without `thread_local`.
+    */
+    #define VMA_BUDGET_SHARD_COUNT (8)
+#endif
+
+#ifndef VMA_STREAMING_COPY
+    /**
+    Enables copying with non-temporal stores to memory types that are not `HOST_CACHED`, typically write-combined,
+    and with streaming loads from them, in vmaCopyMemoryToAllocation() and vmaCopyAllocationToMemory().
+    SSE2, SSE4.1, or AVX2 instructions are chosen depending on the CPU at runtime.
+    Available on x86-64 only. Define to 0 to always use `memcpy`.
+    */
+    #if defined(_M_X64) || defined(__x86_64__)
+        #define VMA_STREAMING_COPY (1)
+    #else
+        #define VMA_STREAMING_COPY (0)
+    #endif
+#endif
+
+#if VMA_STREAMING_COPY
+    #include <immintrin.h> // For non-temporal stores and streaming loads
+    #if !defined(_MSC_VER)
+        #include <cpuid.h> // For __cpuid_count
+    #endif
+#endif
+
+#ifndef VMA_STREAMING_COPY_MIN_SIZE
+    /**
+    Minimum number of bytes copied with non-temporal stores or streaming loads when #VMA_STREAMING_COPY is enabled.
+    Smaller copies use `memcpy`.
+    */
+    #define VMA_STREAMING_COPY_MIN_SIZE (1024)
+#endif
+
 #ifndef VMA_DEBUG_ALWAYS_DEDICATED_MEMORY
     /**
     Every allocation will have its own memory block.
@@ -4502,39 +5575,248 @@ bool VmaVectorRemoveSorted(VectorT& vector, const typename VectorT::value_type&
     return false;
 }
 
-} // namespace
+/*
+Sorts ranges of VkMappedMemoryRange by memory and offset, then merges overlapping and adjacent ones.
+Ranges are expected to be already aligned to nonCoherentAtomSize, so merged ones stay aligned.
+*/
+template<typename VectorT>
+void VmaMergeMappedMemoryRanges(VectorT& ranges)
+{
+    if (ranges.size() < 2)
+        return;
+    VMA_SORT(ranges.begin(), ranges.end(),
+        [](const VkMappedMemoryRange& lhs, const VkMappedMemoryRange& rhs)
+        {
+            if (lhs.memory != rhs.memory)
+                return lhs.memory < rhs.memory;
+            return lhs.offset < rhs.offset;
+        });
 
-#endif // _VMA_FUNCTIONS
+    size_t rangeCount = 1;
+    for (size_t i = 1; i < ranges.size(); ++i)
+    {
+        VkMappedMemoryRange& prevRange = ranges[rangeCount - 1];
+        const VkMappedMemoryRange& range = ranges[i];
+        if (prevRange.memory == range.memory && range.offset <= prevRange.offset + prevRange.size)
+            prevRange.size = VMA_MAX(prevRange.size, range.offset + range.size - prevRange.offset);
+        else
+            ranges[rangeCount++] = range;
+    }
+    ranges.resize(rangeCount);
+}
 
-#ifndef _VMA_STATISTICS_FUNCTIONS
+#if VMA_STREAMING_COPY
+#if defined(_MSC_VER) && !defined(__clang__)
+    #define VMA_TARGET_FEATURES(features)
+#else
+    // Allows using intrinsics of given instruction sets in the function, regardless of compiler options.
+    #define VMA_TARGET_FEATURES(features) __attribute__((target(features)))
+#endif
 
-namespace
+enum VMA_CPU_FEATURE
 {
+    VMA_CPU_FEATURE_SSE41 = 0x1,
+    VMA_CPU_FEATURE_AVX2 = 0x2,
+};
 
-void VmaClearStatistics(VmaStatistics& outStats)
+inline void VmaCpuid(uint32_t leaf, uint32_t subleaf, uint32_t outRegisters[4])
 {
-    outStats.blockCount = 0;
-    outStats.allocationCount = 0;
-    outStats.blockBytes = 0;
-    outStats.allocationBytes = 0;
+#ifdef _MSC_VER
+    __cpuidex(reinterpret_cast<int*>(outRegisters), (int)leaf, (int)subleaf);
+#else
+    __cpuid_count(leaf, subleaf, outRegisters[0], outRegisters[1], outRegisters[2], outRegisters[3]);
+#endif
 }
 
-void VmaAddStatistics(VmaStatistics& inoutStats, const VmaStatistics& src)
+// Returns combination of VMA_CPU_FEATURE flags supported by the CPU and the OS.
+inline uint32_t VmaGetCpuFeatures()
 {
-    inoutStats.blockCount += src.blockCount;
-    inoutStats.allocationCount += src.allocationCount;
-    inoutStats.blockBytes += src.blockBytes;
-    inoutStats.allocationBytes += src.allocationBytes;
-}
+    static const uint32_t features = []() -> uint32_t
+    {
+        uint32_t regs[4] = {}; // EAX, EBX, ECX, EDX
+        VmaCpuid(0, 0, regs);
+        const uint32_t maxLeaf = regs[0];
+        if (maxLeaf < 1)
+            return 0;
 
-void VmaClearDetailedStatistics(VmaDetailedStatistics& outStats)
-{
-    VmaClearStatistics(outStats.statistics);
-    outStats.unusedRangeCount = 0;
-    outStats.allocationSizeMin = VK_WHOLE_SIZE;
-    outStats.allocationSizeMax = 0;
-    outStats.unusedRangeSizeMin = VK_WHOLE_SIZE;
-    outStats.unusedRangeSizeMax = 0;
+        uint32_t result = 0;
+        VmaCpuid(1, 0, regs);
+        if ((regs[2] & (1u << 19)) != 0)
+            result |= VMA_CPU_FEATURE_SSE41;
+        // AVX registers need to be saved by the OS: OSXSAVE, AVX, and XMM and YMM state enabled in XCR0.
+        const uint32_t osxsaveAvx = (1u << 27) | (1u << 28);
+        if ((regs[2] & osxsaveAvx) == osxsaveAvx && maxLeaf >= 7)
+        {
+#ifdef _MSC_VER
+            const uint64_t xcr0 = _xgetbv(0);
+#else
+            uint32_t xcr0Low = 0, xcr0High = 0;
+            __asm__ volatile("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+            const uint64_t xcr0 = ((uint64_t)xcr0High << 32) | xcr0Low;
+#endif
+            VmaCpuid(7, 0, regs);
+            if ((xcr0 & 0x6) == 0x6 && (regs[1] & (1u << 5)) != 0)
+                result |= VMA_CPU_FEATURE_AVX2;
+        }
+        return result;
+    }();
+    return features;
+}
+
+// Size must be multiply of 64 and pDst aligned to 16.
+inline void VmaStreamStoreSse2(char* pDst, const char* pSrc, size_t size)
+{
+    for (size_t i = 0; i < size; i += 64)
+    {
+        const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+        const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i + 16));
+        const __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i + 32));
+        const __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(pDst + i), v0);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(pDst + i + 16), v1);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(pDst + i + 32), v2);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(pDst + i + 48), v3);
+    }
+}
+
+// Size must be multiply of 64 and pDst aligned to 32.
+VMA_TARGET_FEATURES("avx2") inline void VmaStreamStoreAvx2(char* pDst, const char* pSrc, size_t size)
+{
+    for (size_t i = 0; i < size; i += 64)
+    {
+        const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i));
+        const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i + 32));
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(pDst + i), v0);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(pDst + i + 32), v1);
+    }
+}
+
+// Size must be multiply of 64 and pSrc aligned to 16.
+VMA_TARGET_FEATURES("sse4.1") inline void VmaStreamLoadSse41(char* pDst, const char* pSrc, size_t size)
+{
+    for (size_t i = 0; i < size; i += 64)
+    {
+        // Parameter of _mm_stream_load_si128 is not const in some compilers.
+        const __m128i v0 = _mm_stream_load_si128(reinterpret_cast<__m128i*>(const_cast<char*>(pSrc + i)));
+        const __m128i v1 = _mm_stream_load_si128(reinterpret_cast<__m128i*>(const_cast<char*>(pSrc + i + 16)));
+        const __m128i v2 = _mm_stream_load_si128(reinterpret_cast<__m128i*>(const_cast<char*>(pSrc + i + 32)));
+        const __m128i v3 = _mm_stream_load_si128(reinterpret_cast<__m128i*>(const_cast<char*>(pSrc + i + 48)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), v0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i + 16), v1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i + 32), v2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i + 48), v3);
+    }
+}
+
+// Size must be multiply of 64 and pSrc aligned to 32.
+VMA_TARGET_FEATURES("avx2") inline void VmaStreamLoadAvx2(char* pDst, const char* pSrc, size_t size)
+{
+    for (size_t i = 0; i < size; i += 64)
+    {
+        const __m256i v0 = _mm256_stream_load_si256(reinterpret_cast<__m256i*>(const_cast<char*>(pSrc + i)));
+        const __m256i v1 = _mm256_stream_load_si256(reinterpret_cast<__m256i*>(const_cast<char*>(pSrc + i + 32)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i), v0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i + 32), v1);
+    }
+}
+#endif // VMA_STREAMING_COPY
+
+/*
+Copies data to mapped memory of a memory type with given property flags.
+Memory that is not HOST_CACHED is written with non-temporal stores, which don't read destination cache lines.
+*/
+inline void VmaCopyToMappedMemory(VkMemoryPropertyFlags memoryFlags, void* pDst, const void* pSrc, size_t size)
+{
+#if VMA_STREAMING_COPY
+    if ((memoryFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) == 0 && size >= VMA_STREAMING_COPY_MIN_SIZE)
+    {
+        const bool avx2 = (VmaGetCpuFeatures() & VMA_CPU_FEATURE_AVX2) != 0;
+        const uintptr_t alignment = avx2 ? 32 : 16;
+        // Unaligned beginning and end are copied normally.
+        const size_t headSize = (size_t)(VmaAlignUp((uintptr_t)pDst, alignment) - (uintptr_t)pDst);
+        const size_t bodySize = VmaAlignDown(size - headSize, (size_t)64);
+        char* const pDstBody = (char*)pDst + headSize;
+        const char* const pSrcBody = (const char*)pSrc + headSize;
+        memcpy(pDst, pSrc, headSize);
+        if (avx2)
+            VmaStreamStoreAvx2(pDstBody, pSrcBody, bodySize);
+        else
+            VmaStreamStoreSse2(pDstBody, pSrcBody, bodySize);
+        memcpy(pDstBody + bodySize, pSrcBody + bodySize, size - headSize - bodySize);
+        // Make non-temporal stores visible before following flush or submit.
+        _mm_sfence();
+        return;
+    }
+#else
+    (void)memoryFlags;
+#endif
+    memcpy(pDst, pSrc, size);
+}
+
+/*
+Copies data from mapped memory of a memory type with given property flags.
+Memory that is not HOST_CACHED is read with streaming loads if supported.
+*/
+inline void VmaCopyFromMappedMemory(VkMemoryPropertyFlags memoryFlags, void* pDst, const void* pSrc, size_t size)
+{
+#if VMA_STREAMING_COPY
+    const uint32_t cpuFeatures = VmaGetCpuFeatures();
+    if ((memoryFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) == 0 && size >= VMA_STREAMING_COPY_MIN_SIZE &&
+        (cpuFeatures & (VMA_CPU_FEATURE_SSE41 | VMA_CPU_FEATURE_AVX2)) != 0)
+    {
+        const bool avx2 = (cpuFeatures & VMA_CPU_FEATURE_AVX2) != 0;
+        const uintptr_t alignment = avx2 ? 32 : 16;
+        const size_t headSize = (size_t)(VmaAlignUp((uintptr_t)pSrc, alignment) - (uintptr_t)pSrc);
+        const size_t bodySize = VmaAlignDown(size - headSize, (size_t)64);
+        char* const pDstBody = (char*)pDst + headSize;
+        const char* const pSrcBody = (const char*)pSrc + headSize;
+        memcpy(pDst, pSrc, headSize);
+        if (avx2)
+            VmaStreamLoadAvx2(pDstBody, pSrcBody, bodySize);
+        else
+            VmaStreamLoadSse41(pDstBody, pSrcBody, bodySize);
+        memcpy(pDstBody + bodySize, pSrcBody + bodySize, size - headSize - bodySize);
+        return;
+    }
+#else
+    (void)memoryFlags;
+#endif
+    memcpy(pDst, pSrc, size);
+}
+
+} // namespace
+
+#endif // _VMA_FUNCTIONS
+
+#ifndef _VMA_STATISTICS_FUNCTIONS
+
+namespace
+{
+
+void VmaClearStatistics(VmaStatistics& outStats)
+{
+    outStats.blockCount = 0;
+    outStats.allocationCount = 0;
+    outStats.blockBytes = 0;
+    outStats.allocationBytes = 0;
+}
+
+void VmaAddStatistics(VmaStatistics& inoutStats, const VmaStatistics& src)
+{
+    inoutStats.blockCount += src.blockCount;
+    inoutStats.allocationCount += src.allocationCount;
+    inoutStats.blockBytes += src.blockBytes;
+    inoutStats.allocationBytes += src.allocationBytes;
+}
+
+void VmaClearDetailedStatistics(VmaDetailedStatistics& outStats)
+{
+    VmaClearStatistics(outStats.statistics);
+    outStats.unusedRangeCount = 0;
+    outStats.allocationSizeMin = VK_WHOLE_SIZE;
+    outStats.allocationSizeMax = 0;
+    outStats.unusedRangeSizeMin = VK_WHOLE_SIZE;
+    outStats.unusedRangeSizeMax = 0;
 }
 
 void VmaAddDetailedStatisticsAllocation(VmaDetailedStatistics& inoutStats, VkDeviceSize size)
@@ -4809,7 +6091,7 @@ void VmaVector<T, AllocatorT>::reserve(size_t newCapacity, bool freeMemory)
 
     if (newCapacity != m_Capacity)
     {
-        T* const newArray = newCapacity ? VmaAllocateArray<T>(m_Allocator, newCapacity) : VMA_NULL;
+        T* const newArray = newCapacity ? VmaAllocateArray<T>(m_Allocator.m_pCallbacks, newCapacity) : VMA_NULL;
         if (m_Count != 0)
         {
             memcpy(newArray, m_pArray, m_Count * sizeof(T));
@@ -6344,12 +7626,21 @@ void VmaPrintDetailedStatistics(VmaJsonWriter& json, const VmaDetailedStatistics
 
 #ifndef _VMA_MAPPING_HYSTERESIS
 
+/*
+Small value type, so that VmaDeviceMemoryBlock can keep it packed together with the map reference count
+in a single atomic variable and update both with one compare-exchange.
+*/
 class VmaMappingHysteresis
 {
-    VMA_CLASS_NO_COPY_NO_MOVE(VmaMappingHysteresis)
 public:
     VmaMappingHysteresis() = default;
+    // Restores the state returned by GetPackedState().
+    explicit VmaMappingHysteresis(uint32_t packedState)
+        : m_MinorCounter(packedState & 0xFFFF),
+        m_MajorCounter((packedState >> 16) & MAX_COUNTER),
+        m_ExtraMapping(packedState >> 31) {}
 
+    uint32_t GetPackedState() const { return m_MinorCounter | (m_MajorCounter << 16) | (m_ExtraMapping << 31); }
     uint32_t GetExtraMapping() const { return m_ExtraMapping; }
 
     // Call when Map was called.
@@ -6359,7 +7650,7 @@ public:
 #if VMA_MAPPING_HYSTERESIS_ENABLED
         if(m_ExtraMapping == 0)
         {
-            ++m_MajorCounter;
+            PostMajorCounter();
             if(m_MajorCounter >= COUNTER_MIN_EXTRA_MAPPING)
             {
                 m_ExtraMapping = 1;
@@ -6379,7 +7670,7 @@ public:
     {
 #if VMA_MAPPING_HYSTERESIS_ENABLED
         if(m_ExtraMapping == 0)
-            ++m_MajorCounter;
+            PostMajorCounter();
         else // m_ExtraMapping == 1
             PostMinorCounter();
 #endif // #if VMA_MAPPING_HYSTERESIS_ENABLED
@@ -6390,7 +7681,7 @@ public:
     {
 #if VMA_MAPPING_HYSTERESIS_ENABLED
         if(m_ExtraMapping == 1)
-            ++m_MajorCounter;
+            PostMajorCounter();
         else // m_ExtraMapping == 0
             PostMinorCounter();
 #endif // #if VMA_MAPPING_HYSTERESIS_ENABLED
@@ -6403,7 +7694,7 @@ public:
 #if VMA_MAPPING_HYSTERESIS_ENABLED
         if(m_ExtraMapping == 1)
         {
-            ++m_MajorCounter;
+            PostMajorCounter();
             if(m_MajorCounter >= COUNTER_MIN_EXTRA_MAPPING &&
                 m_MajorCounter > m_MinorCounter + 1)
             {
@@ -6421,11 +7712,19 @@ public:
 
 private:
     static constexpr int32_t COUNTER_MIN_EXTRA_MAPPING = 7;
+    // Counters saturate so that the packed state fits in 32 bits. m_MinorCounter never exceeds m_MajorCounter.
+    static constexpr uint32_t MAX_COUNTER = 0x7FFF;
 
     uint32_t m_MinorCounter = 0;
     uint32_t m_MajorCounter = 0;
     uint32_t m_ExtraMapping = 0; // 0 or 1.
 
+    void PostMajorCounter()
+    {
+        if(m_MajorCounter < MAX_COUNTER)
+            ++m_MajorCounter;
+    }
+
     void PostMinorCounter()
     {
         if(m_MinorCounter < m_MajorCounter)
@@ -6546,6 +7845,17 @@ class VmaDeviceMemoryBlock
     VMA_CLASS_NO_COPY_NO_MOVE(VmaDeviceMemoryBlock)
 public:
     VmaBlockMetadata* m_pMetadata;
+    // Set when the block became empty and was kept for reuse by VmaBlockVector::Free, together with the current frame index at that moment.
+    // Protected by parent's VmaBlockVector::m_Mutex.
+    bool m_KeptEmpty = false;
+    uint32_t m_EmptySinceFrameIndex = 0;
+    // Usage of the block, used to calculate its dynamic priority. See VmaBlockVector::UpdatePriorities.
+    // Number of allocations created with VMA_ALLOCATION_CREATE_PRIORITY_HOT_BIT, VMA_ALLOCATION_CREATE_PRIORITY_COLD_BIT.
+    // Protected by the mutex of the parent VmaBlockVector.
+    uint32_t m_HotAllocationCount = 0;
+    uint32_t m_ColdAllocationCount = 0;
+    // Frame index of last allocation, vmaMapMemory() or vmaNotifyAllocationUsed() in this block.
+    VMA_ATOMIC_UINT32 m_LastUseFrameIndex{ 0 };
 
     explicit VmaDeviceMemoryBlock(VmaAllocator hAllocator);
     ~VmaDeviceMemoryBlock();
@@ -6559,7 +7869,8 @@ public:
         VkDeviceSize newSize,
         uint32_t id,
         uint32_t algorithm,
-        VkDeviceSize bufferImageGranularity);
+        VkDeviceSize bufferImageGranularity,
+        float priority);
     // Always call before destruction.
     void Destroy(VmaAllocator allocator);
 
@@ -6569,13 +7880,19 @@ public:
     uint32_t GetId() const { return m_Id; }
     void* GetMappedData() const { return m_pMappedData; }
     bool IsMapped() const { return m_IsMapped.load(); }
-    uint32_t GetMapRefCount() const { return m_MapCount; }
+    uint32_t GetMapRefCount() const { return GetMapCount(m_MapState.load()); }
 
     // Call when allocation/free was made from m_pMetadata.
-    // Used for m_MappingHysteresis.
-    void PostAlloc(VmaAllocator hAllocator);
+    // Used for the mapping hysteresis kept in m_MapState.
+    void PostAlloc();
     void PostFree(VmaAllocator hAllocator);
 
+    // Call when the allocation is added to / removed from this block. Update m_HotAllocationCount, m_ColdAllocationCount.
+    void AddPriorityHint(VmaAllocation hAllocation);
+    void RemovePriorityHint(VmaAllocation hAllocation);
+    // Calls vkSetDeviceMemoryPriorityEXT if the priority is different from the current one.
+    void SetPriority(VmaAllocator hAllocator, float priority);
+
     // Validates all data structures inside this object. If not valid, returns false.
     bool Validate() const;
     VkResult CheckCorruption(VmaAllocator hAllocator);
@@ -6615,14 +7932,21 @@ private:
 
     /*
     Protects access to m_hMemory so it is not used by multiple threads simultaneously, e.g. vkMapMemory, vkBindBufferMemory.
-    Also protects m_MapCount, m_pMappedData.
+    Map and Unmap take it only for the transitions of the total map count between 0 and nonzero, which call
+    vkMapMemory, vkUnmapMemory and write m_pMappedData. Other changes of m_MapState are lock-free.
     m_IsMapped mirrors whether m_pMappedData is non-null and can be read without this mutex in allocation heuristics.
     Allocations, deallocations, any change in m_pMetadata is protected by parent's VmaBlockVector::m_Mutex.
     */
     VMA_MUTEX m_MapAndBindMutex;
-    VmaMappingHysteresis m_MappingHysteresis;
-    uint32_t m_MapCount;
+    /*
+    Low 32 bits: reference count of Map calls. High 32 bits: VmaMappingHysteresis::GetPackedState().
+    Kept in one variable so that a single compare-exchange checks that the memory is mapped and adds a reference.
+    The memory is mapped while the total map count, which includes the extra mapping of the hysteresis, is not 0.
+    */
+    VMA_ATOMIC_UINT64 m_MapState;
     void* m_pMappedData;
+    // Priority of m_hMemory last passed to Vulkan. Protected by m_MapAndBindMutex.
+    float m_Priority;
     /*
     Mirrors `m_pMappedData != VMA_NULL` for allocation heuristics that only need mapped/unmapped state.
     This is atomic so allocation scans don't race with Map/Unmap while the actual mapped pointer remains protected by m_MapAndBindMutex.
@@ -6630,6 +7954,11 @@ private:
     VMA_ATOMIC_BOOL m_IsMapped;
 
     VmaWin32Handle m_Handle;
+
+    static uint32_t GetMapCount(uint64_t mapState) { return (uint32_t)mapState; }
+    static VmaMappingHysteresis GetMappingHysteresis(uint64_t mapState) { return VmaMappingHysteresis((uint32_t)(mapState >> 32)); }
+    static uint32_t GetTotalMapCount(uint64_t mapState) { return GetMapCount(mapState) + GetMappingHysteresis(mapState).GetExtraMapping(); }
+    static uint64_t MakeMapState(uint32_t mapCount, const VmaMappingHysteresis& hysteresis) { return ((uint64_t)hysteresis.GetPackedState() << 32) | mapCount; }
 };
 #endif // _VMA_DEVICE_MEMORY_BLOCK
 
@@ -6648,6 +7977,10 @@ struct VmaAllocation_T
     {
         FLAG_PERSISTENT_MAP   = 0x01,
         FLAG_MAPPING_ALLOWED  = 0x02,
+        FLAG_DEDICATED_FALLBACK = 0x04,
+        FLAG_IMMOVABLE = 0x08,
+        FLAG_PRIORITY_HOT = 0x10,
+        FLAG_PRIORITY_COLD = 0x20,
     };
 
 public:
@@ -6671,6 +8004,7 @@ public:
         VmaSuballocationType suballocationType,
         bool mapped);
     // pMappedData not null means allocation is created with MAPPED flag.
+    // blockAlignment not 0 means allocation is dedicated only because it didn't fit into a block with this alignment.
     void InitDedicatedAllocation(
         VmaAllocator allocator,
         VmaPool hParentPool,
@@ -6678,7 +8012,8 @@ public:
         VkDeviceMemory hMemory,
         VmaSuballocationType suballocationType,
         void* pMappedData,
-        VkDeviceSize size);
+        VkDeviceSize size,
+        VkDeviceSize blockAlignment);
     void Destroy(VmaAllocator allocator);
 
     ALLOCATION_TYPE GetType() const { return (ALLOCATION_TYPE)m_Type; }
@@ -6692,11 +8027,36 @@ public:
     uint32_t GetMemoryTypeIndex() const { return m_MemoryTypeIndex; }
     bool IsPersistentMap() const { return (m_Flags & FLAG_PERSISTENT_MAP) != 0; }
     bool IsMappingAllowed() const { return (m_Flags & FLAG_MAPPING_ALLOWED) != 0; }
+    bool IsDedicatedFallback() const { return (m_Flags & FLAG_DEDICATED_FALLBACK) != 0; }
+    bool IsImmovable() const { return (m_Flags & FLAG_IMMOVABLE) != 0; }
+    bool IsPriorityHot() const { return (m_Flags & FLAG_PRIORITY_HOT) != 0; }
+    bool IsPriorityCold() const { return (m_Flags & FLAG_PRIORITY_COLD) != 0; }
+    float GetMoveCost() const { return m_MoveCost; }
+    bool IsEvictable() const { return m_ResidencyMemoryTypeBits != 0; }
+    uint32_t GetResidencyMemoryTypeBits() const { return m_ResidencyMemoryTypeBits; }
+    uint32_t GetHomeMemoryTypeIndex() const { return m_HomeMemoryTypeIndex; }
+    uint32_t GetIgnoringDefragmentationId() const { return m_IgnoringDefragmentationId; }
+    bool IsMapped() const { return m_MapCount != 0 || IsPersistentMap(); }
 
     void SetUserData(VmaAllocator hAllocator, void* pUserData) { m_pUserData = pUserData; }
+    void SetImmovable(bool immovable) { m_Flags = immovable ? (uint8_t)(m_Flags | FLAG_IMMOVABLE) : (uint8_t)(m_Flags & ~FLAG_IMMOVABLE); }
+    // Takes VMA_ALLOCATION_CREATE_PRIORITY_HOT_BIT, VMA_ALLOCATION_CREATE_PRIORITY_COLD_BIT from allocation flags.
+    void SetPriorityHint(VmaAllocationCreateFlags flags);
+    // Non-positive cost is replaced with the default 1.
+    void SetMoveCost(float moveCost) { m_MoveCost = moveCost > 0.f ? moveCost : 1.f; }
+    // Makes the allocation evictable between given memory types, returning to homeMemoryTypeIndex. See VMA_ALLOCATION_CREATE_EVICTABLE_BIT.
+    void SetResidency(uint32_t memoryTypeBits, uint32_t homeMemoryTypeIndex)
+    {
+        m_ResidencyMemoryTypeBits = memoryTypeBits;
+        m_HomeMemoryTypeIndex = (uint8_t)homeMemoryTypeIndex;
+    }
+    // Marks the allocation not to be moved again by the defragmentation context with given id. See VmaAllocator_T::AcquireDefragmentationId().
+    void SetIgnoringDefragmentationId(uint32_t id) { m_IgnoringDefragmentationId = id; }
     void SetName(VmaAllocator hAllocator, const char* pName);
     void FreeName(VmaAllocator hAllocator);
     uint8_t SwapBlockAllocation(VmaAllocator hAllocator, VmaAllocation allocation);
+    // Takes over block allocation of `allocation`, which becomes the owner of this dedicated memory and must then be freed.
+    uint8_t PromoteToBlockAllocation(VmaAllocator hAllocator, VmaAllocation allocation);
     VmaAllocHandle GetAllocHandle() const;
     VkDeviceSize GetOffset() const;
     VmaPool GetParentPool() const;
@@ -6755,7 +8115,15 @@ private:
     VkDeviceSize m_Size;
     void* m_pUserData;
     char* m_pName;
+    // Cost of moving by defragmentation, relative to allocations of the same size.
+    float m_MoveCost;
     uint32_t m_MemoryTypeIndex;
+    // Memory types that residency management can move the allocation to. 0 if it's not evictable.
+    uint32_t m_ResidencyMemoryTypeBits;
+    // Id of the defragmentation context whose move of the allocation was ignored by the user, 0 if none.
+    uint32_t m_IgnoringDefragmentationId;
+    // Memory type preferred for the allocation, where residency management moves it back.
+    uint8_t m_HomeMemoryTypeIndex;
     uint8_t m_Type; // ALLOCATION_TYPE
     uint8_t m_SuballocationType; // VmaSuballocationType
     // Reference counter for vmaMapMemory()/vmaUnmapMemory().
@@ -6804,6 +8172,7 @@ Thread-safe, synchronized internally.
 */
 class VmaDedicatedAllocationList
 {
+    friend struct VmaDefragmentationContext_T;
     VMA_CLASS_NO_COPY_NO_MOVE(VmaDedicatedAllocationList)
 public:
     VmaDedicatedAllocationList() = default;
@@ -6983,6 +8352,61 @@ struct VmaAllocationRequest
 };
 #endif // _VMA_ALLOCATION_REQUEST
 
+#ifndef _VMA_VIRTUAL_BLOCK_SNAPSHOT
+/*
+Binary layout of data produced by vmaSerializeVirtualBlock(), in native byte order:
+VmaVirtualBlockSnapshotHeader followed by rangeCount x VmaVirtualBlockSnapshotRange.
+Bump VMA_VIRTUAL_BLOCK_SNAPSHOT_VERSION whenever the layout changes.
+*/
+constexpr uint32_t VMA_VIRTUAL_BLOCK_SNAPSHOT_MAGIC = 0x56414D56U; // "VMAV"
+constexpr uint32_t VMA_VIRTUAL_BLOCK_SNAPSHOT_VERSION = 1;
+// Set in VmaVirtualBlockSnapshotRange::size for ranges that are free.
+constexpr uint64_t VMA_VIRTUAL_BLOCK_SNAPSHOT_FREE_BIT = 1ULL << 63;
+
+struct VmaVirtualBlockSnapshotHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    // VMA_VIRTUAL_BLOCK_CREATE_ALGORITHM_MASK bits of the block.
+    uint32_t algorithm;
+    // Linear algorithm only: mode of the 2nd suballocation vector.
+    uint32_t secondVectorMode;
+    uint64_t size;
+    uint64_t allocationCount;
+    uint64_t rangeCount;
+    // Linear algorithm only: number of ranges belonging to the 1st suballocation vector, the rest belongs to the 2nd one.
+    uint64_t firstVectorRangeCount;
+};
+
+struct VmaVirtualBlockSnapshotRange
+{
+    uint64_t offset;
+    uint64_t size;
+    uint64_t userData;
+};
+
+static void VmaWriteSnapshotRange(char* pDst, VkDeviceSize offset, VkDeviceSize size, void* userData, bool isFree)
+{
+    VMA_ASSERT(size < VMA_VIRTUAL_BLOCK_SNAPSHOT_FREE_BIT);
+    VmaVirtualBlockSnapshotRange range = {};
+    range.offset = offset;
+    range.size = isFree ? (size | VMA_VIRTUAL_BLOCK_SNAPSHOT_FREE_BIT) : size;
+    range.userData = (uint64_t)(uintptr_t)userData;
+    memcpy(pDst, &range, sizeof(range));
+}
+
+static void VmaReadSnapshotRange(const char* pSrc, VmaSuballocation& outSuballoc)
+{
+    VmaVirtualBlockSnapshotRange range;
+    memcpy(&range, pSrc, sizeof(range));
+    const bool isFree = (range.size & VMA_VIRTUAL_BLOCK_SNAPSHOT_FREE_BIT) != 0;
+    outSuballoc.offset = range.offset;
+    outSuballoc.size = range.size & ~VMA_VIRTUAL_BLOCK_SNAPSHOT_FREE_BIT;
+    outSuballoc.userData = isFree ? VMA_NULL : (void*)(uintptr_t)range.userData;
+    outSuballoc.type = isFree ? VMA_SUBALLOCATION_TYPE_FREE : VMA_SUBALLOCATION_TYPE_UNKNOWN;
+}
+#endif // _VMA_VIRTUAL_BLOCK_SNAPSHOT
+
 #ifndef _VMA_BLOCK_METADATA
 /*
 Data structure used for bookkeeping of allocations and unused ranges of memory
@@ -7006,6 +8430,7 @@ public:
     virtual size_t GetAllocationCount() const = 0;
     virtual size_t GetFreeRegionsCount() const = 0;
     virtual VkDeviceSize GetSumFreeSize() const = 0;
+    virtual VkDeviceSize GetLargestFreeRegionSize() const = 0;
     // Returns true if this block is empty - contains only single free suballocation.
     virtual bool IsEmpty() const = 0;
     virtual void GetAllocationInfo(VmaAllocHandle allocHandle, VmaVirtualAllocationInfo& outInfo) = 0;
@@ -7050,11 +8475,24 @@ public:
     // Frees all allocations.
     // Careful! Don't call it if there are VmaAllocation objects owned by userData of cleared allocations!
     virtual void Clear() = 0;
+    // Changes size of the block, keeping all allocations at their offsets. Only free space at the end can be added or removed.
+    // Supported only for virtual blocks.
+    virtual VkResult Resize(VkDeviceSize newSize) = 0;
+
+    // Snapshots of virtual blocks, see vmaSerializeVirtualBlock().
+    // TLSF metadata of real memory blocks can also be written, to simulate defragmentation on a virtual copy.
+    // pRanges may be unaligned, it must be accessed with memcpy.
+    virtual size_t GetSnapshotRangeCount() const = 0;
+    virtual void WriteSnapshot(VmaVirtualBlockSnapshotHeader& inoutHeader, char* pRanges) const = 0;
+    // Must be called on an empty block of header.size. Returns false, leaving the block empty, if the data is malformed.
+    virtual bool ReadSnapshot(const VmaVirtualBlockSnapshotHeader& header, const char* pRanges,
+        VmaVirtualAllocation* pAllocations) = 0;
 
     virtual void SetAllocationUserData(VmaAllocHandle allocHandle, void* userData) = 0;
     virtual void DebugLogAllAllocations() const = 0;
 
 protected:
+    void SetSize(VkDeviceSize size) { m_Size = size; }
     const VkAllocationCallbacks* GetAllocationCallbacks() const { return m_pAllocationCallbacks; }
     VkDeviceSize GetBufferImageGranularity() const { return m_BufferImageGranularity; }
     VkDeviceSize GetDebugMargin() const { return VkDeviceSize(IsVirtual() ? 0 : VMA_DEBUG_MARGIN); }
@@ -7551,6 +8989,7 @@ public:
     bool Validate() const override;
     size_t GetAllocationCount() const override;
     size_t GetFreeRegionsCount() const override;
+    VkDeviceSize GetLargestFreeRegionSize() const override;
 
     void AddDetailedStatistics(VmaDetailedStatistics& inoutStats) const override;
     void AddStatistics(VmaStatistics& inoutStats) const override;
@@ -7581,6 +9020,11 @@ public:
     VmaAllocHandle GetNextAllocation(VmaAllocHandle prevAlloc) const override;
     VkDeviceSize GetNextFreeRegionSize(VmaAllocHandle alloc) const override;
     void Clear() override;
+    VkResult Resize(VkDeviceSize newSize) override;
+    size_t GetSnapshotRangeCount() const override;
+    void WriteSnapshot(VmaVirtualBlockSnapshotHeader& inoutHeader, char* pRanges) const override;
+    bool ReadSnapshot(const VmaVirtualBlockSnapshotHeader& header, const char* pRanges,
+        VmaVirtualAllocation* pAllocations) override;
     void SetAllocationUserData(VmaAllocHandle allocHandle, void* userData) override;
     void DebugLogAllAllocations() const override;
 
@@ -7825,6 +9269,13 @@ size_t VmaBlockMetadata_Linear::GetFreeRegionsCount() const
     return SIZE_MAX;
 }
 
+VkDeviceSize VmaBlockMetadata_Linear::GetLargestFreeRegionSize() const
+{
+    // Function only used for tracking fragmentation, which is disabled for this algorithm
+    VMA_ASSERT(0);
+    return 0;
+}
+
 void VmaBlockMetadata_Linear::AddDetailedStatistics(VmaDetailedStatistics& inoutStats) const
 {
     const VkDeviceSize size = GetSize();
@@ -8680,6 +10131,142 @@ void VmaBlockMetadata_Linear::Clear()
     m_2ndNullItemsCount = 0;
 }
 
+VkResult VmaBlockMetadata_Linear::Resize(VkDeviceSize newSize)
+{
+    VMA_ASSERT(IsVirtual() && "Resizing is supported only for virtual blocks!");
+    VMA_HEAVY_ASSERT(Validate());
+
+    // Upper side of the double stack is attached to the end of the block, so it would have to be moved.
+    if (m_2ndVectorMode == SECOND_VECTOR_DOUBLE_STACK)
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+
+    // Both without 2nd vector and in ring buffer mode, the last item of 1st vector has the highest offset.
+    const SuballocationVectorType& suballocations1st = AccessSuballocations1st();
+    VkDeviceSize usedEnd = 0;
+    if (!suballocations1st.empty())
+    {
+        const VmaSuballocation& lastSuballoc = suballocations1st.back();
+        usedEnd = lastSuballoc.offset + lastSuballoc.size;
+    }
+    if (newSize < usedEnd)
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+
+    m_SumFreeSize = m_SumFreeSize + newSize - GetSize();
+    SetSize(newSize);
+
+    VMA_HEAVY_ASSERT(Validate());
+    return VK_SUCCESS;
+}
+
+size_t VmaBlockMetadata_Linear::GetSnapshotRangeCount() const
+{
+    return AccessSuballocations1st().size() + AccessSuballocations2nd().size();
+}
+
+void VmaBlockMetadata_Linear::WriteSnapshot(VmaVirtualBlockSnapshotHeader& inoutHeader, char* pRanges) const
+{
+    VMA_ASSERT(IsVirtual());
+    const SuballocationVectorType& suballocations1st = AccessSuballocations1st();
+    const SuballocationVectorType& suballocations2nd = AccessSuballocations2nd();
+    inoutHeader.secondVectorMode = (uint32_t)m_2ndVectorMode;
+    inoutHeader.firstVectorRangeCount = suballocations1st.size();
+
+    // Both vectors are stored as they are, including null items, so that they can be restored without any processing.
+    for (const VmaSuballocation& suballoc : suballocations1st)
+    {
+        VmaWriteSnapshotRange(pRanges, suballoc.offset, suballoc.size, suballoc.userData, suballoc.type == VMA_SUBALLOCATION_TYPE_FREE);
+        pRanges += sizeof(VmaVirtualBlockSnapshotRange);
+    }
+    for (const VmaSuballocation& suballoc : suballocations2nd)
+    {
+        VmaWriteSnapshotRange(pRanges, suballoc.offset, suballoc.size, suballoc.userData, suballoc.type == VMA_SUBALLOCATION_TYPE_FREE);
+        pRanges += sizeof(VmaVirtualBlockSnapshotRange);
+    }
+}
+
+bool VmaBlockMetadata_Linear::ReadSnapshot(const VmaVirtualBlockSnapshotHeader& header, const char* pRanges,
+    VmaVirtualAllocation* pAllocations)
+{
+    VMA_ASSERT(IsVirtual() && IsEmpty());
+    if (header.secondVectorMode > SECOND_VECTOR_DOUBLE_STACK || header.firstVectorRangeCount > header.rangeCount)
+        return false;
+    const SECOND_VECTOR_MODE secondVectorMode = (SECOND_VECTOR_MODE)header.secondVectorMode;
+    const size_t suballoc1stCount = (size_t)header.firstVectorRangeCount;
+    const size_t suballoc2ndCount = (size_t)(header.rangeCount - header.firstVectorRangeCount);
+    if ((suballoc2ndCount == 0) != (secondVectorMode == SECOND_VECTOR_EMPTY) ||
+        (suballoc1stCount == 0 && secondVectorMode == SECOND_VECTOR_RING_BUFFER))
+        return false;
+
+    SuballocationVectorType& suballocations1st = AccessSuballocations1st();
+    SuballocationVectorType& suballocations2nd = AccessSuballocations2nd();
+    suballocations1st.resize(suballoc1stCount);
+    for (size_t i = 0; i < suballoc1stCount; ++i, pRanges += sizeof(VmaVirtualBlockSnapshotRange))
+        VmaReadSnapshotRange(pRanges, suballocations1st[i]);
+    suballocations2nd.resize(suballoc2ndCount);
+    for (size_t i = 0; i < suballoc2ndCount; ++i, pRanges += sizeof(VmaVirtualBlockSnapshotRange))
+        VmaReadSnapshotRange(pRanges, suballocations2nd[i]);
+    m_2ndVectorMode = secondVectorMode;
+
+    // Same rules as in Validate(), but checked without asserting, as the data comes from outside.
+    // Allocations are visited in order of increasing offsets.
+    size_t nullItemsBeginCount = 0;
+    while (nullItemsBeginCount < suballoc1stCount && suballocations1st[nullItemsBeginCount].type == VMA_SUBALLOCATION_TYPE_FREE)
+        ++nullItemsBeginCount;
+    bool valid = (suballoc1stCount == 0 || suballocations1st.back().type != VMA_SUBALLOCATION_TYPE_FREE) &&
+        (suballoc2ndCount == 0 || suballocations2nd.back().type != VMA_SUBALLOCATION_TYPE_FREE);
+
+    VkDeviceSize offset = 0;
+    VkDeviceSize sumUsedSize = 0;
+    size_t allocCount = 0;
+    size_t nullItems1stCount = 0;
+    size_t nullItems2ndCount = 0;
+    auto visitSuballoc = [&](const VmaSuballocation& suballoc, size_t& nullItemCount)
+        {
+            if (suballoc.offset < offset || suballoc.offset > GetSize() || suballoc.size > GetSize() - suballoc.offset)
+            {
+                valid = false;
+                return;
+            }
+            offset = suballoc.offset + suballoc.size;
+            if (suballoc.type == VMA_SUBALLOCATION_TYPE_FREE)
+                ++nullItemCount;
+            else
+            {
+                sumUsedSize += suballoc.size;
+                if (pAllocations != VMA_NULL && allocCount < header.allocationCount)
+                    pAllocations[allocCount] = (VmaVirtualAllocation)(suballoc.offset + 1);
+                ++allocCount;
+            }
+        };
+
+    if (secondVectorMode == SECOND_VECTOR_RING_BUFFER)
+    {
+        for (size_t i = 0; valid && i < suballoc2ndCount; ++i)
+            visitSuballoc(suballocations2nd[i], nullItems2ndCount);
+    }
+    for (size_t i = nullItemsBeginCount; valid && i < suballoc1stCount; ++i)
+        visitSuballoc(suballocations1st[i], nullItems1stCount);
+    if (secondVectorMode == SECOND_VECTOR_DOUBLE_STACK)
+    {
+        for (size_t i = suballoc2ndCount; valid && i--; )
+            visitSuballoc(suballocations2nd[i], nullItems2ndCount);
+    }
+
+    if (!valid || allocCount != header.allocationCount)
+    {
+        Clear();
+        return false;
+    }
+
+    m_SumFreeSize = GetSize() - sumUsedSize;
+    m_1stNullItemsBeginCount = nullItemsBeginCount;
+    m_1stNullItemsMiddleCount = nullItems1stCount;
+    m_2ndNullItemsCount = nullItems2ndCount;
+
+    VMA_HEAVY_ASSERT(Validate());
+    return true;
+}
+
 void VmaBlockMetadata_Linear::SetAllocationUserData(VmaAllocHandle allocHandle, void* userData)
 {
     VmaSuballocation& suballoc = FindSuballocation((VkDeviceSize)allocHandle - 1);
@@ -9161,6 +10748,7 @@ public:
     size_t GetAllocationCount() const override { return m_AllocCount; }
     size_t GetFreeRegionsCount() const override { return m_BlocksFreeCount + 1; }
     VkDeviceSize GetSumFreeSize() const override { return m_BlocksFreeSize + m_NullBlock->size; }
+    VkDeviceSize GetLargestFreeRegionSize() const override;
     bool IsEmpty() const override { return m_NullBlock->offset == 0; }
     VkDeviceSize GetAllocationOffset(VmaAllocHandle allocHandle) const override { return ((Block*)allocHandle)->offset; }
 
@@ -9195,6 +10783,11 @@ public:
     VmaAllocHandle GetNextAllocation(VmaAllocHandle prevAlloc) const override;
     VkDeviceSize GetNextFreeRegionSize(VmaAllocHandle alloc) const override;
     void Clear() override;
+    VkResult Resize(VkDeviceSize newSize) override;
+    size_t GetSnapshotRangeCount() const override;
+    void WriteSnapshot(VmaVirtualBlockSnapshotHeader& inoutHeader, char* pRanges) const override;
+    bool ReadSnapshot(const VmaVirtualBlockSnapshotHeader& header, const char* pRanges,
+        VmaVirtualAllocation* pAllocations) override;
     void SetAllocationUserData(VmaAllocHandle allocHandle, void* userData) override;
     void DebugLogAllAllocations() const override;
 
@@ -9254,6 +10847,7 @@ private:
     uint16_t SizeToSecondIndex(VkDeviceSize size, uint8_t memoryClass) const;
     uint32_t GetListIndex(uint8_t memoryClass, uint16_t secondIndex) const;
     uint32_t GetListIndex(VkDeviceSize size) const;
+    uint32_t CalcListsCount(VkDeviceSize size) const;
 
     void RemoveFreeBlock(Block* block);
     void InsertFreeBlock(Block* block);
@@ -9306,15 +10900,8 @@ void VmaBlockMetadata_TLSF::Init(VkDeviceSize size)
     m_NullBlock->MarkFree();
     m_NullBlock->NextFree() = VMA_NULL;
     m_NullBlock->PrevFree() = VMA_NULL;
-    uint8_t memoryClass = SizeToMemoryClass(size);
-    uint16_t sli = SizeToSecondIndex(size, memoryClass);
-    m_ListsCount = (memoryClass == 0 ? 0 : (memoryClass - 1) * (1UL << SECOND_LEVEL_INDEX) + sli) + 1;
-    if (IsVirtual())
-        m_ListsCount += 1UL << SECOND_LEVEL_INDEX;
-    else
-        m_ListsCount += 4;
-
-    m_MemoryClasses = memoryClass + uint8_t(2);
+    m_ListsCount = CalcListsCount(size);
+    m_MemoryClasses = SizeToMemoryClass(size) + uint8_t(2);
     memset(m_InnerIsFreeBitmap, 0, MAX_MEMORY_CLASSES * sizeof(uint32_t));
 
     m_FreeList = vma_new_array(GetAllocationCallbacks(), Block*, m_ListsCount);
@@ -9419,6 +11006,20 @@ bool VmaBlockMetadata_TLSF::Validate() const
     return true;
 }
 
+VkDeviceSize VmaBlockMetadata_TLSF::GetLargestFreeRegionSize() const
+{
+    VkDeviceSize result = m_NullBlock->size;
+    if (m_IsFreeBitmap != 0)
+    {
+        // Free lists are ordered by size, so only the highest non-empty one needs to be searched
+        const uint8_t memoryClass = VMA_BITSCAN_MSB(m_IsFreeBitmap);
+        const uint32_t listIndex = GetListIndex(memoryClass, VMA_BITSCAN_MSB(m_InnerIsFreeBitmap[memoryClass]));
+        for (Block* block = m_FreeList[listIndex]; block != VMA_NULL; block = block->NextFree())
+            result = VMA_MAX(result, block->size);
+    }
+    return result;
+}
+
 void VmaBlockMetadata_TLSF::AddDetailedStatistics(VmaDetailedStatistics& inoutStats) const
 {
     inoutStats.statistics.blockCount++;
@@ -9899,6 +11500,119 @@ void VmaBlockMetadata_TLSF::Clear()
     m_GranularityHandler.Clear();
 }
 
+VkResult VmaBlockMetadata_TLSF::Resize(VkDeviceSize newSize)
+{
+    VMA_ASSERT(IsVirtual() && "Resizing is supported only for virtual blocks!");
+
+    // Only the null block at the end can grow or shrink, all other blocks keep their offsets.
+    if (newSize < m_NullBlock->offset)
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+
+    const uint32_t newListsCount = CalcListsCount(newSize);
+    if (newListsCount != m_ListsCount)
+    {
+        // All free blocks end before the null block, so their lists always fit in the new array.
+        Block** newFreeList = vma_new_array(GetAllocationCallbacks(), Block*, newListsCount);
+        memset(newFreeList, 0, newListsCount * sizeof(Block*));
+        memcpy(newFreeList, m_FreeList, VMA_MIN(newListsCount, m_ListsCount) * sizeof(Block*));
+        vma_delete_array(GetAllocationCallbacks(), m_FreeList, m_ListsCount);
+        m_FreeList = newFreeList;
+        m_ListsCount = newListsCount;
+    }
+    m_MemoryClasses = SizeToMemoryClass(newSize) + uint8_t(2);
+
+    m_NullBlock->size = newSize - m_NullBlock->offset;
+    SetSize(newSize);
+
+    VMA_HEAVY_ASSERT(Validate());
+    return VK_SUCCESS;
+}
+
+size_t VmaBlockMetadata_TLSF::GetSnapshotRangeCount() const
+{
+    return m_AllocCount + m_BlocksFreeCount;
+}
+
+void VmaBlockMetadata_TLSF::WriteSnapshot(VmaVirtualBlockSnapshotHeader& inoutHeader, char* pRanges) const
+{
+    inoutHeader.secondVectorMode = 0;
+    inoutHeader.firstVectorRangeCount = 0;
+
+    // Physical blocks before the null block, written in order of increasing offsets.
+    size_t rangeIndex = GetSnapshotRangeCount();
+    for (Block* block = m_NullBlock->prevPhysical; block != VMA_NULL; block = block->prevPhysical)
+    {
+        VMA_ASSERT(rangeIndex > 0);
+        const bool isFree = block->IsFree();
+        VmaWriteSnapshotRange(pRanges + --rangeIndex * sizeof(VmaVirtualBlockSnapshotRange),
+            block->offset, block->size, isFree ? VMA_NULL : block->UserData(), isFree);
+    }
+    VMA_ASSERT(rangeIndex == 0);
+}
+
+bool VmaBlockMetadata_TLSF::ReadSnapshot(const VmaVirtualBlockSnapshotHeader& header, const char* pRanges,
+    VmaVirtualAllocation* pAllocations)
+{
+    VMA_ASSERT(IsVirtual() && IsEmpty());
+    const size_t rangeCount = (size_t)header.rangeCount;
+
+    // Validate all ranges first, so that nothing has to be rolled back.
+    VkDeviceSize offset = 0;
+    size_t allocCount = 0;
+    bool prevFree = false;
+    VmaSuballocation range;
+    for (size_t i = 0; i < rangeCount; ++i)
+    {
+        VmaReadSnapshotRange(pRanges + i * sizeof(VmaVirtualBlockSnapshotRange), range);
+        if (range.offset != offset || range.size == 0 || range.size > GetSize() - offset)
+            return false;
+        offset += range.size;
+        const bool isFree = range.type == VMA_SUBALLOCATION_TYPE_FREE;
+        // Adjacent free blocks are always merged and free space at the end belongs to the null block.
+        if (isFree && (prevFree || i + 1 == rangeCount))
+            return false;
+        if (!isFree)
+            ++allocCount;
+        prevFree = isFree;
+    }
+    if (allocCount != header.allocationCount)
+        return false;
+
+    Block* prev = VMA_NULL;
+    for (size_t i = 0; i < rangeCount; ++i)
+    {
+        VmaReadSnapshotRange(pRanges + i * sizeof(VmaVirtualBlockSnapshotRange), range);
+        Block* block = m_BlockAllocator.Alloc();
+        block->offset = range.offset;
+        block->size = range.size;
+        block->prevPhysical = prev;
+        block->nextPhysical = VMA_NULL;
+        block->MarkTaken();
+        if (prev != VMA_NULL)
+            prev->nextPhysical = block;
+
+        if (range.type == VMA_SUBALLOCATION_TYPE_FREE)
+            InsertFreeBlock(block);
+        else
+        {
+            block->UserData() = range.userData;
+            if (pAllocations != VMA_NULL)
+                pAllocations[m_AllocCount] = (VmaVirtualAllocation)block;
+            ++m_AllocCount;
+        }
+        prev = block;
+    }
+
+    m_NullBlock->offset = offset;
+    m_NullBlock->size = GetSize() - offset;
+    m_NullBlock->prevPhysical = prev;
+    if (prev != VMA_NULL)
+        prev->nextPhysical = m_NullBlock;
+
+    VMA_HEAVY_ASSERT(Validate());
+    return true;
+}
+
 void VmaBlockMetadata_TLSF::SetAllocationUserData(VmaAllocHandle allocHandle, void* userData)
 {
     Block* block = (Block*)allocHandle;
@@ -9948,6 +11662,18 @@ uint32_t VmaBlockMetadata_TLSF::GetListIndex(VkDeviceSize size) const
     return GetListIndex(memoryClass, SizeToSecondIndex(size, memoryClass));
 }
 
+uint32_t VmaBlockMetadata_TLSF::CalcListsCount(VkDeviceSize size) const
+{
+    uint8_t memoryClass = SizeToMemoryClass(size);
+    uint16_t sli = SizeToSecondIndex(size, memoryClass);
+    uint32_t listsCount = (memoryClass == 0 ? 0 : (memoryClass - 1) * (1UL << SECOND_LEVEL_INDEX) + sli) + 1;
+    if (IsVirtual())
+        listsCount += 1UL << SECOND_LEVEL_INDEX;
+    else
+        listsCount += 4;
+    return listsCount;
+}
+
 void VmaBlockMetadata_TLSF::RemoveFreeBlock(Block* block)
 {
     VMA_ASSERT(block != m_NullBlock);
@@ -10103,7 +11829,9 @@ public:
         uint32_t algorithm,
         float priority,
         VkDeviceSize minAllocationAlignment,
-        void* pMemoryAllocateNext);
+        void* pMemoryAllocateNext,
+        size_t maxEmptyBlockCount,
+        uint32_t emptyBlockReleaseFrameCount);
     ~VmaBlockVector();
 
     VmaAllocator GetAllocator() const { return m_hAllocator; }
@@ -10138,6 +11866,17 @@ public:
 
     void Free(VmaAllocation hAllocation);
 
+    bool IsIdleBlockReleaseEnabled() const { return m_EmptyBlockReleaseFrameCount != 0; }
+    // Frees empty blocks kept for reuse that stayed unused for m_EmptyBlockReleaseFrameCount frames.
+    void ReleaseIdleEmptyBlocks(uint32_t frameIndex);
+    void GetEmptyBlockStatistics(VmaEmptyBlockStatistics& outStats);
+    // Sets priorities of blocks based on their usage. See \ref vk_ext_memory_priority_dynamic.
+    void UpdatePriorities(uint32_t frameIndex);
+
+    // Fragmentation is tracked only when the allocator has a defragmentation monitor and the algorithm supports defragmentation.
+    bool IsFragmentationTracked() const;
+    void GetFragmentationInfo(VmaFragmentationInfo& outInfo);
+
 #if VMA_STATS_STRING_ENABLED
     void PrintDetailedMap(class VmaJsonWriter& json);
 #endif
@@ -10158,13 +11897,23 @@ private:
     const VkDeviceSize m_MinAllocationAlignment;
 
     void* const m_pMemoryAllocateNext;
+    // 0 means default: one empty block is kept.
+    const size_t m_MaxEmptyBlockCount;
+    const uint32_t m_EmptyBlockReleaseFrameCount;
     VMA_RW_MUTEX m_Mutex;
     // Incrementally sorted by sumFreeSize, ascending.
     VmaVector<VmaDeviceMemoryBlock*, VmaStlAllocator<VmaDeviceMemoryBlock*>> m_Blocks;
     uint32_t m_NextBlockId;
+    // Counters returned in VmaEmptyBlockStatistics, protected by m_Mutex.
+    uint64_t m_ReusedEmptyBlockCount = 0;
+    uint64_t m_ReleasedEmptyBlockCount = 0;
     bool m_IncrementalSort = true;
+    // Sums over all blocks, updated on every change of their metadata while fragmentation is tracked.
+    VmaFragmentationInfo m_Fragmentation = {};
 
     void SetIncrementalSort(bool val) { m_IncrementalSort = val; }
+    // Adds or subtracts contribution of the block to m_Fragmentation. Call with add = false before changing its metadata and add = true after.
+    void UpdateFragmentation(const VmaDeviceMemoryBlock* pBlock, bool add);
 
     VkDeviceSize CalcMaxBlockSize() const;
     // Finds and removes given block from vector.
@@ -10172,7 +11921,6 @@ private:
     // Performs single step in sorting m_Blocks. They may not be fully sorted
     // after this call.
     void IncrementallySortBlocks();
-    void SortByFreeSize();
 
     VkResult AllocatePage(
         VkDeviceSize size,
@@ -10201,380 +11949,1739 @@ private:
         VmaAllocation* pAllocation);
 
     VkResult CreateBlock(VkDeviceSize blockSize, size_t* pNewBlockIndex);
-    bool HasEmptyBlock();
+    size_t CountEmptyBlocks() const;
 };
 #endif // _VMA_BLOCK_VECTOR
 
-#ifndef _VMA_DEFRAGMENTATION_CONTEXT
-struct VmaDefragmentationContext_T
+#ifndef _VMA_HOST_COPY
+// Copy of data on the host, between mapped memory and other memory.
+struct VmaHostCopy
 {
-    VMA_CLASS_NO_COPY_NO_MOVE(VmaDefragmentationContext_T)
-public:
-    VmaDefragmentationContext_T(
-        VmaAllocator hAllocator,
-        const VmaDefragmentationInfo& info);
-    ~VmaDefragmentationContext_T();
+    const char* src;
+    char* dst;
+    size_t size;
+    // Property flags of the memory type mapped at dst if toMappedMemory, otherwise at src, choosing the copy method.
+    VkMemoryPropertyFlags memoryFlags;
+    bool toMappedMemory;
+};
+typedef VmaVector<VmaHostCopy, VmaStlAllocator<VmaHostCopy>> VmaHostCopyVector;
 
-    void GetStats(VmaDefragmentationStats& outStats) { outStats = m_GlobalStats; }
+// Data of jobs dispatched by VmaExecuteHostCopies(). Job i copies elements [firstCopies[i], firstCopies[i + 1]) of copies.
+struct VmaHostCopyJobs
+{
+    const VmaHostCopy* copies;
+    const size_t* firstCopies;
+};
 
-    VkResult DefragmentPassBegin(VmaDefragmentationPassMoveInfo& moveInfo);
-    VkResult DefragmentPassEnd(VmaDefragmentationPassMoveInfo& moveInfo);
+inline void VmaExecuteHostCopy(const VmaHostCopy& copy)
+{
+    if (copy.toMappedMemory)
+        VmaCopyToMappedMemory(copy.memoryFlags, copy.dst, copy.src, copy.size);
+    else
+        VmaCopyFromMappedMemory(copy.memoryFlags, copy.dst, copy.src, copy.size);
+}
 
-private:
-    // Max number of allocations to ignore due to size constraints before ending single pass
-    static constexpr uint8_t MAX_ALLOCS_TO_IGNORE = 16;
-    enum class CounterStatus { Pass, Ignore, End };
+inline void VKAPI_PTR VmaHostCopyJob(void* pJobData, uint32_t jobIndex)
+{
+    const VmaHostCopyJobs* const jobs = reinterpret_cast<const VmaHostCopyJobs*>(pJobData);
+    for (size_t i = jobs->firstCopies[jobIndex]; i < jobs->firstCopies[jobIndex + 1]; ++i)
+        VmaExecuteHostCopy(jobs->copies[i]);
+}
 
-    struct FragmentedBlock
+/*
+Performs the copies, sorted by source, merging the ones continuing each other in both source and destination.
+If pfnDispatchJobs is not null, copies larger than VMA_DEFRAGMENTATION_HOST_COPY_JOB_SIZE in total are split into jobs of that size.
+*/
+inline void VmaExecuteHostCopies(
+    const VkAllocationCallbacks* allocationCallbacks,
+    VmaHostCopyVector& copies,
+    PFN_vmaDispatchJobsFunction pfnDispatchJobs,
+    void* pDispatchJobsUserData)
+{
+    VMA_SORT(copies.begin(), copies.end(), [](const VmaHostCopy& lhs, const VmaHostCopy& rhs) { return lhs.src < rhs.src; });
+
+    size_t copyCount = 0;
+    size_t totalSize = 0;
+    for (size_t i = 0; i < copies.size(); ++i)
     {
-        uint32_t data;
-        VmaDeviceMemoryBlock* block;
-    };
+        const VmaHostCopy copy = copies[i];
+        totalSize += copy.size;
+        if (copyCount > 0)
+        {
+            VmaHostCopy& prevCopy = copies[copyCount - 1];
+            if (prevCopy.src + prevCopy.size == copy.src && prevCopy.dst + prevCopy.size == copy.dst &&
+                prevCopy.memoryFlags == copy.memoryFlags && prevCopy.toMappedMemory == copy.toMappedMemory)
+            {
+                prevCopy.size += copy.size;
+                continue;
+            }
+        }
+        copies[copyCount++] = copy;
+    }
+    copies.resize(copyCount);
+
+    const size_t jobSize = (size_t)VMA_DEFRAGMENTATION_HOST_COPY_JOB_SIZE;
+    if (pfnDispatchJobs == VMA_NULL || totalSize <= jobSize)
+    {
+        for (const VmaHostCopy& copy : copies)
+            VmaExecuteHostCopy(copy);
+        return;
+    }
+
+    // Cut the copies into pieces, so that each job copies jobSize bytes, except the last one.
+    VmaHostCopyVector pieces = VmaHostCopyVector(VmaStlAllocator<VmaHostCopy>(allocationCallbacks));
+    const VmaStlAllocator<size_t> indexAllocator(allocationCallbacks);
+    VmaVector<size_t, VmaStlAllocator<size_t>> firstPieces(indexAllocator);
+    size_t jobBytes = jobSize;
+    for (const VmaHostCopy& copy : copies)
+    {
+        for (size_t offset = 0; offset < copy.size; )
+        {
+            if (jobBytes == jobSize)
+            {
+                firstPieces.push_back(pieces.size());
+                jobBytes = 0;
+            }
+            const size_t size = VMA_MIN(copy.size - offset, jobSize - jobBytes);
+            pieces.push_back({ copy.src + offset, copy.dst + offset, size, copy.memoryFlags, copy.toMappedMemory });
+            offset += size;
+            jobBytes += size;
+        }
+    }
+    firstPieces.push_back(pieces.size());
+
+    VmaHostCopyJobs jobs = { pieces.data(), firstPieces.data() };
+    pfnDispatchJobs(pDispatchJobsUserData, static_cast<uint32_t>(firstPieces.size() - 1), VmaHostCopyJob, &jobs);
+}
+#endif // _VMA_HOST_COPY
+
+#ifndef _VMA_DEFRAGMENTATION_ALGORITHM
+/*
+Defragmentation algorithms shared by VmaDefragmentationContext_T, moving allocations between blocks of VmaBlockVector,
+and VmaVirtualDefragmentationContext_T, moving them between virtual blocks.
+
+DerivedT provides, accessible to this class:
+
+- `static size_t GetBlockCount(VectorT& vector)` and `static BlockT* GetBlock(VectorT& vector, size_t index)`.
+- `static VmaBlockMetadata* GetMetadata(BlockT* block)`.
+- `GetMoveData(BlockT* block, VmaAllocHandle handle)` returning description of the move with members
+  `VkDeviceSize size` and `MoveT move`, and `bool IsMovable(const MoveData& data) const`.
+- `bool AllocInBlock(VectorT& vector, BlockT* dstBlock, MoveData& data)` reserving space for the move in another block.
+- `bool ReallocInBlock(VectorT& vector, BlockT* block, MoveData& data, VkDeviceSize offset)` reserving space
+  in the same block at lower offset than given one.
+*/
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+class VmaDefragmentationAlgorithm
+{
+    VMA_CLASS_NO_COPY_NO_MOVE(VmaDefragmentationAlgorithm)
+protected:
+    // Max number of allocations to ignore due to size constraints before ending single pass
+    static constexpr uint8_t MAX_ALLOCS_TO_IGNORE = 16;
+    enum class CounterStatus { Pass, Ignore, End };
+
+    typedef VmaVector<MoveT, VmaStlAllocator<MoveT>> MoveVector;
     struct StateBalanced
     {
         VkDeviceSize avgFreeSize = 0;
         VkDeviceSize avgAllocSize = UINT64_MAX;
     };
-    struct StateExtensive
+    // Allocation where computation of a block vector stopped due to time limit or break callback, to be resumed in the next pass.
+    struct ResumePoint
     {
-        enum class Operation : uint8_t
-        {
-            FindFreeBlockBuffer, FindFreeBlockTexture, FindFreeBlockAll,
-            MoveBuffers, MoveTextures, MoveAll,
-            Cleanup, Done
-        };
-
-        Operation operation = Operation::FindFreeBlockTexture;
-        size_t firstFreeBlock = SIZE_MAX;
+        BlockT* block = VMA_NULL;
+        VkDeviceSize offset = 0;
     };
-    struct MoveAllocationData
-    {
-        VkDeviceSize size;
-        VkDeviceSize alignment;
-        VmaSuballocationType type;
-        VmaAllocationCreateFlags flags;
-        VmaDefragmentationMove move = {};
+    // Moves and counters gathered while computing a pass, for one block vector or all of them.
+    struct PassPlan
+    {
+        MoveVector& moves;
+        VkDeviceSize bytesMoved;
+        uint32_t allocationsMoved;
+        uint8_t ignoredAllocs;
+        // Block vector currently computed.
+        size_t vectorIndex = 0;
+        // Where to resume computation of current block vector. Cleared once reached.
+        ResumePoint resume = {};
+        // Set when computation stopped due to time limit or break callback.
+        bool interrupted = false;
     };
 
     const VkDeviceSize m_MaxPassBytes;
     const uint32_t m_MaxPassAllocations;
     const PFN_vmaCheckDefragmentationBreakFunction m_BreakCallback;
     void* m_BreakCallbackUserData;
+    const uint64_t m_MaxPassPlanningTime;
+    uint64_t m_PassPlanningStartTime = 0;
+    // Number of blocks at the beginning of the vectors that are never a source of moves.
+    size_t m_ImmovableBlockCount = 0;
+    // Array with element for every block vector, indexed by PassPlan::vectorIndex.
+    ResumePoint* m_ResumePoints = VMA_NULL;
+
+    VmaDefragmentationAlgorithm(VkDeviceSize maxPassBytes, uint32_t maxPassAllocations,
+        PFN_vmaCheckDefragmentationBreakFunction pfnBreakCallback, void* pBreakCallbackUserData, uint64_t maxPassPlanningTime);
+    ~VmaDefragmentationAlgorithm() = default;
+
+    DerivedT& GetDerived() { return *static_cast<DerivedT*>(this); }
+
+    // Returns true when the break callback or planning time limit requests to end the pass.
+    bool IsPassInterrupted(const PassPlan& plan) const;
+    CounterStatus CheckCounters(PassPlan& plan, BlockT* block, VmaAllocHandle handle, VkDeviceSize size);
+    // Returns index of the block to start scanning from, going down from `first`, taking the resume point into account.
+    static size_t GetFirstBlockToCheck(const PassPlan& plan, VectorT& vector, size_t first);
+    // Returns first allocation in the block to check, skipping the ones before the resume point.
+    static VmaAllocHandle GetFirstAllocationToCheck(PassPlan& plan, BlockT* block);
+    bool IncrementCounters(PassPlan& plan, VkDeviceSize bytes);
+    bool ReallocWithinBlock(PassPlan& plan, VectorT& vector, BlockT* block);
+    template<typename MoveDataT>
+    bool AllocInOtherBlock(PassPlan& plan, size_t start, size_t end, MoveDataT& data, VectorT& vector);
+
+    bool ComputeDefragmentation_Fast(PassPlan& plan, VectorT& vector);
+    bool ComputeDefragmentation_Balanced(PassPlan& plan, VectorT& vector, StateBalanced& state, bool update);
+    bool ComputeDefragmentation_Full(PassPlan& plan, VectorT& vector);
+
+    static void UpdateVectorStatistics(VectorT& vector, StateBalanced& state);
+};
 
-    VmaStlAllocator<VmaDefragmentationMove> m_MoveAllocator;
-    VmaVector<VmaDefragmentationMove, VmaStlAllocator<VmaDefragmentationMove>> m_Moves;
+#ifndef _VMA_DEFRAGMENTATION_ALGORITHM_FUNCTIONS
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::VmaDefragmentationAlgorithm(
+    VkDeviceSize maxPassBytes,
+    uint32_t maxPassAllocations,
+    PFN_vmaCheckDefragmentationBreakFunction pfnBreakCallback,
+    void* pBreakCallbackUserData,
+    uint64_t maxPassPlanningTime)
+    : m_MaxPassBytes(maxPassBytes == 0 ? VK_WHOLE_SIZE : maxPassBytes),
+    m_MaxPassAllocations(maxPassAllocations == 0 ? UINT32_MAX : maxPassAllocations),
+    m_BreakCallback(pfnBreakCallback),
+    m_BreakCallbackUserData(pBreakCallbackUserData),
+    m_MaxPassPlanningTime(maxPassPlanningTime) {}
+
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+bool VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::IsPassInterrupted(const PassPlan& plan) const
+{
+    // Check custom criteria if exists, and time limit once at least one move is found so every pass makes progress
+    return (m_BreakCallback && m_BreakCallback(m_BreakCallbackUserData)) ||
+        (m_MaxPassPlanningTime != 0 && plan.allocationsMoved > 0 &&
+            VMA_GET_TIME_NANOSECONDS() - m_PassPlanningStartTime >= m_MaxPassPlanningTime);
+}
+
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+typename VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::CounterStatus
+VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::CheckCounters(
+    PassPlan& plan, BlockT* block, VmaAllocHandle handle, VkDeviceSize size)
+{
+    if (IsPassInterrupted(plan))
+    {
+        // Next pass continues from this allocation
+        m_ResumePoints[plan.vectorIndex] = { block, DerivedT::GetMetadata(block)->GetAllocationOffset(handle) };
+        plan.interrupted = true;
+        return CounterStatus::End;
+    }
 
-    uint8_t m_IgnoredAllocs = 0;
-    uint32_t m_Algorithm;
-    uint32_t m_BlockVectorCount;
-    VmaBlockVector* m_PoolBlockVector;
-    VmaBlockVector** m_pBlockVectors;
-    size_t m_ImmovableBlockCount = 0;
-    VmaDefragmentationStats m_GlobalStats = { 0 };
-    VmaDefragmentationStats m_PassStats = { 0 };
-    void* m_AlgorithmState = VMA_NULL;
+    // Ignore allocation if will exceed max size for copy
+    if (plan.bytesMoved + size > m_MaxPassBytes)
+    {
+        if (++plan.ignoredAllocs < MAX_ALLOCS_TO_IGNORE)
+            return CounterStatus::Ignore;
+        return CounterStatus::End;
+    }
 
-    static MoveAllocationData GetMoveData(VmaAllocHandle handle, VmaBlockMetadata* metadata);
-    CounterStatus CheckCounters(VkDeviceSize bytes);
-    bool IncrementCounters(VkDeviceSize bytes);
-    bool ReallocWithinBlock(VmaBlockVector& vector, VmaDeviceMemoryBlock* block);
-    bool AllocInOtherBlock(size_t start, size_t end, MoveAllocationData& data, VmaBlockVector& vector);
+    plan.ignoredAllocs = 0;
+    return CounterStatus::Pass;
+}
 
-    bool ComputeDefragmentation(VmaBlockVector& vector, size_t index);
-    bool ComputeDefragmentation_Fast(VmaBlockVector& vector);
-    bool ComputeDefragmentation_Balanced(VmaBlockVector& vector, size_t index, bool update);
-    bool ComputeDefragmentation_Full(VmaBlockVector& vector);
-    bool ComputeDefragmentation_Extensive(VmaBlockVector& vector, size_t index);
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+size_t VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::GetFirstBlockToCheck(
+    const PassPlan& plan, VectorT& vector, size_t first)
+{
+    if (plan.resume.block != VMA_NULL)
+    {
+        for (size_t i = first; i != SIZE_MAX; --i)
+        {
+            if (DerivedT::GetBlock(vector, i) == plan.resume.block)
+                return i;
+        }
+    }
+    return first;
+}
 
-    static void UpdateVectorStatistics(VmaBlockVector& vector, StateBalanced& state);
-    bool MoveDataToFreeBlocks(VmaSuballocationType currentType,
-        VmaBlockVector& vector, size_t firstFreeBlock,
-        bool& texturePresent, bool& bufferPresent, bool& otherPresent);
-};
-#endif // _VMA_DEFRAGMENTATION_CONTEXT
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+VmaAllocHandle VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::GetFirstAllocationToCheck(
+    PassPlan& plan, BlockT* block)
+{
+    VmaBlockMetadata* metadata = DerivedT::GetMetadata(block);
+    VmaAllocHandle handle = metadata->GetAllocationListBegin();
+    if (plan.resume.block == block)
+    {
+        // Allocations are listed in order of decreasing offsets.
+        while (handle != VK_NULL_HANDLE && metadata->GetAllocationOffset(handle) > plan.resume.offset)
+            handle = metadata->GetNextAllocation(handle);
+        plan.resume = {};
+    }
+    return handle;
+}
 
-#ifndef _VMA_POOL_T
-struct VmaPool_T
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+bool VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::IncrementCounters(PassPlan& plan, VkDeviceSize bytes)
 {
-    friend struct VmaPoolListItemTraits;
-    VMA_CLASS_NO_COPY_NO_MOVE(VmaPool_T)
-public:
-    VmaBlockVector m_BlockVector;
-    VmaDedicatedAllocationList m_DedicatedAllocations;
+    plan.bytesMoved += bytes;
+    // Early return when max found
+    if (++plan.allocationsMoved >= m_MaxPassAllocations || plan.bytesMoved >= m_MaxPassBytes)
+    {
+        VMA_ASSERT((plan.allocationsMoved == m_MaxPassAllocations ||
+            plan.bytesMoved == m_MaxPassBytes) && "Exceeded maximal pass threshold!");
+        return true;
+    }
+    return false;
+}
 
-    VmaPool_T(
-        VmaAllocator hAllocator,
-        const VmaPoolCreateInfo& createInfo,
-        VkDeviceSize preferredBlockSize);
-    ~VmaPool_T();
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+bool VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::ReallocWithinBlock(
+    PassPlan& plan, VectorT& vector, BlockT* block)
+{
+    VmaBlockMetadata* metadata = DerivedT::GetMetadata(block);
 
-    uint32_t GetId() const { return m_Id; }
-    void SetId(uint32_t id) { VMA_ASSERT(m_Id == 0); m_Id = id; }
+    for (VmaAllocHandle handle = GetFirstAllocationToCheck(plan, block);
+        handle != VK_NULL_HANDLE;
+        handle = metadata->GetNextAllocation(handle))
+    {
+        auto moveData = GetDerived().GetMoveData(block, handle);
+        // Ignore newly created allocations by defragmentation algorithm and immovable ones
+        if (!GetDerived().IsMovable(moveData))
+            continue;
+        switch (CheckCounters(plan, block, handle, moveData.size))
+        {
+        case CounterStatus::Ignore:
+            continue;
+        case CounterStatus::End:
+            return true;
+        case CounterStatus::Pass:
+            break;
+        default:
+            VMA_ASSERT(0);
+        }
 
-    const char* GetName() const { return m_Name; }
-    void SetName(const char* pName);
+        VkDeviceSize offset = metadata->GetAllocationOffset(handle);
+        if (offset != 0 && metadata->GetSumFreeSize() >= moveData.size &&
+            GetDerived().ReallocInBlock(vector, block, moveData, offset))
+        {
+            plan.moves.push_back(moveData.move);
+            if (IncrementCounters(plan, moveData.size))
+                return true;
+        }
+    }
+    return false;
+}
 
-#if VMA_STATS_STRING_ENABLED
-    //void PrintDetailedMap(class VmaStringBuilder& sb);
-#endif
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+template<typename MoveDataT>
+bool VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::AllocInOtherBlock(
+    PassPlan& plan, size_t start, size_t end, MoveDataT& data, VectorT& vector)
+{
+    for (; start < end; ++start)
+    {
+        BlockT* dstBlock = DerivedT::GetBlock(vector, start);
+        if (DerivedT::GetMetadata(dstBlock)->GetSumFreeSize() >= data.size &&
+            GetDerived().AllocInBlock(vector, dstBlock, data))
+        {
+            plan.moves.push_back(data.move);
+            if (IncrementCounters(plan, data.size))
+                return true;
+            break;
+        }
+    }
+    return false;
+}
 
-private:
-    uint32_t m_Id;
-    char* m_Name;
-    VmaPool_T* m_PrevPool = VMA_NULL;
-    VmaPool_T* m_NextPool = VMA_NULL;
-};
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+bool VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::ComputeDefragmentation_Fast(
+    PassPlan& plan, VectorT& vector)
+{
+    // Move only between blocks
+
+    // Go through allocations in last blocks and try to fit them inside first ones
+    for (size_t i = GetFirstBlockToCheck(plan, vector, DerivedT::GetBlockCount(vector) - 1); i > m_ImmovableBlockCount; --i)
+    {
+        BlockT* block = DerivedT::GetBlock(vector, i);
+        VmaBlockMetadata* metadata = DerivedT::GetMetadata(block);
+
+        for (VmaAllocHandle handle = GetFirstAllocationToCheck(plan, block);
+            handle != VK_NULL_HANDLE;
+            handle = metadata->GetNextAllocation(handle))
+        {
+            auto moveData = GetDerived().GetMoveData(block, handle);
+            // Ignore newly created allocations by defragmentation algorithm and immovable ones
+            if (!GetDerived().IsMovable(moveData))
+                continue;
+            switch (CheckCounters(plan, block, handle, moveData.size))
+            {
+            case CounterStatus::Ignore:
+                continue;
+            case CounterStatus::End:
+                return true;
+            case CounterStatus::Pass:
+                break;
+            default:
+                VMA_ASSERT(0);
+            }
+
+            // Check all previous blocks for free space
+            if (AllocInOtherBlock(plan, 0, i, moveData, vector))
+                return true;
+        }
+    }
+    return false;
+}
+
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+bool VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::ComputeDefragmentation_Balanced(
+    PassPlan& plan, VectorT& vector, StateBalanced& state, bool update)
+{
+    // Go over every allocation and try to fit it in previous blocks at lowest offsets,
+    // if not possible: realloc within single block to minimize offset (exclude offset == 0),
+    // but only if there are noticeable gaps between them (some heuristic, ex. average size of allocation in block)
+    if (update && state.avgAllocSize == UINT64_MAX)
+        UpdateVectorStatistics(vector, state);
+
+    const size_t startMoveCount = plan.moves.size();
+    VkDeviceSize minimalFreeRegion = state.avgFreeSize / 2;
+    for (size_t i = GetFirstBlockToCheck(plan, vector, DerivedT::GetBlockCount(vector) - 1); i > m_ImmovableBlockCount; --i)
+    {
+        BlockT* block = DerivedT::GetBlock(vector, i);
+        VmaBlockMetadata* metadata = DerivedT::GetMetadata(block);
+        VkDeviceSize prevFreeRegionSize = 0;
+
+        for (VmaAllocHandle handle = GetFirstAllocationToCheck(plan, block);
+            handle != VK_NULL_HANDLE;
+            handle = metadata->GetNextAllocation(handle))
+        {
+            auto moveData = GetDerived().GetMoveData(block, handle);
+            // Ignore newly created allocations by defragmentation algorithm and immovable ones
+            if (!GetDerived().IsMovable(moveData))
+                continue;
+            switch (CheckCounters(plan, block, handle, moveData.size))
+            {
+            case CounterStatus::Ignore:
+                continue;
+            case CounterStatus::End:
+                return true;
+            case CounterStatus::Pass:
+                break;
+            default:
+                VMA_ASSERT(0);
+            }
+
+            // Check all previous blocks for free space
+            const size_t prevMoveCount = plan.moves.size();
+            if (AllocInOtherBlock(plan, 0, i, moveData, vector))
+                return true;
+
+            VkDeviceSize nextFreeRegionSize = metadata->GetNextFreeRegionSize(handle);
+            // If no room found then realloc within block for lower offset
+            VkDeviceSize offset = metadata->GetAllocationOffset(handle);
+            if (prevMoveCount == plan.moves.size() && offset != 0 && metadata->GetSumFreeSize() >= moveData.size)
+            {
+                // Check if realloc will make sense
+                if (prevFreeRegionSize >= minimalFreeRegion ||
+                    nextFreeRegionSize >= minimalFreeRegion ||
+                    moveData.size <= state.avgFreeSize ||
+                    moveData.size <= state.avgAllocSize)
+                {
+                    if (GetDerived().ReallocInBlock(vector, block, moveData, offset))
+                    {
+                        plan.moves.push_back(moveData.move);
+                        if (IncrementCounters(plan, moveData.size))
+                            return true;
+                    }
+                }
+            }
+            prevFreeRegionSize = nextFreeRegionSize;
+        }
+    }
+
+    // No moves performed, update statistics to current vector state
+    if (startMoveCount == plan.moves.size() && !update)
+    {
+        state.avgAllocSize = UINT64_MAX;
+        return ComputeDefragmentation_Balanced(plan, vector, state, false);
+    }
+    return false;
+}
+
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+bool VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::ComputeDefragmentation_Full(
+    PassPlan& plan, VectorT& vector)
+{
+    // Go over every allocation and try to fit it in previous blocks at lowest offsets,
+    // if not possible: realloc within single block to minimize offset (exclude offset == 0)
+
+    for (size_t i = GetFirstBlockToCheck(plan, vector, DerivedT::GetBlockCount(vector) - 1); i > m_ImmovableBlockCount; --i)
+    {
+        BlockT* block = DerivedT::GetBlock(vector, i);
+        VmaBlockMetadata* metadata = DerivedT::GetMetadata(block);
+
+        for (VmaAllocHandle handle = GetFirstAllocationToCheck(plan, block);
+            handle != VK_NULL_HANDLE;
+            handle = metadata->GetNextAllocation(handle))
+        {
+            auto moveData = GetDerived().GetMoveData(block, handle);
+            // Ignore newly created allocations by defragmentation algorithm and immovable ones
+            if (!GetDerived().IsMovable(moveData))
+                continue;
+            switch (CheckCounters(plan, block, handle, moveData.size))
+            {
+            case CounterStatus::Ignore:
+                continue;
+            case CounterStatus::End:
+                return true;
+            case CounterStatus::Pass:
+                break;
+            default:
+                VMA_ASSERT(0);
+            }
+
+            // Check all previous blocks for free space
+            const size_t prevMoveCount = plan.moves.size();
+            if (AllocInOtherBlock(plan, 0, i, moveData, vector))
+                return true;
+
+            // If no room found then realloc within block for lower offset
+            VkDeviceSize offset = metadata->GetAllocationOffset(handle);
+            if (prevMoveCount == plan.moves.size() && offset != 0 && metadata->GetSumFreeSize() >= moveData.size &&
+                GetDerived().ReallocInBlock(vector, block, moveData, offset))
+            {
+                plan.moves.push_back(moveData.move);
+                if (IncrementCounters(plan, moveData.size))
+                    return true;
+            }
+        }
+    }
+    // The first movable block is never a source of moves to other blocks, only compact it in place.
+    if (m_ImmovableBlockCount < DerivedT::GetBlockCount(vector))
+        return ReallocWithinBlock(plan, vector, DerivedT::GetBlock(vector, m_ImmovableBlockCount));
+    return false;
+}
+
+template<typename DerivedT, typename VectorT, typename BlockT, typename MoveT>
+void VmaDefragmentationAlgorithm<DerivedT, VectorT, BlockT, MoveT>::UpdateVectorStatistics(
+    VectorT& vector, StateBalanced& state)
+{
+    size_t allocCount = 0;
+    size_t freeCount = 0;
+    state.avgFreeSize = 0;
+    state.avgAllocSize = 0;
+
+    for (size_t i = 0; i < DerivedT::GetBlockCount(vector); ++i)
+    {
+        VmaBlockMetadata* metadata = DerivedT::GetMetadata(DerivedT::GetBlock(vector, i));
+
+        allocCount += metadata->GetAllocationCount();
+        freeCount += metadata->GetFreeRegionsCount();
+        state.avgFreeSize += metadata->GetSumFreeSize();
+        state.avgAllocSize += metadata->GetSize();
+    }
+
+    state.avgAllocSize = (state.avgAllocSize - state.avgFreeSize) / VMA_MAX(allocCount, (size_t)1);
+    state.avgFreeSize /= VMA_MAX(freeCount, (size_t)1);
+}
+#endif // _VMA_DEFRAGMENTATION_ALGORITHM_FUNCTIONS
+#endif // _VMA_DEFRAGMENTATION_ALGORITHM
+
+#ifndef _VMA_DEFRAGMENTATION_CONTEXT
+struct VmaDefragmentationContext_T : public VmaDefragmentationAlgorithm<
+    VmaDefragmentationContext_T, VmaBlockVector, VmaDeviceMemoryBlock, VmaDefragmentationMove>
+{
+    VMA_CLASS_NO_COPY_NO_MOVE(VmaDefragmentationContext_T)
+public:
+    // pResidencyInfo not null makes the passes move evictable allocations between memory types, see vmaBeginResidency().
+    VmaDefragmentationContext_T(
+        VmaAllocator hAllocator,
+        const VmaDefragmentationInfo& info,
+        const VmaResidencyInfo* pResidencyInfo = VMA_NULL);
+    ~VmaDefragmentationContext_T();
+
+    void GetStats(VmaDefragmentationStats& outStats) { outStats = m_GlobalStats; }
+
+    VkResult DefragmentPassBegin(VmaDefragmentationPassMoveInfo& moveInfo);
+    VkResult DefragmentPassEnd(VmaDefragmentationPassMoveInfo& moveInfo);
+
+    // Copies data of the moves through mapped pointers, see vmaExecuteDefragmentationPassOnHost().
+    VkResult ExecutePassOnHost(VmaAllocator hAllocator, const VmaDefragmentationPassMoveInfo& moveInfo);
+    // Records copies of the moves into the command buffer, see vmaRecordDefragmentationPassCopies().
+    VkResult RecordPassCopies(VmaAllocator hAllocator, const VmaDefragmentationPassMoveInfo& moveInfo, VkCommandBuffer commandBuffer);
+    // Predicts the result of defragmentation by running it on virtual copies of the blocks, see vmaEstimateDefragmentation().
+    static void Estimate(VmaAllocator hAllocator, const VmaDefragmentationInfo& info, VmaDefragmentationEstimate& outEstimate);
+
+private:
+    typedef VmaDefragmentationAlgorithm<VmaDefragmentationContext_T, VmaBlockVector, VmaDeviceMemoryBlock, VmaDefragmentationMove> Base;
+    friend Base;
+
+    struct FragmentedBlock
+    {
+        uint32_t data;
+        VmaDeviceMemoryBlock* block;
+    };
+    struct StateExtensive
+    {
+        enum class Operation : uint8_t
+        {
+            FindFreeBlockBuffer, FindFreeBlockTexture, FindFreeBlockAll,
+            MoveBuffers, MoveTextures, MoveAll,
+            Cleanup, Done
+        };
+
+        Operation operation = Operation::FindFreeBlockTexture;
+        size_t firstFreeBlock = SIZE_MAX;
+    };
+    struct MoveAllocationData
+    {
+        VkDeviceSize size;
+        VkDeviceSize alignment;
+        VmaSuballocationType type;
+        VmaAllocationCreateFlags flags;
+        VmaDefragmentationMove move = {};
+    };
+    // Moves appended to m_Moves by single job of ComputeDefragmentationParallel().
+    struct MoveRange
+    {
+        uint32_t vectorIndex;
+        size_t firstMove;
+        size_t moveCount;
+    };
+    typedef VmaVector<VmaDefragmentationCopyRegion, VmaStlAllocator<VmaDefragmentationCopyRegion>> CopyRegionVector;
+    // Buffer bound to the whole VkDeviceMemory, used by RecordPassCopies() as source or destination of the copies.
+    struct CopyBuffer
+    {
+        VkDeviceMemory memory;
+        VkBuffer buffer;
+        VmaBlockVector* vector;
+        // Block owning the memory with its id, to detect that it has been freed.
+        VmaDeviceMemoryBlock* block;
+        uint32_t blockId;
+    };
+    struct CopyBufferMemoryLess
+    {
+        bool operator()(const CopyBuffer& lhs, VkDeviceMemory rhs) const { return lhs.memory < rhs; }
+    };
+
+    const PFN_vmaDispatchJobsFunction m_DispatchJobs;
+    void* m_DispatchJobsUserData;
+    const bool m_PromoteDedicated;
+    const VmaAllocator m_hAllocator;
+    // Set for contexts created by vmaBeginResidency(), with ratios of usage to budget from VmaResidencyInfo.
+    const bool m_Residency;
+    const float m_EvictionThreshold;
+    const float m_RestoreThreshold;
+    // Dedicated allocations whose promotions or allocations whose residency moves were ignored by the user
+    // are marked with it, not to be proposed again. The mark lives in the allocation, so it's gone once it's freed.
+    const uint32_t m_Id;
+
+    VmaStlAllocator<VmaDefragmentationMove> m_MoveAllocator;
+    MoveVector m_Moves;
+    // Protects m_Moves and m_JobMoveRanges while parallel jobs merge their results.
+    VMA_MUTEX m_MovesMutex;
+    VmaVector<MoveRange, VmaStlAllocator<MoveRange>> m_JobMoveRanges;
+    CopyRegionVector m_CopyRegions;
+    // Sorted by memory.
+    VmaVector<CopyBuffer, VmaStlAllocator<CopyBuffer>> m_CopyBuffers;
+
+    uint8_t m_IgnoredAllocs = 0;
+    uint32_t m_Algorithm;
+    uint32_t m_BlockVectorCount;
+    VmaBlockVector* m_PoolBlockVector;
+    VmaBlockVector** m_pBlockVectors;
+    VmaDefragmentationStats m_GlobalStats = {};
+    VmaDefragmentationStats m_PassStats = {};
+    void* m_AlgorithmState = VMA_NULL;
+    // Block vector to start the next pass from, when computing them sequentially.
+    uint32_t m_ResumeVectorIndex = 0;
+
+    static size_t GetBlockCount(VmaBlockVector& vector) { return vector.GetBlockCount(); }
+    static VmaDeviceMemoryBlock* GetBlock(VmaBlockVector& vector, size_t index) { return vector.GetBlock(index); }
+    static VmaBlockMetadata* GetMetadata(VmaDeviceMemoryBlock* block) { return block->m_pMetadata; }
+    static MoveAllocationData GetMoveData(VmaAllocation allocation);
+    static MoveAllocationData GetMoveData(VmaDeviceMemoryBlock* block, VmaAllocHandle handle);
+    // Allocations created by defragmentation itself and immovable ones are never moved.
+    bool IsMovable(VmaAllocation allocation) const { return allocation->GetUserData() != this && !allocation->IsImmovable(); }
+    bool IsMovable(const MoveAllocationData& data) const { return IsMovable(data.move.srcAllocation); }
+    bool AllocInBlock(VmaBlockVector& vector, VmaDeviceMemoryBlock* dstBlock, MoveAllocationData& data);
+    bool ReallocInBlock(VmaBlockVector& vector, VmaDeviceMemoryBlock* block, MoveAllocationData& data, VkDeviceSize offset);
+
+    // Computes moves for single block vector, locking it for the time of the computation.
+    bool ComputeVectorDefragmentation(PassPlan& plan, VmaBlockVector& vector, size_t index);
+    // Computes moves for all default pools in jobs dispatched through m_DispatchJobs and merges them into m_Moves.
+    void ComputeDefragmentationParallel();
+    static void VKAPI_PTR ComputeDefragmentationJob(void* pJobData, uint32_t jobIndex);
+    // Updates StateExtensive::firstFreeBlock after given number of blocks has been released from the vector.
+    void UpdateFirstFreeBlock(VmaBlockVector& vector, size_t index, size_t freedBlockCount);
+    // Fills m_CopyRegions with data copies of m_Moves, merging the ones contiguous in both source and destination.
+    void ComputeCopyRegions();
+    // Sorts regions by source memory, destination memory and offset, merging the ones contiguous in both source and destination.
+    static void MergeCopyRegions(CopyRegionVector& regions);
+    static VmaDedicatedAllocationList& GetDedicatedAllocations(VmaBlockVector& vector);
+    // Writes blocks of the vector to outBlocks sorted so that the ones cheapest to free, by free size reduced by cost
+    // of moving their allocations, are at the end. Blocks with immovable allocations, which cannot be freed, go first.
+    // outBlocks can point to the blocks of the vector itself.
+    static void SortBlocksByMoveCost(VmaBlockVector& vector, VmaDeviceMemoryBlock** outBlocks);
+    // Reserves space in existing blocks of the vector for dedicated allocations created only because they didn't fit into a block.
+    bool ComputePromotions(PassPlan& plan, VmaBlockVector& vector);
+    bool IsIgnored(VmaAllocation allocation) const;
+    // Computes moves of evictable allocations out of DEVICE_LOCAL heaps over the eviction threshold
+    // and back to their preferred memory types in heaps below the restore threshold.
+    void ComputeResidency(PassPlan& plan);
+    // Reserves space for the allocation in the first of given memory types where it fits and adds the move to the plan.
+    bool AllocInOtherMemoryType(PassPlan& plan, VmaAllocation allocation, uint32_t memoryTypeBits);
+    // Frees destinations of the moves starting from given index and removes them from the plan, without changing counters.
+    void ReleaseMoves(PassPlan& plan, size_t firstMove);
+
+    bool ComputeDefragmentation(PassPlan& plan, VmaBlockVector& vector, size_t index);
+    bool ComputeDefragmentation_Extensive(PassPlan& plan, VmaBlockVector& vector, size_t index);
+
+    bool MoveDataToFreeBlocks(PassPlan& plan, VmaSuballocationType currentType,
+        VmaBlockVector& vector, size_t firstFreeBlock,
+        bool& texturePresent, bool& bufferPresent, bool& otherPresent);
+
+    // Maps memory of the allocation like VmaAllocator_T::Map(), but also when it was created without
+    // VMA_ALLOCATION_CREATE_HOST_ACCESS_* flags, which only tell how the user accesses it.
+    static VkResult MapForHostCopy(VmaAllocator hAllocator, VmaAllocation allocation, void** ppData);
+    static void UnmapAfterHostCopy(VmaAllocator hAllocator, VmaAllocation allocation);
+    // Returns index of the buffer of given memory in m_CopyBuffers, or where it would be inserted.
+    size_t FindCopyBuffer(VkDeviceMemory memory) const;
+    // Creates buffer bound to the whole memory block of the allocation, if there isn't one yet.
+    VkResult CreateCopyBuffer(VmaAllocator hAllocator, VmaBlockVector& vector, VmaAllocation allocation);
+    // Destroys buffers of memory that has been freed, or all of them.
+    void ReleaseCopyBuffers(bool all);
+    static VkDeviceSize GetAllocationAlignment(void* pUserData);
+    // Adds predicted results of defragmenting single block vector to inoutEstimate.
+    static void EstimateVectorDefragmentation(VmaBlockVector& vector, const VmaDefragmentationInfo& info,
+        VmaDefragmentationEstimate& inoutEstimate);
+};
+#endif // _VMA_DEFRAGMENTATION_CONTEXT
+
+#ifndef _VMA_POOL_T
+struct VmaPool_T
+{
+    friend struct VmaPoolListItemTraits;
+    VMA_CLASS_NO_COPY_NO_MOVE(VmaPool_T)
+private:
+    // Declared before m_BlockVector, whose destructor frees blocks through ReleaseMemory().
+    const VkDeviceSize m_SoftMemoryLimit;
+    const VkDeviceSize m_HardMemoryLimit;
+    const PFN_vmaPoolMemoryLimitFunction m_pfnSoftMemoryLimit;
+    void* const m_pSoftMemoryLimitUserData;
+    VMA_ATOMIC_UINT64 m_MemoryBytes;
+
+public:
+    VmaBlockVector m_BlockVector;
+    VmaDedicatedAllocationList m_DedicatedAllocations;
+
+    VmaPool_T(
+        VmaAllocator hAllocator,
+        const VmaPoolCreateInfo& createInfo,
+        VkDeviceSize preferredBlockSize);
+    ~VmaPool_T();
+
+    uint32_t GetId() const { return m_Id; }
+    void SetId(uint32_t id) { VMA_ASSERT(m_Id == 0); m_Id = id; }
+
+    const char* GetName() const { return m_Name; }
+    void SetName(const char* pName);
+
+    /*
+    Accounts `size` bytes of new VkDeviceMemory before it is allocated, without locking.
+    Returns false if it would exceed hardMemoryLimit. Otherwise returns previous number of bytes in outPrevMemoryBytes.
+    */
+    bool ReserveMemory(VkDeviceSize size, VkDeviceSize& outPrevMemoryBytes);
+    // To be called after VkDeviceMemory reserved with ReserveMemory() has been allocated. Calls soft limit callback if crossed.
+    void OnMemoryAllocated(VkDeviceSize prevMemoryBytes, VkDeviceSize size);
+    // To be called after VkDeviceMemory has been freed or its allocation failed.
+    void ReleaseMemory(VkDeviceSize size) { m_MemoryBytes -= size; }
+
+#if VMA_STATS_STRING_ENABLED
+    //void PrintDetailedMap(class VmaStringBuilder& sb);
+#endif
+
+private:
+    uint32_t m_Id;
+    char* m_Name;
+    VmaPool_T* m_PrevPool = VMA_NULL;
+    VmaPool_T* m_NextPool = VMA_NULL;
+};
+
+struct VmaPoolListItemTraits
+{
+    typedef VmaPool_T ItemType;
+
+    static ItemType* GetPrev(const ItemType* item) { return item->m_PrevPool; }
+    static ItemType* GetNext(const ItemType* item) { return item->m_NextPool; }
+    static ItemType*& AccessPrev(ItemType* item) { return item->m_PrevPool; }
+    static ItemType*& AccessNext(ItemType* item) { return item->m_NextPool; }
+};
+#endif // _VMA_POOL_T
+
+#ifndef _VMA_CURRENT_BUDGET_DATA
+struct VmaCurrentBudgetData
+{
+    VMA_CLASS_NO_COPY_NO_MOVE(VmaCurrentBudgetData)
+public:
+
+    /*
+    Counters of allocations, updated on every allocation and free. Each thread updates one of the shards,
+    each starting at its own cache line, and GetHeapBudgets sums them. Allocations and frees are counted
+    separately and only grow, as memory can be freed on a different thread than it was allocated on.
+    Frees are summed before allocations, so every free seen is matched by its allocation and the difference
+    is never negative. Counters of blocks are not sharded, as they change only with vkAllocateMemory / vkFreeMemory
+    and m_BlockBytes must stay exact for checks of heap size limit and budget.
+    */
+#ifdef _MSC_VER
+    #pragma warning(push)
+    #pragma warning(disable: 4324) // Structure was padded due to alignment specifier - intended.
+#endif
+    struct alignas(VMA_CACHE_LINE_SIZE) Shard
+    {
+        VMA_ATOMIC_UINT32 m_AllocationCount[VK_MAX_MEMORY_HEAPS];
+        VMA_ATOMIC_UINT32 m_FreeCount[VK_MAX_MEMORY_HEAPS];
+        VMA_ATOMIC_UINT64 m_AllocationBytes[VK_MAX_MEMORY_HEAPS];
+        VMA_ATOMIC_UINT64 m_FreeBytes[VK_MAX_MEMORY_HEAPS];
+#if VMA_MEMORY_BUDGET
+        VMA_ATOMIC_UINT32 m_OperationsSinceBudgetFetch;
+#endif
+    };
+#ifdef _MSC_VER
+    #pragma warning(pop)
+#endif
+
+    VMA_ATOMIC_UINT32 m_BlockCount[VK_MAX_MEMORY_HEAPS];
+    VMA_ATOMIC_UINT64 m_BlockBytes[VK_MAX_MEMORY_HEAPS];
+    Shard m_Shards[VMA_BUDGET_SHARD_COUNT];
+    // Bit (1 << heapIndex) is set while the heap is under pressure, see VmaMemoryPressureMonitor.
+    // Accessed only by the thread that brings m_PressureCheckRequests from 0.
+    uint32_t m_PressureHeapMask;
+    // Number of pending requests to compare usage of heaps with the watermarks, see VmaAllocator_T::CheckMemoryPressure.
+    VMA_ATOMIC_UINT32 m_PressureCheckRequests;
+
+#if VMA_MEMORY_BUDGET
+    VMA_RW_MUTEX m_BudgetMutex;
+    uint64_t m_VulkanUsage[VK_MAX_MEMORY_HEAPS];
+    uint64_t m_VulkanBudget[VK_MAX_MEMORY_HEAPS];
+    uint64_t m_BlockBytesAtBudgetFetch[VK_MAX_MEMORY_HEAPS];
+#endif // VMA_MEMORY_BUDGET
+
+    VmaCurrentBudgetData();
+
+    void AddAllocation(uint32_t heapIndex, VkDeviceSize allocationSize);
+    void RemoveAllocation(uint32_t heapIndex, VkDeviceSize allocationSize);
+
+    uint32_t GetAllocationCount(uint32_t heapIndex) const;
+    VkDeviceSize GetAllocationBytes(uint32_t heapIndex) const;
+#if VMA_MEMORY_BUDGET
+    uint32_t GetOperationsSinceBudgetFetch() const;
+    void AddOperation() { ++GetCurrentShard().m_OperationsSinceBudgetFetch; }
+    void ResetOperationsSinceBudgetFetch();
+#endif
+
+private:
+    static uint32_t GetCurrentShardIndex();
+    Shard& GetCurrentShard() { return m_Shards[GetCurrentShardIndex()]; }
+};
+
+#ifndef _VMA_CURRENT_BUDGET_DATA_FUNCTIONS
+VmaCurrentBudgetData::VmaCurrentBudgetData()
+{
+    m_PressureHeapMask = 0;
+    m_PressureCheckRequests = 0;
+    for (uint32_t heapIndex = 0; heapIndex < VK_MAX_MEMORY_HEAPS; ++heapIndex)
+    {
+        m_BlockCount[heapIndex] = 0;
+        m_BlockBytes[heapIndex] = 0;
+#if VMA_MEMORY_BUDGET
+        m_VulkanUsage[heapIndex] = 0;
+        m_VulkanBudget[heapIndex] = 0;
+        m_BlockBytesAtBudgetFetch[heapIndex] = 0;
+#endif
+    }
+
+    for (uint32_t shardIndex = 0; shardIndex < VMA_BUDGET_SHARD_COUNT; ++shardIndex)
+    {
+        Shard& shard = m_Shards[shardIndex];
+        for (uint32_t heapIndex = 0; heapIndex < VK_MAX_MEMORY_HEAPS; ++heapIndex)
+        {
+            shard.m_AllocationCount[heapIndex] = 0;
+            shard.m_FreeCount[heapIndex] = 0;
+            shard.m_AllocationBytes[heapIndex] = 0;
+            shard.m_FreeBytes[heapIndex] = 0;
+        }
+#if VMA_MEMORY_BUDGET
+        shard.m_OperationsSinceBudgetFetch = 0;
+#endif
+    }
+}
+
+void VmaCurrentBudgetData::AddAllocation(uint32_t heapIndex, VkDeviceSize allocationSize)
+{
+    Shard& shard = GetCurrentShard();
+    shard.m_AllocationBytes[heapIndex] += allocationSize;
+    ++shard.m_AllocationCount[heapIndex];
+#if VMA_MEMORY_BUDGET
+    ++shard.m_OperationsSinceBudgetFetch;
+#endif
+}
+
+void VmaCurrentBudgetData::RemoveAllocation(uint32_t heapIndex, VkDeviceSize allocationSize)
+{
+    VMA_ASSERT(GetAllocationBytes(heapIndex) >= allocationSize);
+    VMA_ASSERT(GetAllocationCount(heapIndex) > 0);
+    Shard& shard = GetCurrentShard();
+    shard.m_FreeBytes[heapIndex] += allocationSize;
+    ++shard.m_FreeCount[heapIndex];
+#if VMA_MEMORY_BUDGET
+    ++shard.m_OperationsSinceBudgetFetch;
+#endif
+}
+
+uint32_t VmaCurrentBudgetData::GetAllocationCount(uint32_t heapIndex) const
+{
+    // Frees first, see comment of struct Shard. Totals can wrap around, their difference is still correct.
+    uint32_t freeCount = 0;
+    for (uint32_t shardIndex = 0; shardIndex < VMA_BUDGET_SHARD_COUNT; ++shardIndex)
+    {
+        freeCount += m_Shards[shardIndex].m_FreeCount[heapIndex];
+    }
+    uint32_t allocationCount = 0;
+    for (uint32_t shardIndex = 0; shardIndex < VMA_BUDGET_SHARD_COUNT; ++shardIndex)
+    {
+        allocationCount += m_Shards[shardIndex].m_AllocationCount[heapIndex];
+    }
+    return allocationCount - freeCount;
+}
+
+VkDeviceSize VmaCurrentBudgetData::GetAllocationBytes(uint32_t heapIndex) const
+{
+    // Frees first, see comment of struct Shard.
+    uint64_t freeBytes = 0;
+    for (uint32_t shardIndex = 0; shardIndex < VMA_BUDGET_SHARD_COUNT; ++shardIndex)
+    {
+        freeBytes += m_Shards[shardIndex].m_FreeBytes[heapIndex];
+    }
+    uint64_t allocationBytes = 0;
+    for (uint32_t shardIndex = 0; shardIndex < VMA_BUDGET_SHARD_COUNT; ++shardIndex)
+    {
+        allocationBytes += m_Shards[shardIndex].m_AllocationBytes[heapIndex];
+    }
+    return allocationBytes - freeBytes;
+}
+
+#if VMA_MEMORY_BUDGET
+uint32_t VmaCurrentBudgetData::GetOperationsSinceBudgetFetch() const
+{
+    uint32_t result = 0;
+    for (uint32_t shardIndex = 0; shardIndex < VMA_BUDGET_SHARD_COUNT; ++shardIndex)
+    {
+        result += m_Shards[shardIndex].m_OperationsSinceBudgetFetch;
+    }
+    return result;
+}
+
+void VmaCurrentBudgetData::ResetOperationsSinceBudgetFetch()
+{
+    for (uint32_t shardIndex = 0; shardIndex < VMA_BUDGET_SHARD_COUNT; ++shardIndex)
+    {
+        m_Shards[shardIndex].m_OperationsSinceBudgetFetch = 0;
+    }
+}
+#endif // VMA_MEMORY_BUDGET
+
+uint32_t VmaCurrentBudgetData::GetCurrentShardIndex()
+{
+#if VMA_BUDGET_SHARD_COUNT > 1
+    // Threads get shards in round-robin order on their first allocation.
+    static VMA_ATOMIC_UINT32 nextShardIndex{ 0 };
+    thread_local const uint32_t shardIndex = nextShardIndex++ % VMA_BUDGET_SHARD_COUNT;
+    return shardIndex;
+#else
+    return 0;
+#endif
+}
+#endif // _VMA_CURRENT_BUDGET_DATA_FUNCTIONS
+#endif // _VMA_CURRENT_BUDGET_DATA
+
+#ifndef _VMA_ALLOCATION_OBJECT_ALLOCATOR
+/*
+Thread-safe wrapper over VmaPoolAllocator free list, for allocation of VmaAllocation_T objects.
+*/
+class VmaAllocationObjectAllocator
+{
+    VMA_CLASS_NO_COPY_NO_MOVE(VmaAllocationObjectAllocator)
+public:
+    explicit VmaAllocationObjectAllocator(const VkAllocationCallbacks* pAllocationCallbacks)
+        : m_Allocator(pAllocationCallbacks, 1024) {}
+
+    template<typename... Types> VmaAllocation Allocate(Types&&... args);
+    void Free(VmaAllocation hAlloc);
+
+private:
+    VMA_MUTEX m_Mutex;
+    VmaPoolAllocator<VmaAllocation_T> m_Allocator;
+};
+
+template<typename... Types>
+VmaAllocation VmaAllocationObjectAllocator::Allocate(Types&&... args)
+{
+    VmaMutexLock mutexLock(m_Mutex);
+    return m_Allocator.Alloc<Types...>(std::forward<Types>(args)...);
+}
+
+void VmaAllocationObjectAllocator::Free(VmaAllocation hAlloc)
+{
+    VmaMutexLock mutexLock(m_Mutex);
+    m_Allocator.Free(hAlloc);
+}
+#endif // _VMA_ALLOCATION_OBJECT_ALLOCATOR
+
+#ifndef _VMA_VIRTUAL_BLOCK_T
+struct VmaVirtualBlock_T
+{
+    VMA_CLASS_NO_COPY_NO_MOVE(VmaVirtualBlock_T)
+    friend struct VmaVirtualBlockVector_T;
+    friend struct VmaVirtualDefragmentationContext_T;
+public:
+    const bool m_AllocationCallbacksSpecified;
+    const VkAllocationCallbacks m_AllocationCallbacks;
+    const uint32_t m_Algorithm;
+
+    explicit VmaVirtualBlock_T(const VmaVirtualBlockCreateInfo& createInfo);
+    ~VmaVirtualBlock_T();
+
+    bool IsEmpty() const { return m_Metadata->IsEmpty(); }
+    void Free(VmaVirtualAllocation allocation) { m_Metadata->Free((VmaAllocHandle)allocation); }
+    void SetAllocationUserData(VmaVirtualAllocation allocation, void* userData) { m_Metadata->SetAllocationUserData((VmaAllocHandle)allocation, userData); }
+    void Clear() { m_Metadata->Clear(); }
+    VkResult Resize(VkDeviceSize newSize) { return m_Metadata->Resize(newSize); }
+    bool ReadSnapshot(const VmaVirtualBlockSnapshotHeader& header, const char* pRanges, VmaVirtualAllocation* pAllocations)
+    {
+        return m_Metadata->ReadSnapshot(header, pRanges, pAllocations);
+    }
+
+    const VkAllocationCallbacks* GetAllocationCallbacks() const;
+    void GetAllocationInfo(VmaVirtualAllocation allocation, VmaVirtualAllocationInfo& outInfo);
+    VkResult Allocate(const VmaVirtualAllocationCreateInfo& createInfo, VmaVirtualAllocation& outAllocation,
+        VkDeviceSize* outOffset);
+    VkResult AllocateMultiple(size_t allocationCount, const VmaVirtualAllocationCreateInfo* pCreateInfos,
+        VmaVirtualAllocation* pAllocations, VkDeviceSize* pOffsets);
+    void FreeMultiple(size_t allocationCount, const VmaVirtualAllocation* pAllocations);
+    VkResult Serialize(size_t& inoutDataSize, void* pData) const;
+    void GetStatistics(VmaStatistics& outStats) const;
+    void CalculateDetailedStatistics(VmaDetailedStatistics& outStats) const;
+#if VMA_STATS_STRING_ENABLED
+    void BuildStatsString(bool detailedMap, VmaStringBuilder& sb) const;
+#endif
+
+private:
+    VmaBlockMetadata* m_Metadata;
+};
+
+#ifndef _VMA_VIRTUAL_BLOCK_T_FUNCTIONS
+VmaVirtualBlock_T::VmaVirtualBlock_T(const VmaVirtualBlockCreateInfo& createInfo)
+    : m_AllocationCallbacksSpecified(createInfo.pAllocationCallbacks != VMA_NULL),
+    m_AllocationCallbacks(createInfo.pAllocationCallbacks != VMA_NULL ? *createInfo.pAllocationCallbacks : VmaEmptyAllocationCallbacks),
+    m_Algorithm(createInfo.flags & VMA_VIRTUAL_BLOCK_CREATE_ALGORITHM_MASK)
+{
+    switch (m_Algorithm)
+    {
+    case 0:
+        m_Metadata = vma_new(GetAllocationCallbacks(), VmaBlockMetadata_TLSF)(VK_NULL_HANDLE, 1, true);
+        break;
+    case VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT:
+        m_Metadata = vma_new(GetAllocationCallbacks(), VmaBlockMetadata_Linear)(VK_NULL_HANDLE, 1, true);
+        break;
+    default:
+        VMA_ASSERT(0);
+        m_Metadata = vma_new(GetAllocationCallbacks(), VmaBlockMetadata_TLSF)(VK_NULL_HANDLE, 1, true);
+    }
+
+    m_Metadata->Init(createInfo.size);
+}
+
+VmaVirtualBlock_T::~VmaVirtualBlock_T()
+{
+    // Define macro VMA_DEBUG_LOG_FORMAT or more specialized VMA_LEAK_LOG_FORMAT
+    // to receive the list of the unfreed allocations.
+    if (!m_Metadata->IsEmpty())
+        m_Metadata->DebugLogAllAllocations();
+    // This is the most important assert in the entire library.
+    // Hitting it means you have some memory leak - unreleased virtual allocations.
+    VMA_ASSERT_LEAK(m_Metadata->IsEmpty() && "Some virtual allocations were not freed before destruction of this virtual block!");
+
+    vma_delete(GetAllocationCallbacks(), m_Metadata);
+}
+
+const VkAllocationCallbacks* VmaVirtualBlock_T::GetAllocationCallbacks() const
+{
+    return m_AllocationCallbacksSpecified ? &m_AllocationCallbacks : VMA_NULL;
+}
+
+void VmaVirtualBlock_T::GetAllocationInfo(VmaVirtualAllocation allocation, VmaVirtualAllocationInfo& outInfo)
+{
+    m_Metadata->GetAllocationInfo((VmaAllocHandle)allocation, outInfo);
+}
+
+VkResult VmaVirtualBlock_T::Allocate(const VmaVirtualAllocationCreateInfo& createInfo, VmaVirtualAllocation& outAllocation,
+    VkDeviceSize* outOffset)
+{
+    VmaAllocationRequest request = {};
+    if (m_Metadata->CreateAllocationRequest(
+        createInfo.size, // allocSize
+        VMA_MAX(createInfo.alignment, (VkDeviceSize)1), // allocAlignment
+        (createInfo.flags & VMA_VIRTUAL_ALLOCATION_CREATE_UPPER_ADDRESS_BIT) != 0, // upperAddress
+        VMA_SUBALLOCATION_TYPE_UNKNOWN, // allocType - unimportant
+        createInfo.flags & VMA_VIRTUAL_ALLOCATION_CREATE_STRATEGY_MASK, // strategy
+        &request))
+    {
+        m_Metadata->Alloc(request,
+            VMA_SUBALLOCATION_TYPE_UNKNOWN, // type - unimportant
+            createInfo.pUserData);
+        outAllocation = (VmaVirtualAllocation)request.allocHandle;
+        if(outOffset)
+            *outOffset = m_Metadata->GetAllocationOffset(request.allocHandle);
+        return VK_SUCCESS;
+    }
+    outAllocation = (VmaVirtualAllocation)VK_NULL_HANDLE;
+    if (outOffset)
+        *outOffset = UINT64_MAX;
+    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+}
+
+VkResult VmaVirtualBlock_T::AllocateMultiple(size_t allocationCount, const VmaVirtualAllocationCreateInfo* pCreateInfos,
+    VmaVirtualAllocation* pAllocations, VkDeviceSize* pOffsets)
+{
+    VkResult result = VK_SUCCESS;
+    for (size_t i = 0; i < allocationCount; ++i)
+    {
+        // Failed allocations are reported as null handles, the rest of the batch continues.
+        if (Allocate(pCreateInfos[i], pAllocations[i], pOffsets != VMA_NULL ? pOffsets + i : VMA_NULL) != VK_SUCCESS)
+            result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+    return result;
+}
+
+void VmaVirtualBlock_T::FreeMultiple(size_t allocationCount, const VmaVirtualAllocation* pAllocations)
+{
+    for (size_t i = 0; i < allocationCount; ++i)
+    {
+        if (pAllocations[i] != VK_NULL_HANDLE)
+            m_Metadata->Free((VmaAllocHandle)pAllocations[i]);
+    }
+}
+
+VkResult VmaVirtualBlock_T::Serialize(size_t& inoutDataSize, void* pData) const
+{
+    const size_t rangeCount = m_Metadata->GetSnapshotRangeCount();
+    const size_t dataSize = sizeof(VmaVirtualBlockSnapshotHeader) + rangeCount * sizeof(VmaVirtualBlockSnapshotRange);
+    if (pData == VMA_NULL)
+    {
+        inoutDataSize = dataSize;
+        return VK_SUCCESS;
+    }
+    if (inoutDataSize < dataSize)
+    {
+        inoutDataSize = 0;
+        return VK_INCOMPLETE;
+    }
+
+    VmaVirtualBlockSnapshotHeader header = {};
+    header.magic = VMA_VIRTUAL_BLOCK_SNAPSHOT_MAGIC;
+    header.version = VMA_VIRTUAL_BLOCK_SNAPSHOT_VERSION;
+    header.algorithm = m_Algorithm;
+    header.size = m_Metadata->GetSize();
+    header.allocationCount = m_Metadata->GetAllocationCount();
+    header.rangeCount = rangeCount;
+    char* const pBytes = static_cast<char*>(pData);
+    m_Metadata->WriteSnapshot(header, pBytes + sizeof(VmaVirtualBlockSnapshotHeader));
+    memcpy(pBytes, &header, sizeof(header));
+
+    inoutDataSize = dataSize;
+    return VK_SUCCESS;
+}
+
+void VmaVirtualBlock_T::GetStatistics(VmaStatistics& outStats) const
+{
+    VmaClearStatistics(outStats);
+    m_Metadata->AddStatistics(outStats);
+}
+
+void VmaVirtualBlock_T::CalculateDetailedStatistics(VmaDetailedStatistics& outStats) const
+{
+    VmaClearDetailedStatistics(outStats);
+    m_Metadata->AddDetailedStatistics(outStats);
+}
+
+#if VMA_STATS_STRING_ENABLED
+void VmaVirtualBlock_T::BuildStatsString(bool detailedMap, VmaStringBuilder& sb) const
+{
+    VmaJsonWriter json(GetAllocationCallbacks(), sb);
+    json.BeginObject();
+
+    VmaDetailedStatistics stats;
+    CalculateDetailedStatistics(stats);
+
+    json.WriteString("Stats");
+    VmaPrintDetailedStatistics(json, stats);
+
+    if (detailedMap)
+    {
+        json.WriteString("Details");
+        json.BeginObject();
+        m_Metadata->PrintDetailedMap(json);
+        json.EndObject();
+    }
+
+    json.EndObject();
+}
+#endif // VMA_STATS_STRING_ENABLED
+#endif // _VMA_VIRTUAL_BLOCK_T_FUNCTIONS
+#endif // _VMA_VIRTUAL_BLOCK_T
+
+#ifndef _VMA_VIRTUAL_BLOCK_VECTOR_T
+// Counterpart of VmaBlockVector for virtual blocks: a sequence of blocks of the same size, growing and shrinking as needed.
+struct VmaVirtualBlockVector_T
+{
+    VMA_CLASS_NO_COPY_NO_MOVE(VmaVirtualBlockVector_T)
+public:
+    const bool m_AllocationCallbacksSpecified;
+    const VkAllocationCallbacks m_AllocationCallbacks;
+
+    explicit VmaVirtualBlockVector_T(const VmaVirtualBlockVectorCreateInfo& createInfo);
+    ~VmaVirtualBlockVector_T();
+
+    const VkAllocationCallbacks* GetAllocationCallbacks() const;
+    VmaVirtualBlock GetBlock(uint32_t blockIndex) const;
+
+    VkResult CreateMinBlocks();
+    VkResult Allocate(const VmaVirtualAllocationCreateInfo& createInfo, VmaVirtualAllocation& outAllocation,
+        uint32_t& outBlockIndex, VkDeviceSize* outOffset);
+    void Free(uint32_t blockIndex, VmaVirtualAllocation allocation);
+    void GetStatistics(VmaStatistics& outStats) const;
+
+private:
+    const VkDeviceSize m_BlockSize;
+    const VmaVirtualBlockCreateFlags m_BlockFlags;
+    const size_t m_MinBlockCount;
+    const size_t m_MaxBlockCount;
+    const PFN_vmaCreateVirtualBlockFunction m_pfnCreateBlock;
+    const PFN_vmaDestroyVirtualBlockFunction m_pfnDestroyBlock;
+    void* const m_pUserData;
+
+    // Blocks indexed by blockIndex returned to the user. Null entries are free indices.
+    VmaVector<VmaVirtualBlock_T*, VmaStlAllocator<VmaVirtualBlock_T*>> m_BlockSlots;
+    // Indices of existing blocks, incrementally sorted by sum of free size, ascending.
+    VmaVector<uint32_t, VmaStlAllocator<uint32_t>> m_Blocks;
+
+    VmaVirtualBlock_T* GetBlockAt(size_t i) const { return m_BlockSlots[m_Blocks[i]]; }
+    bool HasEmptyBlock() const;
+    VkResult AllocateFromBlock(size_t i, const VmaVirtualAllocationCreateInfo& createInfo,
+        VmaVirtualAllocation& outAllocation, uint32_t& outBlockIndex, VkDeviceSize* outOffset);
+    VkResult CreateBlock(size_t* pNewBlockIndex);
+    void DestroyBlock(size_t i);
+    // Performs single step in sorting m_Blocks. They may not be fully sorted after this call.
+    void IncrementallySortBlocks();
+};
+
+#ifndef _VMA_VIRTUAL_BLOCK_VECTOR_T_FUNCTIONS
+VmaVirtualBlockVector_T::VmaVirtualBlockVector_T(const VmaVirtualBlockVectorCreateInfo& createInfo)
+    : m_AllocationCallbacksSpecified(createInfo.pAllocationCallbacks != VMA_NULL),
+    m_AllocationCallbacks(createInfo.pAllocationCallbacks != VMA_NULL ? *createInfo.pAllocationCallbacks : VmaEmptyAllocationCallbacks),
+    m_BlockSize(createInfo.blockSize),
+    m_BlockFlags(createInfo.flags),
+    m_MinBlockCount(createInfo.minBlockCount),
+    m_MaxBlockCount(createInfo.maxBlockCount != 0 ? createInfo.maxBlockCount : SIZE_MAX),
+    m_pfnCreateBlock(createInfo.pfnCreateBlock),
+    m_pfnDestroyBlock(createInfo.pfnDestroyBlock),
+    m_pUserData(createInfo.pUserData),
+    m_BlockSlots(VmaStlAllocator<VmaVirtualBlock_T*>(GetAllocationCallbacks())),
+    m_Blocks(VmaStlAllocator<uint32_t>(GetAllocationCallbacks())) {}
+
+VmaVirtualBlockVector_T::~VmaVirtualBlockVector_T()
+{
+    for (size_t i = m_Blocks.size(); i--; )
+        DestroyBlock(i);
+}
+
+const VkAllocationCallbacks* VmaVirtualBlockVector_T::GetAllocationCallbacks() const
+{
+    return m_AllocationCallbacksSpecified ? &m_AllocationCallbacks : VMA_NULL;
+}
+
+VmaVirtualBlock VmaVirtualBlockVector_T::GetBlock(uint32_t blockIndex) const
+{
+    return blockIndex < m_BlockSlots.size() ? m_BlockSlots[blockIndex] : VMA_NULL;
+}
+
+VkResult VmaVirtualBlockVector_T::CreateMinBlocks()
+{
+    for (size_t i = 0; i < m_MinBlockCount; ++i)
+    {
+        VkResult res = CreateBlock(VMA_NULL);
+        if (res != VK_SUCCESS)
+            return res;
+    }
+    return VK_SUCCESS;
+}
 
-struct VmaPoolListItemTraits
+VkResult VmaVirtualBlockVector_T::Allocate(const VmaVirtualAllocationCreateInfo& createInfo, VmaVirtualAllocation& outAllocation,
+    uint32_t& outBlockIndex, VkDeviceSize* outOffset)
 {
-    typedef VmaPool_T ItemType;
+    outAllocation = (VmaVirtualAllocation)VK_NULL_HANDLE;
+    outBlockIndex = UINT32_MAX;
+    if (outOffset)
+        *outOffset = UINT64_MAX;
 
-    static ItemType* GetPrev(const ItemType* item) { return item->m_PrevPool; }
-    static ItemType* GetNext(const ItemType* item) { return item->m_NextPool; }
-    static ItemType*& AccessPrev(ItemType* item) { return item->m_PrevPool; }
-    static ItemType*& AccessNext(ItemType* item) { return item->m_NextPool; }
-};
-#endif // _VMA_POOL_T
+    const bool isUpperAddress = (createInfo.flags & VMA_VIRTUAL_ALLOCATION_CREATE_UPPER_ADDRESS_BIT) != 0;
+    const bool isLinear = (m_BlockFlags & VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT) != 0;
 
-#ifndef _VMA_CURRENT_BUDGET_DATA
-struct VmaCurrentBudgetData
-{
-    VMA_CLASS_NO_COPY_NO_MOVE(VmaCurrentBudgetData)
-public:
+    // Upper address can only be used with linear allocator and within single block.
+    if (isUpperAddress && (!isLinear || m_MaxBlockCount > 1))
+        return VK_ERROR_FEATURE_NOT_PRESENT;
 
-    VMA_ATOMIC_UINT32 m_BlockCount[VK_MAX_MEMORY_HEAPS];
-    VMA_ATOMIC_UINT32 m_AllocationCount[VK_MAX_MEMORY_HEAPS];
-    VMA_ATOMIC_UINT64 m_BlockBytes[VK_MAX_MEMORY_HEAPS];
-    VMA_ATOMIC_UINT64 m_AllocationBytes[VK_MAX_MEMORY_HEAPS];
+    // Early reject: requested allocation size is larger that the size of a block.
+    if (createInfo.size > m_BlockSize)
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
 
-#if VMA_MEMORY_BUDGET
-    VMA_ATOMIC_UINT32 m_OperationsSinceBudgetFetch;
-    VMA_RW_MUTEX m_BudgetMutex;
-    uint64_t m_VulkanUsage[VK_MAX_MEMORY_HEAPS];
-    uint64_t m_VulkanBudget[VK_MAX_MEMORY_HEAPS];
-    uint64_t m_BlockBytesAtBudgetFetch[VK_MAX_MEMORY_HEAPS];
-#endif // VMA_MEMORY_BUDGET
+    // 1. Search existing blocks. Try to allocate.
+    if (isLinear)
+    {
+        // Use only last block.
+        if (!m_Blocks.empty() && AllocateFromBlock(m_Blocks.size() - 1, createInfo, outAllocation, outBlockIndex, outOffset) == VK_SUCCESS)
+            return VK_SUCCESS;
+    }
+    else if ((createInfo.flags & VMA_VIRTUAL_ALLOCATION_CREATE_STRATEGY_MIN_TIME_BIT) == 0) // MIN_MEMORY or default
+    {
+        // Forward order in m_Blocks - prefer blocks with smallest amount of free space.
+        for (size_t i = 0; i < m_Blocks.size(); ++i)
+        {
+            if (AllocateFromBlock(i, createInfo, outAllocation, outBlockIndex, outOffset) == VK_SUCCESS)
+                return VK_SUCCESS;
+        }
+    }
+    else // VMA_VIRTUAL_ALLOCATION_CREATE_STRATEGY_MIN_TIME_BIT
+    {
+        // Backward order in m_Blocks - prefer blocks with largest amount of free space.
+        for (size_t i = m_Blocks.size(); i--; )
+        {
+            if (AllocateFromBlock(i, createInfo, outAllocation, outBlockIndex, outOffset) == VK_SUCCESS)
+                return VK_SUCCESS;
+        }
+    }
 
-    VmaCurrentBudgetData();
+    // 2. Try to create new block.
+    if (m_Blocks.size() < m_MaxBlockCount)
+    {
+        size_t newBlockIndex = 0;
+        VkResult res = CreateBlock(&newBlockIndex);
+        if (res != VK_SUCCESS)
+            return res;
+        // Allocation from new block can still fail due to alignment.
+        return AllocateFromBlock(newBlockIndex, createInfo, outAllocation, outBlockIndex, outOffset);
+    }
 
-    void AddAllocation(uint32_t heapIndex, VkDeviceSize allocationSize);
-    void RemoveAllocation(uint32_t heapIndex, VkDeviceSize allocationSize);
-};
+    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+}
 
-#ifndef _VMA_CURRENT_BUDGET_DATA_FUNCTIONS
-VmaCurrentBudgetData::VmaCurrentBudgetData()
+void VmaVirtualBlockVector_T::Free(uint32_t blockIndex, VmaVirtualAllocation allocation)
 {
-    for (uint32_t heapIndex = 0; heapIndex < VK_MAX_MEMORY_HEAPS; ++heapIndex)
+    VmaVirtualBlock_T* const block = GetBlock(blockIndex);
+    VMA_ASSERT(block != VMA_NULL && "Invalid block index!");
+
+    const bool hadEmptyBlockBeforeFree = HasEmptyBlock();
+    block->Free(allocation);
+
+    const bool canDeleteBlock = m_Blocks.size() > m_MinBlockCount;
+    // Block became empty after this deallocation.
+    if (block->IsEmpty())
     {
-        m_BlockCount[heapIndex] = 0;
-        m_AllocationCount[heapIndex] = 0;
-        m_BlockBytes[heapIndex] = 0;
-        m_AllocationBytes[heapIndex] = 0;
-#if VMA_MEMORY_BUDGET
-        m_VulkanUsage[heapIndex] = 0;
-        m_VulkanBudget[heapIndex] = 0;
-        m_BlockBytesAtBudgetFetch[heapIndex] = 0;
-#endif
+        // Already had empty block. We don't want to have two, so release this one.
+        if (hadEmptyBlockBeforeFree && canDeleteBlock)
+        {
+            for (size_t i = 0; i < m_Blocks.size(); ++i)
+            {
+                if (m_Blocks[i] == blockIndex)
+                {
+                    DestroyBlock(i);
+                    break;
+                }
+            }
+        }
+        // else: We now have one empty block - leave it. A hysteresis to avoid creating whole block back and forth.
+    }
+    // Block didn't become empty, but we have another empty block - find and release that one.
+    else if (hadEmptyBlockBeforeFree && canDeleteBlock)
+    {
+        if (GetBlockAt(m_Blocks.size() - 1)->IsEmpty())
+            DestroyBlock(m_Blocks.size() - 1);
     }
 
-#if VMA_MEMORY_BUDGET
-    m_OperationsSinceBudgetFetch = 0;
-#endif
+    IncrementallySortBlocks();
 }
 
-void VmaCurrentBudgetData::AddAllocation(uint32_t heapIndex, VkDeviceSize allocationSize)
+void VmaVirtualBlockVector_T::GetStatistics(VmaStatistics& outStats) const
 {
-    m_AllocationBytes[heapIndex] += allocationSize;
-    ++m_AllocationCount[heapIndex];
-#if VMA_MEMORY_BUDGET
-    ++m_OperationsSinceBudgetFetch;
-#endif
+    VmaClearStatistics(outStats);
+    for (size_t i = 0; i < m_Blocks.size(); ++i)
+        GetBlockAt(i)->m_Metadata->AddStatistics(outStats);
 }
 
-void VmaCurrentBudgetData::RemoveAllocation(uint32_t heapIndex, VkDeviceSize allocationSize)
+bool VmaVirtualBlockVector_T::HasEmptyBlock() const
 {
-    VMA_ASSERT(m_AllocationBytes[heapIndex] >= allocationSize);
-    m_AllocationBytes[heapIndex] -= allocationSize;
-    VMA_ASSERT(m_AllocationCount[heapIndex] > 0);
-    --m_AllocationCount[heapIndex];
-#if VMA_MEMORY_BUDGET
-    ++m_OperationsSinceBudgetFetch;
-#endif
+    for (size_t i = 0; i < m_Blocks.size(); ++i)
+    {
+        if (GetBlockAt(i)->IsEmpty())
+            return true;
+    }
+    return false;
 }
-#endif // _VMA_CURRENT_BUDGET_DATA_FUNCTIONS
-#endif // _VMA_CURRENT_BUDGET_DATA
 
-#ifndef _VMA_ALLOCATION_OBJECT_ALLOCATOR
-/*
-Thread-safe wrapper over VmaPoolAllocator free list, for allocation of VmaAllocation_T objects.
-*/
-class VmaAllocationObjectAllocator
+VkResult VmaVirtualBlockVector_T::AllocateFromBlock(size_t i, const VmaVirtualAllocationCreateInfo& createInfo,
+    VmaVirtualAllocation& outAllocation, uint32_t& outBlockIndex, VkDeviceSize* outOffset)
 {
-    VMA_CLASS_NO_COPY_NO_MOVE(VmaAllocationObjectAllocator)
-public:
-    explicit VmaAllocationObjectAllocator(const VkAllocationCallbacks* pAllocationCallbacks)
-        : m_Allocator(pAllocationCallbacks, 1024) {}
+    VkResult res = GetBlockAt(i)->Allocate(createInfo, outAllocation, outOffset);
+    if (res == VK_SUCCESS)
+    {
+        outBlockIndex = m_Blocks[i];
+        IncrementallySortBlocks();
+    }
+    return res;
+}
 
-    template<typename... Types> VmaAllocation Allocate(Types&&... args);
-    void Free(VmaAllocation hAlloc);
+VkResult VmaVirtualBlockVector_T::CreateBlock(size_t* pNewBlockIndex)
+{
+    // Reuse the lowest free index.
+    uint32_t blockIndex = 0;
+    while (blockIndex < m_BlockSlots.size() && m_BlockSlots[blockIndex] != VMA_NULL)
+        ++blockIndex;
 
-private:
-    VMA_MUTEX m_Mutex;
-    VmaPoolAllocator<VmaAllocation_T> m_Allocator;
-};
+    if (m_pfnCreateBlock != VMA_NULL)
+    {
+        VkResult res = (*m_pfnCreateBlock)(this, blockIndex, m_BlockSize, m_pUserData);
+        if (res != VK_SUCCESS)
+            return res;
+    }
 
-template<typename... Types>
-VmaAllocation VmaAllocationObjectAllocator::Allocate(Types&&... args)
+    VmaVirtualBlockCreateInfo blockCreateInfo = {};
+    blockCreateInfo.size = m_BlockSize;
+    blockCreateInfo.flags = m_BlockFlags;
+    blockCreateInfo.pAllocationCallbacks = GetAllocationCallbacks();
+    VmaVirtualBlock_T* const block = vma_new(GetAllocationCallbacks(), VmaVirtualBlock_T)(blockCreateInfo);
+    if (blockIndex == m_BlockSlots.size())
+        m_BlockSlots.push_back(block);
+    else
+        m_BlockSlots[blockIndex] = block;
+    m_Blocks.push_back(blockIndex);
+
+    if (pNewBlockIndex != VMA_NULL)
+        *pNewBlockIndex = m_Blocks.size() - 1;
+    return VK_SUCCESS;
+}
+
+void VmaVirtualBlockVector_T::DestroyBlock(size_t i)
 {
-    VmaMutexLock mutexLock(m_Mutex);
-    return m_Allocator.Alloc<Types...>(std::forward<Types>(args)...);
+    const uint32_t blockIndex = m_Blocks[i];
+    VmaVirtualBlock_T* const block = m_BlockSlots[blockIndex];
+    VmaVectorRemove(m_Blocks, i);
+    m_BlockSlots[blockIndex] = VMA_NULL;
+    while (!m_BlockSlots.empty() && m_BlockSlots.back() == VMA_NULL)
+        m_BlockSlots.pop_back();
+
+    vma_delete(GetAllocationCallbacks(), block);
+    if (m_pfnDestroyBlock != VMA_NULL)
+        (*m_pfnDestroyBlock)(this, blockIndex, m_pUserData);
 }
 
-void VmaAllocationObjectAllocator::Free(VmaAllocation hAlloc)
+void VmaVirtualBlockVector_T::IncrementallySortBlocks()
 {
-    VmaMutexLock mutexLock(m_Mutex);
-    m_Allocator.Free(hAlloc);
+    if ((m_BlockFlags & VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT) == 0)
+    {
+        // Bubble sort only until first swap.
+        for (size_t i = 1; i < m_Blocks.size(); ++i)
+        {
+            if (GetBlockAt(i - 1)->m_Metadata->GetSumFreeSize() > GetBlockAt(i)->m_Metadata->GetSumFreeSize())
+            {
+                std::swap(m_Blocks[i - 1], m_Blocks[i]);
+                return;
+            }
+        }
+    }
 }
-#endif // _VMA_ALLOCATION_OBJECT_ALLOCATOR
+#endif // _VMA_VIRTUAL_BLOCK_VECTOR_T_FUNCTIONS
+#endif // _VMA_VIRTUAL_BLOCK_VECTOR_T
 
-#ifndef _VMA_VIRTUAL_BLOCK_T
-struct VmaVirtualBlock_T
+#ifndef _VMA_VIRTUAL_DEFRAGMENTATION_CONTEXT
+// Counterpart of VmaDefragmentationContext_T working on a set of TLSF virtual blocks.
+struct VmaVirtualDefragmentationContext_T : public VmaDefragmentationAlgorithm<VmaVirtualDefragmentationContext_T,
+    VmaVector<VmaVirtualBlock_T*, VmaStlAllocator<VmaVirtualBlock_T*>>, VmaVirtualBlock_T, VmaVirtualDefragmentationMove>
 {
-    VMA_CLASS_NO_COPY_NO_MOVE(VmaVirtualBlock_T)
+    VMA_CLASS_NO_COPY_NO_MOVE(VmaVirtualDefragmentationContext_T)
 public:
-    const bool m_AllocationCallbacksSpecified;
-    const VkAllocationCallbacks m_AllocationCallbacks;
-
-    explicit VmaVirtualBlock_T(const VmaVirtualBlockCreateInfo& createInfo);
-    ~VmaVirtualBlock_T();
+    // pfnGetAlignment, if not null, returns additional alignment required by an allocation given its user data.
+    // Unless sortBlocks is false, blocks are sorted by their free size, otherwise they are used in the given order.
+    VmaVirtualDefragmentationContext_T(const VmaVirtualDefragmentationInfo& info,
+        VkDeviceSize (*pfnGetAlignment)(void* pUserData) = VMA_NULL, bool sortBlocks = true);
+    ~VmaVirtualDefragmentationContext_T() = default;
 
-    bool IsEmpty() const { return m_Metadata->IsEmpty(); }
-    void Free(VmaVirtualAllocation allocation) { m_Metadata->Free((VmaAllocHandle)allocation); }
-    void SetAllocationUserData(VmaVirtualAllocation allocation, void* userData) { m_Metadata->SetAllocationUserData((VmaAllocHandle)allocation, userData); }
-    void Clear() { m_Metadata->Clear(); }
+    const VkAllocationCallbacks* GetAllocationCallbacks() const { return m_Blocks[0]->GetAllocationCallbacks(); }
+    void GetStats(VmaDefragmentationStats& outStats) { outStats = m_GlobalStats; }
 
-    const VkAllocationCallbacks* GetAllocationCallbacks() const;
-    void GetAllocationInfo(VmaVirtualAllocation allocation, VmaVirtualAllocationInfo& outInfo);
-    VkResult Allocate(const VmaVirtualAllocationCreateInfo& createInfo, VmaVirtualAllocation& outAllocation,
-        VkDeviceSize* outOffset);
-    void GetStatistics(VmaStatistics& outStats) const;
-    void CalculateDetailedStatistics(VmaDetailedStatistics& outStats) const;
-#if VMA_STATS_STRING_ENABLED
-    void BuildStatsString(bool detailedMap, VmaStringBuilder& sb) const;
-#endif
+    VkResult DefragmentPassBegin(VmaVirtualDefragmentationPassMoveInfo& moveInfo);
+    VkResult DefragmentPassEnd(VmaVirtualDefragmentationPassMoveInfo& moveInfo);
 
 private:
-    VmaBlockMetadata* m_Metadata;
+    typedef VmaVector<VmaVirtualBlock_T*, VmaStlAllocator<VmaVirtualBlock_T*>> BlockVector;
+    typedef VmaDefragmentationAlgorithm<VmaVirtualDefragmentationContext_T,
+        BlockVector, VmaVirtualBlock_T, VmaVirtualDefragmentationMove> Base;
+    friend Base;
+
+    struct MoveData
+    {
+        VkDeviceSize size;
+        VmaVirtualDefragmentationMove move;
+    };
+
+    const VkDeviceSize m_Alignment;
+    VkDeviceSize (* const m_pfnGetAlignment)(void* pUserData);
+
+    VmaStlAllocator<VmaVirtualBlock_T*> m_BlockAllocator;
+    // Sorted by sum of free size at the beginning of defragmentation, fullest blocks first.
+    BlockVector m_Blocks;
+    VmaStlAllocator<VmaVirtualDefragmentationMove> m_MoveAllocator;
+    MoveVector m_Moves;
+
+    uint8_t m_IgnoredAllocs = 0;
+    uint32_t m_Algorithm;
+    StateBalanced m_StateBalanced;
+    // The only element of Base::m_ResumePoints, blocks are defragmented as a single vector.
+    ResumePoint m_ResumePoint;
+    VmaDefragmentationStats m_GlobalStats = {};
+    VmaDefragmentationStats m_PassStats = {};
+
+    static size_t GetBlockCount(BlockVector& blocks) { return blocks.size(); }
+    static VmaVirtualBlock_T* GetBlock(BlockVector& blocks, size_t index) { return blocks[index]; }
+    static VmaBlockMetadata* GetMetadata(VmaVirtualBlock_T* block) { return block->m_Metadata; }
+    MoveData GetMoveData(VmaVirtualBlock_T* block, VmaAllocHandle handle) const;
+    // Allocations created by defragmentation itself are never moved.
+    bool IsMovable(const MoveData& data) const;
+    // Doesn't refill blocks that have been freed by defragmentation.
+    bool AllocInBlock(BlockVector& blocks, VmaVirtualBlock_T* dstBlock, MoveData& data);
+    bool ReallocInBlock(BlockVector& blocks, VmaVirtualBlock_T* block, MoveData& data, VkDeviceSize offset);
+    // Reserves space for the move in given block at the lowest offset, below srcOffset when it is the source block.
+    bool Reserve(VmaVirtualBlock_T* block, VmaVirtualDefragmentationMove& move);
+
+    bool ComputeDefragmentation(PassPlan& plan);
 };
 
-#ifndef _VMA_VIRTUAL_BLOCK_T_FUNCTIONS
-VmaVirtualBlock_T::VmaVirtualBlock_T(const VmaVirtualBlockCreateInfo& createInfo)
-    : m_AllocationCallbacksSpecified(createInfo.pAllocationCallbacks != VMA_NULL),
-    m_AllocationCallbacks(createInfo.pAllocationCallbacks != VMA_NULL ? *createInfo.pAllocationCallbacks : VmaEmptyAllocationCallbacks)
+#ifndef _VMA_VIRTUAL_DEFRAGMENTATION_CONTEXT_FUNCTIONS
+VmaVirtualDefragmentationContext_T::VmaVirtualDefragmentationContext_T(const VmaVirtualDefragmentationInfo& info,
+    VkDeviceSize (*pfnGetAlignment)(void* pUserData), bool sortBlocks)
+    : Base(info.maxBytesPerPass, info.maxAllocationsPerPass, info.pfnBreakCallback, info.pBreakCallbackUserData, 0),
+    m_Alignment(VMA_MAX(info.alignment, (VkDeviceSize)1)),
+    m_pfnGetAlignment(pfnGetAlignment),
+    m_BlockAllocator(info.pBlocks[0]->GetAllocationCallbacks()),
+    m_Blocks(m_BlockAllocator),
+    m_MoveAllocator(info.pBlocks[0]->GetAllocationCallbacks()),
+    m_Moves(m_MoveAllocator),
+    m_Algorithm(info.flags & VMA_DEFRAGMENTATION_FLAG_ALGORITHM_MASK)
 {
-    const uint32_t algorithm = createInfo.flags & VMA_VIRTUAL_BLOCK_CREATE_ALGORITHM_MASK;
-    switch (algorithm)
+    m_ResumePoints = &m_ResumePoint;
+    m_Blocks.resize(info.blockCount);
+    for (uint32_t i = 0; i < info.blockCount; ++i)
+        m_Blocks[i] = info.pBlocks[i];
+    if (sortBlocks)
     {
-    case 0:
-        m_Metadata = vma_new(GetAllocationCallbacks(), VmaBlockMetadata_TLSF)(VK_NULL_HANDLE, 1, true);
+        VMA_SORT(m_Blocks.begin(), m_Blocks.end(), [](const VmaVirtualBlock_T* lhs, const VmaVirtualBlock_T* rhs)
+            {
+                return lhs->m_Metadata->GetSumFreeSize() < rhs->m_Metadata->GetSumFreeSize();
+            });
+    }
+
+    switch (m_Algorithm)
+    {
+    case 0: // Default algorithm
+        m_Algorithm = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
         break;
-    case VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT:
-        m_Metadata = vma_new(GetAllocationCallbacks(), VmaBlockMetadata_Linear)(VK_NULL_HANDLE, 1, true);
+    case VMA_DEFRAGMENTATION_FLAG_ALGORITHM_EXTENSIVE_BIT:
+        // No buffer-image granularity conflicts are possible, so full algorithm achieves max packing.
+        m_Algorithm = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT;
         break;
     default:
-        VMA_ASSERT(0);
-        m_Metadata = vma_new(GetAllocationCallbacks(), VmaBlockMetadata_TLSF)(VK_NULL_HANDLE, 1, true);
+        ; // Do nothing.
     }
+}
 
-    m_Metadata->Init(createInfo.size);
+VkResult VmaVirtualDefragmentationContext_T::DefragmentPassBegin(VmaVirtualDefragmentationPassMoveInfo& moveInfo)
+{
+    m_PassPlanningStartTime = VMA_GET_TIME_NANOSECONDS();
+    PassPlan plan = { m_Moves, 0, 0, m_IgnoredAllocs };
+    plan.resume = m_ResumePoint;
+    m_ResumePoint = {};
+    if (m_Blocks.size() > 1)
+        ComputeDefragmentation(plan);
+    else
+        ReallocWithinBlock(plan, m_Blocks, m_Blocks[0]);
+    m_IgnoredAllocs = plan.ignoredAllocs;
+    m_PassStats.bytesMoved = plan.bytesMoved;
+    m_PassStats.allocationsMoved = plan.allocationsMoved;
+    m_GlobalStats.planningTime += VMA_GET_TIME_NANOSECONDS() - m_PassPlanningStartTime;
+
+    moveInfo.moveCount = static_cast<uint32_t>(m_Moves.size());
+    if (moveInfo.moveCount > 0)
+    {
+        moveInfo.pMoves = m_Moves.data();
+        return VK_INCOMPLETE;
+    }
+
+    moveInfo.pMoves = VMA_NULL;
+    return VK_SUCCESS;
 }
 
-VmaVirtualBlock_T::~VmaVirtualBlock_T()
+VkResult VmaVirtualDefragmentationContext_T::DefragmentPassEnd(VmaVirtualDefragmentationPassMoveInfo& moveInfo)
 {
-    // Define macro VMA_DEBUG_LOG_FORMAT or more specialized VMA_LEAK_LOG_FORMAT
-    // to receive the list of the unfreed allocations.
-    if (!m_Metadata->IsEmpty())
-        m_Metadata->DebugLogAllAllocations();
-    // This is the most important assert in the entire library.
-    // Hitting it means you have some memory leak - unreleased virtual allocations.
-    VMA_ASSERT_LEAK(m_Metadata->IsEmpty() && "Some virtual allocations were not freed before destruction of this virtual block!");
+    VMA_ASSERT(moveInfo.moveCount > 0 ? moveInfo.pMoves != VMA_NULL : true);
+
+    VkResult result = VK_SUCCESS;
+    for (uint32_t i = 0; i < moveInfo.moveCount; ++i)
+    {
+        VmaVirtualDefragmentationMove& move = moveInfo.pMoves[i];
+        VmaVirtualBlock_T* const srcBlock = move.srcBlock;
+        VmaVirtualBlock_T* const dstBlock = move.dstBlock;
+        bool srcFreed = false;
+
+        switch (move.operation)
+        {
+        case VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY:
+            dstBlock->m_Metadata->SetAllocationUserData((VmaAllocHandle)move.dstAllocation,
+                srcBlock->m_Metadata->GetAllocationUserData((VmaAllocHandle)move.srcAllocation));
+            srcBlock->Free(move.srcAllocation);
+            srcFreed = true;
+            result = VK_INCOMPLETE;
+            break;
+        case VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE:
+            m_PassStats.bytesMoved -= move.size;
+            --m_PassStats.allocationsMoved;
+            dstBlock->Free(move.dstAllocation);
+            break;
+        case VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY:
+            m_PassStats.bytesMoved -= move.size;
+            --m_PassStats.allocationsMoved;
+            srcBlock->Free(move.srcAllocation);
+            dstBlock->Free(move.dstAllocation);
+            srcFreed = true;
+            result = VK_INCOMPLETE;
+            break;
+        default:
+            VMA_ASSERT(0);
+        }
+
+        // Empty blocks are never chosen as a destination, so each one is counted only once.
+        if (srcFreed && srcBlock->IsEmpty())
+        {
+            ++m_PassStats.deviceMemoryBlocksFreed;
+            m_PassStats.bytesFreed += srcBlock->m_Metadata->GetSize();
+        }
+    }
+    moveInfo.moveCount = 0;
+    moveInfo.pMoves = VMA_NULL;
+    m_Moves.clear();
+
+    // Update stats
+    m_GlobalStats.allocationsMoved += m_PassStats.allocationsMoved;
+    m_GlobalStats.bytesFreed += m_PassStats.bytesFreed;
+    m_GlobalStats.bytesMoved += m_PassStats.bytesMoved;
+    m_GlobalStats.deviceMemoryBlocksFreed += m_PassStats.deviceMemoryBlocksFreed;
+    m_PassStats = {};
 
-    vma_delete(GetAllocationCallbacks(), m_Metadata);
+    return result;
 }
 
-const VkAllocationCallbacks* VmaVirtualBlock_T::GetAllocationCallbacks() const
+VmaVirtualDefragmentationContext_T::MoveData VmaVirtualDefragmentationContext_T::GetMoveData(
+    VmaVirtualBlock_T* block, VmaAllocHandle handle) const
 {
-    return m_AllocationCallbacksSpecified ? &m_AllocationCallbacks : VMA_NULL;
-}
+    VmaVirtualAllocationInfo info = {};
+    block->m_Metadata->GetAllocationInfo(handle, info);
 
-void VmaVirtualBlock_T::GetAllocationInfo(VmaVirtualAllocation allocation, VmaVirtualAllocationInfo& outInfo)
-{
-    m_Metadata->GetAllocationInfo((VmaAllocHandle)allocation, outInfo);
+    MoveData data = {};
+    data.size = info.size;
+    data.move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY;
+    data.move.srcBlock = block;
+    data.move.srcAllocation = (VmaVirtualAllocation)handle;
+    data.move.srcOffset = info.offset;
+    data.move.size = info.size;
+    return data;
 }
 
-VkResult VmaVirtualBlock_T::Allocate(const VmaVirtualAllocationCreateInfo& createInfo, VmaVirtualAllocation& outAllocation,
-    VkDeviceSize* outOffset)
+bool VmaVirtualDefragmentationContext_T::IsMovable(const MoveData& data) const
 {
-    VmaAllocationRequest request = {};
-    if (m_Metadata->CreateAllocationRequest(
-        createInfo.size, // allocSize
-        VMA_MAX(createInfo.alignment, (VkDeviceSize)1), // allocAlignment
-        (createInfo.flags & VMA_VIRTUAL_ALLOCATION_CREATE_UPPER_ADDRESS_BIT) != 0, // upperAddress
-        VMA_SUBALLOCATION_TYPE_UNKNOWN, // allocType - unimportant
-        createInfo.flags & VMA_VIRTUAL_ALLOCATION_CREATE_STRATEGY_MASK, // strategy
-        &request))
-    {
-        m_Metadata->Alloc(request,
-            VMA_SUBALLOCATION_TYPE_UNKNOWN, // type - unimportant
-            createInfo.pUserData);
-        outAllocation = (VmaVirtualAllocation)request.allocHandle;
-        if(outOffset)
-            *outOffset = m_Metadata->GetAllocationOffset(request.allocHandle);
-        return VK_SUCCESS;
-    }
-    outAllocation = (VmaVirtualAllocation)VK_NULL_HANDLE;
-    if (outOffset)
-        *outOffset = UINT64_MAX;
-    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    return data.move.srcBlock->m_Metadata->GetAllocationUserData((VmaAllocHandle)data.move.srcAllocation) != this;
 }
 
-void VmaVirtualBlock_T::GetStatistics(VmaStatistics& outStats) const
+bool VmaVirtualDefragmentationContext_T::AllocInBlock(BlockVector& blocks, VmaVirtualBlock_T* dstBlock, MoveData& data)
 {
-    VmaClearStatistics(outStats);
-    m_Metadata->AddStatistics(outStats);
+    (void)blocks;
+    return !dstBlock->IsEmpty() && Reserve(dstBlock, data.move);
 }
 
-void VmaVirtualBlock_T::CalculateDetailedStatistics(VmaDetailedStatistics& outStats) const
+bool VmaVirtualDefragmentationContext_T::ReallocInBlock(BlockVector& blocks, VmaVirtualBlock_T* block,
+    MoveData& data, VkDeviceSize offset)
 {
-    VmaClearDetailedStatistics(outStats);
-    m_Metadata->AddDetailedStatistics(outStats);
+    (void)blocks;
+    VMA_ASSERT(block == data.move.srcBlock && offset == data.move.srcOffset);
+    return Reserve(block, data.move);
 }
 
-#if VMA_STATS_STRING_ENABLED
-void VmaVirtualBlock_T::BuildStatsString(bool detailedMap, VmaStringBuilder& sb) const
+bool VmaVirtualDefragmentationContext_T::Reserve(VmaVirtualBlock_T* block, VmaVirtualDefragmentationMove& move)
 {
-    VmaJsonWriter json(GetAllocationCallbacks(), sb);
-    json.BeginObject();
+    VmaBlockMetadata* metadata = block->m_Metadata;
+    VkDeviceSize alignment = m_Alignment;
+    if (m_pfnGetAlignment)
+    {
+        alignment = VMA_MAX(alignment, m_pfnGetAlignment(
+            move.srcBlock->m_Metadata->GetAllocationUserData((VmaAllocHandle)move.srcAllocation)));
+    }
+    VmaAllocationRequest request = {};
+    if (!metadata->CreateAllocationRequest(
+        move.size,
+        alignment,
+        false,
+        VMA_SUBALLOCATION_TYPE_UNKNOWN,
+        VMA_ALLOCATION_CREATE_STRATEGY_MIN_OFFSET_BIT,
+        &request))
+        return false;
 
-    VmaDetailedStatistics stats;
-    CalculateDetailedStatistics(stats);
+    // For TLSF, handle of the request points to the free block before alignment, final offset is stored separately.
+    const VkDeviceSize dstOffset = request.algorithmData;
+    // Within the same block only moves towards the beginning make sense.
+    if (block == move.srcBlock && dstOffset >= move.srcOffset)
+        return false;
 
-    json.WriteString("Stats");
-    VmaPrintDetailedStatistics(json, stats);
+    // Mark newly created allocations so that the algorithm doesn't try to move them again.
+    metadata->Alloc(request, VMA_SUBALLOCATION_TYPE_UNKNOWN, this);
+    move.dstBlock = block;
+    move.dstAllocation = (VmaVirtualAllocation)request.allocHandle;
+    move.dstOffset = dstOffset;
+    return true;
+}
 
-    if (detailedMap)
+bool VmaVirtualDefragmentationContext_T::ComputeDefragmentation(PassPlan& plan)
+{
+    switch (m_Algorithm)
     {
-        json.WriteString("Details");
-        json.BeginObject();
-        m_Metadata->PrintDetailedMap(json);
-        json.EndObject();
+    case VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT:
+        return ComputeDefragmentation_Fast(plan, m_Blocks);
+    case VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT:
+        return ComputeDefragmentation_Full(plan, m_Blocks);
+    default:
+        VMA_ASSERT(m_Algorithm == VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT);
+        return ComputeDefragmentation_Balanced(plan, m_Blocks, m_StateBalanced, true);
     }
-
-    json.EndObject();
 }
-#endif // VMA_STATS_STRING_ENABLED
-#endif // _VMA_VIRTUAL_BLOCK_T_FUNCTIONS
-#endif // _VMA_VIRTUAL_BLOCK_T
+#endif // _VMA_VIRTUAL_DEFRAGMENTATION_CONTEXT_FUNCTIONS
+#endif // _VMA_VIRTUAL_DEFRAGMENTATION_CONTEXT
 
 
 // Main allocator object.
@@ -10593,11 +13700,16 @@ public:
     bool m_UseKhrMaintenance4;
     bool m_UseKhrMaintenance5;
     bool m_UseKhrExternalMemoryWin32;
+    bool m_UseExtPageableDeviceLocalMemory;
     const VkDevice m_hDevice;
     const VkInstance m_hInstance;
     const bool m_AllocationCallbacksSpecified;
     const VkAllocationCallbacks m_AllocationCallbacks;
     VmaDeviceMemoryCallbacks m_DeviceMemoryCallbacks;
+    // pfnProposal is null if fragmentation is not tracked.
+    VmaDefragmentationMonitor m_DefragmentationMonitor;
+    // pfnPressure is null if memory pressure is not monitored.
+    VmaMemoryPressureMonitor m_MemoryPressureMonitor;
     VmaAllocationObjectAllocator m_AllocationObjectAllocator;
 
     // Each bit (1 << i) is set if HeapSizeLimit is enabled for that heap, so cannot allocate more than the heap size.
@@ -10679,6 +13791,11 @@ public:
         const VmaAllocationCreateInfo* pAllocationCreateInfo,
         VmaBufferImageUsage bufImgUsage,
         uint32_t* pMemoryTypeIndex) const;
+    // Returns the memory types from memoryTypeBits that FindMemoryTypeIndex() accepts for the allocation, ignoring preferences.
+    uint32_t CalcAcceptableMemoryTypeBits(
+        uint32_t memoryTypeBits,
+        const VmaAllocationCreateInfo& createInfo,
+        VmaBufferImageUsage bufImgUsage) const;
 
     // Common code for public functions vmaCreateBuffer, vmaCreateBufferWithAlignment, etc.
     VkResult CreateBuffer(
@@ -10740,9 +13857,10 @@ public:
     VkResult CheckCorruption(uint32_t memoryTypeBits);
 
     // Call to Vulkan function vkAllocateMemory with accompanying bookkeeping.
-    VkResult AllocateVulkanMemory(const VkMemoryAllocateInfo* pAllocateInfo, VkDeviceMemory* pMemory);
+    // hPool is the custom pool whose memory limits apply, or null.
+    VkResult AllocateVulkanMemory(const VkMemoryAllocateInfo* pAllocateInfo, VmaPool hPool, VkDeviceMemory* pMemory);
     // Call to Vulkan function vkFreeMemory with accompanying bookkeeping.
-    void FreeVulkanMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory hMemory);
+    void FreeVulkanMemory(uint32_t memoryType, VmaPool hPool, VkDeviceSize size, VkDeviceMemory hMemory);
     // Call to Vulkan function vkBindBufferMemory or vkBindBufferMemory2KHR.
     VkResult BindVulkanBuffer(
         VkDeviceMemory memory,
@@ -10779,6 +13897,12 @@ public:
         const VmaAllocation* allocations,
         const VkDeviceSize* offsets, const VkDeviceSize* sizes,
         VMA_CACHE_OPERATION op);
+    // Records the range for FlushOrInvalidateDeferredRanges(), used by vmaMarkDirty() and vmaMarkStale().
+    void DeferFlushOrInvalidate(
+        VmaAllocation hAllocation,
+        VkDeviceSize offset, VkDeviceSize size,
+        VMA_CACHE_OPERATION op);
+    VkResult FlushOrInvalidateDeferredRanges(VMA_CACHE_OPERATION op);
 
     VkResult CopyMemoryToAllocation(
         const void* pSrcHostPointer,
@@ -10790,6 +13914,16 @@ public:
         VkDeviceSize srcAllocationLocalOffset,
         void* pDstHostPointer,
         VkDeviceSize size);
+    // Copies from host pointers to allocations if op == VMA_CACHE_FLUSH, from allocations to host pointers otherwise.
+    VkResult CopyBetweenMemoryAndAllocations(
+        uint32_t copyCount,
+        const VmaAllocation* allocations,
+        const VkDeviceSize* allocationLocalOffsets,
+        const void* const* ppHostPointers,
+        const VkDeviceSize* sizes,
+        PFN_vmaDispatchJobsFunction pfnDispatchJobs,
+        void* pDispatchJobsUserData,
+        VMA_CACHE_OPERATION op);
 
     void FillAllocation(VmaAllocation hAllocation, uint8_t pattern);
 
@@ -10798,6 +13932,8 @@ public:
     they support creation of required buffer for copy operations.
     */
     uint32_t GetGpuDefragmentationMemoryTypeBits();
+    // Returns nonzero id for a new defragmentation context, used to mark allocations in VmaAllocation_T.
+    uint32_t AcquireDefragmentationId();
 
 #if VMA_EXTERNAL_MEMORY
     VkExternalMemoryHandleTypeFlagsKHR GetExternalMemoryHandleTypeFlags(uint32_t memTypeIndex) const
@@ -10812,6 +13948,9 @@ private:
     VkPhysicalDevice m_PhysicalDevice;
     VMA_ATOMIC_UINT32 m_CurrentFrameIndex;
     VMA_ATOMIC_UINT32 m_GpuDefragmentationMemoryTypeBits; // UINT32_MAX means uninitialized.
+    // Frame index of the last update of block priorities. Used with m_UseExtPageableDeviceLocalMemory.
+    VMA_ATOMIC_UINT32 m_LastPriorityUpdateFrameIndex;
+    VMA_ATOMIC_UINT32 m_NextDefragmentationId;
 #if VMA_EXTERNAL_MEMORY
     VkExternalMemoryHandleTypeFlagsKHR m_TypeExternalMemoryHandleTypes[VK_MAX_MEMORY_TYPES];
 #endif // #if VMA_EXTERNAL_MEMORY
@@ -10822,6 +13961,12 @@ private:
     PoolList m_Pools;
     uint32_t m_NextPoolId;
 
+    typedef VmaVector<VkMappedMemoryRange, VmaStlAllocator<VkMappedMemoryRange>> MappedRangeVector;
+    VMA_MUTEX m_DeferredRangesMutex;
+    // Protected by m_DeferredRangesMutex. Recorded by vmaMarkDirty() and vmaMarkStale() respectively.
+    MappedRangeVector m_DirtyRanges;
+    MappedRangeVector m_StaleRanges;
+
     VmaVulkanFunctions m_VulkanFunctions;
 
     // Global bit mask AND-ed with any memoryTypeBits to disallow certain memory types.
@@ -10841,6 +13986,15 @@ private:
 
     void ValidateVulkanFunctions() const;
 
+    // Returns true and fills outInfo if fragmentation of the block vector exceeds thresholds of m_DefragmentationMonitor.
+    bool NeedsDefragmentation(VmaBlockVector& blockVector, VmaFragmentationInfo& outInfo) const;
+    // Calls m_DefragmentationMonitor.pfnProposal for the pools that need defragmentation.
+    void ProposeDefragmentation();
+    // Compares usage of heaps with watermarks of m_MemoryPressureMonitor and calls pfnPressure for heaps that entered or left the pressure state.
+    void CheckMemoryPressure();
+    // Updates priorities of blocks in DEVICE_LOCAL memory types of default pools and custom pools.
+    void UpdateMemoryPriorities(uint32_t frameIndex);
+
     VkDeviceSize CalcPreferredBlockSize(uint32_t memTypeIndex);
 
     VkResult AllocateMemoryOfType(
@@ -10859,6 +14013,8 @@ private:
         VmaBlockVector& blockVector,
         size_t allocationCount,
         VmaAllocation* pAllocations);
+    // Applies defragmentation hints from createInfo to newly created allocations.
+    static void SetMoveHints(const VmaAllocationCreateInfo& createInfo, size_t allocationCount, VmaAllocation* pAllocations);
 
     // Helper function only to be used inside AllocateDedicatedMemory.
     VkResult AllocateDedicatedMemoryPage(
@@ -10871,9 +14027,11 @@ private:
         bool isUserDataString,
         bool isMappingAllowed,
         void* pUserData,
+        VkDeviceSize blockAlignment,
         VmaAllocation* pAllocation);
 
     // Allocates and registers new VkDeviceMemory specifically for dedicated allocations.
+    // blockAlignment not 0 marks them as a fallback after allocation from a block failed, see VMA_DEFRAGMENTATION_FLAG_PROMOTE_DEDICATED_BIT.
     VkResult AllocateDedicatedMemory(
         VmaPool pool,
         VkDeviceSize size,
@@ -10886,6 +14044,7 @@ private:
         bool canAliasMemory,
         void* pUserData,
         float priority,
+        VkDeviceSize blockAlignment,
         VkBuffer dedicatedBuffer,
         VkImage dedicatedImage,
         VmaBufferImageUsage dedicatedBufferImageUsage,
@@ -10977,13 +14136,14 @@ VmaDeviceMemoryBlock::VmaDeviceMemoryBlock(VmaAllocator hAllocator)
     m_MemoryTypeIndex(UINT32_MAX),
     m_Id(0),
     m_hMemory(VK_NULL_HANDLE),
-    m_MapCount(0),
+    m_MapState(0),
     m_pMappedData(VMA_NULL),
+    m_Priority(0.5f),
     m_IsMapped(false){}
 
 VmaDeviceMemoryBlock::~VmaDeviceMemoryBlock()
 {
-    VMA_ASSERT_LEAK(m_MapCount == 0 && "VkDeviceMemory block is being destroyed while it is still mapped.");
+    VMA_ASSERT_LEAK(GetMapCount(m_MapState.load()) == 0 && "VkDeviceMemory block is being destroyed while it is still mapped.");
     VMA_ASSERT_LEAK(m_hMemory == VK_NULL_HANDLE);
 }
 
@@ -10995,7 +14155,8 @@ void VmaDeviceMemoryBlock::Init(
     VkDeviceSize newSize,
     uint32_t id,
     uint32_t algorithm,
-    VkDeviceSize bufferImageGranularity)
+    VkDeviceSize bufferImageGranularity,
+    float priority)
 {
     VMA_ASSERT(m_hMemory == VK_NULL_HANDLE);
 
@@ -11003,6 +14164,8 @@ void VmaDeviceMemoryBlock::Init(
     m_MemoryTypeIndex = newMemoryTypeIndex;
     m_Id = id;
     m_hMemory = newMemory;
+    m_Priority = priority;
+    m_LastUseFrameIndex = hAllocator->GetCurrentFrameIndex();
 
     switch (algorithm)
     {
@@ -11033,7 +14196,7 @@ void VmaDeviceMemoryBlock::Destroy(VmaAllocator allocator)
     VMA_ASSERT_LEAK(m_pMetadata->IsEmpty() && "Some allocations were not freed before destruction of this memory block!");
 
     VMA_ASSERT_LEAK(m_hMemory != VK_NULL_HANDLE);
-    allocator->FreeVulkanMemory(m_MemoryTypeIndex, m_pMetadata->GetSize(), m_hMemory);
+    allocator->FreeVulkanMemory(m_MemoryTypeIndex, m_hParentPool, m_pMetadata->GetSize(), m_hMemory);
     m_hMemory = VK_NULL_HANDLE;
     m_pMappedData = VMA_NULL;
     m_IsMapped.store(false);
@@ -11042,27 +14205,75 @@ void VmaDeviceMemoryBlock::Destroy(VmaAllocator allocator)
     m_pMetadata = VMA_NULL;
 }
 
-void VmaDeviceMemoryBlock::PostAlloc(VmaAllocator hAllocator)
+void VmaDeviceMemoryBlock::PostAlloc()
 {
-    VmaMutexLock lock(m_MapAndBindMutex, hAllocator->m_UseMutex);
-    m_MappingHysteresis.PostAlloc();
+    // Only the counters of the hysteresis change, so no lock is needed.
+    uint64_t mapState = m_MapState.load();
+    for (;;)
+    {
+        VmaMappingHysteresis hysteresis = GetMappingHysteresis(mapState);
+        hysteresis.PostAlloc();
+        if (m_MapState.compare_exchange_weak(mapState, MakeMapState(GetMapCount(mapState), hysteresis)))
+            return;
+    }
 }
 
 void VmaDeviceMemoryBlock::PostFree(VmaAllocator hAllocator)
 {
+    // Removing the extra mapping may release the last reference, so the lock is needed to call vkUnmapMemory.
     VmaMutexLock lock(m_MapAndBindMutex, hAllocator->m_UseMutex);
-    if(m_MappingHysteresis.PostFree())
+    uint64_t mapState = m_MapState.load();
+    for (;;)
     {
-        VMA_ASSERT(m_MappingHysteresis.GetExtraMapping() == 0);
-        if (m_MapCount == 0)
+        VmaMappingHysteresis hysteresis = GetMappingHysteresis(mapState);
+        const bool extraMappingRemoved = hysteresis.PostFree();
+        const uint64_t newMapState = MakeMapState(GetMapCount(mapState), hysteresis);
+        if (m_MapState.compare_exchange_weak(mapState, newMapState))
         {
-            m_pMappedData = VMA_NULL;
-            m_IsMapped.store(false);
-            (*hAllocator->GetVulkanFunctions().vkUnmapMemory)(hAllocator->m_hDevice, m_hMemory);
+            if (extraMappingRemoved && GetTotalMapCount(newMapState) == 0)
+            {
+                m_pMappedData = VMA_NULL;
+                m_IsMapped.store(false);
+                (*hAllocator->GetVulkanFunctions().vkUnmapMemory)(hAllocator->m_hDevice, m_hMemory);
+            }
+            return;
         }
     }
 }
 
+void VmaDeviceMemoryBlock::AddPriorityHint(VmaAllocation hAllocation)
+{
+    if (hAllocation->IsPriorityHot())
+        ++m_HotAllocationCount;
+    else if (hAllocation->IsPriorityCold())
+        ++m_ColdAllocationCount;
+}
+
+void VmaDeviceMemoryBlock::RemovePriorityHint(VmaAllocation hAllocation)
+{
+    if (hAllocation->IsPriorityHot())
+    {
+        VMA_ASSERT(m_HotAllocationCount > 0);
+        --m_HotAllocationCount;
+    }
+    else if (hAllocation->IsPriorityCold())
+    {
+        VMA_ASSERT(m_ColdAllocationCount > 0);
+        --m_ColdAllocationCount;
+    }
+}
+
+void VmaDeviceMemoryBlock::SetPriority(VmaAllocator hAllocator, float priority)
+{
+    VmaMutexLock lock(m_MapAndBindMutex, hAllocator->m_UseMutex);
+    if (priority == m_Priority)
+        return;
+    m_Priority = priority;
+#if VMA_PAGEABLE_DEVICE_LOCAL_MEMORY
+    (*hAllocator->GetVulkanFunctions().vkSetDeviceMemoryPriorityEXT)(hAllocator->m_hDevice, m_hMemory, priority);
+#endif
+}
+
 bool VmaDeviceMemoryBlock::Validate() const
 {
     VMA_VALIDATE((m_hMemory != VK_NULL_HANDLE) &&
@@ -11094,39 +14305,56 @@ VkResult VmaDeviceMemoryBlock::Map(VmaAllocator hAllocator, uint32_t count, void
         return VK_SUCCESS;
     }
 
-    VmaMutexLock lock(m_MapAndBindMutex, hAllocator->m_UseMutex);
-    const uint32_t oldTotalMapCount = m_MapCount + m_MappingHysteresis.GetExtraMapping();
-    if (oldTotalMapCount != 0)
+    // Fast path: the memory is already mapped, so only the reference count and the hysteresis change.
+    // The reference taken by a successful compare-exchange keeps the memory mapped, so m_pMappedData can be read.
+    uint64_t mapState = m_MapState.load();
+    while (GetTotalMapCount(mapState) != 0)
     {
-        VMA_ASSERT(m_pMappedData != VMA_NULL);
-        m_MappingHysteresis.PostMap();
-        m_MapCount += count;
-        if (ppData != VMA_NULL)
+        VmaMappingHysteresis hysteresis = GetMappingHysteresis(mapState);
+        hysteresis.PostMap();
+        if (m_MapState.compare_exchange_weak(mapState, MakeMapState(GetMapCount(mapState) + count, hysteresis)))
         {
-            *ppData = m_pMappedData;
+            VMA_ASSERT(m_pMappedData != VMA_NULL);
+            if (ppData != VMA_NULL)
+            {
+                *ppData = m_pMappedData;
+            }
+            return VK_SUCCESS;
         }
-        return VK_SUCCESS;
     }
 
-    VkResult result = (*hAllocator->GetVulkanFunctions().vkMapMemory)(
-        hAllocator->m_hDevice,
-        m_hMemory,
-        0, // offset
-        VK_WHOLE_SIZE,
-        0, // flags
-        &m_pMappedData);
-    if (result == VK_SUCCESS)
+    // Slow path: the memory may need to be mapped. While the total map count is 0 it can only be
+    // changed under the lock, so another thread may have mapped the memory only before we got it.
+    VmaMutexLock lock(m_MapAndBindMutex, hAllocator->m_UseMutex);
+    mapState = m_MapState.load();
+    if (GetTotalMapCount(mapState) == 0)
     {
-        VMA_ASSERT(m_pMappedData != VMA_NULL);
-        m_IsMapped.store(true);
-        m_MappingHysteresis.PostMap();
-        m_MapCount = count;
-        if (ppData != VMA_NULL)
+        VkResult result = (*hAllocator->GetVulkanFunctions().vkMapMemory)(
+            hAllocator->m_hDevice,
+            m_hMemory,
+            0, // offset
+            VK_WHOLE_SIZE,
+            0, // flags
+            &m_pMappedData);
+        if (result != VK_SUCCESS)
         {
-            *ppData = m_pMappedData;
+            return result;
         }
+        VMA_ASSERT(m_pMappedData != VMA_NULL);
+        m_IsMapped.store(true);
     }
-    return result;
+    for (;;)
+    {
+        VmaMappingHysteresis hysteresis = GetMappingHysteresis(mapState);
+        hysteresis.PostMap();
+        if (m_MapState.compare_exchange_weak(mapState, MakeMapState(GetMapCount(mapState) + count, hysteresis)))
+            break;
+    }
+    if (ppData != VMA_NULL)
+    {
+        *ppData = m_pMappedData;
+    }
+    return VK_SUCCESS;
 }
 
 void VmaDeviceMemoryBlock::Unmap(VmaAllocator hAllocator, uint32_t count)
@@ -11136,22 +14364,47 @@ void VmaDeviceMemoryBlock::Unmap(VmaAllocator hAllocator, uint32_t count)
         return;
     }
 
-    VmaMutexLock lock(m_MapAndBindMutex, hAllocator->m_UseMutex);
-    if (m_MapCount >= count)
+    // Fast path: references remain after this call, so only the reference count and the hysteresis change.
+    uint64_t mapState = m_MapState.load();
+    for (;;)
     {
-        m_MapCount -= count;
-        const uint32_t totalMapCount = m_MapCount + m_MappingHysteresis.GetExtraMapping();
-        if (totalMapCount == 0)
+        if (GetMapCount(mapState) < count)
         {
-            m_pMappedData = VMA_NULL;
-            m_IsMapped.store(false);
-            (*hAllocator->GetVulkanFunctions().vkUnmapMemory)(hAllocator->m_hDevice, m_hMemory);
+            VMA_ASSERT(0 && "VkDeviceMemory block is being unmapped while it was not previously mapped.");
+            return;
         }
-        m_MappingHysteresis.PostUnmap();
+        VmaMappingHysteresis hysteresis = GetMappingHysteresis(mapState);
+        hysteresis.PostUnmap();
+        const uint64_t newMapState = MakeMapState(GetMapCount(mapState) - count, hysteresis);
+        if (GetTotalMapCount(newMapState) == 0)
+            break;
+        if (m_MapState.compare_exchange_weak(mapState, newMapState))
+            return;
     }
-    else
+
+    // Slow path: this may release the last reference, which needs the lock to call vkUnmapMemory.
+    VmaMutexLock lock(m_MapAndBindMutex, hAllocator->m_UseMutex);
+    mapState = m_MapState.load();
+    for (;;)
     {
-        VMA_ASSERT(0 && "VkDeviceMemory block is being unmapped while it was not previously mapped.");
+        if (GetMapCount(mapState) < count)
+        {
+            VMA_ASSERT(0 && "VkDeviceMemory block is being unmapped while it was not previously mapped.");
+            return;
+        }
+        VmaMappingHysteresis hysteresis = GetMappingHysteresis(mapState);
+        hysteresis.PostUnmap();
+        const uint64_t newMapState = MakeMapState(GetMapCount(mapState) - count, hysteresis);
+        if (m_MapState.compare_exchange_weak(mapState, newMapState))
+        {
+            if (GetTotalMapCount(newMapState) == 0)
+            {
+                m_pMappedData = VMA_NULL;
+                m_IsMapped.store(false);
+                (*hAllocator->GetVulkanFunctions().vkUnmapMemory)(hAllocator->m_hDevice, m_hMemory);
+            }
+            return;
+        }
     }
 }
 
@@ -11241,7 +14494,11 @@ VmaAllocation_T::VmaAllocation_T(bool mappingAllowed)
     m_Size{ 0 },
     m_pUserData{ VMA_NULL },
     m_pName{ VMA_NULL },
+    m_MoveCost{ 1.f },
     m_MemoryTypeIndex{ 0 },
+    m_ResidencyMemoryTypeBits{ 0 },
+    m_IgnoringDefragmentationId{ 0 },
+    m_HomeMemoryTypeIndex{ 0 },
     m_Type{ (uint8_t)ALLOCATION_TYPE_NONE },
     m_SuballocationType{ (uint8_t)VMA_SUBALLOCATION_TYPE_UNKNOWN },
     m_MapCount{ 0 },
@@ -11291,12 +14548,15 @@ void VmaAllocation_T::InitDedicatedAllocation(
     VkDeviceMemory hMemory,
     VmaSuballocationType suballocationType,
     void* pMappedData,
-    VkDeviceSize size)
+    VkDeviceSize size,
+    VkDeviceSize blockAlignment)
 {
     VMA_ASSERT(m_Type == ALLOCATION_TYPE_NONE);
     VMA_ASSERT(hMemory != VK_NULL_HANDLE);
     m_Type = (uint8_t)ALLOCATION_TYPE_DEDICATED;
-    m_Alignment = 0;
+    m_Alignment = blockAlignment;
+    if (blockAlignment != 0)
+        m_Flags |= (uint8_t)FLAG_DEDICATED_FALLBACK;
     m_Size = size;
     m_MemoryTypeIndex = memoryTypeIndex;
     m_SuballocationType = (uint8_t)suballocationType;
@@ -11315,6 +14575,16 @@ void VmaAllocation_T::InitDedicatedAllocation(
     }
 }
 
+void VmaAllocation_T::SetPriorityHint(VmaAllocationCreateFlags flags)
+{
+    VMA_ASSERT((flags & VMA_ALLOCATION_CREATE_PRIORITY_HOT_BIT) == 0 || (flags & VMA_ALLOCATION_CREATE_PRIORITY_COLD_BIT) == 0);
+    m_Flags &= (uint8_t)~(FLAG_PRIORITY_HOT | FLAG_PRIORITY_COLD);
+    if (flags & VMA_ALLOCATION_CREATE_PRIORITY_HOT_BIT)
+        m_Flags |= (uint8_t)FLAG_PRIORITY_HOT;
+    else if (flags & VMA_ALLOCATION_CREATE_PRIORITY_COLD_BIT)
+        m_Flags |= (uint8_t)FLAG_PRIORITY_COLD;
+}
+
 void VmaAllocation_T::Destroy(VmaAllocator allocator)
 {
     FreeName(allocator);
@@ -11345,8 +14615,47 @@ uint8_t VmaAllocation_T::SwapBlockAllocation(VmaAllocator hAllocator, VmaAllocat
         m_BlockAllocation.m_Block->Unmap(hAllocator, m_MapCount);
 
     m_BlockAllocation.m_Block->m_pMetadata->SetAllocationUserData(m_BlockAllocation.m_AllocHandle, allocation);
+    m_BlockAllocation.m_Block->RemovePriorityHint(this);
+    allocation->m_BlockAllocation.m_Block->RemovePriorityHint(allocation);
     std::swap(m_BlockAllocation, allocation->m_BlockAllocation);
+    // Different only for moves of residency management, between block vectors of different memory types.
+    std::swap(m_MemoryTypeIndex, allocation->m_MemoryTypeIndex);
+    m_BlockAllocation.m_Block->m_pMetadata->SetAllocationUserData(m_BlockAllocation.m_AllocHandle, this);
+    m_BlockAllocation.m_Block->AddPriorityHint(this);
+    allocation->m_BlockAllocation.m_Block->AddPriorityHint(allocation);
+
+#if VMA_STATS_STRING_ENABLED
+    std::swap(m_BufferImageUsage, allocation->m_BufferImageUsage);
+#endif
+    return m_MapCount;
+}
+
+uint8_t VmaAllocation_T::PromoteToBlockAllocation(VmaAllocator hAllocator, VmaAllocation allocation)
+{
+    VMA_ASSERT(allocation != VMA_NULL);
+    VMA_ASSERT(m_Type == ALLOCATION_TYPE_DEDICATED);
+    VMA_ASSERT(allocation->m_Type == ALLOCATION_TYPE_BLOCK);
+    VMA_ASSERT(m_DedicatedAllocation.m_Prev == VMA_NULL && m_DedicatedAllocation.m_Next == VMA_NULL &&
+        "Allocation must be unregistered from its dedicated allocation list first.");
+
+    const DedicatedAllocation dedicatedAllocation = m_DedicatedAllocation;
+    if (m_MapCount != 0 && !IsPersistentMap())
+    {
+        // Mapping made by vmaMapMemory() moves to the block, persistent one is released together with the memory.
+        (*hAllocator->GetVulkanFunctions().vkUnmapMemory)(hAllocator->m_hDevice, dedicatedAllocation.m_hMemory);
+        dedicatedAllocation.m_ExtraData->m_pMappedData = VMA_NULL;
+    }
+
+    m_BlockAllocation = allocation->m_BlockAllocation;
     m_BlockAllocation.m_Block->m_pMetadata->SetAllocationUserData(m_BlockAllocation.m_AllocHandle, this);
+    m_BlockAllocation.m_Block->RemovePriorityHint(allocation);
+    m_BlockAllocation.m_Block->AddPriorityHint(this);
+    m_Type = (uint8_t)ALLOCATION_TYPE_BLOCK;
+    m_Alignment = allocation->m_Alignment;
+
+    allocation->m_DedicatedAllocation = dedicatedAllocation;
+    allocation->m_Type = (uint8_t)ALLOCATION_TYPE_DEDICATED;
+    allocation->m_Alignment = 0;
 
 #if VMA_STATS_STRING_ENABLED
     std::swap(m_BufferImageUsage, allocation->m_BufferImageUsage);
@@ -11597,7 +14906,9 @@ VmaBlockVector::VmaBlockVector(
     uint32_t algorithm,
     float priority,
     VkDeviceSize minAllocationAlignment,
-    void* pMemoryAllocateNext)
+    void* pMemoryAllocateNext,
+    size_t maxEmptyBlockCount,
+    uint32_t emptyBlockReleaseFrameCount)
     : m_hAllocator(hAllocator),
     m_hParentPool(hParentPool),
     m_MemoryTypeIndex(memoryTypeIndex),
@@ -11610,6 +14921,8 @@ VmaBlockVector::VmaBlockVector(
     m_Priority(priority),
     m_MinAllocationAlignment(minAllocationAlignment),
     m_pMemoryAllocateNext(pMemoryAllocateNext),
+    m_MaxEmptyBlockCount(maxEmptyBlockCount),
+    m_EmptyBlockReleaseFrameCount(emptyBlockReleaseFrameCount),
     m_Blocks(VmaStlAllocator<VmaDeviceMemoryBlock*>(hAllocator->GetAllocationCallbacks())),
     m_NextBlockId(0) {}
 
@@ -11931,7 +15244,8 @@ VkResult VmaBlockVector::AllocatePage(
 
 void VmaBlockVector::Free(VmaAllocation hAllocation)
 {
-    VmaDeviceMemoryBlock* pBlockToDelete = VMA_NULL;
+    const VmaStlAllocator<VmaDeviceMemoryBlock*> blockAllocator(m_hAllocator->GetAllocationCallbacks());
+    VmaVector<VmaDeviceMemoryBlock*, VmaStlAllocator<VmaDeviceMemoryBlock*>> blocksToDelete(blockAllocator);
 
     bool budgetExceeded = false;
     {
@@ -11958,8 +15272,11 @@ void VmaBlockVector::Free(VmaAllocation hAllocation)
             pBlock->Unmap(m_hAllocator, 1);
         }
 
-        const bool hadEmptyBlockBeforeFree = HasEmptyBlock();
+        const size_t emptyBlockCountBeforeFree = CountEmptyBlocks();
+        pBlock->RemovePriorityHint(hAllocation);
+        UpdateFragmentation(pBlock, false);
         pBlock->m_pMetadata->Free(hAllocation->GetAllocHandle());
+        UpdateFragmentation(pBlock, true);
         pBlock->PostFree(m_hAllocator);
         VMA_HEAVY_ASSERT(pBlock->Validate());
 
@@ -11969,23 +15286,46 @@ void VmaBlockVector::Free(VmaAllocation hAllocation)
         // pBlock became empty after this deallocation.
         if (pBlock->m_pMetadata->IsEmpty())
         {
-            // Already had empty block. We don't want to have two, so delete this one.
-            if ((hadEmptyBlockBeforeFree || budgetExceeded) && canDeleteBlock)
+            // Already had enough empty blocks, so delete this one.
+            const size_t maxEmptyBlockCount = m_MaxEmptyBlockCount != 0 ? m_MaxEmptyBlockCount : 1;
+            if ((emptyBlockCountBeforeFree >= maxEmptyBlockCount || budgetExceeded) && canDeleteBlock)
             {
-                pBlockToDelete = pBlock;
+                blocksToDelete.push_back(pBlock);
                 Remove(pBlock);
+                UpdateFragmentation(pBlock, false);
+            }
+            // else: Leave it. A hysteresis to avoid allocating whole block back and forth.
+            else
+            {
+                pBlock->m_KeptEmpty = true;
+                pBlock->m_EmptySinceFrameIndex = m_hAllocator->GetCurrentFrameIndex();
             }
-            // else: We now have one empty block - leave it. A hysteresis to avoid allocating whole block back and forth.
         }
         // pBlock didn't become empty, but we have another empty block - find and free that one.
-        // (This is optional, heuristics.)
-        else if (hadEmptyBlockBeforeFree && canDeleteBlock)
+        // (This is optional, heuristics. Not done when m_MaxEmptyBlockCount is specified, as then empty blocks are kept on purpose.)
+        else if (m_MaxEmptyBlockCount == 0 && emptyBlockCountBeforeFree > 0 && canDeleteBlock)
         {
             VmaDeviceMemoryBlock* pLastBlock = m_Blocks.back();
             if (pLastBlock->m_pMetadata->IsEmpty())
             {
-                pBlockToDelete = pLastBlock;
+                blocksToDelete.push_back(pLastBlock);
                 m_Blocks.pop_back();
+                UpdateFragmentation(pLastBlock, false);
+            }
+        }
+
+        // Empty blocks kept on purpose are released as well when the budget is exceeded.
+        if (budgetExceeded && m_MaxEmptyBlockCount != 0)
+        {
+            for (size_t i = m_Blocks.size(); i-- > 0 && m_Blocks.size() > m_MinBlockCount; )
+            {
+                VmaDeviceMemoryBlock* const pEmptyBlock = m_Blocks[i];
+                if (pEmptyBlock->m_pMetadata->IsEmpty())
+                {
+                    VmaVectorRemove(m_Blocks, i);
+                    UpdateFragmentation(pEmptyBlock, false);
+                    blocksToDelete.push_back(pEmptyBlock);
+                }
             }
         }
 
@@ -11996,13 +15336,84 @@ void VmaBlockVector::Free(VmaAllocation hAllocation)
         m_hAllocator->m_AllocationObjectAllocator.Free(hAllocation);
     }
 
-    // Destruction of a free block. Deferred until this point, outside of mutex
+    // Destruction of free blocks. Deferred until this point, outside of mutex
     // lock, for performance reason.
-    if (pBlockToDelete != VMA_NULL)
+    for (size_t i = 0; i < blocksToDelete.size(); ++i)
+    {
+        VMA_DEBUG_LOG_FORMAT("    Deleted empty block #%" PRIu32, blocksToDelete[i]->GetId());
+        blocksToDelete[i]->Destroy(m_hAllocator);
+        vma_delete(m_hAllocator, blocksToDelete[i]);
+    }
+}
+
+void VmaBlockVector::ReleaseIdleEmptyBlocks(uint32_t frameIndex)
+{
+    const VmaStlAllocator<VmaDeviceMemoryBlock*> blockAllocator(m_hAllocator->GetAllocationCallbacks());
+    VmaVector<VmaDeviceMemoryBlock*, VmaStlAllocator<VmaDeviceMemoryBlock*>> blocksToDelete(blockAllocator);
+
+    // Scope for lock.
+    {
+        VmaMutexLockWrite lock(m_Mutex, m_hAllocator->m_UseMutex);
+        for (size_t i = m_Blocks.size(); i-- > 0 && m_Blocks.size() > m_MinBlockCount; )
+        {
+            VmaDeviceMemoryBlock* const pBlock = m_Blocks[i];
+            // Unsigned difference also works after the frame index wraps around.
+            if (pBlock->m_KeptEmpty && pBlock->m_pMetadata->IsEmpty() &&
+                frameIndex - pBlock->m_EmptySinceFrameIndex >= m_EmptyBlockReleaseFrameCount)
+            {
+                VmaVectorRemove(m_Blocks, i);
+                UpdateFragmentation(pBlock, false);
+                blocksToDelete.push_back(pBlock);
+                ++m_ReleasedEmptyBlockCount;
+            }
+        }
+    }
+
+    // Destruction of the blocks outside of mutex lock, like in Free().
+    for (size_t i = 0; i < blocksToDelete.size(); ++i)
+    {
+        VMA_DEBUG_LOG_FORMAT("    Deleted idle empty block #%" PRIu32, blocksToDelete[i]->GetId());
+        blocksToDelete[i]->Destroy(m_hAllocator);
+        vma_delete(m_hAllocator, blocksToDelete[i]);
+    }
+}
+
+void VmaBlockVector::GetEmptyBlockStatistics(VmaEmptyBlockStatistics& outStats)
+{
+    VmaMutexLockRead lock(m_Mutex, m_hAllocator->m_UseMutex);
+
+    outStats.emptyBlockCount = 0;
+    outStats.emptyBlockBytes = 0;
+    for (size_t i = 0; i < m_Blocks.size(); ++i)
+    {
+        const VmaBlockMetadata* const pMetadata = m_Blocks[i]->m_pMetadata;
+        if (pMetadata->IsEmpty())
+        {
+            ++outStats.emptyBlockCount;
+            outStats.emptyBlockBytes += pMetadata->GetSize();
+        }
+    }
+    outStats.reusedBlockCount = m_ReusedEmptyBlockCount;
+    outStats.releasedBlockCount = m_ReleasedEmptyBlockCount;
+}
+
+void VmaBlockVector::UpdatePriorities(uint32_t frameIndex)
+{
+    VmaMutexLockRead lock(m_Mutex, m_hAllocator->m_UseMutex);
+    for (size_t i = 0; i < m_Blocks.size(); ++i)
     {
-        VMA_DEBUG_LOG_FORMAT("    Deleted empty block #%" PRIu32, pBlockToDelete->GetId());
-        pBlockToDelete->Destroy(m_hAllocator);
-        vma_delete(m_hAllocator, pBlockToDelete);
+        VmaDeviceMemoryBlock* const pBlock = m_Blocks[i];
+        float priority;
+        if (pBlock->m_HotAllocationCount > 0)
+            priority = 1.f;
+        else if (pBlock->m_ColdAllocationCount > 0 && pBlock->m_ColdAllocationCount == pBlock->m_pMetadata->GetAllocationCount())
+            priority = 0.f;
+        // Unsigned difference also works after the frame index wraps around.
+        else if (frameIndex - pBlock->m_LastUseFrameIndex.load() < VMA_MEMORY_PRIORITY_RECENT_FRAME_COUNT)
+            priority = m_Priority;
+        else
+            priority = m_Priority * 0.5f;
+        pBlock->SetPriority(m_hAllocator, priority);
     }
 }
 
@@ -12020,6 +15431,48 @@ VkDeviceSize VmaBlockVector::CalcMaxBlockSize() const
     return result;
 }
 
+bool VmaBlockVector::IsFragmentationTracked() const
+{
+    return m_hAllocator->m_DefragmentationMonitor.pfnProposal != VMA_NULL &&
+        m_Algorithm != VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT;
+}
+
+void VmaBlockVector::GetFragmentationInfo(VmaFragmentationInfo& outInfo)
+{
+    VMA_ASSERT(IsFragmentationTracked());
+    {
+        VmaMutexLockRead lock(m_Mutex, m_hAllocator->m_UseMutex);
+        outInfo = m_Fragmentation;
+    }
+    outInfo.fragmentation = outInfo.freeSize > 0 ?
+        1.f - (float)outInfo.largestFreeRegionsSize / (float)outInfo.freeSize : 0.f;
+}
+
+void VmaBlockVector::UpdateFragmentation(const VmaDeviceMemoryBlock* pBlock, bool add)
+{
+    if (!IsFragmentationTracked())
+        return;
+
+    const VmaBlockMetadata* const pMetadata = pBlock->m_pMetadata;
+    const VkDeviceSize freeSize = pMetadata->GetSumFreeSize();
+    const VkDeviceSize largestFreeRegionSize = pMetadata->GetLargestFreeRegionSize();
+    const uint32_t freeRegionCount = static_cast<uint32_t>(pMetadata->GetFreeRegionsCount());
+    if (add)
+    {
+        m_Fragmentation.freeSize += freeSize;
+        m_Fragmentation.largestFreeRegionsSize += largestFreeRegionSize;
+        m_Fragmentation.freeRegionCount += freeRegionCount;
+    }
+    else
+    {
+        VMA_ASSERT(m_Fragmentation.freeSize >= freeSize && m_Fragmentation.largestFreeRegionsSize >= largestFreeRegionSize &&
+            m_Fragmentation.freeRegionCount >= freeRegionCount);
+        m_Fragmentation.freeSize -= freeSize;
+        m_Fragmentation.largestFreeRegionsSize -= largestFreeRegionSize;
+        m_Fragmentation.freeRegionCount -= freeRegionCount;
+    }
+}
+
 void VmaBlockVector::Remove(VmaDeviceMemoryBlock* pBlock)
 {
     for (uint32_t blockIndex = 0; blockIndex < m_Blocks.size(); ++blockIndex)
@@ -12051,15 +15504,6 @@ void VmaBlockVector::IncrementallySortBlocks()
     }
 }
 
-void VmaBlockVector::SortByFreeSize()
-{
-    VMA_SORT(m_Blocks.begin(), m_Blocks.end(),
-        [](VmaDeviceMemoryBlock* b1, VmaDeviceMemoryBlock* b2) -> bool
-        {
-            return b1->m_pMetadata->GetSumFreeSize() < b2->m_pMetadata->GetSumFreeSize();
-        });
-}
-
 VkResult VmaBlockVector::AllocateFromBlock(
     VmaDeviceMemoryBlock* pBlock,
     VkDeviceSize size,
@@ -12100,7 +15544,13 @@ VkResult VmaBlockVector::CommitAllocationRequest(
     const bool isMappingAllowed = (allocFlags &
         (VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT)) != 0;
 
-    pBlock->PostAlloc(m_hAllocator);
+    pBlock->PostAlloc();
+    if (pBlock->m_KeptEmpty)
+    {
+        // Reusing empty block kept by Free() instead of allocating new one.
+        pBlock->m_KeptEmpty = false;
+        ++m_ReusedEmptyBlockCount;
+    }
     // Allocate from pCurrBlock.
     if (mapped)
     {
@@ -12112,7 +15562,9 @@ VkResult VmaBlockVector::CommitAllocationRequest(
     }
 
     *pAllocation = m_hAllocator->m_AllocationObjectAllocator.Allocate(isMappingAllowed);
+    UpdateFragmentation(pBlock, false);
     pBlock->m_pMetadata->Alloc(allocRequest, suballocType, *pAllocation);
+    UpdateFragmentation(pBlock, true);
     (*pAllocation)->InitBlockAllocation(
         pBlock,
         allocRequest.allocHandle,
@@ -12121,6 +15573,9 @@ VkResult VmaBlockVector::CommitAllocationRequest(
         m_MemoryTypeIndex,
         suballocType,
         mapped);
+    (*pAllocation)->SetPriorityHint(allocFlags);
+    pBlock->AddPriorityHint(*pAllocation);
+    pBlock->m_LastUseFrameIndex = m_hAllocator->GetCurrentFrameIndex();
     VMA_HEAVY_ASSERT(pBlock->Validate());
     if (isUserDataString)
         (*pAllocation)->SetName(m_hAllocator, (const char*)pUserData);
@@ -12178,7 +15633,7 @@ VkResult VmaBlockVector::CreateBlock(VkDeviceSize blockSize, size_t* pNewBlockIn
 #endif // VMA_EXTERNAL_MEMORY
 
     VkDeviceMemory mem = VK_NULL_HANDLE;
-    VkResult res = m_hAllocator->AllocateVulkanMemory(&allocInfo, &mem);
+    VkResult res = m_hAllocator->AllocateVulkanMemory(&allocInfo, m_hParentPool, &mem);
     if (res < 0)
     {
         return res;
@@ -12196,9 +15651,11 @@ VkResult VmaBlockVector::CreateBlock(VkDeviceSize blockSize, size_t* pNewBlockIn
         allocInfo.allocationSize,
         m_NextBlockId++,
         m_Algorithm,
-        m_BufferImageGranularity);
+        m_BufferImageGranularity,
+        m_Priority);
 
     m_Blocks.push_back(pBlock);
+    UpdateFragmentation(pBlock, true);
     if (pNewBlockIndex != VMA_NULL)
     {
         *pNewBlockIndex = m_Blocks.size() - 1;
@@ -12207,17 +15664,18 @@ VkResult VmaBlockVector::CreateBlock(VkDeviceSize blockSize, size_t* pNewBlockIn
     return VK_SUCCESS;
 }
 
-bool VmaBlockVector::HasEmptyBlock()
+size_t VmaBlockVector::CountEmptyBlocks() const
 {
+    size_t result = 0;
     for (size_t index = 0, count = m_Blocks.size(); index < count; ++index)
     {
         VmaDeviceMemoryBlock* const pBlock = m_Blocks[index];
         if (pBlock->m_pMetadata->IsEmpty())
         {
-            return true;
+            ++result;
         }
     }
-    return false;
+    return result;
 }
 
 #if VMA_STATS_STRING_ENABLED
@@ -12270,13 +15728,23 @@ VkResult VmaBlockVector::CheckCorruption()
 #ifndef _VMA_DEFRAGMENTATION_CONTEXT_FUNCTIONS
 VmaDefragmentationContext_T::VmaDefragmentationContext_T(
     VmaAllocator hAllocator,
-    const VmaDefragmentationInfo& info)
-    : m_MaxPassBytes(info.maxBytesPerPass == 0 ? VK_WHOLE_SIZE : info.maxBytesPerPass),
-    m_MaxPassAllocations(info.maxAllocationsPerPass == 0 ? UINT32_MAX : info.maxAllocationsPerPass),
-    m_BreakCallback(info.pfnBreakCallback),
-    m_BreakCallbackUserData(info.pBreakCallbackUserData),
+    const VmaDefragmentationInfo& info,
+    const VmaResidencyInfo* pResidencyInfo)
+    : Base(info.maxBytesPerPass, info.maxAllocationsPerPass,
+        info.pfnBreakCallback, info.pBreakCallbackUserData, info.maxPlanningTimePerPass),
+    m_DispatchJobs(info.pfnDispatchJobs),
+    m_DispatchJobsUserData(info.pDispatchJobsUserData),
+    m_PromoteDedicated((info.flags & VMA_DEFRAGMENTATION_FLAG_PROMOTE_DEDICATED_BIT) != 0),
+    m_hAllocator(hAllocator),
+    m_Residency(pResidencyInfo != VMA_NULL),
+    m_EvictionThreshold(pResidencyInfo != VMA_NULL ? pResidencyInfo->evictionThreshold : 0.f),
+    m_RestoreThreshold(pResidencyInfo != VMA_NULL ? pResidencyInfo->restoreThreshold : 0.f),
+    m_Id(hAllocator->AcquireDefragmentationId()),
     m_MoveAllocator(hAllocator->GetAllocationCallbacks()),
     m_Moves(m_MoveAllocator),
+    m_JobMoveRanges(VmaStlAllocator<MoveRange>(hAllocator->GetAllocationCallbacks())),
+    m_CopyRegions(VmaStlAllocator<VmaDefragmentationCopyRegion>(hAllocator->GetAllocationCallbacks())),
+    m_CopyBuffers(VmaStlAllocator<CopyBuffer>(hAllocator->GetAllocationCallbacks())),
     m_Algorithm(info.flags & VMA_DEFRAGMENTATION_FLAG_ALGORITHM_MASK)
 {
     if (info.pool != VMA_NULL)
@@ -12287,7 +15755,7 @@ VmaDefragmentationContext_T::VmaDefragmentationContext_T(
 
         VmaMutexLockWrite lock(m_PoolBlockVector->m_Mutex, hAllocator->m_UseMutex);
         m_PoolBlockVector->SetIncrementalSort(false);
-        m_PoolBlockVector->SortByFreeSize();
+        SortBlocksByMoveCost(*m_PoolBlockVector, m_PoolBlockVector->m_Blocks.data());
     }
     else
     {
@@ -12301,11 +15769,16 @@ VmaDefragmentationContext_T::VmaDefragmentationContext_T(
             {
                 VmaMutexLockWrite lock(vector->m_Mutex, hAllocator->m_UseMutex);
                 vector->SetIncrementalSort(false);
-                vector->SortByFreeSize();
+                SortBlocksByMoveCost(*vector, vector->m_Blocks.data());
             }
         }
     }
 
+    // vma_new_array constructs only the first element.
+    m_ResumePoints = vma_new_array(hAllocator, ResumePoint, m_BlockVectorCount);
+    for (uint32_t i = 0; i < m_BlockVectorCount; ++i)
+        m_ResumePoints[i] = {};
+
     switch (m_Algorithm)
     {
     case 0: // Default algorithm
@@ -12346,6 +15819,9 @@ VmaDefragmentationContext_T::~VmaDefragmentationContext_T()
         }
     }
 
+    ReleaseCopyBuffers(true);
+    vma_delete_array(m_MoveAllocator.m_pCallbacks, m_ResumePoints, m_BlockVectorCount);
+
     if (m_AlgorithmState)
     {
         switch (m_Algorithm)
@@ -12364,45 +15840,60 @@ VmaDefragmentationContext_T::~VmaDefragmentationContext_T()
 
 VkResult VmaDefragmentationContext_T::DefragmentPassBegin(VmaDefragmentationPassMoveInfo& moveInfo)
 {
-    if (m_PoolBlockVector != VMA_NULL)
+    m_PassPlanningStartTime = VMA_GET_TIME_NANOSECONDS();
+    if (m_Residency)
     {
-        VmaMutexLockWrite lock(m_PoolBlockVector->GetMutex(), m_PoolBlockVector->GetAllocator()->m_UseMutex);
-
-        if (m_PoolBlockVector->GetBlockCount() > 1)
-            ComputeDefragmentation(*m_PoolBlockVector, 0);
-        else if (m_PoolBlockVector->GetBlockCount() == 1)
-            ReallocWithinBlock(*m_PoolBlockVector, m_PoolBlockVector->GetBlock(0));
+        PassPlan plan = { m_Moves, 0, 0, 0 };
+        ComputeResidency(plan);
+        m_PassStats.bytesMoved = plan.bytesMoved;
+        m_PassStats.allocationsMoved = plan.allocationsMoved;
+    }
+    else if (m_PoolBlockVector == VMA_NULL && m_DispatchJobs != VMA_NULL)
+    {
+        ComputeDefragmentationParallel();
     }
     else
     {
-        for (uint32_t i = 0; i < m_BlockVectorCount; ++i)
+        PassPlan plan = { m_Moves, 0, 0, m_IgnoredAllocs };
+        if (m_PoolBlockVector != VMA_NULL)
         {
-            if (m_pBlockVectors[i] != VMA_NULL)
-            {
-                VmaMutexLockWrite lock(m_pBlockVectors[i]->GetMutex(), m_pBlockVectors[i]->GetAllocator()->m_UseMutex);
-
-                if (m_pBlockVectors[i]->GetBlockCount() > 1)
-                {
-                    if (ComputeDefragmentation(*m_pBlockVectors[i], i))
-                        break;
-                }
-                else if (m_pBlockVectors[i]->GetBlockCount() == 1)
+            ComputeVectorDefragmentation(plan, *m_PoolBlockVector, 0);
+        }
+        else
+        {
+            // Start from the block vector where previous pass was interrupted.
+            const uint32_t firstVectorIndex = m_ResumeVectorIndex;
+            m_ResumeVectorIndex = 0;
+            for (uint32_t n = 0; n < m_BlockVectorCount; ++n)
+            {
+                const uint32_t i = (firstVectorIndex + n) % m_BlockVectorCount;
+                if (m_pBlockVectors[i] != VMA_NULL && ComputeVectorDefragmentation(plan, *m_pBlockVectors[i], i))
                 {
-                    if (ReallocWithinBlock(*m_pBlockVectors[i], m_pBlockVectors[i]->GetBlock(0)))
-                        break;
+                    if (plan.interrupted)
+                        m_ResumeVectorIndex = i;
+                    break;
                 }
             }
         }
+        m_IgnoredAllocs = plan.ignoredAllocs;
+        m_PassStats.bytesMoved = plan.bytesMoved;
+        m_PassStats.allocationsMoved = plan.allocationsMoved;
     }
+    ComputeCopyRegions();
+    m_GlobalStats.planningTime += VMA_GET_TIME_NANOSECONDS() - m_PassPlanningStartTime;
 
     moveInfo.moveCount = static_cast<uint32_t>(m_Moves.size());
     if (moveInfo.moveCount > 0)
     {
         moveInfo.pMoves = m_Moves.data();
+        moveInfo.copyRegionCount = static_cast<uint32_t>(m_CopyRegions.size());
+        moveInfo.pCopyRegions = m_CopyRegions.data();
         return VK_INCOMPLETE;
     }
 
     moveInfo.pMoves = VMA_NULL;
+    moveInfo.copyRegionCount = 0;
+    moveInfo.pCopyRegions = VMA_NULL;
     return VK_SUCCESS;
 }
 
@@ -12425,24 +15916,44 @@ VkResult VmaDefragmentationContext_T::DefragmentPassEnd(VmaDefragmentationPassMo
 
         uint32_t vectorIndex = 0;
         VmaBlockVector* vector = VMA_NULL;
+        // Block vector of the destination, different from the source one only for moves of residency management.
+        VmaBlockVector* dstVector = VMA_NULL;
         if (m_PoolBlockVector != VMA_NULL)
         {
-            vector = m_PoolBlockVector;
+            vector = dstVector = m_PoolBlockVector;
         }
         else
         {
             vectorIndex = move.srcAllocation->GetMemoryTypeIndex();
             vector = m_pBlockVectors[vectorIndex];
-            VMA_ASSERT(vector != VMA_NULL);
+            dstVector = m_pBlockVectors[move.dstTmpAllocation->GetMemoryTypeIndex()];
+            VMA_ASSERT(vector != VMA_NULL && dstVector != VMA_NULL);
         }
 
+        const bool promoted = move.srcAllocation->GetType() == VmaAllocation_T::ALLOCATION_TYPE_DEDICATED;
         switch (move.operation)
         {
         case VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY:
         {
             uint8_t mapCount = 0;
+            if (promoted)
+            {
+                // Source takes over the block allocation and the temporary one becomes owner of the dedicated memory
+                VmaDedicatedAllocationList& dedicatedAllocations = GetDedicatedAllocations(*vector);
+                dedicatedAllocations.Unregister(move.srcAllocation);
+                {
+                    VmaMutexLockWrite swapLock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
+                    mapCount = move.srcAllocation->PromoteToBlockAllocation(vector->m_hAllocator, move.dstTmpAllocation);
+                }
+                dedicatedAllocations.Register(move.dstTmpAllocation);
+            }
+            else
             {
-                VmaMutexLockWrite swapLock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
+                // Both vectors are locked for a move between them, in order of memory types to avoid a deadlock.
+                VmaBlockVector* const firstVector = vector->GetMemoryTypeIndex() <= dstVector->GetMemoryTypeIndex() ? vector : dstVector;
+                VmaBlockVector* const secondVector = firstVector == vector ? dstVector : vector;
+                VmaMutexLockWrite swapLock(firstVector->GetMutex(), vector->GetAllocator()->m_UseMutex);
+                VmaMutexLockWrite dstSwapLock(secondVector->GetMutex(), vector->GetAllocator()->m_UseMutex && secondVector != firstVector);
                 mapCount = move.srcAllocation->SwapBlockAllocation(vector->m_hAllocator, move.dstTmpAllocation);
             }
             if (mapCount > 0)
@@ -12463,6 +15974,15 @@ VkResult VmaDefragmentationContext_T::DefragmentPassEnd(VmaDefragmentationPassMo
                     mappedBlocks.push_back({ mapCount, newMapBlock });
             }
 
+            if (promoted)
+            {
+                ++m_PassStats.deviceMemoryBlocksFreed;
+                m_PassStats.bytesFreed += move.dstTmpAllocation->GetSize();
+                vector->GetAllocator()->FreeMemory(1, &move.dstTmpAllocation);
+                result = VK_INCOMPLETE;
+                break;
+            }
+
             // Scope for locks, Free have it's own lock
             {
                 VmaMutexLockRead lock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
@@ -12482,7 +16002,13 @@ VkResult VmaDefragmentationContext_T::DefragmentPassEnd(VmaDefragmentationPassMo
         {
             m_PassStats.bytesMoved -= move.srcAllocation->GetSize();
             --m_PassStats.allocationsMoved;
-            vector->Free(move.dstTmpAllocation);
+            dstVector->Free(move.dstTmpAllocation);
+
+            if (promoted || m_Residency)
+            {
+                move.srcAllocation->SetIgnoringDefragmentationId(m_Id);
+                break;
+            }
 
             VmaDeviceMemoryBlock* newBlock = move.srcAllocation->GetBlock();
             bool notPresent = true;
@@ -12502,29 +16028,45 @@ VkResult VmaDefragmentationContext_T::DefragmentPassEnd(VmaDefragmentationPassMo
         {
             m_PassStats.bytesMoved -= move.srcAllocation->GetSize();
             --m_PassStats.allocationsMoved;
-            // Scope for locks, Free have it's own lock
+            if (promoted)
             {
-                VmaMutexLockRead lock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
-                prevCount = vector->GetBlockCount();
-                freedBlockSize = move.srcAllocation->GetBlock()->m_pMetadata->GetSize();
+                ++m_PassStats.deviceMemoryBlocksFreed;
+                m_PassStats.bytesFreed += move.srcAllocation->GetSize();
+                vector->GetAllocator()->FreeMemory(1, &move.srcAllocation);
+                {
+                    VmaMutexLockRead lock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
+                    prevCount = currentCount = vector->GetBlockCount();
+                }
             }
-            vector->Free(move.srcAllocation);
+            else
             {
-                VmaMutexLockRead lock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
-                currentCount = vector->GetBlockCount();
+                // Scope for locks, Free have it's own lock
+                {
+                    VmaMutexLockRead lock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
+                    prevCount = vector->GetBlockCount();
+                    freedBlockSize = move.srcAllocation->GetBlock()->m_pMetadata->GetSize();
+                }
+                vector->Free(move.srcAllocation);
+                {
+                    VmaMutexLockRead lock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
+                    currentCount = vector->GetBlockCount();
+                }
+                freedBlockSize *= prevCount - currentCount;
             }
-            freedBlockSize *= prevCount - currentCount;
 
             VkDeviceSize dstBlockSize = SIZE_MAX;
+            size_t dstPrevCount = 0;
             {
-                VmaMutexLockRead lock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
+                VmaMutexLockRead lock(dstVector->GetMutex(), dstVector->GetAllocator()->m_UseMutex);
                 dstBlockSize = move.dstTmpAllocation->GetBlock()->m_pMetadata->GetSize();
+                dstPrevCount = dstVector->GetBlockCount();
             }
-            vector->Free(move.dstTmpAllocation);
+            dstVector->Free(move.dstTmpAllocation);
             {
-                VmaMutexLockRead lock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
-                freedBlockSize += dstBlockSize * (currentCount - vector->GetBlockCount());
-                currentCount = vector->GetBlockCount();
+                VmaMutexLockRead lock(dstVector->GetMutex(), dstVector->GetAllocator()->m_UseMutex);
+                const size_t dstFreedCount = dstPrevCount - dstVector->GetBlockCount();
+                freedBlockSize += dstBlockSize * dstFreedCount;
+                prevCount += dstFreedCount;
             }
 
             result = VK_INCOMPLETE;
@@ -12541,35 +16083,21 @@ VkResult VmaDefragmentationContext_T::DefragmentPassEnd(VmaDefragmentationPassMo
             m_PassStats.bytesFreed += freedBlockSize;
         }
 
-        if(m_Algorithm == VMA_DEFRAGMENTATION_FLAG_ALGORITHM_EXTENSIVE_BIT &&
-            m_AlgorithmState != VMA_NULL)
-        {
-            // Avoid unnecessary tries to allocate when new free block is available
-            StateExtensive& state = reinterpret_cast<StateExtensive*>(m_AlgorithmState)[vectorIndex];
-            if (state.firstFreeBlock != SIZE_MAX)
-            {
-                const size_t diff = prevCount - currentCount;
-                if (state.firstFreeBlock >= diff)
-                {
-                    state.firstFreeBlock -= diff;
-                    if (state.firstFreeBlock != 0)
-                        state.firstFreeBlock -= vector->GetBlock(state.firstFreeBlock - 1)->m_pMetadata->IsEmpty();
-                }
-                else
-                    state.firstFreeBlock = 0;
-            }
-        }
+        UpdateFirstFreeBlock(*vector, vectorIndex, prevCount - currentCount);
     }
     moveInfo.moveCount = 0;
     moveInfo.pMoves = VMA_NULL;
+    moveInfo.copyRegionCount = 0;
+    moveInfo.pCopyRegions = VMA_NULL;
     m_Moves.clear();
+    m_CopyRegions.clear();
 
     // Update stats
     m_GlobalStats.allocationsMoved += m_PassStats.allocationsMoved;
     m_GlobalStats.bytesFreed += m_PassStats.bytesFreed;
     m_GlobalStats.bytesMoved += m_PassStats.bytesMoved;
     m_GlobalStats.deviceMemoryBlocksFreed += m_PassStats.deviceMemoryBlocksFreed;
-    m_PassStats = { 0 };
+    m_PassStats = {};
 
     // Move blocks with immovable allocations according to algorithm
     if (!immovableBlocks.empty())
@@ -12644,368 +16172,522 @@ VkResult VmaDefragmentationContext_T::DefragmentPassEnd(VmaDefragmentationPassMo
     return result;
 }
 
-bool VmaDefragmentationContext_T::ComputeDefragmentation(VmaBlockVector& vector, size_t index)
+void VmaDefragmentationContext_T::UpdateFirstFreeBlock(VmaBlockVector& vector, size_t index, size_t freedBlockCount)
 {
-    switch (m_Algorithm)
+    if(m_Algorithm == VMA_DEFRAGMENTATION_FLAG_ALGORITHM_EXTENSIVE_BIT &&
+        m_AlgorithmState != VMA_NULL)
     {
-    case VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT:
-        return ComputeDefragmentation_Fast(vector);
-    case VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT:
-        return ComputeDefragmentation_Balanced(vector, index, true);
-    case VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT:
-        return ComputeDefragmentation_Full(vector);
-    case VMA_DEFRAGMENTATION_FLAG_ALGORITHM_EXTENSIVE_BIT:
-        return ComputeDefragmentation_Extensive(vector, index);
-    default:
-        VMA_ASSERT(0);
-        return ComputeDefragmentation_Balanced(vector, index, true);
+        // Avoid unnecessary tries to allocate when new free block is available
+        StateExtensive& state = reinterpret_cast<StateExtensive*>(m_AlgorithmState)[index];
+        if (state.firstFreeBlock != SIZE_MAX)
+        {
+            if (state.firstFreeBlock >= freedBlockCount)
+            {
+                state.firstFreeBlock -= freedBlockCount;
+                if (state.firstFreeBlock != 0)
+                    state.firstFreeBlock -= vector.GetBlock(state.firstFreeBlock - 1)->m_pMetadata->IsEmpty();
+            }
+            else
+                state.firstFreeBlock = 0;
+        }
     }
 }
 
-VmaDefragmentationContext_T::MoveAllocationData VmaDefragmentationContext_T::GetMoveData(
-    VmaAllocHandle handle, VmaBlockMetadata* metadata)
+void VmaDefragmentationContext_T::ComputeCopyRegions()
 {
-    MoveAllocationData moveData;
-    moveData.move.srcAllocation = (VmaAllocation)metadata->GetAllocationUserData(handle);
-    moveData.size = moveData.move.srcAllocation->GetSize();
-    moveData.alignment = moveData.move.srcAllocation->GetAlignment();
-    moveData.type = moveData.move.srcAllocation->GetSuballocationType();
-    moveData.flags = 0;
-
-    if (moveData.move.srcAllocation->IsPersistentMap())
-        moveData.flags |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
-    if (moveData.move.srcAllocation->IsMappingAllowed())
-        moveData.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
-
-    return moveData;
+    m_CopyRegions.clear();
+    for (size_t i = 0; i < m_Moves.size(); ++i)
+    {
+        const VmaDefragmentationMove& move = m_Moves[i];
+        VmaDefragmentationCopyRegion region = {};
+        region.srcMemory = move.srcAllocation->GetMemory();
+        region.dstMemory = move.dstTmpAllocation->GetMemory();
+        region.srcOffset = move.srcAllocation->GetOffset();
+        region.dstOffset = move.dstTmpAllocation->GetOffset();
+        region.size = move.srcAllocation->GetSize();
+        m_CopyRegions.push_back(region);
+    }
+    MergeCopyRegions(m_CopyRegions);
 }
 
-VmaDefragmentationContext_T::CounterStatus VmaDefragmentationContext_T::CheckCounters(VkDeviceSize bytes)
+void VmaDefragmentationContext_T::MergeCopyRegions(CopyRegionVector& regions)
 {
-    // Check custom criteria if exists
-    if (m_BreakCallback && m_BreakCallback(m_BreakCallbackUserData))
-        return CounterStatus::End;
+    VMA_SORT(regions.begin(), regions.end(),
+        [](const VmaDefragmentationCopyRegion& lhs, const VmaDefragmentationCopyRegion& rhs)
+        {
+            if (lhs.srcMemory != rhs.srcMemory)
+                return lhs.srcMemory < rhs.srcMemory;
+            if (lhs.dstMemory != rhs.dstMemory)
+                return lhs.dstMemory < rhs.dstMemory;
+            return lhs.srcOffset < rhs.srcOffset;
+        });
 
-    // Ignore allocation if will exceed max size for copy
-    if (m_PassStats.bytesMoved + bytes > m_MaxPassBytes)
+    // Merge regions continuing the previous one in both source and destination.
+    // Destinations are reserved in free space, so merged ranges never overlap.
+    size_t regionCount = 0;
+    for (size_t i = 0; i < regions.size(); ++i)
     {
-        if (++m_IgnoredAllocs < MAX_ALLOCS_TO_IGNORE)
-            return CounterStatus::Ignore;
-        return CounterStatus::End;
+        const VmaDefragmentationCopyRegion region = regions[i];
+        if (regionCount > 0)
+        {
+            VmaDefragmentationCopyRegion& prevRegion = regions[regionCount - 1];
+            if (prevRegion.srcMemory == region.srcMemory &&
+                prevRegion.dstMemory == region.dstMemory &&
+                prevRegion.srcOffset + prevRegion.size == region.srcOffset &&
+                prevRegion.dstOffset + prevRegion.size == region.dstOffset)
+            {
+                prevRegion.size += region.size;
+                continue;
+            }
+        }
+        regions[regionCount++] = region;
     }
+    regions.resize(regionCount);
+}
 
-    m_IgnoredAllocs = 0;
-    return CounterStatus::Pass;
+bool VmaDefragmentationContext_T::ComputeVectorDefragmentation(PassPlan& plan, VmaBlockVector& vector, size_t index)
+{
+    VmaMutexLockWrite lock(vector.GetMutex(), vector.GetAllocator()->m_UseMutex);
+
+    // Resume point is valid only for the next computation of this vector.
+    plan.vectorIndex = index;
+    plan.resume = m_ResumePoints[index];
+    m_ResumePoints[index] = {};
+
+    bool end = false;
+    if (vector.GetBlockCount() > 1)
+        end = ComputeDefragmentation(plan, vector, index);
+    else if (vector.GetBlockCount() == 1)
+        end = ReallocWithinBlock(plan, vector, vector.GetBlock(0));
+
+    if (!end && m_PromoteDedicated)
+        end = ComputePromotions(plan, vector);
+    return end;
 }
 
-bool VmaDefragmentationContext_T::IncrementCounters(VkDeviceSize bytes)
+VmaDedicatedAllocationList& VmaDefragmentationContext_T::GetDedicatedAllocations(VmaBlockVector& vector)
 {
-    m_PassStats.bytesMoved += bytes;
-    // Early return when max found
-    if (++m_PassStats.allocationsMoved >= m_MaxPassAllocations || m_PassStats.bytesMoved >= m_MaxPassBytes)
+    if (vector.GetParentPool() != VK_NULL_HANDLE)
+        return vector.GetParentPool()->m_DedicatedAllocations;
+    return vector.GetAllocator()->m_DedicatedAllocations[vector.GetMemoryTypeIndex()];
+}
+
+void VmaDefragmentationContext_T::SortBlocksByMoveCost(VmaBlockVector& vector, VmaDeviceMemoryBlock** outBlocks)
+{
+    struct BlockMoveCost
     {
-        VMA_ASSERT((m_PassStats.allocationsMoved == m_MaxPassAllocations ||
-            m_PassStats.bytesMoved == m_MaxPassBytes) && "Exceeded maximal pass threshold!");
-        return true;
+        VmaDeviceMemoryBlock* block;
+        bool immovable;
+        // Free size minus size of allocations weighted by their move cost, equal to free size when all costs are 1.
+        double freeSize;
+    };
+    const size_t blockCount = vector.GetBlockCount();
+    if (blockCount == 0)
+        return;
+
+    BlockMoveCost* const costs = vma_new_array(vector.m_hAllocator, BlockMoveCost, blockCount);
+    for (size_t i = 0; i < blockCount; ++i)
+    {
+        VmaDeviceMemoryBlock* const block = vector.GetBlock(i);
+        VmaBlockMetadata* const metadata = block->m_pMetadata;
+        BlockMoveCost& cost = costs[i];
+        cost = { block, false, (double)metadata->GetSize() };
+        for (VmaAllocHandle handle = metadata->GetAllocationListBegin();
+            handle != VK_NULL_HANDLE;
+            handle = metadata->GetNextAllocation(handle))
+        {
+            const VmaAllocation alloc = (VmaAllocation)metadata->GetAllocationUserData(handle);
+            cost.immovable |= alloc->IsImmovable();
+            cost.freeSize -= (double)alloc->GetSize() * alloc->GetMoveCost();
+        }
     }
-    return false;
+    VMA_SORT(costs, costs + blockCount, [](const BlockMoveCost& lhs, const BlockMoveCost& rhs) -> bool
+        {
+            if (lhs.immovable != rhs.immovable)
+                return lhs.immovable;
+            return lhs.freeSize < rhs.freeSize;
+        });
+    for (size_t i = 0; i < blockCount; ++i)
+        outBlocks[i] = costs[i].block;
+    vma_delete_array(vector.m_hAllocator, costs, blockCount);
 }
 
-bool VmaDefragmentationContext_T::ReallocWithinBlock(VmaBlockVector& vector, VmaDeviceMemoryBlock* block)
+bool VmaDefragmentationContext_T::ComputePromotions(PassPlan& plan, VmaBlockVector& vector)
 {
-    VmaBlockMetadata* metadata = block->m_pMetadata;
+    VmaDedicatedAllocationList& dedicatedAllocations = GetDedicatedAllocations(vector);
+    // Keep the list locked so none of the allocations can be freed meanwhile.
+    VmaMutexLockRead lock(dedicatedAllocations.m_Mutex, dedicatedAllocations.m_UseMutex);
 
-    for (VmaAllocHandle handle = metadata->GetAllocationListBegin();
-        handle != VK_NULL_HANDLE;
-        handle = metadata->GetNextAllocation(handle))
+    for (VmaAllocation alloc = dedicatedAllocations.m_AllocationList.Front();
+        alloc != VMA_NULL;
+        alloc = VmaDedicatedAllocationList::DedicatedAllocationLinkedList::GetNext(alloc))
     {
-        MoveAllocationData moveData = GetMoveData(handle, metadata);
-        // Ignore newly created allocations by defragmentation algorithm
-        if (moveData.move.srcAllocation->GetUserData() == this)
+        if (!alloc->IsDedicatedFallback() || alloc->IsImmovable() || IsIgnored(alloc))
             continue;
-        switch (CheckCounters(moveData.move.srcAllocation->GetSize()))
+        if (IsPassInterrupted(plan))
         {
-        case CounterStatus::Ignore:
+            plan.interrupted = true;
+            return true;
+        }
+        if (plan.bytesMoved + alloc->GetSize() > m_MaxPassBytes)
             continue;
-        case CounterStatus::End:
+
+        MoveAllocationData moveData = GetMoveData(alloc);
+        if (AllocInOtherBlock(plan, 0, vector.GetBlockCount(), moveData, vector))
             return true;
-        case CounterStatus::Pass:
-            break;
-        default:
-            VMA_ASSERT(0);
+    }
+    return false;
+}
+
+bool VmaDefragmentationContext_T::IsIgnored(VmaAllocation allocation) const
+{
+    return allocation->GetIgnoringDefragmentationId() == m_Id;
+}
+
+void VmaDefragmentationContext_T::ComputeResidency(PassPlan& plan)
+{
+    const VkMemoryPropertyFlags hostVisibleFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    const uint32_t heapCount = m_hAllocator->GetMemoryHeapCount();
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    m_hAllocator->GetHeapBudgets(budgets, 0, heapCount);
+
+    // Heaps over the eviction threshold and sizes of their blocks emptied by moves of this pass.
+    uint32_t evictedHeapBits = 0;
+    VkDeviceSize evictedBytes[VK_MAX_MEMORY_HEAPS] = {};
+    for (uint32_t heapIndex = 0; heapIndex < heapCount; ++heapIndex)
+    {
+        if ((double)budgets[heapIndex].usage > (double)budgets[heapIndex].budget * m_EvictionThreshold)
+            evictedHeapBits |= 1u << heapIndex;
+    }
+
+    // 1. Move allocations out of DEVICE_LOCAL memory types of heaps over the threshold, to HOST_VISIBLE ones of other heaps.
+    // Usage drops only when a whole block is freed, so only blocks that can be emptied completely are processed.
+    for (uint32_t memTypeIndex = 0; memTypeIndex < m_BlockVectorCount; ++memTypeIndex)
+    {
+        VmaBlockVector* const vector = m_pBlockVectors[memTypeIndex];
+        const uint32_t heapIndex = m_hAllocator->MemoryTypeIndexToHeapIndex(memTypeIndex);
+        if (vector == VMA_NULL || (evictedHeapBits & (1u << heapIndex)) == 0 ||
+            (m_hAllocator->m_MemProps.memoryTypes[memTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == 0)
+        {
+            continue;
+        }
+
+        uint32_t targetMemTypeBits = 0;
+        for (uint32_t i = 0; i < m_BlockVectorCount; ++i)
+        {
+            if (m_hAllocator->MemoryTypeIndexToHeapIndex(i) != heapIndex &&
+                (m_hAllocator->m_MemProps.memoryTypes[i].propertyFlags & hostVisibleFlags) != 0)
+            {
+                targetMemTypeBits |= 1u << i;
+            }
         }
 
-        VkDeviceSize offset = moveData.move.srcAllocation->GetOffset();
-        if (offset != 0 && metadata->GetSumFreeSize() >= moveData.size)
+        VmaMutexLockRead lock(vector->GetMutex(), m_hAllocator->m_UseMutex);
+        // Empty blocks kept by the vector for reuse don't count, otherwise every pass would evict another block.
+        for (size_t blockIndex = 0; blockIndex < vector->GetBlockCount(); ++blockIndex)
         {
-            VmaAllocationRequest request = {};
-            if (metadata->CreateAllocationRequest(
-                moveData.size,
-                moveData.alignment,
-                false,
-                moveData.type,
-                VMA_ALLOCATION_CREATE_STRATEGY_MIN_OFFSET_BIT,
-                &request))
+            if (vector->GetBlock(blockIndex)->m_pMetadata->IsEmpty())
+                evictedBytes[heapIndex] += vector->GetBlock(blockIndex)->m_pMetadata->GetSize();
+        }
+        // Blocks at the end are the cheapest to free, see SortBlocksByMoveCost().
+        for (size_t blockIndex = vector->GetBlockCount(); blockIndex--; )
+        {
+            if ((double)(budgets[heapIndex].usage - evictedBytes[heapIndex]) <= (double)budgets[heapIndex].budget * m_EvictionThreshold)
+                break;
+
+            VmaBlockMetadata* const metadata = vector->GetBlock(blockIndex)->m_pMetadata;
+            if (metadata->IsEmpty())
+                continue;
+            bool evictable = true;
+            for (VmaAllocHandle handle = metadata->GetAllocationListBegin();
+                evictable && handle != VK_NULL_HANDLE;
+                handle = metadata->GetNextAllocation(handle))
+            {
+                const VmaAllocation alloc = (VmaAllocation)metadata->GetAllocationUserData(handle);
+                evictable = IsMovable(alloc) && (alloc->GetResidencyMemoryTypeBits() & targetMemTypeBits) != 0 && !IsIgnored(alloc);
+            }
+            if (!evictable)
+                continue;
+
+            const size_t firstMove = plan.moves.size();
+            bool emptied = true;
+            for (VmaAllocHandle handle = metadata->GetAllocationListBegin();
+                handle != VK_NULL_HANDLE;
+                handle = metadata->GetNextAllocation(handle))
             {
-                if (metadata->GetAllocationOffset(request.allocHandle) < offset)
+                const VmaAllocation alloc = (VmaAllocation)metadata->GetAllocationUserData(handle);
+                if (IsPassInterrupted(plan))
                 {
-                    if (vector.CommitAllocationRequest(
-                        request,
-                        block,
-                        moveData.alignment,
-                        moveData.flags,
-                        this,
-                        moveData.type,
-                        &moveData.move.dstTmpAllocation) == VK_SUCCESS)
-                    {
-                        m_Moves.push_back(moveData.move);
-                        if (IncrementCounters(moveData.size))
-                            return true;
-                    }
+                    plan.interrupted = true;
+                    return;
+                }
+                // Moves found so far are kept, next pass continues emptying this block.
+                if (plan.bytesMoved + alloc->GetSize() > m_MaxPassBytes)
+                    return;
+                if (!AllocInOtherMemoryType(plan, alloc, alloc->GetResidencyMemoryTypeBits() & targetMemTypeBits))
+                {
+                    emptied = false;
+                    break;
+                }
+                if (IncrementCounters(plan, alloc->GetSize()))
+                    return;
+            }
+
+            if (emptied)
+                evictedBytes[heapIndex] += metadata->GetSize();
+            else
+            {
+                // Moving only part of the allocations wouldn't free the block.
+                for (size_t i = firstMove; i < plan.moves.size(); ++i)
+                {
+                    plan.bytesMoved -= plan.moves[i].srcAllocation->GetSize();
+                    --plan.allocationsMoved;
                 }
+                ReleaseMoves(plan, firstMove);
             }
         }
     }
-    return false;
-}
 
-bool VmaDefragmentationContext_T::AllocInOtherBlock(size_t start, size_t end, MoveAllocationData& data, VmaBlockVector& vector)
-{
-    for (; start < end; ++start)
+    // 2. Move allocations back to their preferred memory types, in heaps below the restore threshold.
+    uint32_t fullHeapBits = evictedHeapBits;
+    for (uint32_t memTypeIndex = 0; memTypeIndex < m_BlockVectorCount; ++memTypeIndex)
     {
-        VmaDeviceMemoryBlock* dstBlock = vector.GetBlock(start);
-        if (dstBlock->m_pMetadata->GetSumFreeSize() >= data.size)
+        VmaBlockVector* const vector = m_pBlockVectors[memTypeIndex];
+        if (vector == VMA_NULL)
+            continue;
+
+        VmaMutexLockRead lock(vector->GetMutex(), m_hAllocator->m_UseMutex);
+        for (size_t blockIndex = 0; blockIndex < vector->GetBlockCount(); ++blockIndex)
         {
-            if (vector.AllocateFromBlock(dstBlock,
-                data.size,
-                data.alignment,
-                data.flags,
-                this,
-                data.type,
-                0,
-                &data.move.dstTmpAllocation) == VK_SUCCESS)
+            VmaBlockMetadata* const metadata = vector->GetBlock(blockIndex)->m_pMetadata;
+            for (VmaAllocHandle handle = metadata->GetAllocationListBegin();
+                handle != VK_NULL_HANDLE;
+                handle = metadata->GetNextAllocation(handle))
             {
-                m_Moves.push_back(data.move);
-                if (IncrementCounters(data.size))
-                    return true;
-                break;
+                const VmaAllocation alloc = (VmaAllocation)metadata->GetAllocationUserData(handle);
+                const uint32_t homeMemTypeIndex = alloc->GetHomeMemoryTypeIndex();
+                if (!IsMovable(alloc) || !alloc->IsEvictable() || homeMemTypeIndex == memTypeIndex || IsIgnored(alloc))
+                    continue;
+                const uint32_t homeHeapIndex = m_hAllocator->MemoryTypeIndexToHeapIndex(homeMemTypeIndex);
+                // Mapped allocation must stay in HOST_VISIBLE memory.
+                if ((fullHeapBits & (1u << homeHeapIndex)) != 0 ||
+                    (alloc->IsMapped() && (m_hAllocator->m_MemProps.memoryTypes[homeMemTypeIndex].propertyFlags & hostVisibleFlags) == 0))
+                {
+                    continue;
+                }
+                if (IsPassInterrupted(plan))
+                {
+                    plan.interrupted = true;
+                    return;
+                }
+                if (plan.bytesMoved + alloc->GetSize() > m_MaxPassBytes)
+                    continue;
+
+                VmaBudget budget = {};
+                m_hAllocator->GetHeapBudgets(&budget, homeHeapIndex, 1);
+                if ((double)(budget.usage + alloc->GetSize()) > (double)budget.budget * m_RestoreThreshold ||
+                    !AllocInOtherMemoryType(plan, alloc, 1u << homeMemTypeIndex))
+                {
+                    fullHeapBits |= 1u << homeHeapIndex;
+                    continue;
+                }
+                // A new block could take the heap over the eviction threshold, so the allocation would be moved out again.
+                m_hAllocator->GetHeapBudgets(&budget, homeHeapIndex, 1);
+                if ((double)budget.usage > (double)budget.budget * m_EvictionThreshold)
+                {
+                    ReleaseMoves(plan, plan.moves.size() - 1);
+                    fullHeapBits |= 1u << homeHeapIndex;
+                    continue;
+                }
+                if (IncrementCounters(plan, alloc->GetSize()))
+                    return;
             }
         }
     }
-    return false;
 }
 
-bool VmaDefragmentationContext_T::ComputeDefragmentation_Fast(VmaBlockVector& vector)
+bool VmaDefragmentationContext_T::AllocInOtherMemoryType(PassPlan& plan, VmaAllocation allocation, uint32_t memoryTypeBits)
 {
-    // Move only between blocks
-
-    // Go through allocations in last blocks and try to fit them inside first ones
-    for (size_t i = vector.GetBlockCount() - 1; i > m_ImmovableBlockCount; --i)
+    MoveAllocationData data = GetMoveData(allocation);
+    VmaAllocationCreateInfo createInfo = {};
+    createInfo.flags = data.flags;
+    createInfo.pUserData = this;
+    for (uint32_t memTypeIndex = 0; memTypeIndex < m_BlockVectorCount; ++memTypeIndex)
     {
-        VmaBlockMetadata* metadata = vector.GetBlock(i)->m_pMetadata;
-
-        for (VmaAllocHandle handle = metadata->GetAllocationListBegin();
-            handle != VK_NULL_HANDLE;
-            handle = metadata->GetNextAllocation(handle))
+        VmaBlockVector* const vector = m_pBlockVectors[memTypeIndex];
+        if ((memoryTypeBits & (1u << memTypeIndex)) != 0 && vector != VMA_NULL &&
+            vector->Allocate(data.size, data.alignment, createInfo, data.type, 1, &data.move.dstTmpAllocation) == VK_SUCCESS)
         {
-            MoveAllocationData moveData = GetMoveData(handle, metadata);
-            // Ignore newly created allocations by defragmentation algorithm
-            if (moveData.move.srcAllocation->GetUserData() == this)
-                continue;
-            switch (CheckCounters(moveData.move.srcAllocation->GetSize()))
-            {
-            case CounterStatus::Ignore:
-                continue;
-            case CounterStatus::End:
-                return true;
-            case CounterStatus::Pass:
-                break;
-            default:
-                VMA_ASSERT(0);
-            }
-
-            // Check all previous blocks for free space
-            if (AllocInOtherBlock(0, i, moveData, vector))
-                return true;
+            plan.moves.push_back(data.move);
+            return true;
         }
     }
     return false;
 }
 
-bool VmaDefragmentationContext_T::ComputeDefragmentation_Balanced(VmaBlockVector& vector, size_t index, bool update)
+void VmaDefragmentationContext_T::ReleaseMoves(PassPlan& plan, size_t firstMove)
 {
-    // Go over every allocation and try to fit it in previous blocks at lowest offsets,
-    // if not possible: realloc within single block to minimize offset (exclude offset == 0),
-    // but only if there are noticeable gaps between them (some heuristic, ex. average size of allocation in block)
-    VMA_ASSERT(m_AlgorithmState != VMA_NULL);
+    while (plan.moves.size() > firstMove)
+    {
+        const VmaAllocation dstTmpAllocation = plan.moves.back().dstTmpAllocation;
+        m_pBlockVectors[dstTmpAllocation->GetMemoryTypeIndex()]->Free(dstTmpAllocation);
+        plan.moves.pop_back();
+    }
+}
 
-    StateBalanced& vectorState = reinterpret_cast<StateBalanced*>(m_AlgorithmState)[index];
-    if (update && vectorState.avgAllocSize == UINT64_MAX)
-        UpdateVectorStatistics(vector, vectorState);
+void VmaDefragmentationContext_T::ComputeDefragmentationParallel()
+{
+    // Each job computes moves for single block vector with its own counters, as if it was the only one in the pass.
+    (*m_DispatchJobs)(m_DispatchJobsUserData, m_BlockVectorCount, ComputeDefragmentationJob, this);
 
-    const size_t startMoveCount = m_Moves.size();
-    VkDeviceSize minimalFreeRegion = vectorState.avgFreeSize / 2;
-    for (size_t i = vector.GetBlockCount() - 1; i > m_ImmovableBlockCount; --i)
-    {
-        VmaDeviceMemoryBlock* block = vector.GetBlock(i);
-        VmaBlockMetadata* metadata = block->m_pMetadata;
-        VkDeviceSize prevFreeRegionSize = 0;
+    // Jobs finish in any order. Put their moves in order of memory types, like sequential computation would,
+    // so that the pass and the moves kept within its limits don't depend on scheduling of the jobs.
+    VMA_SORT(m_JobMoveRanges.begin(), m_JobMoveRanges.end(), [](const MoveRange& lhs, const MoveRange& rhs)
+        {
+            return lhs.vectorIndex < rhs.vectorIndex;
+        });
+    const MoveVector jobMoves(m_Moves);
+    m_Moves.clear();
 
-        for (VmaAllocHandle handle = metadata->GetAllocationListBegin();
-            handle != VK_NULL_HANDLE;
-            handle = metadata->GetNextAllocation(handle))
+    VkDeviceSize bytesMoved = 0;
+    for (size_t rangeIndex = 0; rangeIndex < m_JobMoveRanges.size(); ++rangeIndex)
+    {
+        const MoveRange& range = m_JobMoveRanges[rangeIndex];
+        for (size_t i = range.firstMove; i < range.firstMove + range.moveCount; ++i)
         {
-            MoveAllocationData moveData = GetMoveData(handle, metadata);
-            // Ignore newly created allocations by defragmentation algorithm
-            if (moveData.move.srcAllocation->GetUserData() == this)
-                continue;
-            switch (CheckCounters(moveData.move.srcAllocation->GetSize()))
+            const VmaDefragmentationMove& move = jobMoves[i];
+            const VkDeviceSize size = move.srcAllocation->GetSize();
+            if (m_Moves.size() < m_MaxPassAllocations && bytesMoved + size <= m_MaxPassBytes)
             {
-            case CounterStatus::Ignore:
-                continue;
-            case CounterStatus::End:
-                return true;
-            case CounterStatus::Pass:
-                break;
-            default:
-                VMA_ASSERT(0);
+                bytesMoved += size;
+                m_Moves.push_back(move);
             }
-
-            // Check all previous blocks for free space
-            const size_t prevMoveCount = m_Moves.size();
-            if (AllocInOtherBlock(0, i, moveData, vector))
-                return true;
-
-            VkDeviceSize nextFreeRegionSize = metadata->GetNextFreeRegionSize(handle);
-            // If no room found then realloc within block for lower offset
-            VkDeviceSize offset = moveData.move.srcAllocation->GetOffset();
-            if (prevMoveCount == m_Moves.size() && offset != 0 && metadata->GetSumFreeSize() >= moveData.size)
+            else
             {
-                // Check if realloc will make sense
-                if (prevFreeRegionSize >= minimalFreeRegion ||
-                    nextFreeRegionSize >= minimalFreeRegion ||
-                    moveData.size <= vectorState.avgFreeSize ||
-                    moveData.size <= vectorState.avgAllocSize)
+                // Limits of the pass are exceeded when taken together, same as if the user ignored this move.
+                VmaBlockVector* const vector = m_pBlockVectors[range.vectorIndex];
+                size_t prevCount = 0;
                 {
-                    VmaAllocationRequest request = {};
-                    if (metadata->CreateAllocationRequest(
-                        moveData.size,
-                        moveData.alignment,
-                        false,
-                        moveData.type,
-                        VMA_ALLOCATION_CREATE_STRATEGY_MIN_OFFSET_BIT,
-                        &request))
-                    {
-                        if (metadata->GetAllocationOffset(request.allocHandle) < offset)
-                        {
-                            if (vector.CommitAllocationRequest(
-                                request,
-                                block,
-                                moveData.alignment,
-                                moveData.flags,
-                                this,
-                                moveData.type,
-                                &moveData.move.dstTmpAllocation) == VK_SUCCESS)
-                            {
-                                m_Moves.push_back(moveData.move);
-                                if (IncrementCounters(moveData.size))
-                                    return true;
-                            }
-                        }
-                    }
+                    VmaMutexLockRead lock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
+                    prevCount = vector->GetBlockCount();
+                }
+                vector->Free(move.dstTmpAllocation);
+                {
+                    VmaMutexLockRead lock(vector->GetMutex(), vector->GetAllocator()->m_UseMutex);
+                    UpdateFirstFreeBlock(*vector, range.vectorIndex, prevCount - vector->GetBlockCount());
                 }
             }
-            prevFreeRegionSize = nextFreeRegionSize;
         }
     }
+    m_JobMoveRanges.clear();
+    m_PassStats.bytesMoved = bytesMoved;
+    m_PassStats.allocationsMoved = static_cast<uint32_t>(m_Moves.size());
+}
 
-    // No moves performed, update statistics to current vector state
-    if (startMoveCount == m_Moves.size() && !update)
+void VKAPI_PTR VmaDefragmentationContext_T::ComputeDefragmentationJob(void* pJobData, uint32_t jobIndex)
+{
+    VmaDefragmentationContext_T* const context = reinterpret_cast<VmaDefragmentationContext_T*>(pJobData);
+    VmaBlockVector* const vector = context->m_pBlockVectors[jobIndex];
+    if (vector == VMA_NULL)
+        return;
+
+    MoveVector moves(context->m_MoveAllocator);
+    PassPlan plan = { moves, 0, 0, 0 };
+    context->ComputeVectorDefragmentation(plan, *vector, jobIndex);
+
+    if (!moves.empty())
+    {
+        VmaMutexLock lock(context->m_MovesMutex);
+        context->m_JobMoveRanges.push_back({ jobIndex, context->m_Moves.size(), moves.size() });
+        for (size_t i = 0; i < moves.size(); ++i)
+            context->m_Moves.push_back(moves[i]);
+    }
+}
+
+bool VmaDefragmentationContext_T::ComputeDefragmentation(PassPlan& plan, VmaBlockVector& vector, size_t index)
+{
+    switch (m_Algorithm)
     {
-        vectorState.avgAllocSize = UINT64_MAX;
-        return ComputeDefragmentation_Balanced(vector, index, false);
+    case VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT:
+        return ComputeDefragmentation_Fast(plan, vector);
+    case VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT:
+        return ComputeDefragmentation_Full(plan, vector);
+    case VMA_DEFRAGMENTATION_FLAG_ALGORITHM_EXTENSIVE_BIT:
+        return ComputeDefragmentation_Extensive(plan, vector, index);
+    default:
+        VMA_ASSERT(m_Algorithm == VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT);
+        VMA_ASSERT(m_AlgorithmState != VMA_NULL);
+        return ComputeDefragmentation_Balanced(plan, vector, reinterpret_cast<StateBalanced*>(m_AlgorithmState)[index], true);
     }
-    return false;
 }
 
-bool VmaDefragmentationContext_T::ComputeDefragmentation_Full(VmaBlockVector& vector)
+VmaDefragmentationContext_T::MoveAllocationData VmaDefragmentationContext_T::GetMoveData(VmaAllocation allocation)
 {
-    // Go over every allocation and try to fit it in previous blocks at lowest offsets,
-    // if not possible: realloc within single block to minimize offset (exclude offset == 0)
+    MoveAllocationData moveData;
+    moveData.move.srcAllocation = allocation;
+    moveData.size = moveData.move.srcAllocation->GetSize();
+    moveData.alignment = moveData.move.srcAllocation->GetAlignment();
+    moveData.type = moveData.move.srcAllocation->GetSuballocationType();
+    moveData.flags = 0;
 
-    for (size_t i = vector.GetBlockCount() - 1; i > m_ImmovableBlockCount; --i)
-    {
-        VmaDeviceMemoryBlock* block = vector.GetBlock(i);
-        VmaBlockMetadata* metadata = block->m_pMetadata;
+    if (moveData.move.srcAllocation->IsPersistentMap())
+        moveData.flags |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    if (moveData.move.srcAllocation->IsMappingAllowed())
+        moveData.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
 
-        for (VmaAllocHandle handle = metadata->GetAllocationListBegin();
-            handle != VK_NULL_HANDLE;
-            handle = metadata->GetNextAllocation(handle))
-        {
-            MoveAllocationData moveData = GetMoveData(handle, metadata);
-            // Ignore newly created allocations by defragmentation algorithm
-            if (moveData.move.srcAllocation->GetUserData() == this)
-                continue;
-            switch (CheckCounters(moveData.move.srcAllocation->GetSize()))
-            {
-            case CounterStatus::Ignore:
-                continue;
-            case CounterStatus::End:
-                return true;
-            case CounterStatus::Pass:
-                break;
-            default:
-                VMA_ASSERT(0);
-            }
+    return moveData;
+}
 
-            // Check all previous blocks for free space
-            const size_t prevMoveCount = m_Moves.size();
-            if (AllocInOtherBlock(0, i, moveData, vector))
-                return true;
+VmaDefragmentationContext_T::MoveAllocationData VmaDefragmentationContext_T::GetMoveData(
+    VmaDeviceMemoryBlock* block, VmaAllocHandle handle)
+{
+    return GetMoveData((VmaAllocation)block->m_pMetadata->GetAllocationUserData(handle));
+}
 
-            // If no room found then realloc within block for lower offset
-            VkDeviceSize offset = moveData.move.srcAllocation->GetOffset();
-            if (prevMoveCount == m_Moves.size() && offset != 0 && metadata->GetSumFreeSize() >= moveData.size)
-            {
-                VmaAllocationRequest request = {};
-                if (metadata->CreateAllocationRequest(
-                    moveData.size,
-                    moveData.alignment,
-                    false,
-                    moveData.type,
-                    VMA_ALLOCATION_CREATE_STRATEGY_MIN_OFFSET_BIT,
-                    &request))
-                {
-                    if (metadata->GetAllocationOffset(request.allocHandle) < offset)
-                    {
-                        if (vector.CommitAllocationRequest(
-                            request,
-                            block,
-                            moveData.alignment,
-                            moveData.flags,
-                            this,
-                            moveData.type,
-                            &moveData.move.dstTmpAllocation) == VK_SUCCESS)
-                        {
-                            m_Moves.push_back(moveData.move);
-                            if (IncrementCounters(moveData.size))
-                                return true;
-                        }
-                    }
-                }
-            }
-        }
-    }
-    return false;
+bool VmaDefragmentationContext_T::AllocInBlock(VmaBlockVector& vector, VmaDeviceMemoryBlock* dstBlock, MoveAllocationData& data)
+{
+    return vector.AllocateFromBlock(dstBlock,
+        data.size,
+        data.alignment,
+        data.flags,
+        this,
+        data.type,
+        VMA_ALLOCATION_CREATE_STRATEGY_MIN_OFFSET_BIT,
+        &data.move.dstTmpAllocation) == VK_SUCCESS;
+}
+
+bool VmaDefragmentationContext_T::ReallocInBlock(VmaBlockVector& vector, VmaDeviceMemoryBlock* block,
+    MoveAllocationData& data, VkDeviceSize offset)
+{
+    VmaBlockMetadata* metadata = block->m_pMetadata;
+    VmaAllocationRequest request = {};
+    if (!metadata->CreateAllocationRequest(
+        data.size,
+        data.alignment,
+        false,
+        data.type,
+        VMA_ALLOCATION_CREATE_STRATEGY_MIN_OFFSET_BIT,
+        &request))
+        return false;
+
+    return metadata->GetAllocationOffset(request.allocHandle) < offset &&
+        vector.CommitAllocationRequest(
+            request,
+            block,
+            data.alignment,
+            data.flags,
+            this,
+            data.type,
+            &data.move.dstTmpAllocation) == VK_SUCCESS;
 }
 
-bool VmaDefragmentationContext_T::ComputeDefragmentation_Extensive(VmaBlockVector& vector, size_t index)
+bool VmaDefragmentationContext_T::ComputeDefragmentation_Extensive(PassPlan& plan, VmaBlockVector& vector, size_t index)
 {
     // First free single block, then populate it to the brim, then free another block, and so on
 
     // Fallback to previous algorithm since without granularity conflicts it can achieve max packing
     if (vector.m_BufferImageGranularity == 1)
-        return ComputeDefragmentation_Full(vector);
+        return ComputeDefragmentation_Full(plan, vector);
 
     VMA_ASSERT(m_AlgorithmState != VMA_NULL);
 
@@ -13026,20 +16708,22 @@ bool VmaDefragmentationContext_T::ComputeDefragmentation_Extensive(VmaBlockVecto
         if (vectorState.firstFreeBlock == 0)
         {
             vectorState.operation = StateExtensive::Operation::Cleanup;
-            return ComputeDefragmentation_Fast(vector);
+            return ComputeDefragmentation_Fast(plan, vector);
         }
 
         // No free blocks, have to clear last one
         size_t last = (vectorState.firstFreeBlock == SIZE_MAX ? vector.GetBlockCount() : vectorState.firstFreeBlock) - 1;
         VmaBlockMetadata* freeMetadata = vector.GetBlock(last)->m_pMetadata;
 
-        const size_t prevMoveCount = m_Moves.size();
-        for (VmaAllocHandle handle = freeMetadata->GetAllocationListBegin();
+        const size_t prevMoveCount = plan.moves.size();
+        for (VmaAllocHandle handle = GetFirstAllocationToCheck(plan, vector.GetBlock(last));
             handle != VK_NULL_HANDLE;
             handle = freeMetadata->GetNextAllocation(handle))
         {
-            MoveAllocationData moveData = GetMoveData(handle, freeMetadata);
-            switch (CheckCounters(moveData.move.srcAllocation->GetSize()))
+            MoveAllocationData moveData = GetMoveData(vector.GetBlock(last), handle);
+            if (moveData.move.srcAllocation->IsImmovable())
+                continue;
+            switch (CheckCounters(plan, vector.GetBlock(last), handle, moveData.size))
             {
             case CounterStatus::Ignore:
                 continue;
@@ -13052,31 +16736,31 @@ bool VmaDefragmentationContext_T::ComputeDefragmentation_Extensive(VmaBlockVecto
             }
 
             // Check all previous blocks for free space
-            if (AllocInOtherBlock(0, last, moveData, vector))
+            if (AllocInOtherBlock(plan, 0, last, moveData, vector))
             {
                 // Full clear performed already
-                if (prevMoveCount != m_Moves.size() && freeMetadata->GetNextAllocation(handle) == VK_NULL_HANDLE)
+                if (prevMoveCount != plan.moves.size() && freeMetadata->GetNextAllocation(handle) == VK_NULL_HANDLE)
                     vectorState.firstFreeBlock = last;
                 return true;
             }
         }
 
-        if (prevMoveCount == m_Moves.size())
+        if (prevMoveCount == plan.moves.size())
         {
             // Cannot perform full clear, have to move data in other blocks around
             if (last != 0)
             {
                 for (size_t i = last - 1; i; --i)
                 {
-                    if (ReallocWithinBlock(vector, vector.GetBlock(i)))
+                    if (ReallocWithinBlock(plan, vector, vector.GetBlock(i)))
                         return true;
                 }
             }
 
-            if (prevMoveCount == m_Moves.size())
+            if (prevMoveCount == plan.moves.size())
             {
                 // No possible reallocs within blocks, try to move them around fast
-                return ComputeDefragmentation_Fast(vector);
+                return ComputeDefragmentation_Fast(plan, vector);
             }
         }
         else
@@ -13098,19 +16782,19 @@ bool VmaDefragmentationContext_T::ComputeDefragmentation_Extensive(VmaBlockVecto
             }
             vectorState.firstFreeBlock = last;
             // Nothing done, block found without reallocations, can perform another reallocs in same pass
-            return ComputeDefragmentation_Extensive(vector, index);
+            return ComputeDefragmentation_Extensive(plan, vector, index);
         }
         break;
     }
     case StateExtensive::Operation::MoveTextures:
     {
-        if (MoveDataToFreeBlocks(VMA_SUBALLOCATION_TYPE_IMAGE_OPTIMAL, vector,
+        if (MoveDataToFreeBlocks(plan, VMA_SUBALLOCATION_TYPE_IMAGE_OPTIMAL, vector,
             vectorState.firstFreeBlock, texturePresent, bufferPresent, otherPresent))
         {
             if (texturePresent)
             {
                 vectorState.operation = StateExtensive::Operation::FindFreeBlockTexture;
-                return ComputeDefragmentation_Extensive(vector, index);
+                return ComputeDefragmentation_Extensive(plan, vector, index);
             }
 
             if (!bufferPresent && !otherPresent)
@@ -13130,13 +16814,13 @@ bool VmaDefragmentationContext_T::ComputeDefragmentation_Extensive(VmaBlockVecto
     }
     case StateExtensive::Operation::MoveBuffers:
     {
-        if (MoveDataToFreeBlocks(VMA_SUBALLOCATION_TYPE_BUFFER, vector,
+        if (MoveDataToFreeBlocks(plan, VMA_SUBALLOCATION_TYPE_BUFFER, vector,
             vectorState.firstFreeBlock, texturePresent, bufferPresent, otherPresent))
         {
             if (bufferPresent)
             {
                 vectorState.operation = StateExtensive::Operation::FindFreeBlockBuffer;
-                return ComputeDefragmentation_Extensive(vector, index);
+                return ComputeDefragmentation_Extensive(plan, vector, index);
             }
 
             if (!otherPresent)
@@ -13155,13 +16839,13 @@ bool VmaDefragmentationContext_T::ComputeDefragmentation_Extensive(VmaBlockVecto
     }
     case StateExtensive::Operation::MoveAll:
     {
-        if (MoveDataToFreeBlocks(VMA_SUBALLOCATION_TYPE_FREE, vector,
+        if (MoveDataToFreeBlocks(plan, VMA_SUBALLOCATION_TYPE_FREE, vector,
             vectorState.firstFreeBlock, texturePresent, bufferPresent, otherPresent))
         {
             if (otherPresent)
             {
                 vectorState.operation = StateExtensive::Operation::FindFreeBlockBuffer;
-                return ComputeDefragmentation_Extensive(vector, index);
+                return ComputeDefragmentation_Extensive(plan, vector, index);
             }
             // Everything moved
             vectorState.operation = StateExtensive::Operation::Cleanup;
@@ -13176,59 +16860,38 @@ bool VmaDefragmentationContext_T::ComputeDefragmentation_Extensive(VmaBlockVecto
     if (vectorState.operation == StateExtensive::Operation::Cleanup)
     {
         // All other work done, pack data in blocks even tighter if possible
-        const size_t prevMoveCount = m_Moves.size();
+        const size_t prevMoveCount = plan.moves.size();
         for (size_t i = 0; i < vector.GetBlockCount(); ++i)
         {
-            if (ReallocWithinBlock(vector, vector.GetBlock(i)))
+            if (ReallocWithinBlock(plan, vector, vector.GetBlock(i)))
                 return true;
         }
 
-        if (prevMoveCount == m_Moves.size())
+        if (prevMoveCount == plan.moves.size())
             vectorState.operation = StateExtensive::Operation::Done;
     }
     return false;
 }
 
-void VmaDefragmentationContext_T::UpdateVectorStatistics(VmaBlockVector& vector, StateBalanced& state)
-{
-    size_t allocCount = 0;
-    size_t freeCount = 0;
-    state.avgFreeSize = 0;
-    state.avgAllocSize = 0;
-
-    for (size_t i = 0; i < vector.GetBlockCount(); ++i)
-    {
-        VmaBlockMetadata* metadata = vector.GetBlock(i)->m_pMetadata;
-
-        allocCount += metadata->GetAllocationCount();
-        freeCount += metadata->GetFreeRegionsCount();
-        state.avgFreeSize += metadata->GetSumFreeSize();
-        state.avgAllocSize += metadata->GetSize();
-    }
-
-    state.avgAllocSize = (state.avgAllocSize - state.avgFreeSize) / allocCount;
-    state.avgFreeSize /= freeCount;
-}
-
-bool VmaDefragmentationContext_T::MoveDataToFreeBlocks(VmaSuballocationType currentType,
+bool VmaDefragmentationContext_T::MoveDataToFreeBlocks(PassPlan& plan, VmaSuballocationType currentType,
     VmaBlockVector& vector, size_t firstFreeBlock,
     bool& texturePresent, bool& bufferPresent, bool& otherPresent)
 {
-    const size_t prevMoveCount = m_Moves.size();
-    for (size_t i = firstFreeBlock ; i;)
+    const size_t prevMoveCount = plan.moves.size();
+    for (size_t i = GetFirstBlockToCheck(plan, vector, firstFreeBlock - 1) + 1; i;)
     {
         VmaDeviceMemoryBlock* block = vector.GetBlock(--i);
         VmaBlockMetadata* metadata = block->m_pMetadata;
 
-        for (VmaAllocHandle handle = metadata->GetAllocationListBegin();
+        for (VmaAllocHandle handle = GetFirstAllocationToCheck(plan, block);
             handle != VK_NULL_HANDLE;
             handle = metadata->GetNextAllocation(handle))
         {
-            MoveAllocationData moveData = GetMoveData(handle, metadata);
-            // Ignore newly created allocations by defragmentation algorithm
-            if (moveData.move.srcAllocation->GetUserData() == this)
+            MoveAllocationData moveData = GetMoveData(block, handle);
+            // Ignore newly created allocations by defragmentation algorithm and immovable ones
+            if (!IsMovable(moveData))
                 continue;
-            switch (CheckCounters(moveData.move.srcAllocation->GetSize()))
+            switch (CheckCounters(plan, block, handle, moveData.size))
             {
             case CounterStatus::Ignore:
                 continue;
@@ -13244,7 +16907,7 @@ bool VmaDefragmentationContext_T::MoveDataToFreeBlocks(VmaSuballocationType curr
             if (!VmaIsBufferImageGranularityConflict(moveData.type, currentType))
             {
                 // Try to fit allocation into free blocks
-                if (AllocInOtherBlock(firstFreeBlock, vector.GetBlockCount(), moveData, vector))
+                if (AllocInOtherBlock(plan, firstFreeBlock, vector.GetBlockCount(), moveData, vector))
                     return false;
             }
 
@@ -13256,7 +16919,395 @@ bool VmaDefragmentationContext_T::MoveDataToFreeBlocks(VmaSuballocationType curr
                 otherPresent = true;
         }
     }
-    return prevMoveCount == m_Moves.size();
+    return prevMoveCount == plan.moves.size();
+}
+
+VkResult VmaDefragmentationContext_T::ExecutePassOnHost(VmaAllocator hAllocator, const VmaDefragmentationPassMoveInfo& moveInfo)
+{
+    // Check all the moves first, so that nothing is copied if any of them cannot be.
+    for (uint32_t i = 0; i < moveInfo.moveCount; ++i)
+    {
+        const VmaDefragmentationMove& move = moveInfo.pMoves[i];
+        if (move.operation == VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY &&
+            ((hAllocator->m_MemProps.memoryTypes[move.srcAllocation->GetMemoryTypeIndex()].propertyFlags &
+                hAllocator->m_MemProps.memoryTypes[move.dstTmpAllocation->GetMemoryTypeIndex()].propertyFlags &
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0))
+        {
+            return VK_ERROR_FEATURE_NOT_PRESENT;
+        }
+    }
+
+    const VkAllocationCallbacks* allocationCallbacks = hAllocator->GetAllocationCallbacks();
+    const VmaStlAllocator<VmaAllocation> allocationAllocator(allocationCallbacks);
+    VmaVector<VmaAllocation, VmaStlAllocator<VmaAllocation>> srcAllocations(allocationAllocator);
+    VmaVector<VmaAllocation, VmaStlAllocator<VmaAllocation>> dstAllocations(allocationAllocator);
+    VmaHostCopyVector copies = VmaHostCopyVector(VmaStlAllocator<VmaHostCopy>(allocationCallbacks));
+
+    VkResult res = VK_SUCCESS;
+    for (uint32_t i = 0; i < moveInfo.moveCount; ++i)
+    {
+        const VmaDefragmentationMove& move = moveInfo.pMoves[i];
+        if (move.operation != VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY)
+            continue;
+
+        void* srcData = VMA_NULL;
+        res = MapForHostCopy(hAllocator, move.srcAllocation, &srcData);
+        if (res != VK_SUCCESS)
+            break;
+        void* dstData = VMA_NULL;
+        res = MapForHostCopy(hAllocator, move.dstTmpAllocation, &dstData);
+        if (res != VK_SUCCESS)
+        {
+            UnmapAfterHostCopy(hAllocator, move.srcAllocation);
+            break;
+        }
+        srcAllocations.push_back(move.srcAllocation);
+        dstAllocations.push_back(move.dstTmpAllocation);
+        copies.push_back({ (const char*)srcData, (char*)dstData, (size_t)move.srcAllocation->GetSize(),
+            hAllocator->m_MemProps.memoryTypes[move.dstTmpAllocation->GetMemoryTypeIndex()].propertyFlags, true });
+    }
+
+    if (res == VK_SUCCESS)
+    {
+        res = hAllocator->FlushOrInvalidateAllocations((uint32_t)srcAllocations.size(), srcAllocations.data(),
+            VMA_NULL, VMA_NULL, VMA_CACHE_INVALIDATE);
+    }
+    if (res == VK_SUCCESS)
+    {
+        VmaExecuteHostCopies(allocationCallbacks, copies, m_DispatchJobs, m_DispatchJobsUserData);
+        res = hAllocator->FlushOrInvalidateAllocations((uint32_t)dstAllocations.size(), dstAllocations.data(),
+            VMA_NULL, VMA_NULL, VMA_CACHE_FLUSH);
+    }
+
+    for (size_t i = 0; i < srcAllocations.size(); ++i)
+    {
+        UnmapAfterHostCopy(hAllocator, srcAllocations[i]);
+        UnmapAfterHostCopy(hAllocator, dstAllocations[i]);
+    }
+    return res;
+}
+
+VkResult VmaDefragmentationContext_T::MapForHostCopy(VmaAllocator hAllocator, VmaAllocation allocation, void** ppData)
+{
+    if (allocation->GetType() == VmaAllocation_T::ALLOCATION_TYPE_BLOCK)
+    {
+        void* pBlockData = VMA_NULL;
+        const VkResult res = allocation->GetBlock()->Map(hAllocator, 1, &pBlockData);
+        if (res == VK_SUCCESS)
+            *ppData = (char*)pBlockData + allocation->GetOffset();
+        return res;
+    }
+
+    // Dedicated memory mapped by the user must not be mapped again, the rest is mapped only for the time of the copy.
+    *ppData = allocation->GetMappedData();
+    if (*ppData != VMA_NULL)
+        return VK_SUCCESS;
+    return (*hAllocator->GetVulkanFunctions().vkMapMemory)(hAllocator->m_hDevice, allocation->GetMemory(), 0, VK_WHOLE_SIZE, 0, ppData);
+}
+
+void VmaDefragmentationContext_T::UnmapAfterHostCopy(VmaAllocator hAllocator, VmaAllocation allocation)
+{
+    if (allocation->GetType() == VmaAllocation_T::ALLOCATION_TYPE_BLOCK)
+        allocation->GetBlock()->Unmap(hAllocator, 1);
+    else if (allocation->GetMappedData() == VMA_NULL)
+        (*hAllocator->GetVulkanFunctions().vkUnmapMemory)(hAllocator->m_hDevice, allocation->GetMemory());
+}
+
+VkResult VmaDefragmentationContext_T::RecordPassCopies(VmaAllocator hAllocator,
+    const VmaDefragmentationPassMoveInfo& moveInfo, VkCommandBuffer commandBuffer)
+{
+    // Memory handles of freed blocks may be reused by new ones, so forget their buffers first.
+    ReleaseCopyBuffers(false);
+
+    const uint32_t memoryTypeBits = hAllocator->GetGpuDefragmentationMemoryTypeBits();
+    const VkAllocationCallbacks* allocationCallbacks = hAllocator->GetAllocationCallbacks();
+    CopyRegionVector regions = CopyRegionVector(VmaStlAllocator<VmaDefragmentationCopyRegion>(allocationCallbacks));
+
+    // Create all the buffers first, so that nothing is recorded if any of them cannot be.
+    VkResult result = VK_SUCCESS;
+    for (uint32_t i = 0; i < moveInfo.moveCount; ++i)
+    {
+        const VmaDefragmentationMove& move = moveInfo.pMoves[i];
+        if (move.operation != VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY)
+            continue;
+
+        // Content of images cannot be copied through buffers. Dedicated memory may have been allocated
+        // with VkMemoryDedicatedAllocateInfo for the user's resource, so no other buffer can be bound to it.
+        const VmaSuballocationType suballocType = move.srcAllocation->GetSuballocationType();
+        const uint32_t srcMemTypeIndex = move.srcAllocation->GetMemoryTypeIndex();
+        const uint32_t dstMemTypeIndex = move.dstTmpAllocation->GetMemoryTypeIndex();
+        if ((suballocType != VMA_SUBALLOCATION_TYPE_BUFFER && suballocType != VMA_SUBALLOCATION_TYPE_UNKNOWN) ||
+            move.srcAllocation->GetType() != VmaAllocation_T::ALLOCATION_TYPE_BLOCK ||
+            (memoryTypeBits & (1u << srcMemTypeIndex)) == 0 || (memoryTypeBits & (1u << dstMemTypeIndex)) == 0)
+        {
+            result = VK_INCOMPLETE;
+            continue;
+        }
+
+        VmaBlockVector& srcVector = m_PoolBlockVector != VMA_NULL ? *m_PoolBlockVector : *m_pBlockVectors[srcMemTypeIndex];
+        VmaBlockVector& dstVector = m_PoolBlockVector != VMA_NULL ? *m_PoolBlockVector : *m_pBlockVectors[dstMemTypeIndex];
+        VkResult res = CreateCopyBuffer(hAllocator, srcVector, move.srcAllocation);
+        if (res == VK_SUCCESS)
+            res = CreateCopyBuffer(hAllocator, dstVector, move.dstTmpAllocation);
+        if (res != VK_SUCCESS)
+            return res;
+
+        VmaDefragmentationCopyRegion region = {};
+        region.srcMemory = move.srcAllocation->GetMemory();
+        region.dstMemory = move.dstTmpAllocation->GetMemory();
+        region.srcOffset = move.srcAllocation->GetOffset();
+        region.dstOffset = move.dstTmpAllocation->GetOffset();
+        region.size = move.srcAllocation->GetSize();
+        regions.push_back(region);
+    }
+    MergeCopyRegions(regions);
+
+    // Record single copy for every pair of memory blocks.
+    const VmaStlAllocator<VkBufferCopy> copyAllocator(allocationCallbacks);
+    VmaVector<VkBufferCopy, VmaStlAllocator<VkBufferCopy>> copies(copyAllocator);
+    for (size_t i = 0; i < regions.size(); )
+    {
+        const VkDeviceMemory srcMemory = regions[i].srcMemory;
+        const VkDeviceMemory dstMemory = regions[i].dstMemory;
+        copies.clear();
+        for (; i < regions.size() && regions[i].srcMemory == srcMemory && regions[i].dstMemory == dstMemory; ++i)
+            copies.push_back({ regions[i].srcOffset, regions[i].dstOffset, regions[i].size });
+
+        (*hAllocator->GetVulkanFunctions().vkCmdCopyBuffer)(commandBuffer,
+            m_CopyBuffers[FindCopyBuffer(srcMemory)].buffer,
+            m_CopyBuffers[FindCopyBuffer(dstMemory)].buffer,
+            static_cast<uint32_t>(copies.size()), copies.data());
+    }
+    return result;
+}
+
+size_t VmaDefragmentationContext_T::FindCopyBuffer(VkDeviceMemory memory) const
+{
+    return VmaBinaryFindFirstNotLess(m_CopyBuffers.data(), m_CopyBuffers.data() + m_CopyBuffers.size(),
+        memory, CopyBufferMemoryLess()) - m_CopyBuffers.data();
+}
+
+VkResult VmaDefragmentationContext_T::CreateCopyBuffer(VmaAllocator hAllocator, VmaBlockVector& vector, VmaAllocation allocation)
+{
+    const VkDeviceMemory memory = allocation->GetMemory();
+    const size_t index = FindCopyBuffer(memory);
+    if (index < m_CopyBuffers.size() && m_CopyBuffers[index].memory == memory)
+        return VK_SUCCESS;
+
+    VMA_ASSERT(allocation->GetType() == VmaAllocation_T::ALLOCATION_TYPE_BLOCK);
+    VmaDeviceMemoryBlock* const block = allocation->GetBlock();
+    CopyBuffer copyBuffer = { memory, VK_NULL_HANDLE, &vector, block, block->GetId() };
+    VkBufferCreateInfo bufCreateInfo;
+    VmaFillGpuDefragmentationBufferCreateInfo(bufCreateInfo);
+    bufCreateInfo.size = block->m_pMetadata->GetSize();
+
+    VkResult res = (*hAllocator->GetVulkanFunctions().vkCreateBuffer)(
+        hAllocator->m_hDevice, &bufCreateInfo, hAllocator->GetAllocationCallbacks(), &copyBuffer.buffer);
+    if (res == VK_SUCCESS)
+    {
+        res = hAllocator->BindVulkanBuffer(memory, 0, copyBuffer.buffer, VMA_NULL);
+        if (res == VK_SUCCESS)
+            VmaVectorInsert(m_CopyBuffers, index, copyBuffer);
+        else
+            (*hAllocator->GetVulkanFunctions().vkDestroyBuffer)(hAllocator->m_hDevice, copyBuffer.buffer, hAllocator->GetAllocationCallbacks());
+    }
+    return res;
+}
+
+void VmaDefragmentationContext_T::ReleaseCopyBuffers(bool all)
+{
+    size_t keptCount = 0;
+    for (size_t i = 0; i < m_CopyBuffers.size(); ++i)
+    {
+        const CopyBuffer copyBuffer = m_CopyBuffers[i];
+        bool keep = false;
+        if (!all)
+        {
+            VmaMutexLockRead lock(copyBuffer.vector->GetMutex(), copyBuffer.vector->GetAllocator()->m_UseMutex);
+            for (size_t j = 0; j < copyBuffer.vector->GetBlockCount(); ++j)
+            {
+                if (copyBuffer.vector->GetBlock(j) == copyBuffer.block)
+                {
+                    keep = copyBuffer.block->GetId() == copyBuffer.blockId;
+                    break;
+                }
+            }
+        }
+
+        if (keep)
+            m_CopyBuffers[keptCount++] = copyBuffer;
+        else
+        {
+            const VmaAllocator hAllocator = copyBuffer.vector->GetAllocator();
+            (*hAllocator->GetVulkanFunctions().vkDestroyBuffer)(hAllocator->m_hDevice, copyBuffer.buffer, hAllocator->GetAllocationCallbacks());
+        }
+    }
+    m_CopyBuffers.resize(keptCount);
+}
+
+void VmaDefragmentationContext_T::Estimate(VmaAllocator hAllocator, const VmaDefragmentationInfo& info,
+    VmaDefragmentationEstimate& outEstimate)
+{
+    outEstimate = {};
+    if (info.pool != VMA_NULL)
+        EstimateVectorDefragmentation(info.pool->m_BlockVector, info, outEstimate);
+    else
+    {
+        for (uint32_t i = 0; i < hAllocator->GetMemoryTypeCount(); ++i)
+        {
+            if (hAllocator->m_pBlockVectors[i] != VMA_NULL)
+                EstimateVectorDefragmentation(*hAllocator->m_pBlockVectors[i], info, outEstimate);
+        }
+    }
+}
+
+VkDeviceSize VmaDefragmentationContext_T::GetAllocationAlignment(void* pUserData)
+{
+    return reinterpret_cast<VmaAllocation>(pUserData)->GetAlignment();
+}
+
+void VmaDefragmentationContext_T::EstimateVectorDefragmentation(VmaBlockVector& vector,
+    const VmaDefragmentationInfo& info, VmaDefragmentationEstimate& inoutEstimate)
+{
+    // Virtual copy of a block together with the number of its allocations the vector would see while freeing moved ones.
+    struct EstimatedBlock
+    {
+        VmaVirtualBlock_T* block;
+        size_t allocationCount;
+    };
+    const VkAllocationCallbacks* allocationCallbacks = vector.m_hAllocator->GetAllocationCallbacks();
+    VmaStlAllocator<VmaVirtualBlock_T*> blockAllocator(allocationCallbacks);
+    VmaVector<VmaVirtualBlock_T*, VmaStlAllocator<VmaVirtualBlock_T*>> blocks(blockAllocator);
+
+    // Copy current state of the blocks into virtual blocks, in the order the defragmentation would sort them,
+    // holding the lock only for the time of copying.
+    {
+        VmaMutexLockRead lock(vector.m_Mutex, vector.m_hAllocator->m_UseMutex);
+        const size_t blockCount = vector.GetBlockCount();
+        if (blockCount == 0)
+            return;
+        const VmaStlAllocator<VmaDeviceMemoryBlock*> memoryBlockAllocator(allocationCallbacks);
+        VmaVector<VmaDeviceMemoryBlock*, VmaStlAllocator<VmaDeviceMemoryBlock*>> memoryBlocks(blockCount, memoryBlockAllocator);
+        SortBlocksByMoveCost(vector, memoryBlocks.data());
+
+        const VmaStlAllocator<char> rangeAllocator(allocationCallbacks);
+        VmaVector<char, VmaStlAllocator<char>> ranges(rangeAllocator);
+        for (size_t i = 0; i < blockCount; ++i)
+        {
+            const VmaBlockMetadata* metadata = memoryBlocks[i]->m_pMetadata;
+            VmaVirtualBlockSnapshotHeader header = {};
+            header.size = metadata->GetSize();
+            header.allocationCount = metadata->GetAllocationCount();
+            header.rangeCount = metadata->GetSnapshotRangeCount();
+            ranges.resize((size_t)header.rangeCount * sizeof(VmaVirtualBlockSnapshotRange));
+            metadata->WriteSnapshot(header, ranges.data());
+
+            VmaVirtualBlockCreateInfo blockCreateInfo = {};
+            blockCreateInfo.size = header.size;
+            blockCreateInfo.pAllocationCallbacks = allocationCallbacks;
+            VmaVirtualBlock_T* const block = vma_new(allocationCallbacks, VmaVirtualBlock_T)(blockCreateInfo);
+            const bool read = block->ReadSnapshot(header, ranges.data(), VMA_NULL);
+            VMA_ASSERT(read && "Snapshot of a memory block is malformed!");
+            (void)read;
+            blocks.push_back(block);
+        }
+    }
+
+    // Blocks still present in the vector, in its order. Emptied ones are released the same way as VmaBlockVector::Free() does.
+    const VmaStlAllocator<EstimatedBlock> estimatedBlockAllocator(allocationCallbacks);
+    VmaVector<EstimatedBlock, VmaStlAllocator<EstimatedBlock>> vectorBlocks(blocks.size(), estimatedBlockAllocator);
+    for (size_t i = 0; i < blocks.size(); ++i)
+        vectorBlocks[i] = { blocks[i], 0 };
+    bool budgetExceeded = false;
+    {
+        VmaBudget heapBudget = {};
+        vector.m_hAllocator->GetHeapBudgets(&heapBudget, vector.m_hAllocator->MemoryTypeIndexToHeapIndex(vector.m_MemoryTypeIndex), 1);
+        budgetExceeded = heapBudget.usage >= heapBudget.budget;
+    }
+    const size_t maxEmptyBlockCount = vector.m_MaxEmptyBlockCount != 0 ? vector.m_MaxEmptyBlockCount : 1;
+
+    // Run the algorithm on the copies, keeping their order. Moves are always committed,
+    // so the passes finish as they would without user interaction.
+    VmaDefragmentationStats stats = {};
+    {
+        VmaVirtualDefragmentationInfo virtualInfo = {};
+        virtualInfo.flags = info.flags & VMA_DEFRAGMENTATION_FLAG_ALGORITHM_MASK;
+        virtualInfo.blockCount = (uint32_t)blocks.size();
+        virtualInfo.pBlocks = blocks.data();
+        virtualInfo.maxBytesPerPass = info.maxBytesPerPass;
+        virtualInfo.maxAllocationsPerPass = info.maxAllocationsPerPass;
+        VmaVirtualDefragmentationContext_T context(virtualInfo, GetAllocationAlignment, false);
+
+        VmaVirtualDefragmentationPassMoveInfo pass = {};
+        while (context.DefragmentPassBegin(pass) == VK_INCOMPLETE)
+        {
+            // Destinations are already reserved, sources are freed one by one at the end of the pass.
+            for (EstimatedBlock& vectorBlock : vectorBlocks)
+            {
+                VmaStatistics blockStats;
+                vectorBlock.block->GetStatistics(blockStats);
+                vectorBlock.allocationCount = blockStats.allocationCount;
+            }
+            for (uint32_t i = 0; i < pass.moveCount; ++i)
+            {
+                size_t emptyBlockCount = 0;
+                size_t srcIndex = SIZE_MAX;
+                for (size_t j = 0; j < vectorBlocks.size(); ++j)
+                {
+                    if (vectorBlocks[j].allocationCount == 0)
+                        ++emptyBlockCount;
+                    if (vectorBlocks[j].block == pass.pMoves[i].srcBlock)
+                        srcIndex = j;
+                }
+                VMA_ASSERT(srcIndex != SIZE_MAX);
+
+                size_t releasedIndex = SIZE_MAX;
+                const bool canDeleteBlock = vectorBlocks.size() > vector.m_MinBlockCount;
+                if (--vectorBlocks[srcIndex].allocationCount == 0)
+                {
+                    if ((emptyBlockCount >= maxEmptyBlockCount || budgetExceeded) && canDeleteBlock)
+                        releasedIndex = srcIndex;
+                }
+                else if (vector.m_MaxEmptyBlockCount == 0 && emptyBlockCount > 0 && canDeleteBlock &&
+                    vectorBlocks.back().allocationCount == 0)
+                    releasedIndex = vectorBlocks.size() - 1;
+
+                for (size_t j = vectorBlocks.size(); j-- > 0 && vectorBlocks.size() > vector.m_MinBlockCount; )
+                {
+                    if (j == releasedIndex ||
+                        (budgetExceeded && vector.m_MaxEmptyBlockCount != 0 && vectorBlocks[j].allocationCount == 0))
+                    {
+                        VmaStatistics blockStats;
+                        vectorBlocks[j].block->GetStatistics(blockStats);
+                        ++inoutEstimate.stats.deviceMemoryBlocksFreed;
+                        inoutEstimate.stats.bytesFreed += blockStats.blockBytes;
+                        VmaVectorRemove(vectorBlocks, j);
+                    }
+                }
+            }
+            if (context.DefragmentPassEnd(pass) != VK_INCOMPLETE)
+                break;
+        }
+        context.GetStats(stats);
+    }
+    inoutEstimate.stats.bytesMoved += stats.bytesMoved;
+    inoutEstimate.stats.allocationsMoved += stats.allocationsMoved;
+    inoutEstimate.stats.planningTime += stats.planningTime;
+
+    VkDeviceSize largestFreeRegionSize = 0;
+    for (const EstimatedBlock& vectorBlock : vectorBlocks)
+    {
+        VmaDetailedStatistics blockStats;
+        vectorBlock.block->CalculateDetailedStatistics(blockStats);
+        largestFreeRegionSize = VMA_MAX(largestFreeRegionSize, blockStats.unusedRangeSizeMax);
+    }
+    inoutEstimate.largestFreeRegionSize = VMA_MAX(inoutEstimate.largestFreeRegionSize, largestFreeRegionSize);
+
+    for (VmaVirtualBlock_T* block : blocks)
+    {
+        block->Clear();
+        vma_delete(allocationCallbacks, block);
+    }
 }
 #endif // _VMA_DEFRAGMENTATION_CONTEXT_FUNCTIONS
 
@@ -13265,7 +17316,12 @@ VmaPool_T::VmaPool_T(
     VmaAllocator hAllocator,
     const VmaPoolCreateInfo& createInfo,
     VkDeviceSize preferredBlockSize)
-    : m_BlockVector(
+    : m_SoftMemoryLimit(createInfo.softMemoryLimit != 0 ? createInfo.softMemoryLimit : VK_WHOLE_SIZE),
+    m_HardMemoryLimit(createInfo.hardMemoryLimit != 0 ? createInfo.hardMemoryLimit : VK_WHOLE_SIZE),
+    m_pfnSoftMemoryLimit(createInfo.pfnSoftMemoryLimit),
+    m_pSoftMemoryLimitUserData(createInfo.pSoftMemoryLimitUserData),
+    m_MemoryBytes(0),
+    m_BlockVector(
         hAllocator,
         this, // hParentPool
         createInfo.memoryTypeIndex,
@@ -13277,7 +17333,9 @@ VmaPool_T::VmaPool_T(
         createInfo.flags & VMA_POOL_CREATE_ALGORITHM_MASK, // algorithm
         createInfo.priority,
         VMA_MAX(hAllocator->GetMemoryTypeMinAlignment(createInfo.memoryTypeIndex), createInfo.minAllocationAlignment),
-        createInfo.pMemoryAllocateNext),
+        createInfo.pMemoryAllocateNext,
+        createInfo.maxEmptyBlockCount,
+        createInfo.emptyBlockReleaseFrameCount),
     m_Id(0),
     m_Name(VMA_NULL) {}
 
@@ -13300,7 +17358,34 @@ void VmaPool_T::SetName(const char* pName)
     }
     else
     {
-        m_Name = VMA_NULL;
+        m_Name = VMA_NULL;
+    }
+}
+
+bool VmaPool_T::ReserveMemory(VkDeviceSize size, VkDeviceSize& outPrevMemoryBytes)
+{
+    VkDeviceSize memoryBytes = m_MemoryBytes.load();
+    for (;;)
+    {
+        if (size > m_HardMemoryLimit - memoryBytes)
+        {
+            return false;
+        }
+        if (m_MemoryBytes.compare_exchange_weak(memoryBytes, memoryBytes + size))
+        {
+            outPrevMemoryBytes = memoryBytes;
+            return true;
+        }
+    }
+}
+
+void VmaPool_T::OnMemoryAllocated(VkDeviceSize prevMemoryBytes, VkDeviceSize size)
+{
+    // Each reservation covers its own range of bytes, so only the one crossing the limit calls the callback.
+    if (m_pfnSoftMemoryLimit != VMA_NULL &&
+        prevMemoryBytes <= m_SoftMemoryLimit && size > m_SoftMemoryLimit - prevMemoryBytes)
+    {
+        (*m_pfnSoftMemoryLimit)(m_BlockVector.GetAllocator(), this, prevMemoryBytes + size, m_pSoftMemoryLimitUserData);
     }
 }
 #endif // _VMA_POOL_T_FUNCTIONS
@@ -13318,6 +17403,7 @@ VmaAllocator_T::VmaAllocator_T(const VmaAllocatorCreateInfo* pCreateInfo) :
     m_UseKhrMaintenance4((pCreateInfo->flags & VMA_ALLOCATOR_CREATE_KHR_MAINTENANCE4_BIT) != 0),
     m_UseKhrMaintenance5((pCreateInfo->flags & VMA_ALLOCATOR_CREATE_KHR_MAINTENANCE5_BIT) != 0),
     m_UseKhrExternalMemoryWin32((pCreateInfo->flags & VMA_ALLOCATOR_CREATE_KHR_EXTERNAL_MEMORY_WIN32_BIT) != 0),
+    m_UseExtPageableDeviceLocalMemory((pCreateInfo->flags & VMA_ALLOCATOR_CREATE_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_BIT) != 0),
     m_hDevice(pCreateInfo->device),
     m_hInstance(pCreateInfo->instance),
     m_AllocationCallbacksSpecified(pCreateInfo->pAllocationCallbacks != VMA_NULL),
@@ -13329,7 +17415,11 @@ VmaAllocator_T::VmaAllocator_T(const VmaAllocatorCreateInfo* pCreateInfo) :
     m_PreferredLargeHeapBlockSize(0),
     m_PhysicalDevice(pCreateInfo->physicalDevice),
     m_GpuDefragmentationMemoryTypeBits(UINT32_MAX),
+    m_LastPriorityUpdateFrameIndex(0),
+    m_NextDefragmentationId(0),
     m_NextPoolId(0),
+    m_DirtyRanges(VmaStlAllocator<VkMappedMemoryRange>(GetAllocationCallbacks())),
+    m_StaleRanges(VmaStlAllocator<VkMappedMemoryRange>(GetAllocationCallbacks())),
     m_GlobalMemoryTypeBits(UINT32_MAX)
 {
     if(m_VulkanApiVersion >= VK_MAKE_VERSION(1, 1, 0))
@@ -13416,8 +17506,18 @@ VmaAllocator_T::VmaAllocator_T(const VmaAllocatorCreateInfo* pCreateInfo) :
         VMA_ASSERT(0 && "VMA_ALLOCATOR_CREATE_KHR_EXTERNAL_MEMORY_WIN32_BIT is set but required extension is not available in your Vulkan header or its support in VMA has been disabled by a preprocessor macro.");
     }
 #endif
+#if !(VMA_PAGEABLE_DEVICE_LOCAL_MEMORY)
+    if(m_UseExtPageableDeviceLocalMemory)
+    {
+        VMA_ASSERT(0 && "VMA_ALLOCATOR_CREATE_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_BIT is set but required extension is not available in your Vulkan header or its support in VMA has been disabled by a preprocessor macro.");
+    }
+#endif
+    VMA_ASSERT((!m_UseExtPageableDeviceLocalMemory || m_UseExtMemoryPriority) &&
+        "VMA_ALLOCATOR_CREATE_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_BIT requires VMA_ALLOCATOR_CREATE_EXT_MEMORY_PRIORITY_BIT.");
 
     memset(&m_DeviceMemoryCallbacks, 0 ,sizeof(m_DeviceMemoryCallbacks));
+    memset(&m_DefragmentationMonitor, 0, sizeof(m_DefragmentationMonitor));
+    memset(&m_MemoryPressureMonitor, 0, sizeof(m_MemoryPressureMonitor));
     memset(&m_PhysicalDeviceProperties, 0, sizeof(m_PhysicalDeviceProperties));
     memset(&m_MemProps, 0, sizeof(m_MemProps));
 
@@ -13434,6 +17534,20 @@ VmaAllocator_T::VmaAllocator_T(const VmaAllocatorCreateInfo* pCreateInfo) :
         m_DeviceMemoryCallbacks.pfnAllocate = pCreateInfo->pDeviceMemoryCallbacks->pfnAllocate;
         m_DeviceMemoryCallbacks.pfnFree = pCreateInfo->pDeviceMemoryCallbacks->pfnFree;
     }
+    if(pCreateInfo->pDefragmentationMonitor != VMA_NULL)
+    {
+        VMA_ASSERT(pCreateInfo->pDefragmentationMonitor->pfnProposal != VMA_NULL);
+        VMA_ASSERT(pCreateInfo->pDefragmentationMonitor->fragmentationThreshold >= 0.f &&
+            pCreateInfo->pDefragmentationMonitor->fragmentationThreshold <= 1.f);
+        m_DefragmentationMonitor = *pCreateInfo->pDefragmentationMonitor;
+    }
+    if(pCreateInfo->pMemoryPressureMonitor != VMA_NULL)
+    {
+        VMA_ASSERT(pCreateInfo->pMemoryPressureMonitor->pfnPressure != VMA_NULL);
+        VMA_ASSERT(pCreateInfo->pMemoryPressureMonitor->highWatermark > 0.f &&
+            pCreateInfo->pMemoryPressureMonitor->lowWatermark <= pCreateInfo->pMemoryPressureMonitor->highWatermark);
+        m_MemoryPressureMonitor = *pCreateInfo->pMemoryPressureMonitor;
+    }
 
     ImportVulkanFunctions(pCreateInfo->pVulkanFunctions);
 
@@ -13519,7 +17633,9 @@ VmaAllocator_T::VmaAllocator_T(const VmaAllocatorCreateInfo* pCreateInfo) :
                 0, // algorithm
                 0.5F, // priority (0.5 is the default per Vulkan spec)
                 GetMemoryTypeMinAlignment(memTypeIndex), // minAllocationAlignment
-                VMA_NULL); // // pMemoryAllocateNext
+                VMA_NULL, // // pMemoryAllocateNext
+                0, // maxEmptyBlockCount
+                0); // emptyBlockReleaseFrameCount
             // No need to call m_pBlockVectors[memTypeIndex][blockVectorTypeIndex]->CreateMinBlocks here,
             // because minBlockCount is 0.
         }
@@ -13672,6 +17788,9 @@ void VmaAllocator_T::ImportVulkanFunctions_Custom(const VmaVulkanFunctions* pVul
 #if VMA_EXTERNAL_MEMORY_WIN32
     VMA_COPY_IF_NOT_NULL(vkGetMemoryWin32HandleKHR);
 #endif
+#if VMA_PAGEABLE_DEVICE_LOCAL_MEMORY
+    VMA_COPY_IF_NOT_NULL(vkSetDeviceMemoryPriorityEXT);
+#endif
 #undef VMA_COPY_IF_NOT_NULL
 }
 
@@ -13776,6 +17895,12 @@ void VmaAllocator_T::ImportVulkanFunctions_Dynamic()
         VMA_FETCH_DEVICE_FUNC(vkGetMemoryWin32HandleKHR, PFN_vkGetMemoryWin32HandleKHR, "vkGetMemoryWin32HandleKHR");
     }
 #endif
+#if VMA_PAGEABLE_DEVICE_LOCAL_MEMORY
+    if (m_UseExtPageableDeviceLocalMemory)
+    {
+        VMA_FETCH_DEVICE_FUNC(vkSetDeviceMemoryPriorityEXT, PFN_vkSetDeviceMemoryPriorityEXT, "vkSetDeviceMemoryPriorityEXT");
+    }
+#endif
 #undef VMA_FETCH_DEVICE_FUNC
 #undef VMA_FETCH_INSTANCE_FUNC
 }
@@ -13833,6 +17958,13 @@ void VmaAllocator_T::ValidateVulkanFunctions() const
     }
 #endif
 
+#if VMA_PAGEABLE_DEVICE_LOCAL_MEMORY
+    if (m_UseExtPageableDeviceLocalMemory)
+    {
+        VMA_ASSERT(m_VulkanFunctions.vkSetDeviceMemoryPriorityEXT != VMA_NULL);
+    }
+#endif
+
     // Not validating these due to suspected driver bugs with these function
     // pointers being null despite correct extension or Vulkan version is enabled.
     // See issue #397. Their usage in VMA is optional anyway.
@@ -13849,6 +17981,20 @@ VkDeviceSize VmaAllocator_T::CalcPreferredBlockSize(uint32_t memTypeIndex)
     return VmaAlignUp(isSmallHeap ? (heapSize / 8) : m_PreferredLargeHeapBlockSize, (VkDeviceSize)32);
 }
 
+void VmaAllocator_T::SetMoveHints(const VmaAllocationCreateInfo& createInfo, size_t allocationCount, VmaAllocation* pAllocations)
+{
+    const bool immovable = (createInfo.flags & VMA_ALLOCATION_CREATE_IMMOVABLE_BIT) != 0;
+    for(size_t i = 0; i < allocationCount; ++i)
+    {
+        pAllocations[i]->SetImmovable(immovable);
+        pAllocations[i]->SetMoveCost(createInfo.moveCost);
+        // Block allocations got their priority hints in VmaBlockVector::CommitAllocationRequest.
+        // Dedicated ones keep them for the case they get promoted into a block by defragmentation.
+        if(pAllocations[i]->GetType() == VmaAllocation_T::ALLOCATION_TYPE_DEDICATED)
+            pAllocations[i]->SetPriorityHint(createInfo.flags);
+    }
+}
+
 VkResult VmaAllocator_T::AllocateMemoryOfType(
     VmaPool pool,
     VkDeviceSize size,
@@ -13901,6 +18047,7 @@ VkResult VmaAllocator_T::AllocateMemoryOfType(
             (finalCreateInfo.flags & VMA_ALLOCATION_CREATE_CAN_ALIAS_BIT) != 0,
             finalCreateInfo.pUserData,
             finalCreateInfo.priority,
+            0, // blockAlignment
             dedicatedBuffer,
             dedicatedImage,
             dedicatedBufferImageUsage,
@@ -13944,6 +18091,7 @@ VkResult VmaAllocator_T::AllocateMemoryOfType(
                 (finalCreateInfo.flags & VMA_ALLOCATION_CREATE_CAN_ALIAS_BIT) != 0,
                 finalCreateInfo.pUserData,
                 finalCreateInfo.priority,
+                0, // blockAlignment
                 dedicatedBuffer,
                 dedicatedImage,
                 dedicatedBufferImageUsage,
@@ -13985,6 +18133,7 @@ VkResult VmaAllocator_T::AllocateMemoryOfType(
             (finalCreateInfo.flags & VMA_ALLOCATION_CREATE_CAN_ALIAS_BIT) != 0,
             finalCreateInfo.pUserData,
             finalCreateInfo.priority,
+            VMA_MAX(alignment, (VkDeviceSize)1), // blockAlignment
             dedicatedBuffer,
             dedicatedImage,
             dedicatedBufferImageUsage,
@@ -14016,6 +18165,7 @@ VkResult VmaAllocator_T::AllocateDedicatedMemory(
     bool canAliasMemory,
     void* pUserData,
     float priority,
+    VkDeviceSize blockAlignment,
     VkBuffer dedicatedBuffer,
     VkImage dedicatedImage,
     VmaBufferImageUsage dedicatedBufferImageUsage,
@@ -14107,6 +18257,7 @@ VkResult VmaAllocator_T::AllocateDedicatedMemory(
             isUserDataString,
             isMappingAllowed,
             pUserData,
+            blockAlignment,
             pAllocations + allocIndex);
         if(res != VK_SUCCESS)
         {
@@ -14140,7 +18291,7 @@ VkResult VmaAllocator_T::AllocateDedicatedMemory(
             }
             */
 
-            FreeVulkanMemory(memTypeIndex, currAlloc->GetSize(), hMemory);
+            FreeVulkanMemory(memTypeIndex, pool, currAlloc->GetSize(), hMemory);
             m_Budget.RemoveAllocation(MemoryTypeIndexToHeapIndex(memTypeIndex), currAlloc->GetSize());
             m_AllocationObjectAllocator.Free(currAlloc);
         }
@@ -14161,10 +18312,11 @@ VkResult VmaAllocator_T::AllocateDedicatedMemoryPage(
     bool isUserDataString,
     bool isMappingAllowed,
     void* pUserData,
+    VkDeviceSize blockAlignment,
     VmaAllocation* pAllocation)
 {
     VkDeviceMemory hMemory = VK_NULL_HANDLE;
-    VkResult res = AllocateVulkanMemory(&allocInfo, &hMemory);
+    VkResult res = AllocateVulkanMemory(&allocInfo, pool, &hMemory);
     if(res < 0)
     {
         VMA_DEBUG_LOG("    vkAllocateMemory FAILED");
@@ -14184,13 +18336,13 @@ VkResult VmaAllocator_T::AllocateDedicatedMemoryPage(
         if(res < 0)
         {
             VMA_DEBUG_LOG("    vkMapMemory FAILED");
-            FreeVulkanMemory(memTypeIndex, size, hMemory);
+            FreeVulkanMemory(memTypeIndex, pool, size, hMemory);
             return res;
         }
     }
 
     *pAllocation = m_AllocationObjectAllocator.Allocate(isMappingAllowed);
-    (*pAllocation)->InitDedicatedAllocation(this, pool, memTypeIndex, hMemory, suballocType, pMappedData, size);
+    (*pAllocation)->InitDedicatedAllocation(this, pool, memTypeIndex, hMemory, suballocType, pMappedData, size, blockAlignment);
     if (isUserDataString)
         (*pAllocation)->SetName(this, (const char*)pUserData);
     else
@@ -14326,6 +18478,40 @@ VkResult VmaAllocator_T::FindMemoryTypeIndex(
     return (*pMemoryTypeIndex != UINT32_MAX) ? VK_SUCCESS : VK_ERROR_FEATURE_NOT_PRESENT;
 }
 
+uint32_t VmaAllocator_T::CalcAcceptableMemoryTypeBits(
+    uint32_t memoryTypeBits,
+    const VmaAllocationCreateInfo& createInfo,
+    VmaBufferImageUsage bufImgUsage) const
+{
+    memoryTypeBits &= GetGlobalMemoryTypeBits();
+
+    if(createInfo.memoryTypeBits != 0)
+    {
+        memoryTypeBits &= createInfo.memoryTypeBits;
+    }
+
+    VkMemoryPropertyFlags requiredFlags = 0;
+    VkMemoryPropertyFlags preferredFlags = 0;
+    VkMemoryPropertyFlags notPreferredFlags = 0;
+    if(!FindMemoryPreferences(
+        IsIntegratedGpu(),
+        createInfo,
+        bufImgUsage,
+        requiredFlags, preferredFlags, notPreferredFlags))
+    {
+        return 0;
+    }
+
+    for(uint32_t memTypeIndex = 0; memTypeIndex < GetMemoryTypeCount(); ++memTypeIndex)
+    {
+        if((requiredFlags & ~m_MemProps.memoryTypes[memTypeIndex].propertyFlags) != 0)
+        {
+            memoryTypeBits &= ~(1U << memTypeIndex);
+        }
+    }
+    return memoryTypeBits;
+}
+
 VkResult VmaAllocator_T::CalcMemTypeParams(
     VmaAllocationCreateInfo& inoutCreateInfo,
     uint32_t memTypeIndex,
@@ -14621,7 +18807,7 @@ VkResult VmaAllocator_T::AllocateMemory(
     if(createInfoFinal.pool != VK_NULL_HANDLE)
     {
         VmaBlockVector& blockVector = createInfoFinal.pool->m_BlockVector;
-        return AllocateMemoryOfType(
+        res = AllocateMemoryOfType(
             createInfoFinal.pool,
             vkMemReq.size,
             vkMemReq.alignment,
@@ -14637,6 +18823,9 @@ VkResult VmaAllocator_T::AllocateMemory(
             blockVector,
             allocationCount,
             pAllocations);
+        if(res == VK_SUCCESS)
+            SetMoveHints(createInfoFinal, allocationCount, pAllocations);
+        return res;
     }
 
     // Bit mask of memory Vulkan types acceptable for this allocation.
@@ -14646,6 +18835,8 @@ VkResult VmaAllocator_T::AllocateMemory(
     // Can't find any single memory type matching requirements. res is VK_ERROR_FEATURE_NOT_PRESENT.
     if(res != VK_SUCCESS)
         return res;
+    // Evictable allocations are moved back to it by residency management, even if they fall back to another one now.
+    const uint32_t preferredMemTypeIndex = memTypeIndex;
     
     do
     {
@@ -14669,7 +18860,18 @@ VkResult VmaAllocator_T::AllocateMemory(
             pAllocations);
         // Allocation succeeded
         if(res == VK_SUCCESS)
+        {
+            SetMoveHints(createInfoFinal, allocationCount, pAllocations);
+            if((createInfoFinal.flags & VMA_ALLOCATION_CREATE_EVICTABLE_BIT) != 0)
+            {
+                // Residency management moves the allocation only between memory types it could be created in.
+                const uint32_t residencyMemoryTypeBits = CalcAcceptableMemoryTypeBits(
+                    vkMemReq.memoryTypeBits, createInfoFinal, dedicatedBufferImageUsage);
+                for(size_t i = 0; i < allocationCount; ++i)
+                    pAllocations[i]->SetResidency(residencyMemoryTypeBits, preferredMemTypeIndex);
+            }
             return VK_SUCCESS;
+        }
 
         // Remove old memTypeIndex from list of possibilities.
         memoryTypeBits &= ~(1U << memTypeIndex);
@@ -14784,7 +18986,7 @@ void VmaAllocator_T::GetHeapBudgets(VmaBudget* outBudgets, uint32_t firstHeap, u
 #if VMA_MEMORY_BUDGET
     if(m_UseExtMemoryBudget)
     {
-        if(m_Budget.m_OperationsSinceBudgetFetch < 30)
+        if(m_Budget.GetOperationsSinceBudgetFetch() < 30)
         {
             VmaMutexLockRead lockRead(m_Budget.m_BudgetMutex, m_UseMutex);
             for(uint32_t i = 0; i < heapCount; ++i, ++outBudgets)
@@ -14792,9 +18994,9 @@ void VmaAllocator_T::GetHeapBudgets(VmaBudget* outBudgets, uint32_t firstHeap, u
                 const uint32_t heapIndex = firstHeap + i;
 
                 outBudgets->statistics.blockCount = m_Budget.m_BlockCount[heapIndex];
-                outBudgets->statistics.allocationCount = m_Budget.m_AllocationCount[heapIndex];
+                outBudgets->statistics.allocationCount = m_Budget.GetAllocationCount(heapIndex);
                 outBudgets->statistics.blockBytes = m_Budget.m_BlockBytes[heapIndex];
-                outBudgets->statistics.allocationBytes = m_Budget.m_AllocationBytes[heapIndex];
+                outBudgets->statistics.allocationBytes = m_Budget.GetAllocationBytes(heapIndex);
 
                 if(m_Budget.m_VulkanUsage[heapIndex] + outBudgets->statistics.blockBytes > m_Budget.m_BlockBytesAtBudgetFetch[heapIndex])
                 {
@@ -14825,9 +19027,9 @@ void VmaAllocator_T::GetHeapBudgets(VmaBudget* outBudgets, uint32_t firstHeap, u
             const uint32_t heapIndex = firstHeap + i;
 
             outBudgets->statistics.blockCount = m_Budget.m_BlockCount[heapIndex];
-            outBudgets->statistics.allocationCount = m_Budget.m_AllocationCount[heapIndex];
+            outBudgets->statistics.allocationCount = m_Budget.GetAllocationCount(heapIndex);
             outBudgets->statistics.blockBytes = m_Budget.m_BlockBytes[heapIndex];
-            outBudgets->statistics.allocationBytes = m_Budget.m_AllocationBytes[heapIndex];
+            outBudgets->statistics.allocationBytes = m_Budget.GetAllocationBytes(heapIndex);
 
             outBudgets->usage = outBudgets->statistics.blockBytes;
             outBudgets->budget = m_MemProps.memoryHeaps[heapIndex].size * 8 / 10; // 80% heuristics.
@@ -14953,6 +19155,165 @@ void VmaAllocator_T::SetCurrentFrameIndex(uint32_t frameIndex)
         UpdateVulkanBudget();
     }
 #endif // #if VMA_MEMORY_BUDGET
+
+#if VMA_PAGEABLE_DEVICE_LOCAL_MEMORY
+    // Unsigned difference also works after the frame index wraps around.
+    if(m_UseExtPageableDeviceLocalMemory &&
+        frameIndex - m_LastPriorityUpdateFrameIndex.load() >= VMA_MEMORY_PRIORITY_UPDATE_FRAME_COUNT)
+    {
+        m_LastPriorityUpdateFrameIndex.store(frameIndex);
+        UpdateMemoryPriorities(frameIndex);
+    }
+#endif // #if VMA_PAGEABLE_DEVICE_LOCAL_MEMORY
+
+    // Free empty blocks of custom pools that stayed unused for long enough.
+    {
+        VmaMutexLockRead lock(m_PoolsMutex, m_UseMutex);
+        for(VmaPool pool = m_Pools.Front(); pool != VMA_NULL; pool = m_Pools.GetNext(pool))
+        {
+            if(pool->m_BlockVector.IsIdleBlockReleaseEnabled())
+            {
+                pool->m_BlockVector.ReleaseIdleEmptyBlocks(frameIndex);
+            }
+        }
+    }
+
+    if(m_DefragmentationMonitor.pfnProposal != VMA_NULL)
+    {
+        ProposeDefragmentation();
+    }
+}
+
+bool VmaAllocator_T::NeedsDefragmentation(VmaBlockVector& blockVector, VmaFragmentationInfo& outInfo) const
+{
+    blockVector.GetFragmentationInfo(outInfo);
+    return outInfo.fragmentation > m_DefragmentationMonitor.fragmentationThreshold &&
+        outInfo.freeSize - outInfo.largestFreeRegionsSize >= m_DefragmentationMonitor.minFragmentedSize;
+}
+
+void VmaAllocator_T::UpdateMemoryPriorities(uint32_t frameIndex)
+{
+    for(uint32_t memTypeIndex = 0; memTypeIndex < GetMemoryTypeCount(); ++memTypeIndex)
+    {
+        VmaBlockVector* const pBlockVector = m_pBlockVectors[memTypeIndex];
+        if(pBlockVector != VMA_NULL &&
+            (m_MemProps.memoryTypes[memTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0)
+        {
+            pBlockVector->UpdatePriorities(frameIndex);
+        }
+    }
+
+    VmaMutexLockRead lock(m_PoolsMutex, m_UseMutex);
+    for(VmaPool pool = m_Pools.Front(); pool != VMA_NULL; pool = m_Pools.GetNext(pool))
+    {
+        const uint32_t memTypeIndex = pool->m_BlockVector.GetMemoryTypeIndex();
+        if((m_MemProps.memoryTypes[memTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0)
+        {
+            pool->m_BlockVector.UpdatePriorities(frameIndex);
+        }
+    }
+}
+
+void VmaAllocator_T::ProposeDefragmentation()
+{
+    // Process default pools. Their defragmentation covers all memory types, so propose it once, for the most fragmented one.
+    uint32_t proposedMemTypeIndex = UINT32_MAX;
+    VmaFragmentationInfo proposedInfo = {};
+    for(uint32_t memTypeIndex = 0; memTypeIndex < GetMemoryTypeCount(); ++memTypeIndex)
+    {
+        VmaBlockVector* const pBlockVector = m_pBlockVectors[memTypeIndex];
+        VmaFragmentationInfo info;
+        if(pBlockVector != VMA_NULL && NeedsDefragmentation(*pBlockVector, info) &&
+            (proposedMemTypeIndex == UINT32_MAX || info.fragmentation > proposedInfo.fragmentation))
+        {
+            proposedMemTypeIndex = memTypeIndex;
+            proposedInfo = info;
+        }
+    }
+    if(proposedMemTypeIndex != UINT32_MAX)
+    {
+        m_DefragmentationMonitor.pfnProposal(this, VMA_NULL, proposedMemTypeIndex, &proposedInfo, m_DefragmentationMonitor.pUserData);
+    }
+
+    // Process custom pools. The callback may create or destroy pools, so it's called after m_PoolsMutex is released.
+    struct PoolProposal
+    {
+        VmaPool pool;
+        uint32_t poolId;
+        VmaFragmentationInfo info;
+    };
+    typedef VmaStlAllocator<PoolProposal> PoolProposalAllocator;
+    VmaSmallVector<PoolProposal, PoolProposalAllocator, 16> proposals =
+        VmaSmallVector<PoolProposal, PoolProposalAllocator, 16>(PoolProposalAllocator(GetAllocationCallbacks()));
+    {
+        VmaMutexLockRead lock(m_PoolsMutex, m_UseMutex);
+        for(VmaPool pool = m_Pools.Front(); pool != VMA_NULL; pool = m_Pools.GetNext(pool))
+        {
+            PoolProposal proposal = { pool, pool->GetId(), {} };
+            if(pool->m_BlockVector.IsFragmentationTracked() && NeedsDefragmentation(pool->m_BlockVector, proposal.info))
+            {
+                proposals.push_back(proposal);
+            }
+        }
+    }
+    for(size_t i = 0; i < proposals.size(); ++i)
+    {
+        // Skip pools destroyed by previous calls. Another pool may have been created at the same address, but not with the same id.
+        const PoolProposal& proposal = proposals[i];
+        uint32_t memTypeIndex = UINT32_MAX;
+        {
+            VmaMutexLockRead lock(m_PoolsMutex, m_UseMutex);
+            for(VmaPool pool = m_Pools.Front(); pool != VMA_NULL; pool = m_Pools.GetNext(pool))
+            {
+                if(pool == proposal.pool && pool->GetId() == proposal.poolId)
+                {
+                    memTypeIndex = pool->m_BlockVector.GetMemoryTypeIndex();
+                    break;
+                }
+            }
+        }
+        if(memTypeIndex != UINT32_MAX)
+        {
+            m_DefragmentationMonitor.pfnProposal(this, proposal.pool, memTypeIndex, &proposal.info, m_DefragmentationMonitor.pUserData);
+        }
+    }
+}
+
+void VmaAllocator_T::CheckMemoryPressure()
+{
+    /*
+    Only the thread that brings the number of requests from 0 evaluates the watermarks and calls the callback.
+    Requests made meanwhile by other threads, or by the callback itself allocating or freeing memory,
+    make it evaluate again with the budget read after them, until no requests are left.
+    This way transitions are reported exactly once and in order, and the final state agrees with the usage.
+    */
+    uint32_t requestCount = 1;
+    if(m_Budget.m_PressureCheckRequests.fetch_add(requestCount) != 0)
+    {
+        return;
+    }
+    do
+    {
+        VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+        GetHeapBudgets(budgets, 0, GetMemoryHeapCount());
+        for(uint32_t heapIndex = 0; heapIndex < GetMemoryHeapCount(); ++heapIndex)
+        {
+            const VmaBudget& budget = budgets[heapIndex];
+            const uint32_t heapBit = 1U << heapIndex;
+            const bool underPressure = (m_Budget.m_PressureHeapMask & heapBit) != 0;
+            if(!underPressure && (double)budget.usage >= (double)budget.budget * m_MemoryPressureMonitor.highWatermark)
+            {
+                m_Budget.m_PressureHeapMask |= heapBit;
+                (*m_MemoryPressureMonitor.pfnPressure)(this, heapIndex, VK_TRUE, budget.usage, budget.budget, m_MemoryPressureMonitor.pUserData);
+            }
+            else if(underPressure && (double)budget.usage < (double)budget.budget * m_MemoryPressureMonitor.lowWatermark)
+            {
+                m_Budget.m_PressureHeapMask &= ~heapBit;
+                (*m_MemoryPressureMonitor.pfnPressure)(this, heapIndex, VK_FALSE, budget.usage, budget.budget, m_MemoryPressureMonitor.pUserData);
+            }
+        }
+        requestCount = m_Budget.m_PressureCheckRequests.fetch_sub(requestCount) - requestCount;
+    } while(requestCount != 0);
 }
 
 VkResult VmaAllocator_T::CheckPoolCorruption(VmaPool hPool)
@@ -15009,7 +19370,7 @@ VkResult VmaAllocator_T::CheckCorruption(uint32_t memoryTypeBits)
     return finalRes;
 }
 
-VkResult VmaAllocator_T::AllocateVulkanMemory(const VkMemoryAllocateInfo* pAllocateInfo, VkDeviceMemory* pMemory)
+VkResult VmaAllocator_T::AllocateVulkanMemory(const VkMemoryAllocateInfo* pAllocateInfo, VmaPool hPool, VkDeviceMemory* pMemory)
 {
     const uint32_t heapIndex = MemoryTypeIndexToHeapIndex(pAllocateInfo->memoryTypeIndex);
 
@@ -15029,6 +19390,13 @@ VkResult VmaAllocator_T::AllocateVulkanMemory(const VkMemoryAllocateInfo* pAlloc
     }
 #endif
 
+    // Memory limits of custom pool.
+    VkDeviceSize prevPoolMemoryBytes = 0;
+    if(hPool != VK_NULL_HANDLE && !hPool->ReserveMemory(pAllocateInfo->allocationSize, prevPoolMemoryBytes))
+    {
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
     // HeapSizeLimit is in effect for this heap.
     if((m_HeapSizeLimitMask & (1U << heapIndex)) != 0)
     {
@@ -15039,6 +19407,10 @@ VkResult VmaAllocator_T::AllocateVulkanMemory(const VkMemoryAllocateInfo* pAlloc
             const VkDeviceSize blockBytesAfterAllocation = blockBytes + pAllocateInfo->allocationSize;
             if(blockBytesAfterAllocation > heapSize)
             {
+                if(hPool != VK_NULL_HANDLE)
+                {
+                    hPool->ReleaseMemory(pAllocateInfo->allocationSize);
+                }
                 return VK_ERROR_OUT_OF_DEVICE_MEMORY;
             }
             if(m_Budget.m_BlockBytes[heapIndex].compare_exchange_strong(blockBytes, blockBytesAfterAllocation))
@@ -15059,7 +19431,7 @@ VkResult VmaAllocator_T::AllocateVulkanMemory(const VkMemoryAllocateInfo* pAlloc
     if(res == VK_SUCCESS)
     {
 #if VMA_MEMORY_BUDGET
-        ++m_Budget.m_OperationsSinceBudgetFetch;
+        m_Budget.AddOperation();
 #endif
 
         // Informative callback.
@@ -15067,6 +19439,14 @@ VkResult VmaAllocator_T::AllocateVulkanMemory(const VkMemoryAllocateInfo* pAlloc
         {
             (*m_DeviceMemoryCallbacks.pfnAllocate)(this, pAllocateInfo->memoryTypeIndex, *pMemory, pAllocateInfo->allocationSize, m_DeviceMemoryCallbacks.pUserData);
         }
+        if(hPool != VK_NULL_HANDLE)
+        {
+            hPool->OnMemoryAllocated(prevPoolMemoryBytes, pAllocateInfo->allocationSize);
+        }
+        if(m_MemoryPressureMonitor.pfnPressure != VMA_NULL)
+        {
+            CheckMemoryPressure();
+        }
 
         deviceMemoryCountIncrement.Commit();
     }
@@ -15074,12 +19454,16 @@ VkResult VmaAllocator_T::AllocateVulkanMemory(const VkMemoryAllocateInfo* pAlloc
     {
         --m_Budget.m_BlockCount[heapIndex];
         m_Budget.m_BlockBytes[heapIndex] -= pAllocateInfo->allocationSize;
+        if(hPool != VK_NULL_HANDLE)
+        {
+            hPool->ReleaseMemory(pAllocateInfo->allocationSize);
+        }
     }
 
     return res;
 }
 
-void VmaAllocator_T::FreeVulkanMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory hMemory)
+void VmaAllocator_T::FreeVulkanMemory(uint32_t memoryType, VmaPool hPool, VkDeviceSize size, VkDeviceMemory hMemory)
 {
     // Informative callback.
     if(m_DeviceMemoryCallbacks.pfnFree != VMA_NULL)
@@ -15087,14 +19471,39 @@ void VmaAllocator_T::FreeVulkanMemory(uint32_t memoryType, VkDeviceSize size, Vk
         (*m_DeviceMemoryCallbacks.pfnFree)(this, memoryType, hMemory, size, m_DeviceMemoryCallbacks.pUserData);
     }
 
+    // Deferred ranges must not refer to freed memory.
+    {
+        VmaMutexLock lock(m_DeferredRangesMutex, m_UseMutex);
+        MappedRangeVector* const rangeVectors[] = { &m_DirtyRanges, &m_StaleRanges };
+        for(MappedRangeVector* ranges : rangeVectors)
+        {
+            size_t rangeCount = 0;
+            for(size_t i = 0; i < ranges->size(); ++i)
+            {
+                if((*ranges)[i].memory != hMemory)
+                    (*ranges)[rangeCount++] = (*ranges)[i];
+            }
+            ranges->resize(rangeCount);
+        }
+    }
+
     // VULKAN CALL vkFreeMemory.
     (*m_VulkanFunctions.vkFreeMemory)(m_hDevice, hMemory, GetAllocationCallbacks());
 
     const uint32_t heapIndex = MemoryTypeIndexToHeapIndex(memoryType);
     --m_Budget.m_BlockCount[heapIndex];
     m_Budget.m_BlockBytes[heapIndex] -= size;
+    if(hPool != VK_NULL_HANDLE)
+    {
+        hPool->ReleaseMemory(size);
+    }
 
     --m_DeviceMemoryCount;
+
+    if(m_MemoryPressureMonitor.pfnPressure != VMA_NULL)
+    {
+        CheckMemoryPressure();
+    }
 }
 
 VkResult VmaAllocator_T::BindVulkanBuffer(
@@ -15166,6 +19575,7 @@ VkResult VmaAllocator_T::Map(VmaAllocation hAllocation, void** ppData)
             {
                 *ppData = pBytes + (ptrdiff_t)hAllocation->GetOffset();
                 hAllocation->BlockAllocMap();
+                pBlock->m_LastUseFrameIndex = GetCurrentFrameIndex();
             }
             return res;
         }
@@ -15293,6 +19703,8 @@ VkResult VmaAllocator_T::FlushOrInvalidateAllocations(
             ranges.push_back(newRange);
         }
     }
+    // Neighboring allocations in the same block are flushed or invalidated as one range.
+    VmaMergeMappedMemoryRanges(ranges);
 
     VkResult res = VK_SUCCESS;
     if(!ranges.empty())
@@ -15313,6 +19725,61 @@ VkResult VmaAllocator_T::FlushOrInvalidateAllocations(
     return res;
 }
 
+void VmaAllocator_T::DeferFlushOrInvalidate(
+    VmaAllocation hAllocation,
+    VkDeviceSize offset, VkDeviceSize size,
+    VMA_CACHE_OPERATION op)
+{
+    VkMappedMemoryRange newRange;
+    if(GetFlushOrInvalidateRange(hAllocation, offset, size, newRange))
+    {
+        VmaMutexLock lock(m_DeferredRangesMutex, m_UseMutex);
+        MappedRangeVector& ranges = op == VMA_CACHE_FLUSH ? m_DirtyRanges : m_StaleRanges;
+        // Consecutive writes to the same allocation are common, so extend the last range when possible.
+        if(!ranges.empty())
+        {
+            VkMappedMemoryRange& lastRange = ranges.back();
+            if(lastRange.memory == newRange.memory &&
+                newRange.offset <= lastRange.offset + lastRange.size &&
+                lastRange.offset <= newRange.offset + newRange.size)
+            {
+                const VkDeviceSize end = VMA_MAX(lastRange.offset + lastRange.size, newRange.offset + newRange.size);
+                lastRange.offset = VMA_MIN(lastRange.offset, newRange.offset);
+                lastRange.size = end - lastRange.offset;
+                return;
+            }
+        }
+        ranges.push_back(newRange);
+    }
+    // else: Just ignore this call.
+}
+
+VkResult VmaAllocator_T::FlushOrInvalidateDeferredRanges(VMA_CACHE_OPERATION op)
+{
+    // The lock is held during the Vulkan call, so that the memory of the ranges is not freed in the meantime.
+    VmaMutexLock lock(m_DeferredRangesMutex, m_UseMutex);
+    MappedRangeVector& ranges = op == VMA_CACHE_FLUSH ? m_DirtyRanges : m_StaleRanges;
+    VmaMergeMappedMemoryRanges(ranges);
+
+    VkResult res = VK_SUCCESS;
+    if(!ranges.empty())
+    {
+        switch(op)
+        {
+        case VMA_CACHE_FLUSH:
+            res = (*GetVulkanFunctions().vkFlushMappedMemoryRanges)(m_hDevice, (uint32_t)ranges.size(), ranges.data());
+            break;
+        case VMA_CACHE_INVALIDATE:
+            res = (*GetVulkanFunctions().vkInvalidateMappedMemoryRanges)(m_hDevice, (uint32_t)ranges.size(), ranges.data());
+            break;
+        default:
+            VMA_ASSERT(0);
+        }
+        ranges.clear();
+    }
+    return res;
+}
+
 VkResult VmaAllocator_T::CopyMemoryToAllocation(
     const void* pSrcHostPointer,
     VmaAllocation dstAllocation,
@@ -15323,7 +19790,8 @@ VkResult VmaAllocator_T::CopyMemoryToAllocation(
     VkResult res = Map(dstAllocation, &dstMappedData);
     if(res == VK_SUCCESS)
     {
-        memcpy((char*)dstMappedData + dstAllocationLocalOffset, pSrcHostPointer, (size_t)size);
+        VmaCopyToMappedMemory(m_MemProps.memoryTypes[dstAllocation->GetMemoryTypeIndex()].propertyFlags,
+            (char*)dstMappedData + dstAllocationLocalOffset, pSrcHostPointer, (size_t)size);
         Unmap(dstAllocation);
         res = FlushOrInvalidateAllocation(dstAllocation, dstAllocationLocalOffset, size, VMA_CACHE_FLUSH);
     }
@@ -15343,9 +19811,131 @@ VkResult VmaAllocator_T::CopyAllocationToMemory(
         res = FlushOrInvalidateAllocation(srcAllocation, srcAllocationLocalOffset, size, VMA_CACHE_INVALIDATE);
         if(res == VK_SUCCESS)
         {
-            memcpy(pDstHostPointer, (const char*)srcMappedData + srcAllocationLocalOffset, (size_t)size);
-            Unmap(srcAllocation);
+            VmaCopyFromMappedMemory(m_MemProps.memoryTypes[srcAllocation->GetMemoryTypeIndex()].propertyFlags,
+                pDstHostPointer, (const char*)srcMappedData + srcAllocationLocalOffset, (size_t)size);
+            Unmap(srcAllocation);
+        }
+    }
+    return res;
+}
+
+VkResult VmaAllocator_T::CopyBetweenMemoryAndAllocations(
+    uint32_t copyCount,
+    const VmaAllocation* allocations,
+    const VkDeviceSize* allocationLocalOffsets,
+    const void* const* ppHostPointers,
+    const VkDeviceSize* sizes,
+    PFN_vmaDispatchJobsFunction pfnDispatchJobs,
+    void* pDispatchJobsUserData,
+    VMA_CACHE_OPERATION op)
+{
+    // Memory blocks and dedicated allocations are mapped once each, so copies are ordered by what owns the mapping.
+    auto mappingOwner = [allocations](uint32_t index) -> uintptr_t
+    {
+        const VmaAllocation alloc = allocations[index];
+        return alloc->GetType() == VmaAllocation_T::ALLOCATION_TYPE_BLOCK ?
+            reinterpret_cast<uintptr_t>(alloc->GetBlock()) : reinterpret_cast<uintptr_t>(alloc);
+    };
+    const VmaStlAllocator<uint32_t> indexAllocator(GetAllocationCallbacks());
+    VmaVector<uint32_t, VmaStlAllocator<uint32_t>> order(copyCount, indexAllocator);
+    for(uint32_t i = 0; i < copyCount; ++i)
+    {
+        VMA_ASSERT(allocations[i]->IsMappingAllowed());
+        VMA_ASSERT((allocationLocalOffsets != VMA_NULL ? allocationLocalOffsets[i] : 0) + sizes[i] <= allocations[i]->GetSize());
+        order[i] = i;
+    }
+    VMA_SORT(order.begin(), order.end(), [&mappingOwner](uint32_t lhs, uint32_t rhs)
+        { return mappingOwner(lhs) < mappingOwner(rhs); });
+
+    const VmaStlAllocator<char*> pointerAllocator(GetAllocationCallbacks());
+    VmaVector<char*, VmaStlAllocator<char*>> mappedData(copyCount, pointerAllocator);
+    VkResult res = VK_SUCCESS;
+    uint32_t mappedCount = 0; // Number of elements of order whose memory is mapped.
+    while(mappedCount < copyCount)
+    {
+        const VmaAllocation firstAlloc = allocations[order[mappedCount]];
+        uint32_t groupEnd = mappedCount + 1;
+        while(groupEnd < copyCount && mappingOwner(order[groupEnd]) == mappingOwner(order[mappedCount]))
+        {
+            ++groupEnd;
+        }
+
+        char* pBytes = VMA_NULL;
+        if(firstAlloc->GetType() == VmaAllocation_T::ALLOCATION_TYPE_BLOCK)
+        {
+            VmaDeviceMemoryBlock* const pBlock = firstAlloc->GetBlock();
+            res = pBlock->Map(this, 1, (void**)&pBytes);
+            if(res != VK_SUCCESS)
+            {
+                break;
+            }
+            pBlock->m_LastUseFrameIndex = GetCurrentFrameIndex();
+            for(uint32_t i = mappedCount; i < groupEnd; ++i)
+            {
+                mappedData[order[i]] = pBytes + (ptrdiff_t)allocations[order[i]]->GetOffset();
+            }
+        }
+        else
+        {
+            res = firstAlloc->DedicatedAllocMap(this, (void**)&pBytes);
+            if(res != VK_SUCCESS)
+            {
+                break;
+            }
+            for(uint32_t i = mappedCount; i < groupEnd; ++i)
+            {
+                mappedData[order[i]] = pBytes;
+            }
+        }
+        mappedCount = groupEnd;
+    }
+
+    if(res == VK_SUCCESS && op == VMA_CACHE_INVALIDATE)
+    {
+        res = FlushOrInvalidateAllocations(copyCount, allocations, allocationLocalOffsets, sizes, VMA_CACHE_INVALIDATE);
+    }
+    if(res == VK_SUCCESS)
+    {
+        VmaHostCopyVector copies = VmaHostCopyVector(VmaStlAllocator<VmaHostCopy>(GetAllocationCallbacks()));
+        copies.reserve(copyCount);
+        for(uint32_t i = 0; i < copyCount; ++i)
+        {
+            const VkMemoryPropertyFlags memoryFlags = m_MemProps.memoryTypes[allocations[i]->GetMemoryTypeIndex()].propertyFlags;
+            char* const pAllocData = mappedData[i] + (allocationLocalOffsets != VMA_NULL ? (ptrdiff_t)allocationLocalOffsets[i] : 0);
+            if(op == VMA_CACHE_FLUSH)
+            {
+                copies.push_back({ (const char*)ppHostPointers[i], pAllocData, (size_t)sizes[i], memoryFlags, true });
+            }
+            else
+            {
+                copies.push_back({ pAllocData, (char*)ppHostPointers[i], (size_t)sizes[i], memoryFlags, false });
+            }
+        }
+        VmaExecuteHostCopies(GetAllocationCallbacks(), copies, pfnDispatchJobs, pDispatchJobsUserData);
+
+        if(op == VMA_CACHE_FLUSH)
+        {
+            res = FlushOrInvalidateAllocations(copyCount, allocations, allocationLocalOffsets, sizes, VMA_CACHE_FLUSH);
+        }
+    }
+
+    for(uint32_t groupBegin = 0; groupBegin < mappedCount; )
+    {
+        const VmaAllocation firstAlloc = allocations[order[groupBegin]];
+        uint32_t groupEnd = groupBegin + 1;
+        while(groupEnd < mappedCount && mappingOwner(order[groupEnd]) == mappingOwner(order[groupBegin]))
+        {
+            ++groupEnd;
+        }
+        if(firstAlloc->GetType() == VmaAllocation_T::ALLOCATION_TYPE_BLOCK)
+        {
+            firstAlloc->GetBlock()->Unmap(this, 1);
+        }
+        else
+        {
+            firstAlloc->DedicatedAllocUnmap(this);
         }
+        groupBegin = groupEnd;
     }
     return res;
 }
@@ -15379,7 +19969,7 @@ void VmaAllocator_T::FreeDedicatedMemory(VmaAllocation allocation)
     }
     */
 
-    FreeVulkanMemory(memTypeIndex, allocation->GetSize(), hMemory);
+    FreeVulkanMemory(memTypeIndex, parentPool, allocation->GetSize(), hMemory);
 
     m_Budget.RemoveAllocation(MemoryTypeIndexToHeapIndex(allocation->GetMemoryTypeIndex()), allocation->GetSize());
     allocation->Destroy(this);
@@ -15533,7 +20123,12 @@ void VmaAllocator_T::UpdateVulkanBudget()
                 m_Budget.m_VulkanUsage[heapIndex] = m_Budget.m_BlockBytesAtBudgetFetch[heapIndex];
             }
         }
-        m_Budget.m_OperationsSinceBudgetFetch = 0;
+        m_Budget.ResetOperationsSinceBudgetFetch();
+    }
+
+    if(m_MemoryPressureMonitor.pfnPressure != VMA_NULL)
+    {
+        CheckMemoryPressure();
     }
 }
 #endif // VMA_MEMORY_BUDGET
@@ -15571,6 +20166,15 @@ uint32_t VmaAllocator_T::GetGpuDefragmentationMemoryTypeBits()
     return memoryTypeBits;
 }
 
+uint32_t VmaAllocator_T::AcquireDefragmentationId()
+{
+    // 0 means the allocation isn't marked by any context, so it's skipped on wraparound.
+    uint32_t id = ++m_NextDefragmentationId;
+    if(id == 0)
+        id = ++m_NextDefragmentationId;
+    return id;
+}
+
 #if VMA_STATS_STRING_ENABLED
 void VmaAllocator_T::PrintDetailedMap(VmaJsonWriter& json)
 {
@@ -15754,6 +20358,12 @@ VMA_CALL_PRE VkResult VMA_CALL_POST vmaImportVulkanFunctionsFromVolk(
         COPY_DEVICE_TO_VMA_FUNC(vkGetMemoryWin32HandleKHR, vkGetMemoryWin32HandleKHR)
     }
 #endif
+#if VMA_PAGEABLE_DEVICE_LOCAL_MEMORY
+    if ((pAllocatorCreateInfo->flags & VMA_ALLOCATOR_CREATE_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_BIT) != 0)
+    {
+        COPY_DEVICE_TO_VMA_FUNC(vkSetDeviceMemoryPriorityEXT, vkSetDeviceMemoryPriorityEXT)
+    }
+#endif
 
 #undef COPY_DEVICE_TO_VMA_FUNC
 #undef COPY_GLOBAL_TO_VMA_FUNC
@@ -16233,6 +20843,18 @@ VMA_CALL_PRE void VMA_CALL_POST vmaCalculatePoolStatistics(
     allocator->CalculatePoolStatistics(pool, pPoolStats);
 }
 
+VMA_CALL_PRE void VMA_CALL_POST vmaGetPoolEmptyBlockStatistics(
+    VmaAllocator allocator,
+    VmaPool pool,
+    VmaEmptyBlockStatistics* pStats)
+{
+    VMA_ASSERT(allocator && pool && pStats);
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    pool->m_BlockVector.GetEmptyBlockStatistics(*pStats);
+}
+
 VMA_CALL_PRE VkResult VMA_CALL_POST vmaCheckPoolCorruption(VmaAllocator allocator, VmaPool pool)
 {
     VMA_ASSERT(allocator && pool);
@@ -16548,6 +21170,43 @@ VMA_CALL_PRE void VMA_CALL_POST vmaSetAllocationName(
     allocation->SetName(allocator, pName);
 }
 
+VMA_CALL_PRE void VMA_CALL_POST vmaSetAllocationImmovable(
+    VmaAllocator allocator,
+    VmaAllocation allocation,
+    VkBool32 immovable)
+{
+    VMA_ASSERT(allocator && allocation);
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    allocation->SetImmovable(immovable != VK_FALSE);
+}
+
+VMA_CALL_PRE void VMA_CALL_POST vmaSetAllocationMoveCost(
+    VmaAllocator allocator,
+    VmaAllocation allocation,
+    float moveCost)
+{
+    VMA_ASSERT(allocator && allocation);
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    allocation->SetMoveCost(moveCost);
+}
+
+VMA_CALL_PRE void VMA_CALL_POST vmaNotifyAllocationUsed(
+    VmaAllocator allocator,
+    VmaAllocation allocation)
+{
+    VMA_ASSERT(allocator && allocation);
+
+    // Dedicated allocations have their own priority that doesn't change.
+    if(allocation->GetType() == VmaAllocation_T::ALLOCATION_TYPE_BLOCK)
+    {
+        allocation->GetBlock()->m_LastUseFrameIndex = allocator->GetCurrentFrameIndex();
+    }
+}
+
 VMA_CALL_PRE void VMA_CALL_POST vmaGetAllocationMemoryProperties(
     VmaAllocator VMA_NOT_NULL allocator,
     VmaAllocation VMA_NOT_NULL allocation,
@@ -16657,6 +21316,58 @@ VMA_CALL_PRE VkResult VMA_CALL_POST vmaInvalidateAllocations(
     return allocator->FlushOrInvalidateAllocations(allocationCount, allocations, offsets, sizes, VMA_CACHE_INVALIDATE);
 }
 
+VMA_CALL_PRE void VMA_CALL_POST vmaMarkDirty(
+    VmaAllocator allocator,
+    VmaAllocation allocation,
+    VkDeviceSize offset,
+    VkDeviceSize size)
+{
+    VMA_ASSERT(allocator && allocation);
+
+    VMA_DEBUG_LOG("vmaMarkDirty");
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    allocator->DeferFlushOrInvalidate(allocation, offset, size, VMA_CACHE_FLUSH);
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaFlushDirty(VmaAllocator allocator)
+{
+    VMA_ASSERT(allocator);
+
+    VMA_DEBUG_LOG("vmaFlushDirty");
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    return allocator->FlushOrInvalidateDeferredRanges(VMA_CACHE_FLUSH);
+}
+
+VMA_CALL_PRE void VMA_CALL_POST vmaMarkStale(
+    VmaAllocator allocator,
+    VmaAllocation allocation,
+    VkDeviceSize offset,
+    VkDeviceSize size)
+{
+    VMA_ASSERT(allocator && allocation);
+
+    VMA_DEBUG_LOG("vmaMarkStale");
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    allocator->DeferFlushOrInvalidate(allocation, offset, size, VMA_CACHE_INVALIDATE);
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaInvalidateStale(VmaAllocator allocator)
+{
+    VMA_ASSERT(allocator);
+
+    VMA_DEBUG_LOG("vmaInvalidateStale");
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    return allocator->FlushOrInvalidateDeferredRanges(VMA_CACHE_INVALIDATE);
+}
+
 VMA_CALL_PRE VkResult VMA_CALL_POST vmaCopyMemoryToAllocation(
     VmaAllocator allocator,
     const void* pSrcHostPointer,
@@ -16699,6 +21410,60 @@ VMA_CALL_PRE VkResult VMA_CALL_POST vmaCopyAllocationToMemory(
     return allocator->CopyAllocationToMemory(srcAllocation, srcAllocationLocalOffset, pDstHostPointer, size);
 }
 
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaCopyMemoryToAllocations(
+    VmaAllocator allocator,
+    uint32_t copyCount,
+    const void* const* ppSrcHostPointers,
+    const VmaAllocation* dstAllocations,
+    const VkDeviceSize* dstAllocationLocalOffsets,
+    const VkDeviceSize* sizes,
+    PFN_vmaDispatchJobsFunction pfnDispatchJobs,
+    void* pDispatchJobsUserData)
+{
+    VMA_ASSERT(allocator);
+
+    if(copyCount == 0)
+    {
+        return VK_SUCCESS;
+    }
+
+    VMA_ASSERT(ppSrcHostPointers && dstAllocations && sizes);
+
+    VMA_DEBUG_LOG("vmaCopyMemoryToAllocations");
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    return allocator->CopyBetweenMemoryAndAllocations(copyCount, dstAllocations, dstAllocationLocalOffsets,
+        ppSrcHostPointers, sizes, pfnDispatchJobs, pDispatchJobsUserData, VMA_CACHE_FLUSH);
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaCopyAllocationsToMemory(
+    VmaAllocator allocator,
+    uint32_t copyCount,
+    const VmaAllocation* srcAllocations,
+    const VkDeviceSize* srcAllocationLocalOffsets,
+    void* const* ppDstHostPointers,
+    const VkDeviceSize* sizes,
+    PFN_vmaDispatchJobsFunction pfnDispatchJobs,
+    void* pDispatchJobsUserData)
+{
+    VMA_ASSERT(allocator);
+
+    if(copyCount == 0)
+    {
+        return VK_SUCCESS;
+    }
+
+    VMA_ASSERT(srcAllocations && ppDstHostPointers && sizes);
+
+    VMA_DEBUG_LOG("vmaCopyAllocationsToMemory");
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    return allocator->CopyBetweenMemoryAndAllocations(copyCount, srcAllocations, srcAllocationLocalOffsets,
+        ppDstHostPointers, sizes, pfnDispatchJobs, pDispatchJobsUserData, VMA_CACHE_INVALIDATE);
+}
+
 VMA_CALL_PRE VkResult VMA_CALL_POST vmaCheckCorruption(
     VmaAllocator allocator,
     uint32_t memoryTypeBits)
@@ -16778,6 +21543,78 @@ VMA_CALL_PRE VkResult VMA_CALL_POST vmaEndDefragmentationPass(
     return context->DefragmentPassEnd(*pPassInfo);
 }
 
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaExecuteDefragmentationPassOnHost(
+    VmaAllocator allocator,
+    VmaDefragmentationContext context,
+    const VmaDefragmentationPassMoveInfo* pPassInfo)
+{
+    VMA_ASSERT(allocator && context && pPassInfo);
+
+    VMA_DEBUG_LOG("vmaExecuteDefragmentationPassOnHost");
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    return context->ExecutePassOnHost(allocator, *pPassInfo);
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaRecordDefragmentationPassCopies(
+    VmaAllocator allocator,
+    VmaDefragmentationContext context,
+    const VmaDefragmentationPassMoveInfo* pPassInfo,
+    VkCommandBuffer commandBuffer)
+{
+    VMA_ASSERT(allocator && context && pPassInfo && commandBuffer);
+
+    VMA_DEBUG_LOG("vmaRecordDefragmentationPassCopies");
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    return context->RecordPassCopies(allocator, *pPassInfo, commandBuffer);
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaEstimateDefragmentation(
+    VmaAllocator allocator,
+    const VmaDefragmentationInfo* pInfo,
+    VmaDefragmentationEstimate* pEstimate)
+{
+    VMA_ASSERT(allocator && pInfo && pEstimate);
+
+    VMA_DEBUG_LOG("vmaEstimateDefragmentation");
+
+    if (pInfo->pool != VMA_NULL)
+    {
+        // Check if run on supported algorithms
+        if (pInfo->pool->m_BlockVector.GetAlgorithm() & VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT)
+            return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    VmaDefragmentationContext_T::Estimate(allocator, *pInfo, *pEstimate);
+    return VK_SUCCESS;
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaBeginResidency(
+    VmaAllocator allocator,
+    const VmaResidencyInfo* pInfo,
+    VmaDefragmentationContext* pContext)
+{
+    VMA_ASSERT(allocator && pInfo && pContext);
+    VMA_ASSERT(pInfo->evictionThreshold > 0.f && pInfo->restoreThreshold <= pInfo->evictionThreshold);
+
+    VMA_DEBUG_LOG("vmaBeginResidency");
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    // Residency uses the limits of defragmentation passes, with the algorithm that needs no extra state.
+    VmaDefragmentationInfo info = {};
+    info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT;
+    info.maxBytesPerPass = pInfo->maxBytesPerPass;
+    info.maxAllocationsPerPass = pInfo->maxAllocationsPerPass;
+    *pContext = vma_new(allocator, VmaDefragmentationContext_T)(allocator, info, pInfo);
+    return VK_SUCCESS;
+}
+
 VMA_CALL_PRE VkResult VMA_CALL_POST vmaBindBufferMemory(
     VmaAllocator allocator,
     VmaAllocation allocation,
@@ -17104,85 +21941,287 @@ VMA_CALL_PRE void VMA_CALL_POST vmaDestroyImage(
     }
 }
 
-VMA_CALL_PRE VkResult VMA_CALL_POST vmaCreateVirtualBlock(
-    const VmaVirtualBlockCreateInfo* VMA_NOT_NULL pCreateInfo,
-    VmaVirtualBlock VMA_NULLABLE * VMA_NOT_NULL pVirtualBlock)
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaCreateVirtualBlock(
+    const VmaVirtualBlockCreateInfo* VMA_NOT_NULL pCreateInfo,
+    VmaVirtualBlock VMA_NULLABLE * VMA_NOT_NULL pVirtualBlock)
+{
+    VMA_ASSERT(pCreateInfo && pVirtualBlock);
+    VMA_ASSERT(pCreateInfo->size > 0);
+    VMA_DEBUG_LOG("vmaCreateVirtualBlock");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    *pVirtualBlock = vma_new(pCreateInfo->pAllocationCallbacks, VmaVirtualBlock_T)(*pCreateInfo);
+    return VK_SUCCESS;
+
+    /*
+    Code for the future if we ever need a separate Init() method that could fail:
+
+    VkResult res = (*pVirtualBlock)->Init();
+    if(res < 0)
+    {
+        vma_delete(pCreateInfo->pAllocationCallbacks, *pVirtualBlock);
+        *pVirtualBlock = VK_NULL_HANDLE;
+    }
+    return res;
+    */
+}
+
+VMA_CALL_PRE void VMA_CALL_POST vmaDestroyVirtualBlock(VmaVirtualBlock VMA_NULLABLE virtualBlock)
+{
+    if(virtualBlock != VK_NULL_HANDLE)
+    {
+        VMA_DEBUG_LOG("vmaDestroyVirtualBlock");
+        VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+        VkAllocationCallbacks allocationCallbacks = virtualBlock->m_AllocationCallbacks; // Have to copy the callbacks when destroying.
+        vma_delete(&allocationCallbacks, virtualBlock);
+    }
+}
+
+VMA_CALL_PRE VkBool32 VMA_CALL_POST vmaIsVirtualBlockEmpty(VmaVirtualBlock VMA_NOT_NULL virtualBlock)
+{
+    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE);
+    VMA_DEBUG_LOG("vmaIsVirtualBlockEmpty");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    return virtualBlock->IsEmpty() ? VK_TRUE : VK_FALSE;
+}
+
+VMA_CALL_PRE void VMA_CALL_POST vmaGetVirtualAllocationInfo(VmaVirtualBlock VMA_NOT_NULL virtualBlock,
+    VmaVirtualAllocation VMA_NOT_NULL_NON_DISPATCHABLE allocation, VmaVirtualAllocationInfo* VMA_NOT_NULL pVirtualAllocInfo)
+{
+    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE && pVirtualAllocInfo != VMA_NULL);
+    VMA_DEBUG_LOG("vmaGetVirtualAllocationInfo");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    virtualBlock->GetAllocationInfo(allocation, *pVirtualAllocInfo);
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaVirtualAllocate(VmaVirtualBlock VMA_NOT_NULL virtualBlock,
+    const VmaVirtualAllocationCreateInfo* VMA_NOT_NULL pCreateInfo, VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE* VMA_NOT_NULL pAllocation,
+    VkDeviceSize* VMA_NULLABLE pOffset)
+{
+    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE && pCreateInfo != VMA_NULL && pAllocation != VMA_NULL);
+    VMA_DEBUG_LOG("vmaVirtualAllocate");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    return virtualBlock->Allocate(*pCreateInfo, *pAllocation, pOffset);
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaVirtualAllocateMultiple(VmaVirtualBlock VMA_NOT_NULL virtualBlock,
+    size_t allocationCount, const VmaVirtualAllocationCreateInfo* VMA_NOT_NULL pCreateInfos,
+    VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE* VMA_NOT_NULL pAllocations, VkDeviceSize* VMA_NULLABLE pOffsets)
+{
+    if(allocationCount == 0)
+    {
+        return VK_SUCCESS;
+    }
+    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE && pCreateInfos != VMA_NULL && pAllocations != VMA_NULL);
+    VMA_DEBUG_LOG("vmaVirtualAllocateMultiple");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    return virtualBlock->AllocateMultiple(allocationCount, pCreateInfos, pAllocations, pOffsets);
+}
+
+VMA_CALL_PRE void VMA_CALL_POST vmaVirtualFree(VmaVirtualBlock VMA_NOT_NULL virtualBlock, VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE allocation)
+{
+    if(allocation != VK_NULL_HANDLE)
+    {
+        VMA_ASSERT(virtualBlock != VK_NULL_HANDLE);
+        VMA_DEBUG_LOG("vmaVirtualFree");
+        VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+        virtualBlock->Free(allocation);
+    }
+}
+
+VMA_CALL_PRE void VMA_CALL_POST vmaVirtualFreeMultiple(VmaVirtualBlock VMA_NOT_NULL virtualBlock,
+    size_t allocationCount, const VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE* VMA_NOT_NULL pAllocations)
+{
+    if(allocationCount == 0)
+    {
+        return;
+    }
+    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE && pAllocations != VMA_NULL);
+    VMA_DEBUG_LOG("vmaVirtualFreeMultiple");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    virtualBlock->FreeMultiple(allocationCount, pAllocations);
+}
+
+VMA_CALL_PRE void VMA_CALL_POST vmaClearVirtualBlock(VmaVirtualBlock VMA_NOT_NULL virtualBlock)
+{
+    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE);
+    VMA_DEBUG_LOG("vmaClearVirtualBlock");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    virtualBlock->Clear();
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaResizeVirtualBlock(VmaVirtualBlock VMA_NOT_NULL virtualBlock, VkDeviceSize newSize)
 {
-    VMA_ASSERT(pCreateInfo && pVirtualBlock);
-    VMA_ASSERT(pCreateInfo->size > 0);
-    VMA_DEBUG_LOG("vmaCreateVirtualBlock");
+    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE);
+    VMA_ASSERT(newSize > 0);
+    VMA_DEBUG_LOG("vmaResizeVirtualBlock");
     VMA_DEBUG_GLOBAL_MUTEX_LOCK;
-    *pVirtualBlock = vma_new(pCreateInfo->pAllocationCallbacks, VmaVirtualBlock_T)(*pCreateInfo);
-    return VK_SUCCESS;
+    return virtualBlock->Resize(newSize);
+}
 
-    /*
-    Code for the future if we ever need a separate Init() method that could fail:
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaCreateVirtualBlockVector(const VmaVirtualBlockVectorCreateInfo* VMA_NOT_NULL pCreateInfo,
+    VmaVirtualBlockVector VMA_NULLABLE* VMA_NOT_NULL pVirtualBlockVector)
+{
+    VMA_ASSERT(pCreateInfo && pVirtualBlockVector);
+    VMA_ASSERT(pCreateInfo->blockSize > 0);
+    VMA_ASSERT(pCreateInfo->maxBlockCount == 0 || pCreateInfo->minBlockCount <= pCreateInfo->maxBlockCount);
+    VMA_DEBUG_LOG("vmaCreateVirtualBlockVector");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    *pVirtualBlockVector = vma_new(pCreateInfo->pAllocationCallbacks, VmaVirtualBlockVector_T)(*pCreateInfo);
 
-    VkResult res = (*pVirtualBlock)->Init();
-    if(res < 0)
+    VkResult res = (*pVirtualBlockVector)->CreateMinBlocks();
+    if (res != VK_SUCCESS)
     {
-        vma_delete(pCreateInfo->pAllocationCallbacks, *pVirtualBlock);
-        *pVirtualBlock = VK_NULL_HANDLE;
+        vma_delete(pCreateInfo->pAllocationCallbacks, *pVirtualBlockVector);
+        *pVirtualBlockVector = VK_NULL_HANDLE;
     }
     return res;
-    */
 }
 
-VMA_CALL_PRE void VMA_CALL_POST vmaDestroyVirtualBlock(VmaVirtualBlock VMA_NULLABLE virtualBlock)
+VMA_CALL_PRE void VMA_CALL_POST vmaDestroyVirtualBlockVector(VmaVirtualBlockVector VMA_NULLABLE virtualBlockVector)
 {
-    if(virtualBlock != VK_NULL_HANDLE)
+    if (virtualBlockVector != VK_NULL_HANDLE)
     {
-        VMA_DEBUG_LOG("vmaDestroyVirtualBlock");
+        VMA_DEBUG_LOG("vmaDestroyVirtualBlockVector");
         VMA_DEBUG_GLOBAL_MUTEX_LOCK;
-        VkAllocationCallbacks allocationCallbacks = virtualBlock->m_AllocationCallbacks; // Have to copy the callbacks when destroying.
-        vma_delete(&allocationCallbacks, virtualBlock);
+        VkAllocationCallbacks allocationCallbacks = virtualBlockVector->m_AllocationCallbacks; // Have to copy the callbacks when destroying.
+        vma_delete(&allocationCallbacks, virtualBlockVector);
     }
 }
 
-VMA_CALL_PRE VkBool32 VMA_CALL_POST vmaIsVirtualBlockEmpty(VmaVirtualBlock VMA_NOT_NULL virtualBlock)
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaVirtualBlockVectorAllocate(VmaVirtualBlockVector VMA_NOT_NULL virtualBlockVector,
+    const VmaVirtualAllocationCreateInfo* VMA_NOT_NULL pCreateInfo, VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE* VMA_NOT_NULL pAllocation,
+    uint32_t* VMA_NOT_NULL pBlockIndex, VkDeviceSize* VMA_NULLABLE pOffset)
 {
-    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE);
-    VMA_DEBUG_LOG("vmaIsVirtualBlockEmpty");
+    VMA_ASSERT(virtualBlockVector != VK_NULL_HANDLE && pCreateInfo != VMA_NULL && pAllocation != VMA_NULL && pBlockIndex != VMA_NULL);
+    VMA_DEBUG_LOG("vmaVirtualBlockVectorAllocate");
     VMA_DEBUG_GLOBAL_MUTEX_LOCK;
-    return virtualBlock->IsEmpty() ? VK_TRUE : VK_FALSE;
+    return virtualBlockVector->Allocate(*pCreateInfo, *pAllocation, *pBlockIndex, pOffset);
 }
 
-VMA_CALL_PRE void VMA_CALL_POST vmaGetVirtualAllocationInfo(VmaVirtualBlock VMA_NOT_NULL virtualBlock,
-    VmaVirtualAllocation VMA_NOT_NULL_NON_DISPATCHABLE allocation, VmaVirtualAllocationInfo* VMA_NOT_NULL pVirtualAllocInfo)
+VMA_CALL_PRE void VMA_CALL_POST vmaVirtualBlockVectorFree(VmaVirtualBlockVector VMA_NOT_NULL virtualBlockVector,
+    uint32_t blockIndex, VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE allocation)
 {
-    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE && pVirtualAllocInfo != VMA_NULL);
-    VMA_DEBUG_LOG("vmaGetVirtualAllocationInfo");
+    if (allocation != VK_NULL_HANDLE)
+    {
+        VMA_ASSERT(virtualBlockVector != VK_NULL_HANDLE);
+        VMA_DEBUG_LOG("vmaVirtualBlockVectorFree");
+        VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+        virtualBlockVector->Free(blockIndex, allocation);
+    }
+}
+
+VMA_CALL_PRE void VMA_CALL_POST vmaGetVirtualBlockVectorBlock(VmaVirtualBlockVector VMA_NOT_NULL virtualBlockVector,
+    uint32_t blockIndex, VmaVirtualBlock VMA_NULLABLE* VMA_NOT_NULL pVirtualBlock)
+{
+    VMA_ASSERT(virtualBlockVector != VK_NULL_HANDLE && pVirtualBlock != VMA_NULL);
+    VMA_DEBUG_LOG("vmaGetVirtualBlockVectorBlock");
     VMA_DEBUG_GLOBAL_MUTEX_LOCK;
-    virtualBlock->GetAllocationInfo(allocation, *pVirtualAllocInfo);
+    *pVirtualBlock = virtualBlockVector->GetBlock(blockIndex);
 }
 
-VMA_CALL_PRE VkResult VMA_CALL_POST vmaVirtualAllocate(VmaVirtualBlock VMA_NOT_NULL virtualBlock,
-    const VmaVirtualAllocationCreateInfo* VMA_NOT_NULL pCreateInfo, VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE* VMA_NOT_NULL pAllocation,
-    VkDeviceSize* VMA_NULLABLE pOffset)
+VMA_CALL_PRE void VMA_CALL_POST vmaGetVirtualBlockVectorStatistics(VmaVirtualBlockVector VMA_NOT_NULL virtualBlockVector,
+    VmaStatistics* VMA_NOT_NULL pStats)
 {
-    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE && pCreateInfo != VMA_NULL && pAllocation != VMA_NULL);
-    VMA_DEBUG_LOG("vmaVirtualAllocate");
+    VMA_ASSERT(virtualBlockVector != VK_NULL_HANDLE && pStats != VMA_NULL);
+    VMA_DEBUG_LOG("vmaGetVirtualBlockVectorStatistics");
     VMA_DEBUG_GLOBAL_MUTEX_LOCK;
-    return virtualBlock->Allocate(*pCreateInfo, *pAllocation, pOffset);
+    virtualBlockVector->GetStatistics(*pStats);
 }
 
-VMA_CALL_PRE void VMA_CALL_POST vmaVirtualFree(VmaVirtualBlock VMA_NOT_NULL virtualBlock, VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE allocation)
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaSerializeVirtualBlock(VmaVirtualBlock VMA_NOT_NULL virtualBlock,
+    size_t* VMA_NOT_NULL pDataSize, void* VMA_NULLABLE pData)
 {
-    if(allocation != VK_NULL_HANDLE)
+    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE && pDataSize != VMA_NULL);
+    VMA_DEBUG_LOG("vmaSerializeVirtualBlock");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    return virtualBlock->Serialize(*pDataSize, pData);
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaDeserializeVirtualBlock(const void* VMA_NOT_NULL pData, size_t dataSize,
+    const VkAllocationCallbacks* VMA_NULLABLE pAllocationCallbacks,
+    size_t allocationCount, VmaVirtualAllocation VMA_NULLABLE_NON_DISPATCHABLE* VMA_NULLABLE VMA_LEN_IF_NOT_NULL(allocationCount) pAllocations,
+    VmaVirtualBlock VMA_NULLABLE* VMA_NOT_NULL pVirtualBlock)
+{
+    VMA_ASSERT(pData && pVirtualBlock);
+    VMA_DEBUG_LOG("vmaDeserializeVirtualBlock");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    *pVirtualBlock = VK_NULL_HANDLE;
+
+    VmaVirtualBlockSnapshotHeader header;
+    if (dataSize < sizeof(header))
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+    memcpy(&header, pData, sizeof(header));
+    if (header.magic != VMA_VIRTUAL_BLOCK_SNAPSHOT_MAGIC ||
+        header.version != VMA_VIRTUAL_BLOCK_SNAPSHOT_VERSION ||
+        (header.algorithm & ~(uint32_t)VMA_VIRTUAL_BLOCK_CREATE_ALGORITHM_MASK) != 0 ||
+        header.size == 0 ||
+        header.rangeCount > (dataSize - sizeof(header)) / sizeof(VmaVirtualBlockSnapshotRange) ||
+        (pAllocations != VMA_NULL && header.allocationCount != allocationCount))
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+
+    VmaVirtualBlockCreateInfo createInfo = {};
+    createInfo.size = header.size;
+    createInfo.flags = header.algorithm;
+    createInfo.pAllocationCallbacks = pAllocationCallbacks;
+    VmaVirtualBlock block = vma_new(pAllocationCallbacks, VmaVirtualBlock_T)(createInfo);
+    if (!block->ReadSnapshot(header, static_cast<const char*>(pData) + sizeof(header), pAllocations))
+    {
+        vma_delete(pAllocationCallbacks, block);
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+    }
+    *pVirtualBlock = block;
+    return VK_SUCCESS;
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaBeginVirtualDefragmentation(const VmaVirtualDefragmentationInfo* VMA_NOT_NULL pInfo,
+    VmaVirtualDefragmentationContext VMA_NULLABLE* VMA_NOT_NULL pContext)
+{
+    VMA_ASSERT(pInfo && pContext);
+    VMA_ASSERT(pInfo->blockCount > 0 && pInfo->pBlocks != VMA_NULL);
+    VMA_ASSERT(VmaIsPow2(VMA_MAX(pInfo->alignment, (VkDeviceSize)1)));
+    VMA_DEBUG_LOG("vmaBeginVirtualDefragmentation");
+
+    // Check if run on supported algorithms
+    for (uint32_t i = 0; i < pInfo->blockCount; ++i)
     {
-        VMA_ASSERT(virtualBlock != VK_NULL_HANDLE);
-        VMA_DEBUG_LOG("vmaVirtualFree");
-        VMA_DEBUG_GLOBAL_MUTEX_LOCK;
-        virtualBlock->Free(allocation);
+        VMA_ASSERT(pInfo->pBlocks[i] != VK_NULL_HANDLE);
+        if (pInfo->pBlocks[i]->m_Algorithm & VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT)
+            return VK_ERROR_FEATURE_NOT_PRESENT;
     }
+
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    *pContext = vma_new(pInfo->pBlocks[0]->GetAllocationCallbacks(), VmaVirtualDefragmentationContext_T)(*pInfo);
+    return VK_SUCCESS;
 }
 
-VMA_CALL_PRE void VMA_CALL_POST vmaClearVirtualBlock(VmaVirtualBlock VMA_NOT_NULL virtualBlock)
+VMA_CALL_PRE void VMA_CALL_POST vmaEndVirtualDefragmentation(VmaVirtualDefragmentationContext VMA_NOT_NULL context,
+    VmaDefragmentationStats* VMA_NULLABLE pStats)
 {
-    VMA_ASSERT(virtualBlock != VK_NULL_HANDLE);
-    VMA_DEBUG_LOG("vmaClearVirtualBlock");
+    VMA_ASSERT(context);
+    VMA_DEBUG_LOG("vmaEndVirtualDefragmentation");
     VMA_DEBUG_GLOBAL_MUTEX_LOCK;
-    virtualBlock->Clear();
+    if (pStats)
+        context->GetStats(*pStats);
+    const VkAllocationCallbacks* allocationCallbacks = context->GetAllocationCallbacks();
+    vma_delete(allocationCallbacks, context);
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaBeginVirtualDefragmentationPass(VmaVirtualDefragmentationContext VMA_NOT_NULL context,
+    VmaVirtualDefragmentationPassMoveInfo* VMA_NOT_NULL pPassInfo)
+{
+    VMA_ASSERT(context && pPassInfo);
+    VMA_DEBUG_LOG("vmaBeginVirtualDefragmentationPass");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    return context->DefragmentPassBegin(*pPassInfo);
+}
+
+VMA_CALL_PRE VkResult VMA_CALL_POST vmaEndVirtualDefragmentationPass(VmaVirtualDefragmentationContext VMA_NOT_NULL context,
+    VmaVirtualDefragmentationPassMoveInfo* VMA_NOT_NULL pPassInfo)
+{
+    VMA_ASSERT(context && pPassInfo);
+    VMA_DEBUG_LOG("vmaEndVirtualDefragmentationPass");
+    VMA_DEBUG_GLOBAL_MUTEX_LOCK;
+    return context->DefragmentPassEnd(*pPassInfo);
 }
 
 VMA_CALL_PRE void VMA_CALL_POST vmaSetVirtualAllocationUserData(VmaVirtualBlock VMA_NOT_NULL virtualBlock,
@@ -17978,6 +23017,18 @@ vmaCopyMemoryToAllocation(allocator, &constantBufferData, alloc, 0, sizeof(Const
 
 Copy in the other direction - from an allocation to a host pointer can be performed the same way using function vmaCopyAllocationToMemory().
 
+When uploading many pieces of data at once, e.g. the contents of many buffers loaded from a file,
+use vmaCopyMemoryToAllocations() and vmaCopyAllocationsToMemory() instead of calling these functions in a loop.
+They map every `VkDeviceMemory` block only once, flush or invalidate all the ranges with a single Vulkan call,
+and can split large copies into jobs executed in parallel by a callback of type #PFN_vmaDispatchJobsFunction.
+
+\code
+const void* srcPointers[] = { vertexData, indexData };
+VmaAllocation dstAllocations[] = { vertexAlloc, indexAlloc };
+VkDeviceSize sizes[] = { vertexDataSize, indexDataSize };
+vmaCopyMemoryToAllocations(allocator, 2, srcPointers, dstAllocations, nullptr, sizes, nullptr, nullptr);
+\endcode
+
 \section memory_mapping_mapping_functions Mapping functions
 
 The library provides following functions for mapping of a specific allocation: vmaMapMemory(), vmaUnmapMemory().
@@ -18068,6 +23119,22 @@ functions that refer to given allocation object: vmaFlushAllocation(),
 vmaInvalidateAllocation(),
 or multiple objects at once: vmaFlushAllocations(), vmaInvalidateAllocations().
 
+When many small writes are made to persistently mapped allocations during a frame, flushing each of them
+separately means many calls to the driver. Instead, you can record each written region with vmaMarkDirty()
+and flush all of them with one call to vmaFlushDirty(), e.g. before submitting the frame.
+Regions are merged, so marking the same or neighboring ones many times is cheap.
+For reading data written by the GPU, vmaMarkStale() and vmaInvalidateStale() work the same way.
+
+\code
+// For each write during the frame:
+memcpy((char*)allocInfo.pMappedData + offset, srcData, size);
+vmaMarkDirty(allocator, alloc, offset, size);
+
+// Once per frame:
+vmaFlushDirty(allocator);
+vkQueueSubmit(...);
+\endcode
+
 Regions of memory specified for flush/invalidate must be aligned to
 `VkPhysicalDeviceLimits::nonCoherentAtomSize`. This is automatically ensured by the library.
 In any memory type that is `HOST_VISIBLE` but not `HOST_COHERENT`, all allocations
@@ -18155,6 +23222,47 @@ to obtain a new block.
 set to more than 0 will currently try to allocate memory blocks without checking whether they
 fit within budget.
 
+\section staying_within_budget_memory_pressure Memory pressure notifications
+
+Instead of polling vmaGetHeapBudgets() every frame, you can ask the library to notify you
+when memory usage of a heap approaches its budget. Fill structure #VmaMemoryPressureMonitor
+and pass it as VmaAllocatorCreateInfo::pMemoryPressureMonitor:
+
+\code
+void VKAPI_PTR MyMemoryPressure(VmaAllocator allocator, uint32_t heapIndex, VkBool32 underPressure,
+    VkDeviceSize usage, VkDeviceSize budget, void* pUserData)
+{
+    // E.g. lower the texture streaming quality while underPressure == VK_TRUE.
+}
+
+VmaMemoryPressureMonitor pressureMonitor = {};
+pressureMonitor.highWatermark = 0.9f;
+pressureMonitor.lowWatermark = 0.75f;
+pressureMonitor.pfnPressure = MyMemoryPressure;
+
+VmaAllocatorCreateInfo allocatorCreateInfo = {};
+// Fill other members...
+allocatorCreateInfo.pMemoryPressureMonitor = &pressureMonitor;
+\endcode
+
+A heap enters the pressure state when VmaBudget::usage reaches `highWatermark * budget`
+and leaves it only when the usage drops below `lowWatermark * budget`, so usage oscillating
+between the two watermarks doesn't cause repeated notifications. The callback is called
+exactly once per every such transition, in order, also when many threads allocate and free memory concurrently.
+Calls are never made concurrently: the thread that evaluates the watermarks also re-evaluates them for changes
+made by other threads meanwhile, so the callback may be called on a different thread than the one
+that allocated or freed the memory. The callback may itself allocate or free memory.
+
+The watermarks are evaluated whenever `VkDeviceMemory` is allocated or freed and, with
+#VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT, whenever the budget is fetched from Vulkan,
+e.g. in vmaSetCurrentFrameIndex(), as the budget reported by the driver can change on its own.
+Changes of usage by other processes are therefore noticed only in the latter case.
+
+\note The callback is called from inside functions like vmaCreateBuffer() or vmaDestroyBuffer(),
+possibly while internal locks are held. It must not call any functions of the library that
+allocate or free memory. It should only record the new state, e.g. in an atomic variable,
+and let the application react to it later.
+
 
 \page resource_aliasing Resource aliasing (overlap)
 
@@ -18383,6 +23491,54 @@ When creating buffers/images allocated in that pool, provide following parameter
   Other members are ignored anyway.
 
 
+\section custom_memory_pools_memory_limits Memory limits of a pool
+
+Budget returned by vmaGetHeapBudgets() applies to whole memory heaps.
+To limit memory used by a subsystem, e.g. textures to 3 GiB and geometry to 1 GiB, give each of them its own custom pool
+and set VmaPoolCreateInfo::softMemoryLimit and VmaPoolCreateInfo::hardMemoryLimit.
+Both count `VkDeviceMemory` allocated by the pool, without taking a lock.
+
+- When an allocation of new memory makes the pool exceed the soft limit, VmaPoolCreateInfo::pfnSoftMemoryLimit is called once,
+  so the subsystem can schedule eviction of its resources.
+- An allocation that would need new memory above the hard limit fails with `VK_ERROR_OUT_OF_DEVICE_MEMORY`
+  without calling `vkAllocateMemory`.
+
+\code
+void VKAPI_PTR OnTexturePoolPressure(VmaAllocator allocator, VmaPool pool, VkDeviceSize memoryBytes, void* pUserData)
+{
+    // Called while the pool is locked - only remember to evict some textures later.
+    ((TextureStreamer*)pUserData)->RequestEviction();
+}
+
+VmaPoolCreateInfo poolCreateInfo = {};
+poolCreateInfo.memoryTypeIndex = memTypeIndex;
+poolCreateInfo.softMemoryLimit = 2560ull * 1024 * 1024;
+poolCreateInfo.hardMemoryLimit = 3072ull * 1024 * 1024;
+poolCreateInfo.pfnSoftMemoryLimit = OnTexturePoolPressure;
+poolCreateInfo.pSoftMemoryLimitUserData = &textureStreamer;
+\endcode
+
+\section custom_memory_pools_empty_blocks Keeping empty blocks
+
+When all allocations in a memory block are freed, the library keeps at most one such empty block
+to avoid freeing and allocating whole `VkDeviceMemory` back and forth. If the number of blocks used
+by a pool regularly changes by more than one, e.g. between N and N + 3 every few seconds, it still
+calls `vkFreeMemory` and `vkAllocateMemory` each time, which can take milliseconds on some drivers.
+
+Set VmaPoolCreateInfo::maxEmptyBlockCount to keep more empty blocks, and VmaPoolCreateInfo::emptyBlockReleaseFrameCount
+to free them only after they stayed unused for that many frames, as counted by vmaSetCurrentFrameIndex():
+
+\code
+VmaPoolCreateInfo poolCreateInfo = {};
+poolCreateInfo.memoryTypeIndex = memTypeIndex;
+poolCreateInfo.blockSize = 64ull * 1024 * 1024;
+poolCreateInfo.maxEmptyBlockCount = 4;
+poolCreateInfo.emptyBlockReleaseFrameCount = 300;
+\endcode
+
+Function vmaGetPoolEmptyBlockStatistics() returns the number of empty blocks currently kept and how many
+times an allocation reused one of them instead of allocating new memory.
+
 \section custom_memory_pools_when_not_use When not to use custom pools
 
 Custom pools are commonly overused by VMA users.
@@ -18617,6 +23773,13 @@ You can, however, refuse to move some of them inside a defragmentation pass, by
 This is not recommended and may result in suboptimal packing of the allocations after defragmentation.
 If you cannot ensure any allocation can be moved, it is better to keep movable allocations separate in a custom pool.
 
+Allocations that must stay in place can be marked with #VMA_ALLOCATION_CREATE_IMMOVABLE_BIT
+or later with vmaSetAllocationImmovable(). Defragmentation never returns them in `pass.pMoves`, so they don't
+count towards the limit of ignored moves, and it starts by emptying the blocks that don't contain them.
+Member VmaAllocationCreateInfo::moveCost or vmaSetAllocationMoveCost() tells how expensive an allocation is to move,
+e.g. a large image with many views to recreate. Blocks are emptied in the order of their free space
+reduced by the size of their allocations multiplied by the cost, so the cheapest blocks to free are processed first.
+
 Inside a pass, for each allocation that should be moved:
 
 - You should copy its data from the source to the destination place by calling e.g. `vkCmdCopyBuffer()`, `vkCmdCopyImage()`.
@@ -18634,6 +23797,10 @@ Inside a pass, for each allocation that should be moved:
   you can set `pass.pMoves[i].operation` to #VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY.
   - vmaEndDefragmentationPass() will then free both source and destination memory, and will destroy the source #VmaAllocation object.
 
+If you copy the data of buffers using `vkCmdCopyBuffer`, you can use VmaDefragmentationPassMoveInfo::pCopyRegions instead of `pMoves`.
+It contains the same copies as ranges of `VkDeviceMemory`, where moves of neighboring allocations by the same distance are merged into one region,
+so the number of copies depends on the number of contiguous ranges rather than the number of allocations.
+
 You can defragment a specific custom pool by setting VmaDefragmentationInfo::pool
 (like in the example above) or all the default pools by setting this member to null.
 
@@ -18646,18 +23813,201 @@ Buffers/images should be recreated with the same `VkBufferCreateInfo` / `VkImage
 You can perform the defragmentation incrementally to limit the number of allocations and bytes to be moved
 in each pass, e.g. to call it in sync with render frames and not to experience too big hitches.
 See members: VmaDefragmentationInfo::maxBytesPerPass, VmaDefragmentationInfo::maxAllocationsPerPass.
+The CPU time spent computing the moves of a pass can be limited as well using VmaDefragmentationInfo::maxPlanningTimePerPass.
+The next pass then continues from the block and allocation where the previous one stopped.
+Total time spent computing the moves is returned in VmaDefragmentationStats::planningTime.
 
 It is also safe to perform the defragmentation asynchronously to render frames and other Vulkan and VMA
 usage, possibly from multiple threads, with the exception that allocations
 returned in VmaDefragmentationPassMoveInfo::pMoves shouldn't be destroyed until the defragmentation pass is ended.
 
+When defragmenting default pools, computing the moves of a pass can take significant time, as all memory types are processed one after another.
+If your application has a job system, you can provide VmaDefragmentationInfo::pfnDispatchJobs.
+Moves of each memory type are then computed in a separate job, which locks only that memory type,
+and the results are merged into a single VmaDefragmentationPassMoveInfo.
+
+\code
+void VKAPI_PTR DispatchDefragmentationJobs(void* pUserData, uint32_t jobCount, PFN_vmaJobFunction pfnJob, void* pJobData)
+{
+    MyJobSystem* jobSystem = (MyJobSystem*)pUserData;
+    jobSystem->ParallelFor(jobCount, [=](uint32_t jobIndex) { pfnJob(pJobData, jobIndex); });
+    // Must return only after all the jobs finished.
+}
+
+defragInfo.pfnDispatchJobs = DispatchDefragmentationJobs;
+defragInfo.pDispatchJobsUserData = &myJobSystem;
+\endcode
+
 <b>Mapping</b> is preserved on allocations that are moved during defragmentation.
 Whether through #VMA_ALLOCATION_CREATE_MAPPED_BIT or vmaMapMemory(), the allocations
 are mapped at their new place. Of course, pointer to the mapped data changes, so it needs to be queried
 using VmaAllocationInfo::pMappedData.
 
+When a new block cannot be created, e.g. because VmaPoolCreateInfo::maxBlockCount or the heap size is reached,
+even a small allocation may end up in its own dedicated `VkDeviceMemory`.
+Using #VMA_DEFRAGMENTATION_FLAG_PROMOTE_DEDICATED_BIT, such allocations are also returned in VmaDefragmentationPassMoveInfo::pMoves,
+with a destination reserved in free space of the existing blocks.
+Once the move is committed, their dedicated memory is freed and counted in VmaDefragmentationStats::deviceMemoryBlocksFreed.
+Allocations created as dedicated on purpose, e.g. with #VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, are never moved this way.
+
 \note Defragmentation is not supported in custom pools created with #VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT.
 
+\section defragmentation_monitor Defragmentation monitor
+
+Instead of deciding yourself when to defragment, e.g. by calling vmaCalculateStatistics() every frame,
+you can let the allocator track fragmentation by filling VmaAllocatorCreateInfo::pDefragmentationMonitor.
+Free space, the largest free region, and the number of free regions of each memory block are then updated on every allocation and free,
+so checking them is cheap.
+vmaSetCurrentFrameIndex() calls VmaDefragmentationMonitor::pfnProposal for every pool where VmaFragmentationInfo::fragmentation
+exceeds VmaDefragmentationMonitor::fragmentationThreshold.
+A good reaction is to perform a single small pass, so that the memory stays compact over a long session without hitches.
+
+\code
+void VKAPI_PTR ProposeDefragmentation(VmaAllocator allocator, VmaPool pool, uint32_t memoryTypeIndex,
+    const VmaFragmentationInfo* pFragmentationInfo, void* pUserData)
+{
+    MyDefragmentationQueue* queue = (MyDefragmentationQueue*)pUserData;
+    VmaDefragmentationInfo defragInfo = {};
+    defragInfo.pool = pool;
+    defragInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT;
+    defragInfo.maxBytesPerPass = 16ull * 1024 * 1024;
+    queue->PushSinglePass(defragInfo);
+}
+
+VmaDefragmentationMonitor defragMonitor = {};
+defragMonitor.fragmentationThreshold = 0.5f;
+defragMonitor.minFragmentedSize = 64ull * 1024 * 1024;
+defragMonitor.pfnProposal = ProposeDefragmentation;
+defragMonitor.pUserData = &myDefragmentationQueue;
+
+allocatorCreateInfo.pDefragmentationMonitor = &defragMonitor;
+\endcode
+
+Default pools are proposed at most once per call with `pool` equal to null, for the most fragmented memory type,
+as their defragmentation processes all memory types.
+The callback is called without any internal lock held, so it can create or destroy pools, including the proposed one.
+Pools destroyed by the callback are not proposed in the rest of the same call.
+Pools created with #VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT are not tracked.
+
+\section defragmentation_estimate Estimating defragmentation
+
+Function vmaEstimateDefragmentation() takes the same VmaDefragmentationInfo as vmaBeginDefragmentation(),
+runs the chosen algorithm over copies of the memory blocks, and returns the predicted VmaDefragmentationStats
+together with the size of the largest free region left after defragmentation.
+Nothing is moved, so it can be called at any time to check whether defragmentation would pay off,
+or to compare the algorithms by their results and VmaDefragmentationStats::planningTime.
+
+\code
+VmaDefragmentationInfo defragInfo = {};
+defragInfo.pool = myPool;
+defragInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT;
+
+VmaDefragmentationEstimate estimate;
+vmaEstimateDefragmentation(allocator, &defragInfo, &estimate);
+if(estimate.stats.bytesFreed >= 64ull * 1024 * 1024)
+{
+    // Worth it - begin defragmentation with the same defragInfo.
+}
+\endcode
+
+The result is a prediction, not a guarantee:
+
+- It assumes that all proposed moves are performed, none ignored or destroyed.
+- Buffer-image granularity is not taken into account, so #VMA_DEFRAGMENTATION_FLAG_ALGORITHM_EXTENSIVE_BIT
+  is estimated as #VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT.
+- Members `pfnBreakCallback`, `maxPlanningTimePerPass`, and #VMA_DEFRAGMENTATION_FLAG_PROMOTE_DEDICATED_BIT are ignored.
+- Move hints: #VMA_ALLOCATION_CREATE_IMMOVABLE_BIT and VmaAllocationCreateInfo::moveCost only affect the order of blocks,
+  allocations are treated as movable.
+- Each memory type of default pools is simulated separately, as if limits per pass applied to each of them.
+- Release of the blocks that become empty is predicted using the heap budget at the time of the call.
+- #VMA_DEBUG_MARGIN is not taken into account.
+
+Within these limits, #VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT and #VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT
+are simulated exactly: the blocks are processed in the same order and the moves get the same destinations,
+so defragmentation started right after the estimate moves and frees the same number of allocations and blocks.
+
+Don't call it on memory being defragmented at the same time.
+
+\section defragmentation_host Defragmentation of host-visible memory
+
+For custom pools and memory types that are `HOST_VISIBLE`, e.g. used for staging or readback, the data can be moved on the CPU.
+Instead of mapping the allocations and copying them yourself, call vmaExecuteDefragmentationPassOnHost() between
+vmaBeginDefragmentationPass() and vmaEndDefragmentationPass().
+It copies the data of all the moves through mapped pointers of the memory blocks and flushes or invalidates memory that is not `HOST_COHERENT`.
+If VmaDefragmentationInfo::pfnDispatchJobs is set, large copies are split into jobs executed through it.
+
+\code
+VmaDefragmentationInfo defragInfo = {};
+defragInfo.pool = myStagingPool;
+
+VmaDefragmentationContext defragCtx;
+vmaBeginDefragmentation(allocator, &defragInfo, &defragCtx);
+
+for(;;)
+{
+    VmaDefragmentationPassMoveInfo pass;
+    if(vmaBeginDefragmentationPass(allocator, defragCtx, &pass) == VK_SUCCESS)
+        break;
+
+    vmaExecuteDefragmentationPassOnHost(allocator, defragCtx, &pass);
+    // Recreate buffers bound to pass.pMoves[i].srcAllocation...
+
+    if(vmaEndDefragmentationPass(allocator, defragCtx, &pass) == VK_SUCCESS)
+        break;
+}
+
+vmaEndDefragmentation(allocator, defragCtx, nullptr);
+\endcode
+
+\section defragmentation_record_copies Recording copies of buffers
+
+Copying data of buffers on the GPU doesn't require creating a new buffer for every move.
+Function vmaRecordDefragmentationPassCopies() records the copies of the whole pass into your command buffer
+with `vkCmdCopyBuffer`, between buffers bound to entire `VkDeviceMemory` blocks, which are created once and reused by following passes.
+Moves of allocations created for images are not recorded - the function returns `VK_INCOMPLETE` then, and you need to copy them yourself.
+
+\code
+BeginCommandBuffer(cmdBuf);
+// Barrier making previous writes to the moved buffers available for transfer...
+vmaRecordDefragmentationPassCopies(allocator, defragCtx, &pass, cmdBuf);
+// Barrier making the copies available for following use...
+EndAndSubmitCommandBufferAndWait(cmdBuf);
+// Recreate buffers bound to pass.pMoves[i].srcAllocation...
+\endcode
+
+\section defragmentation_residency Residency management
+
+When video memory is oversubscribed, e.g. by other applications, resources used less frequently can be moved
+to system memory and brought back later. Create such allocations with #VMA_ALLOCATION_CREATE_EVICTABLE_BIT.
+The memory types allowed by `VkMemoryRequirements::memoryTypeBits` of the resource, VmaAllocationCreateInfo::memoryTypeBits,
+and required flags, including those implied by VmaAllocationCreateInfo::usage, are remembered, as well as the memory type chosen at creation time, which becomes the preferred one.
+
+Function vmaBeginResidency() returns a context used by the same pass functions as defragmentation.
+Each pass compares VmaBudget::usage of the heaps with VmaBudget::budget:
+
+- From a `DEVICE_LOCAL` heap with usage above VmaResidencyInfo::evictionThreshold of the budget,
+  evictable allocations are moved to `HOST_VISIBLE` memory types of other heaps.
+  Only blocks whose all allocations can be moved are processed, so that their `VkDeviceMemory` is freed.
+- Allocations not in their preferred memory type are moved back when usage of its heap with them stays
+  below VmaResidencyInfo::restoreThreshold.
+
+\code
+VmaResidencyInfo residencyInfo = {};
+residencyInfo.evictionThreshold = 0.95f;
+residencyInfo.restoreThreshold = 0.8f;
+residencyInfo.maxBytesPerPass = 64ull * 1024 * 1024;
+
+VmaDefragmentationContext residencyCtx;
+vmaBeginResidency(allocator, &residencyInfo, &residencyCtx);
+// Passes as in the examples above, with data copied by vmaRecordDefragmentationPassCopies()...
+vmaEndDefragmentation(allocator, residencyCtx, nullptr);
+\endcode
+
+It can be done e.g. once every few seconds, or when VmaAllocatorCreateInfo::pMemoryPressureMonitor reports high usage.
+Allocations whose move is ignored by setting #VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE are not moved again by the same context.
+Only allocations made in default pools and not as dedicated are moved. Mapped allocations are not moved back to
+memory types that are not `HOST_VISIBLE`. Don't use more than one such context or defragmentation at the same time.
+
 
 \page statistics Statistics
 
@@ -18838,6 +24188,11 @@ else
 }
 \endcode
 
+When you need to make many allocations at once, you can use vmaVirtualAllocateMultiple() with an array of
+#VmaVirtualAllocationCreateInfo structures, and free them with vmaVirtualFreeMultiple().
+They work the same way as calling the single-allocation functions in a loop, but with less overhead per allocation.
+When some of the allocations fail, the others are still made and failed ones are returned as `VK_NULL_HANDLE`.
+
 \section virtual_allocator_deallocation Deallocation
 
 When no longer needed, an allocation can be freed by calling vmaVirtualFree().
@@ -18928,11 +24283,137 @@ vmaBuildVirtualBlockStatsString().
 Returned string must be later freed using vmaFreeVirtualBlockStatsString().
 The format of this string differs from the one returned by the main Vulkan allocator, but it is similar.
 
+\section virtual_allocator_resizing Resizing virtual block
+
+Size of a virtual block, specified in VmaVirtualBlockCreateInfo::size, can be changed later without recreating the block
+by calling vmaResizeVirtualBlock(). This is useful e.g. when the buffer suballocated using the virtual block
+gets replaced with a bigger one. Existing allocations keep their offsets and handles.
+A block can shrink only if the space being removed from its end is free.
+
+\code
+res = vmaResizeVirtualBlock(block, 2 * 1048576); // Grow to 2 MB
+\endcode
+
+\section virtual_allocator_defragmentation Defragmentation of virtual blocks
+
+Virtual blocks fragment just like the real GPU memory does. One or more of them can be defragmented together
+using an API similar to the one described in chapter \ref defragmentation. Fill structure #VmaVirtualDefragmentationInfo
+and call vmaBeginVirtualDefragmentation(), then perform passes with vmaBeginVirtualDefragmentationPass() and
+vmaEndVirtualDefragmentationPass(). Each move describes a range of `size` bytes to be copied from `srcOffset` in `srcBlock`
+to `dstOffset` in `dstBlock`. Because virtual allocation handles are tied to their place in the block,
+after the pass ends the allocation is represented by the new handle VmaVirtualDefragmentationMove::dstAllocation,
+which keeps the custom `pUserData` pointer. It can be used to find the object that needs to be updated.
+
+\code
+VmaVirtualDefragmentationInfo defragInfo = {};
+defragInfo.blockCount = 1;
+defragInfo.pBlocks = &block;
+defragInfo.alignment = 16;
+
+VmaVirtualDefragmentationContext defragCtx;
+res = vmaBeginVirtualDefragmentation(&defragInfo, &defragCtx);
+// Check res...
+
+for(;;)
+{
+    VmaVirtualDefragmentationPassMoveInfo pass;
+    res = vmaBeginVirtualDefragmentationPass(defragCtx, &pass);
+    if(res == VK_SUCCESS)
+        break;
+
+    for(uint32_t i = 0; i < pass.moveCount; ++i)
+    {
+        // Record copy of pass.pMoves[i].size bytes from pass.pMoves[i].srcOffset to pass.pMoves[i].dstOffset...
+        VmaVirtualAllocationInfo allocInfo;
+        vmaGetVirtualAllocationInfo(block, pass.pMoves[i].srcAllocation, &allocInfo);
+        MyObject* obj = (MyObject*)allocInfo.pUserData;
+        obj->allocation = pass.pMoves[i].dstAllocation;
+        obj->offset = pass.pMoves[i].dstOffset;
+    }
+    // Submit the copies and wait for them to finish...
+
+    res = vmaEndVirtualDefragmentationPass(defragCtx, &pass);
+    if(res == VK_SUCCESS)
+        break;
+}
+
+vmaEndVirtualDefragmentation(defragCtx, nullptr);
+\endcode
+
+Allocations are moved towards the beginning of the blocks, so after defragmentation a block can often be shrunk
+with vmaResizeVirtualBlock(). Only blocks using the default algorithm can be defragmented.
+
+\section virtual_allocator_serialization Saving and restoring virtual block
+
+Rebuilding a large virtual block by repeating all the calls to vmaVirtualAllocate() can take a long time.
+Instead, the whole state of the block can be saved with vmaSerializeVirtualBlock() and restored with vmaDeserializeVirtualBlock(),
+which recreates the internal structures directly, preserving offsets, sizes, and `pUserData` pointers of all allocations.
+Handles of the restored allocations are different - they can be returned in an array, in order of increasing offsets.
+
+\code
+size_t dataSize = 0;
+vmaSerializeVirtualBlock(block, &dataSize, nullptr); // Query required size.
+std::vector<char> data(dataSize);
+vmaSerializeVirtualBlock(block, &dataSize, data.data());
+
+// Later...
+VmaVirtualBlock restoredBlock;
+res = vmaDeserializeVirtualBlock(data.data(), data.size(), nullptr, 0, nullptr, &restoredBlock);
+\endcode
+
+`pUserData` pointers are stored as plain integer values, so they are meaningful after restoring only if they don't point to memory,
+e.g. when they store indices. The snapshot uses native byte order and is versioned - data created by a different version of the library
+is rejected with `VK_ERROR_FORMAT_NOT_SUPPORTED`.
+
+\section virtual_allocator_block_vector Collection of virtual blocks
+
+A single virtual block has fixed size. If you need the amount of space to grow on demand,
+you can create a #VmaVirtualBlockVector object using vmaCreateVirtualBlockVector().
+It keeps a list of virtual blocks of the same size and, just like default pools of the real GPU memory,
+chooses a block to try first for a new allocation, creates new blocks when out of free space, and deletes empty ones.
+
+Each allocation made with vmaVirtualBlockVectorAllocate() is identified by the index of its block and the allocation handle within that block.
+Optional callbacks VmaVirtualBlockVectorCreateInfo::pfnCreateBlock and VmaVirtualBlockVectorCreateInfo::pfnDestroyBlock
+let you create and release the resource backing each block, e.g. a large `VkBuffer`.
+Index of a released block may be reused for a block created later.
+
+\code
+VkResult CreateBackingBuffer(VmaVirtualBlockVector vector, uint32_t blockIndex, VkDeviceSize size, void* pUserData)
+{
+    // Create buffer of given size and remember it under blockIndex...
+    return VK_SUCCESS;
+}
+void DestroyBackingBuffer(VmaVirtualBlockVector vector, uint32_t blockIndex, void* pUserData)
+{
+    // Destroy buffer remembered under blockIndex...
+}
+
+VmaVirtualBlockVectorCreateInfo vectorCreateInfo = {};
+vectorCreateInfo.blockSize = 16ull * 1024 * 1024; // 16 MB
+vectorCreateInfo.pfnCreateBlock = CreateBackingBuffer;
+vectorCreateInfo.pfnDestroyBlock = DestroyBackingBuffer;
+
+VmaVirtualBlockVector vector;
+VkResult res = vmaCreateVirtualBlockVector(&vectorCreateInfo, &vector);
+
+VmaVirtualAllocationCreateInfo allocCreateInfo = {};
+allocCreateInfo.size = 4096; // 4 KB
+
+VmaVirtualAllocation alloc;
+uint32_t blockIndex;
+VkDeviceSize offset;
+res = vmaVirtualBlockVectorAllocate(vector, &allocCreateInfo, &alloc, &blockIndex, &offset);
+// Use range [offset, offset + 4096) of the buffer created for blockIndex...
+
+vmaVirtualBlockVectorFree(vector, blockIndex, alloc);
+vmaDestroyVirtualBlockVector(vector);
+\endcode
+
 \section virtual_allocator_additional_considerations Additional considerations
 
 The "virtual allocator" functionality is implemented on a level of individual memory blocks.
-Keeping track of a whole collection of blocks, allocating new ones when out of free space,
-deleting empty ones, and deciding which one to try first for a new allocation must be implemented by the user.
+Keeping track of a whole collection of blocks can be implemented by the user or delegated to #VmaVirtualBlockVector,
+as described in section \ref virtual_allocator_block_vector.
 
 Alternative allocation algorithms are supported, just like in custom pools of the real GPU memory.
 See enum #VmaVirtualBlockCreateFlagBits to learn how to specify them (e.g. #VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT).
@@ -19770,6 +25251,29 @@ vmaCreateImage(allocator, &imgCreateInfo, &allocCreateInfo, &img, &alloc, nullpt
 - Allocations created in default pools: They inherit the priority from the parameters
   VMA used when creating default pools, which means `priority == 0.5F`.
 
+\section vk_ext_memory_priority_dynamic Dynamic priorities
+
+Priorities described above are static - they are set once when the `VkDeviceMemory` is allocated.
+If you also enable VK_EXT_pageable_device_local_memory extension and its feature
+`VkPhysicalDevicePageableDeviceLocalMemoryFeaturesEXT::pageableDeviceLocalMemory`
+and add #VMA_ALLOCATOR_CREATE_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_BIT to VmaAllocatorCreateInfo::flags,
+the library changes priorities of its memory blocks in `DEVICE_LOCAL` memory types based on how they are used,
+using `vkSetDeviceMemoryPriorityEXT`.
+
+Priorities are updated in vmaSetCurrentFrameIndex() once every #VMA_MEMORY_PRIORITY_UPDATE_FRAME_COUNT frames.
+Each block gets:
+
+- `1.0f` if it contains any allocation created with #VMA_ALLOCATION_CREATE_PRIORITY_HOT_BIT,
+- `0.0f` if all its allocations were created with #VMA_ALLOCATION_CREATE_PRIORITY_COLD_BIT,
+- the priority of its pool (`0.5f` for default pools) if it was used within the last #VMA_MEMORY_PRIORITY_RECENT_FRAME_COUNT frames,
+- half of the priority of its pool otherwise.
+
+A block is considered used when an allocation is created in it, mapped using vmaMapMemory(),
+or when you call vmaNotifyAllocationUsed() for any of its allocations.
+`vkSetDeviceMemoryPriorityEXT` is called only for blocks whose priority changed.
+
+Dedicated allocations keep the priority they were created with.
+
 
 \page vk_amd_device_coherent_memory VK_AMD_device_coherent_memory
 
@@ -240,6 +240,25 @@ static uint32_t MemoryTypeToHeap(uint32_t memoryTypeIndex)
     return props->memoryTypes[memoryTypeIndex].heapIndex;
 }
 
+// Fills device and Vulkan functions of a separate allocator for tests that need custom allocator parameters.
+// Members of outVulkanFunctions can be replaced with stubs afterwards, before the allocator is created.
+// Set flags and vulkanApiVersion before calling it, as they decide which functions are imported.
+static void SetBasicAllocatorCreateInfo(VmaAllocatorCreateInfo& outInfo, VmaVulkanFunctions& outVulkanFunctions)
+{
+    outInfo.physicalDevice = g_hPhysicalDevice;
+    outInfo.device = g_hDevice;
+    outInfo.instance = g_hVulkanInstance;
+    outVulkanFunctions = {};
+#ifdef VOLK_HEADER_VERSION
+    vmaImportVulkanFunctionsFromVolk(&outInfo, &outVulkanFunctions);
+#endif
+#if VMA_DYNAMIC_VULKAN_FUNCTIONS
+    outVulkanFunctions.vkGetInstanceProcAddr = vkGetInstanceProcAddr;
+    outVulkanFunctions.vkGetDeviceProcAddr = vkGetDeviceProcAddr;
+#endif
+    outInfo.pVulkanFunctions = &outVulkanFunctions;
+}
+
 static uint32_t GetAllocationStrategyCount()
 {
     switch(ConfigType)
@@ -1623,6 +1642,29 @@ static void ProcessDefragmentationPass(VmaDefragmentationPassMoveInfo& stepInfo)
     }
 }
 
+static void ValidateDefragmentationCopyRegions(const VmaDefragmentationPassMoveInfo& pass)
+{
+    // Copy regions must cover exactly the data of all the moves.
+    VkDeviceSize moveBytes = 0;
+    for(uint32_t i = 0; i < pass.moveCount; ++i)
+    {
+        VmaAllocationInfo allocInfo;
+        vmaGetAllocationInfo(g_hAllocator, pass.pMoves[i].srcAllocation, &allocInfo);
+        moveBytes += allocInfo.size;
+    }
+    VkDeviceSize regionBytes = 0;
+    for(uint32_t i = 0; i < pass.copyRegionCount; ++i)
+    {
+        const VmaDefragmentationCopyRegion& region = pass.pCopyRegions[i];
+        TEST(region.size > 0);
+        TEST(region.srcMemory != region.dstMemory ||
+            region.srcOffset + region.size <= region.dstOffset || region.dstOffset + region.size <= region.srcOffset);
+        regionBytes += region.size;
+    }
+    TEST(pass.copyRegionCount > 0 && pass.copyRegionCount <= pass.moveCount);
+    TEST(regionBytes == moveBytes);
+}
+
 static void Defragment(VmaDefragmentationInfo& defragmentationInfo,
     VmaDefragmentationStats* defragmentationStats = nullptr)
 {
@@ -1633,7 +1675,8 @@ static void Defragment(VmaDefragmentationInfo& defragmentationInfo,
     VmaDefragmentationPassMoveInfo pass = {};
     while ((res = vmaBeginDefragmentationPass(g_hAllocator, defragCtx, &pass)) == VK_INCOMPLETE)
     {
-        wprintf(L"  Pass: moveCount=%u\n", pass.moveCount);
+        wprintf(L"  Pass: moveCount=%u, copyRegionCount=%u\n", pass.moveCount, pass.copyRegionCount);
+        ValidateDefragmentationCopyRegions(pass);
 
         BeginSingleTimeCommands();
         ProcessDefragmentationPass(pass);
@@ -2390,6 +2433,12 @@ void TestDefragmentationAlgorithms()
                 output += L"_Move";
             SaveAllocatorStatsToFile((output + L"_Before.json").c_str());
 
+            VmaDefragmentationEstimate estimate = {};
+            TEST(vmaEstimateDefragmentation(g_hAllocator, &defragInfo, &estimate) == VK_SUCCESS);
+            wprintf(L"  Estimate: bytesMoved=%llu, allocationsMoved=%u, deviceMemoryBlocksFreed=%u, largestFreeRegionSize=%llu, planningTime=%llu ns\n",
+                estimate.stats.bytesMoved, estimate.stats.allocationsMoved, estimate.stats.deviceMemoryBlocksFreed,
+                estimate.largestFreeRegionSize, estimate.stats.planningTime);
+
             VmaDefragmentationContext defragCtx = nullptr;
             VkResult res = vmaBeginDefragmentation(g_hAllocator, &defragInfo, &defragCtx);
             TEST(res == VK_SUCCESS);
@@ -2453,6 +2502,17 @@ void TestDefragmentationAlgorithms()
       
             VmaDefragmentationStats defragStats;
             vmaEndDefragmentation(g_hAllocator, defragCtx, &defragStats);
+            wprintf(L"  Actual: bytesMoved=%llu, allocationsMoved=%u, deviceMemoryBlocksFreed=%u, planningTime=%llu ns\n",
+                defragStats.bytesMoved, defragStats.allocationsMoved, defragStats.deviceMemoryBlocksFreed, defragStats.planningTime);
+
+            // Without ignored moves the estimate of these algorithms is exact.
+            if (j == 0 && VMA_DEBUG_MARGIN == 0 &&
+                (defragInfo.flags == VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT ||
+                defragInfo.flags == VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT))
+            {
+                TEST(estimate.stats.allocationsMoved == defragStats.allocationsMoved);
+                TEST(estimate.stats.deviceMemoryBlocksFreed == defragStats.deviceMemoryBlocksFreed);
+            }
 
             SaveAllocatorStatsToFile((output + L"_After.json").c_str());
             ValidateAllocationsData(allocations.data(), allocations.size());
@@ -2532,222 +2592,1072 @@ void TestDefragmentationFull()
 
 static void PrintDefragmentationStats(const VmaDefragmentationStats& stats)
 {
-    wprintf(L"  Stats: bytesMoved=%llu, bytesFreed=%llu, allocationsMoved=%u, deviceMemoryBlocksFreed=%u\n",
-        stats.bytesMoved, stats.bytesFreed, stats.allocationsMoved, stats.deviceMemoryBlocksFreed);
+    wprintf(L"  Stats: bytesMoved=%llu, bytesFreed=%llu, allocationsMoved=%u, deviceMemoryBlocksFreed=%u, planningTime=%llu ns\n",
+        stats.bytesMoved, stats.bytesFreed, stats.allocationsMoved, stats.deviceMemoryBlocksFreed, stats.planningTime);
 }
 
-static void TestDefragmentationGpu()
+static void TestDefragmentationParallel()
 {
-    wprintf(L"Test defragmentation GPU\n");
-
-    // Create that many allocations to surely fill 3 new blocks of 256 MB.
-    const VkDeviceSize bufSizeMin = 5ull * 1024 * 1024;
-    const VkDeviceSize bufSizeMax = 10ull * 1024 * 1024;
-    const VkDeviceSize totalSize = 3ull * 256 * 1024 * 1024;
-    const size_t bufCount = (size_t)(totalSize / bufSizeMin);
-    const size_t percentToLeave = 30;
-    const size_t percentNonMovable = 3;
-    RandomNumberGenerator rand = { 234522 };
+    wprintf(L"Test defragmentation parallel\n");
 
     std::vector<AllocInfo> allocations;
-    allocations.reserve(bufCount);
-
-    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-
-    VmaAllocationCreateInfo allocCreateInfo = {};
-    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
 
-    // Create all intended buffers.
-    for(size_t i = 0; i < bufCount; ++i)
+    // Create initial allocations.
+    for(size_t i = 0; i < 400; ++i)
     {
-        bufCreateInfo.size = align_up(rand.Generate() % (bufSizeMax - bufSizeMin) + bufSizeMin, 32ull);
-
-        AllocInfo alloc;
-
-        if(rand.Generate() % 100 < percentNonMovable)
-        {
-            bufCreateInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-                VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-            alloc.m_DefragmentationMovable = false;
-        }
-        else
-        {
-            // Different usage just to see different color in output from VmaDumpVis.
-            bufCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
-                VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-            // And in JSON dump.
-        }
-
-        alloc.CreateBuffer(bufCreateInfo, allocCreateInfo);
-        alloc.m_StartValue = rand.Generate();
-        allocations.push_back(alloc);
+        AllocInfo allocation;
+        CreateAllocation(allocation);
+        allocations.push_back(allocation);
     }
 
-    // Destroy some percentage of them.
+    // Delete random allocations
+    const size_t allocationsToDeletePercent = 80;
+    size_t allocationsToDelete = allocations.size() * allocationsToDeletePercent / 100;
+    for(size_t i = 0; i < allocationsToDelete; ++i)
     {
-        const size_t buffersToDestroy = round_div<size_t>(bufCount * (100 - percentToLeave), 100);
-        for(size_t i = 0; i < buffersToDestroy; ++i)
-        {
-            const size_t index = rand.Generate() % allocations.size();
-            allocations[index].Destroy();
-            allocations.erase(allocations.begin() + index);
-        }
+        size_t index = (size_t)rand() % allocations.size();
+        DestroyAllocation(allocations[index]);
+        allocations.erase(allocations.begin() + index);
     }
 
     // Set data for defragmentation retrieval
     for (auto& alloc : allocations)
         vmaSetAllocationUserData(g_hAllocator, alloc.m_Allocation, &alloc);
 
-    // Fill them with meaningful data.
-    UploadGpuData(allocations.data(), allocations.size());
+    struct DispatchData
+    {
+        std::atomic<uint32_t> dispatchCount{ 0 };
+        std::atomic<uint32_t> jobCount{ 0 };
+    } dispatchData;
+    const PFN_vmaDispatchJobsFunction dispatchJobs = [](void* pUserData, uint32_t jobCount, PFN_vmaJobFunction pfnJob, void* pJobData)
+    {
+        DispatchData* data = (DispatchData*)pUserData;
+        ++data->dispatchCount;
 
-    wchar_t fileName[MAX_PATH];
-    swprintf_s(fileName, L"GPU_defragmentation_A_before.json");
-    SaveAllocatorStatsToFile(fileName);
+        std::vector<std::thread> threads;
+        for(uint32_t i = 0; i < jobCount; ++i)
+        {
+            threads.emplace_back([=]()
+            {
+                pfnJob(pJobData, i);
+                ++data->jobCount;
+            });
+        }
+        for(auto& thread : threads)
+            thread.join();
+    };
 
-    // Defragment using GPU only.
-    {
-        VmaDefragmentationInfo defragInfo = {};
-        VmaDefragmentationStats stats;
-        Defragment(defragInfo, &stats);
-        PrintDefragmentationStats(stats);
+    VmaDefragmentationInfo defragmentationInfo = {};
+    defragmentationInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT;
+    defragmentationInfo.maxAllocationsPerPass = 16;
+    defragmentationInfo.pfnDispatchJobs = dispatchJobs;
+    defragmentationInfo.pDispatchJobsUserData = &dispatchData;
 
-        // If corruption detection is enabled, GPU defragmentation may not work on
-        // memory types that have this detection active, e.g. on Intel.
-        #if !defined(VMA_DEBUG_DETECT_CORRUPTION) || VMA_DEBUG_DETECT_CORRUPTION == 0
-            TEST(stats.allocationsMoved > 0 && stats.bytesMoved > 0);
-            TEST(stats.deviceMemoryBlocksFreed > 0 && stats.bytesFreed > 0);
-        #endif
-    }
+    VmaDefragmentationStats stats;
+    Defragment(defragmentationInfo, &stats);
+    PrintDefragmentationStats(stats);
 
-    swprintf_s(fileName, L"GPU_defragmentation_B_after.json");
-    SaveAllocatorStatsToFile(fileName);
-    ValidateGpuData(allocations.data(), allocations.size());
+    // One job per memory type in each pass.
+    const VkPhysicalDeviceMemoryProperties* memProps = nullptr;
+    vmaGetMemoryProperties(g_hAllocator, &memProps);
+    TEST(dispatchData.dispatchCount > 0);
+    TEST(dispatchData.jobCount == dispatchData.dispatchCount * memProps->memoryTypeCount);
 
-    // Destroy all remaining buffers.
-    for(size_t i = allocations.size(); i--; )
-    {
-        allocations[i].Destroy();
-    }
+    ValidateAllocationsData(allocations.data(), allocations.size());
+    DestroyAllAllocations(allocations);
 }
 
-static void TestDefragmentationIncrementalBasic()
+static void TestDefragmentationTimeBudget()
 {
-    wprintf(L"Test defragmentation incremental basic\n");
+    wprintf(L"Test defragmentation time budget\n");
 
     std::vector<AllocInfo> allocations;
 
-    // Create that many allocations to surely fill 3 new blocks of 256 MB.
-    const std::array<uint32_t, 3> imageSizes = { 256, 512, 1024 };
-    const VkDeviceSize bufSizeMin = 5ull * 1024 * 1024;
-    const VkDeviceSize bufSizeMax = 10ull * 1024 * 1024;
-    const VkDeviceSize totalSize = 3ull * 256 * 1024 * 1024;
-    const size_t imageCount = totalSize / ((size_t)imageSizes[0] * imageSizes[0] * 4) / 2;
-    const size_t bufCount = (size_t)(totalSize / bufSizeMin) / 2;
-    const size_t percentToLeave = 30;
-    RandomNumberGenerator rand = { 234522 };
+    // Create initial allocations.
+    for(size_t i = 0; i < 400; ++i)
+    {
+        AllocInfo allocation;
+        CreateAllocation(allocation);
+        allocations.push_back(allocation);
+    }
 
-    VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
-    imageInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
-    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
-    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    // Delete random allocations
+    const size_t allocationsToDeletePercent = 80;
+    size_t allocationsToDelete = allocations.size() * allocationsToDeletePercent / 100;
+    for(size_t i = 0; i < allocationsToDelete; ++i)
+    {
+        size_t index = (size_t)rand() % allocations.size();
+        DestroyAllocation(allocations[index]);
+        allocations.erase(allocations.begin() + index);
+    }
 
-    VmaAllocationCreateInfo allocCreateInfo = {};
-    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+    // Set data for defragmentation retrieval
+    for (auto& alloc : allocations)
+        vmaSetAllocationUserData(g_hAllocator, alloc.m_Allocation, &alloc);
 
-    // Create all intended images.
-    for(size_t i = 0; i < imageCount; ++i)
+    // Budget so small that every pass stops right after finding its first move.
+    VmaDefragmentationInfo defragmentationInfo = {};
+    defragmentationInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT;
+    defragmentationInfo.maxPlanningTimePerPass = 1;
+
+    VmaDefragmentationStats stats;
+    Defragment(defragmentationInfo, &stats);
+    PrintDefragmentationStats(stats);
+
+    TEST(stats.allocationsMoved > 0);
+    TEST(stats.planningTime > 0);
+
+    ValidateAllocationsData(allocations.data(), allocations.size());
+    DestroyAllAllocations(allocations);
+}
+
+static void TestDefragmentationMonitor()
+{
+    wprintf(L"Test defragmentation monitor\n");
+
+    struct Proposal
     {
-        const uint32_t size = imageSizes[rand.Generate() % 3];
+        VmaPool pool;
+        uint32_t memoryTypeIndex;
+        VmaFragmentationInfo fragmentationInfo;
+    };
+    std::vector<Proposal> proposals;
+    const PFN_vmaDefragmentationProposalFunction proposeDefragmentation = [](VmaAllocator allocator, VmaPool pool,
+        uint32_t memoryTypeIndex, const VmaFragmentationInfo* pFragmentationInfo, void* pUserData)
+    {
+        TEST(allocator != VK_NULL_HANDLE);
+        ((std::vector<Proposal>*)pUserData)->push_back({ pool, memoryTypeIndex, *pFragmentationInfo });
+
+        // No lock is held during the call, so pools can be created and destroyed.
+        VmaPoolCreateInfo tmpPoolCreateInfo = {};
+        tmpPoolCreateInfo.memoryTypeIndex = memoryTypeIndex;
+        VmaPool tmpPool = VK_NULL_HANDLE;
+        TEST(vmaCreatePool(allocator, &tmpPoolCreateInfo, &tmpPool) == VK_SUCCESS);
+        vmaDestroyPool(allocator, tmpPool);
+    };
 
-        imageInfo.extent.width = size;
-        imageInfo.extent.height = size;
+    VmaDefragmentationMonitor defragMonitor = {};
+    defragMonitor.fragmentationThreshold = 0.5f;
+    defragMonitor.minFragmentedSize = 64 * 1024;
+    defragMonitor.pfnProposal = proposeDefragmentation;
+    defragMonitor.pUserData = &proposals;
 
-        AllocInfo alloc;
-        CreateImage(allocCreateInfo, imageInfo, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, alloc);
-        alloc.m_StartValue = 0;
+    VmaAllocatorCreateInfo allocatorCreateInfo = {};
+    SetAllocatorCreateInfo(allocatorCreateInfo);
+    allocatorCreateInfo.pDefragmentationMonitor = &defragMonitor;
 
-        allocations.push_back(alloc);
-    }
+    VmaAllocator localAllocator = VK_NULL_HANDLE;
+    VkResult res = vmaCreateAllocator(&allocatorCreateInfo, &localAllocator);
+    TEST(res == VK_SUCCESS && localAllocator);
 
-    // And all buffers
     VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.size = 0x10000;
+    bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
-    for(size_t i = 0; i < bufCount; ++i)
-    {
-        bufCreateInfo.size = align_up<VkDeviceSize>(bufSizeMin + rand.Generate() % (bufSizeMax - bufSizeMin), 16);
-        bufCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
 
-        AllocInfo alloc;
-        alloc.CreateBuffer(bufCreateInfo, allocCreateInfo);
-        alloc.m_StartValue = 0;
+    const VkDeviceSize blockSize = 4ull * 1024 * 1024;
+    const VkDeviceSize allocSize = 64ull * 1024;
+    VmaPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.blockSize = blockSize;
+    res = vmaFindMemoryTypeIndexForBufferInfo(localAllocator, &bufCreateInfo, &allocCreateInfo, &poolCreateInfo.memoryTypeIndex);
+    TEST(res == VK_SUCCESS);
 
-        allocations.push_back(alloc);
-    }
+    VmaPool pool = VK_NULL_HANDLE;
+    res = vmaCreatePool(localAllocator, &poolCreateInfo, &pool);
+    TEST(res == VK_SUCCESS);
 
-    // Destroy some percentage of them.
+    // Fill 2 blocks completely.
+    allocCreateInfo = {};
+    allocCreateInfo.pool = pool;
+    const VkMemoryRequirements memReq = { allocSize, 256, 1u << poolCreateInfo.memoryTypeIndex };
+    std::vector<VmaAllocation> allocations(2 * (size_t)(blockSize / allocSize));
+    for(auto& alloc : allocations)
     {
-        const size_t allocationsToDestroy = round_div<size_t>((imageCount + bufCount) * (100 - percentToLeave), 100);
-        for(size_t i = 0; i < allocationsToDestroy; ++i)
-        {
-            const size_t index = rand.Generate() % allocations.size();
-            allocations[index].Destroy();
-            allocations.erase(allocations.begin() + index);
-        }
+        res = vmaAllocateMemory(localAllocator, &memReq, &allocCreateInfo, &alloc, nullptr);
+        TEST(res == VK_SUCCESS);
     }
 
+    vmaSetCurrentFrameIndex(localAllocator, 1);
+    TEST(proposals.empty());
+
+    // Free every other allocation - all the free space is fragmented.
+    for(size_t i = 0; i < allocations.size(); i += 2)
     {
-        // Set our user data pointers. A real application should probably be more clever here
-        const size_t allocationCount = allocations.size();
-        for(size_t i = 0; i < allocationCount; ++i)
-        {
-            AllocInfo &alloc = allocations[i];
-            vmaSetAllocationUserData(g_hAllocator, alloc.m_Allocation, &alloc);
-        }
+        vmaFreeMemory(localAllocator, allocations[i]);
+        allocations[i] = VK_NULL_HANDLE;
     }
 
-    // Fill them with meaningful data.
-    UploadGpuData(allocations.data(), allocations.size());
+    vmaSetCurrentFrameIndex(localAllocator, 2);
+    TEST(proposals.size() == 1);
+    TEST(proposals[0].pool == pool && proposals[0].memoryTypeIndex == poolCreateInfo.memoryTypeIndex);
+    const VmaFragmentationInfo& fragmentationInfo = proposals[0].fragmentationInfo;
+    TEST(fragmentationInfo.freeSize == blockSize);
+    TEST(fragmentationInfo.largestFreeRegionsSize == 2 * allocSize);
+    TEST(fragmentationInfo.freeRegionCount >= (uint32_t)(allocations.size() / 2));
+    TEST(fragmentationInfo.fragmentation > defragMonitor.fragmentationThreshold);
 
-    wchar_t fileName[MAX_PATH];
-    swprintf_s(fileName, L"GPU_defragmentation_incremental_basic_A_before.json");
-    SaveAllocatorStatsToFile(fileName);
+    // Free the rest - empty blocks are not fragmented.
+    for(auto& alloc : allocations)
+        vmaFreeMemory(localAllocator, alloc);
+    proposals.clear();
+    vmaSetCurrentFrameIndex(localAllocator, 3);
+    TEST(proposals.empty());
 
-    // Defragment using GPU only.
-    {
-        VmaDefragmentationInfo defragInfo = {};
-        VmaDefragmentationContext ctx = VK_NULL_HANDLE;
-        VkResult res = vmaBeginDefragmentation(g_hAllocator, &defragInfo, &ctx);
-        TEST(res == VK_SUCCESS);
+    vmaDestroyPool(localAllocator, pool);
+    vmaDestroyAllocator(localAllocator);
+}
 
-        VmaDefragmentationPassMoveInfo pass = {};
-        while ((res = vmaBeginDefragmentationPass(g_hAllocator, ctx, &pass)) == VK_INCOMPLETE)
-        {
-            wprintf(L"  Pass: moveCount=%u\n", pass.moveCount);
+static void TestDefragmentationPromoteDedicated()
+{
+    wprintf(L"Test defragmentation promoting dedicated allocations\n");
 
-            // Ignore data outside of test
-            for (uint32_t i = 0; i < pass.moveCount; ++i)
-            {
-                auto it = std::find_if(allocations.begin(), allocations.end(), [&](const AllocInfo& info) { return pass.pMoves[i].srcAllocation == info.m_Allocation; });
-                if (it == allocations.end())
-                    pass.pMoves[i].operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
-            }
+    VmaAllocatorCreateInfo allocatorCreateInfo = {};
+    SetAllocatorCreateInfo(allocatorCreateInfo);
+    allocatorCreateInfo.preferredLargeHeapBlockSize = 1024 * 1024;
 
-            BeginSingleTimeCommands();
-            ProcessDefragmentationPass(pass);
-            EndSingleTimeCommands();
+    VmaAllocator localAllocator = VK_NULL_HANDLE;
+    VkResult res = vmaCreateAllocator(&allocatorCreateInfo, &localAllocator);
+    TEST(res == VK_SUCCESS && localAllocator);
 
-            // Destroy old buffers/images and replace them with new handles.
-            for (size_t i = 0; i < pass.moveCount; ++i)
-            {
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.size = 0x10000;
+    bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+
+    // No explicit block size and a single block, so allocations that don't fit fall back to dedicated memory.
+    VmaPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.minBlockCount = 1;
+    poolCreateInfo.maxBlockCount = 1;
+    res = vmaFindMemoryTypeIndexForBufferInfo(localAllocator, &bufCreateInfo, &allocCreateInfo, &poolCreateInfo.memoryTypeIndex);
+    TEST(res == VK_SUCCESS);
+
+    VmaPool pool = VK_NULL_HANDLE;
+    res = vmaCreatePool(localAllocator, &poolCreateInfo, &pool);
+    TEST(res == VK_SUCCESS);
+
+    VmaStatistics poolStats = {};
+    vmaGetPoolStatistics(localAllocator, pool, &poolStats);
+    TEST(poolStats.blockCount == 1);
+    const VkDeviceSize blockSize = poolStats.blockBytes;
+    const VkDeviceSize allocSize = blockSize / 16;
+    const size_t dedicatedCount = 4;
+
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
+    allocCreateInfo.pool = pool;
+    const VkMemoryRequirements memReq = { allocSize, 256, 1u << poolCreateInfo.memoryTypeIndex };
+    std::vector<VmaAllocation> allocations(16 + dedicatedCount);
+    for(size_t i = 0; i < allocations.size(); ++i)
+    {
+        res = vmaAllocateMemory(localAllocator, &memReq, &allocCreateInfo, &allocations[i], nullptr);
+        TEST(res == VK_SUCCESS);
+        res = vmaCopyMemoryToAllocation(localAllocator, &i, allocations[i], 0, sizeof(i));
+        TEST(res == VK_SUCCESS);
+    }
+    vmaGetPoolStatistics(localAllocator, pool, &poolStats);
+    TEST(poolStats.blockCount == 1 + dedicatedCount);
+
+    // Make room in the block for 2 of the dedicated allocations.
+    vmaFreeMemory(localAllocator, allocations[0]);
+    vmaFreeMemory(localAllocator, allocations[1]);
+    allocations[0] = allocations[1] = VK_NULL_HANDLE;
+
+    VmaDefragmentationInfo defragInfo = {};
+    defragInfo.pool = pool;
+    defragInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT | VMA_DEFRAGMENTATION_FLAG_PROMOTE_DEDICATED_BIT;
+
+    VmaDefragmentationContext defragCtx = nullptr;
+    res = vmaBeginDefragmentation(localAllocator, &defragInfo, &defragCtx);
+    TEST(res == VK_SUCCESS);
+    size_t dedicatedMoveCount = 0;
+    for(;;)
+    {
+        VmaDefragmentationPassMoveInfo pass = {};
+        res = vmaBeginDefragmentationPass(localAllocator, defragCtx, &pass);
+        if(res == VK_SUCCESS)
+            break;
+        TEST(res == VK_INCOMPLETE);
+
+        // Copies from dedicated memory cannot be recorded, as no other buffer can be bound to it.
+        bool dedicatedSource = false;
+        for(uint32_t i = 0; i < pass.moveCount; ++i)
+        {
+            VmaAllocationInfo2 allocInfo = {};
+            vmaGetAllocationInfo2(localAllocator, pass.pMoves[i].srcAllocation, &allocInfo);
+            if(allocInfo.dedicatedMemory)
+            {
+                dedicatedSource = true;
+                ++dedicatedMoveCount;
+            }
+        }
+        BeginSingleTimeCommands();
+        res = vmaRecordDefragmentationPassCopies(localAllocator, defragCtx, &pass, g_hTemporaryCommandBuffer);
+        EndSingleTimeCommands();
+        TEST(res == VK_INCOMPLETE || (res == VK_SUCCESS && !dedicatedSource));
+
+        // Copy everything on the CPU too, which is the same data for the moves that were recorded.
+        for(uint32_t i = 0; i < pass.moveCount; ++i)
+        {
+            size_t value = 0;
+            res = vmaCopyAllocationToMemory(localAllocator, pass.pMoves[i].srcAllocation, 0, &value, sizeof(value));
+            TEST(res == VK_SUCCESS);
+            res = vmaCopyMemoryToAllocation(localAllocator, &value, pass.pMoves[i].dstTmpAllocation, 0, sizeof(value));
+            TEST(res == VK_SUCCESS);
+        }
+
+        res = vmaEndDefragmentationPass(localAllocator, defragCtx, &pass);
+        if(res == VK_SUCCESS)
+            break;
+        TEST(res == VK_INCOMPLETE);
+    }
+    VmaDefragmentationStats defragStats = {};
+    vmaEndDefragmentation(localAllocator, defragCtx, &defragStats);
+    TEST(dedicatedMoveCount == 2);
+    TEST(defragStats.deviceMemoryBlocksFreed == 2);
+    TEST(defragStats.bytesFreed == 2 * allocSize);
+
+    vmaGetPoolStatistics(localAllocator, pool, &poolStats);
+    TEST(poolStats.blockCount == 1 + dedicatedCount - 2);
+    for(size_t i = 2; i < allocations.size(); ++i)
+    {
+        size_t value = 0;
+        res = vmaCopyAllocationToMemory(localAllocator, allocations[i], 0, &value, sizeof(value));
+        TEST(res == VK_SUCCESS && value == i);
+        vmaFreeMemory(localAllocator, allocations[i]);
+    }
+
+    vmaDestroyPool(localAllocator, pool);
+    vmaDestroyAllocator(localAllocator);
+}
+
+static void TestDefragmentationOnHost()
+{
+    wprintf(L"Test defragmentation on host\n");
+
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.size = 0x10000;
+    bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+
+    VmaPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.blockSize = 16ull * 1024 * 1024;
+    VkResult res = vmaFindMemoryTypeIndexForBufferInfo(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &poolCreateInfo.memoryTypeIndex);
+    TEST(res == VK_SUCCESS);
+
+    VmaPool pool = VK_NULL_HANDLE;
+    res = vmaCreatePool(g_hAllocator, &poolCreateInfo, &pool);
+    TEST(res == VK_SUCCESS);
+
+    // Every allocation is filled with its index, half of them are persistently mapped.
+    RandomNumberGenerator rand{ 8142 };
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
+    allocCreateInfo.pool = pool;
+    std::vector<VmaAllocation> allocations(200);
+    std::vector<VkDeviceSize> sizes(allocations.size());
+    for(size_t i = 0; i < allocations.size(); ++i)
+    {
+        allocCreateInfo.flags = i % 2 ? VMA_ALLOCATION_CREATE_MAPPED_BIT : 0;
+        sizes[i] = (rand.Generate() % 64 + 1) * 16 * 1024;
+        const VkMemoryRequirements memReq = { sizes[i], 256, 1u << poolCreateInfo.memoryTypeIndex };
+        res = vmaAllocateMemory(g_hAllocator, &memReq, &allocCreateInfo, &allocations[i], nullptr);
+        TEST(res == VK_SUCCESS);
+        const std::vector<uint32_t> data((size_t)sizes[i] / sizeof(uint32_t), (uint32_t)i);
+        res = vmaCopyMemoryToAllocation(g_hAllocator, data.data(), allocations[i], 0, sizes[i]);
+        TEST(res == VK_SUCCESS);
+    }
+    for(size_t i = 0; i < allocations.size(); ++i)
+    {
+        if(rand.Generate() % 2)
+        {
+            vmaFreeMemory(g_hAllocator, allocations[i]);
+            allocations[i] = VK_NULL_HANDLE;
+        }
+    }
+
+    uint32_t dispatchedJobCount = 0;
+    const PFN_vmaDispatchJobsFunction dispatchJobs = [](void* pUserData, uint32_t jobCount, PFN_vmaJobFunction pfnJob, void* pJobData)
+    {
+        *(uint32_t*)pUserData += jobCount;
+        for(uint32_t i = 0; i < jobCount; ++i)
+            pfnJob(pJobData, i);
+    };
+
+    VmaDefragmentationInfo defragInfo = {};
+    defragInfo.pool = pool;
+    defragInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT;
+    defragInfo.pfnDispatchJobs = dispatchJobs;
+    defragInfo.pDispatchJobsUserData = &dispatchedJobCount;
+
+    VmaDefragmentationContext defragCtx = nullptr;
+    res = vmaBeginDefragmentation(g_hAllocator, &defragInfo, &defragCtx);
+    TEST(res == VK_SUCCESS);
+    for(;;)
+    {
+        VmaDefragmentationPassMoveInfo pass = {};
+        res = vmaBeginDefragmentationPass(g_hAllocator, defragCtx, &pass);
+        if(res == VK_SUCCESS)
+            break;
+        TEST(res == VK_INCOMPLETE);
+
+        res = vmaExecuteDefragmentationPassOnHost(g_hAllocator, defragCtx, &pass);
+        TEST(res == VK_SUCCESS);
+
+        res = vmaEndDefragmentationPass(g_hAllocator, defragCtx, &pass);
+        if(res == VK_SUCCESS)
+            break;
+        TEST(res == VK_INCOMPLETE);
+    }
+    VmaDefragmentationStats defragStats = {};
+    vmaEndDefragmentation(g_hAllocator, defragCtx, &defragStats);
+    PrintDefragmentationStats(defragStats);
+    TEST(defragStats.allocationsMoved > 0);
+    // Tens of megabytes are moved, more than a single copy job.
+    TEST(dispatchedJobCount > 1);
+
+    for(size_t i = 0; i < allocations.size(); ++i)
+    {
+        if(allocations[i] == VK_NULL_HANDLE)
+            continue;
+        std::vector<uint32_t> data((size_t)sizes[i] / sizeof(uint32_t));
+        res = vmaCopyAllocationToMemory(g_hAllocator, allocations[i], 0, data.data(), sizes[i]);
+        TEST(res == VK_SUCCESS);
+        for(uint32_t value : data)
+            TEST(value == (uint32_t)i);
+        vmaFreeMemory(g_hAllocator, allocations[i]);
+    }
+
+    vmaDestroyPool(g_hAllocator, pool);
+
+    // Buffers created with VMA_MEMORY_USAGE_AUTO and no HOST_ACCESS flags cannot be mapped by the user,
+    // but they are copied just the same when their memory is HOST_VISIBLE, e.g. on UMA or with ReBAR.
+    bufCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+    res = vmaFindMemoryTypeIndexForBufferInfo(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &poolCreateInfo.memoryTypeIndex);
+    TEST(res == VK_SUCCESS);
+    res = vmaCreatePool(g_hAllocator, &poolCreateInfo, &pool);
+    TEST(res == VK_SUCCESS);
+
+    allocCreateInfo.flags = 0;
+    allocCreateInfo.pool = pool;
+    std::vector<AllocInfo> buffers(100);
+    for(size_t i = 0; i < buffers.size(); ++i)
+    {
+        bufCreateInfo.size = align_up<VkDeviceSize>(rand.Generate() % (512 * 1024) + 1024, 16);
+        buffers[i].CreateBuffer(bufCreateInfo, allocCreateInfo);
+        buffers[i].m_StartValue = rand.Generate();
+    }
+    for(size_t i = buffers.size(); i--; )
+    {
+        if(rand.Generate() % 2)
+        {
+            buffers[i].Destroy();
+            buffers.erase(buffers.begin() + i);
+        }
+    }
+    UploadGpuData(buffers.data(), buffers.size());
+    for(auto& buffer : buffers)
+        vmaSetAllocationUserData(g_hAllocator, buffer.m_Allocation, &buffer);
+
+    defragInfo.pool = pool;
+    res = vmaBeginDefragmentation(g_hAllocator, &defragInfo, &defragCtx);
+    TEST(res == VK_SUCCESS);
+    for(;;)
+    {
+        VmaDefragmentationPassMoveInfo pass = {};
+        res = vmaBeginDefragmentationPass(g_hAllocator, defragCtx, &pass);
+        if(res == VK_SUCCESS)
+            break;
+        TEST(res == VK_INCOMPLETE);
+
+        res = vmaExecuteDefragmentationPassOnHost(g_hAllocator, defragCtx, &pass);
+        TEST(res == VK_SUCCESS);
+
+        // Recreate moved buffers in the new place.
+        for(uint32_t i = 0; i < pass.moveCount; ++i)
+        {
+            VmaAllocationInfo vmaAllocInfo;
+            vmaGetAllocationInfo(g_hAllocator, pass.pMoves[i].srcAllocation, &vmaAllocInfo);
+            AllocInfo* allocInfo = (AllocInfo*)vmaAllocInfo.pUserData;
+            vkDestroyBuffer(g_hDevice, allocInfo->m_Buffer, g_Allocs);
+            res = vkCreateBuffer(g_hDevice, &allocInfo->m_BufferInfo, g_Allocs, &allocInfo->m_Buffer);
+            TEST(res == VK_SUCCESS);
+            res = vmaBindBufferMemory(g_hAllocator, pass.pMoves[i].dstTmpAllocation, allocInfo->m_Buffer);
+            TEST(res == VK_SUCCESS);
+        }
+
+        res = vmaEndDefragmentationPass(g_hAllocator, defragCtx, &pass);
+        if(res == VK_SUCCESS)
+            break;
+        TEST(res == VK_INCOMPLETE);
+    }
+    vmaEndDefragmentation(g_hAllocator, defragCtx, &defragStats);
+    PrintDefragmentationStats(defragStats);
+    TEST(defragStats.allocationsMoved > 0);
+
+    ValidateGpuData(buffers.data(), buffers.size());
+
+    for(size_t i = buffers.size(); i--; )
+        buffers[i].Destroy();
+    vmaDestroyPool(g_hAllocator, pool);
+}
+
+static void TestDefragmentationMoveHints()
+{
+    wprintf(L"Test defragmentation move hints\n");
+
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.size = 0x10000;
+    bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+
+    VmaPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.blockSize = 1024 * 1024;
+    VkResult res = vmaFindMemoryTypeIndexForBufferInfo(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &poolCreateInfo.memoryTypeIndex);
+    TEST(res == VK_SUCCESS);
+
+    VmaPool pool = VK_NULL_HANDLE;
+    res = vmaCreatePool(g_hAllocator, &poolCreateInfo, &pool);
+    TEST(res == VK_SUCCESS);
+
+    // Two blocks: the first one full of allocations expensive to move, with one immovable, the second one with default cost.
+    // After freeing every other allocation both are half full, so only the move cost decides which one gets emptied.
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
+    allocCreateInfo.pool = pool;
+    const VkMemoryRequirements memReq = { poolCreateInfo.blockSize / 8, 256, 1u << poolCreateInfo.memoryTypeIndex };
+    std::vector<VmaAllocation> allocations(16);
+    for(size_t i = 0; i < allocations.size(); ++i)
+    {
+        allocCreateInfo.moveCost = i < 8 ? 100.f : 0.f;
+        res = vmaAllocateMemory(g_hAllocator, &memReq, &allocCreateInfo, &allocations[i], nullptr);
+        TEST(res == VK_SUCCESS);
+    }
+    vmaSetAllocationImmovable(g_hAllocator, allocations[0], VK_TRUE);
+    for(size_t i = 1; i < allocations.size(); i += 2)
+    {
+        vmaFreeMemory(g_hAllocator, allocations[i]);
+        allocations[i] = VK_NULL_HANDLE;
+    }
+
+    std::vector<VmaAllocationInfo> allocInfos(allocations.size());
+    for(size_t i = 0; i < allocations.size(); i += 2)
+        vmaGetAllocationInfo(g_hAllocator, allocations[i], &allocInfos[i]);
+
+    VmaDefragmentationInfo defragInfo = {};
+    defragInfo.pool = pool;
+    defragInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT;
+
+    VmaDefragmentationContext defragCtx = nullptr;
+    res = vmaBeginDefragmentation(g_hAllocator, &defragInfo, &defragCtx);
+    TEST(res == VK_SUCCESS);
+    for(;;)
+    {
+        VmaDefragmentationPassMoveInfo pass = {};
+        res = vmaBeginDefragmentationPass(g_hAllocator, defragCtx, &pass);
+        if(res == VK_SUCCESS)
+            break;
+        TEST(res == VK_INCOMPLETE);
+
+        // No data to copy, only the choice of moved allocations is checked.
+        for(uint32_t i = 0; i < pass.moveCount; ++i)
+            TEST(pass.pMoves[i].srcAllocation != allocations[0]);
+
+        res = vmaEndDefragmentationPass(g_hAllocator, defragCtx, &pass);
+        if(res == VK_SUCCESS)
+            break;
+        TEST(res == VK_INCOMPLETE);
+    }
+    VmaDefragmentationStats defragStats = {};
+    vmaEndDefragmentation(g_hAllocator, defragCtx, &defragStats);
+    PrintDefragmentationStats(defragStats);
+    TEST(defragStats.allocationsMoved == 4);
+
+    for(size_t i = 0; i < allocations.size(); i += 2)
+    {
+        VmaAllocationInfo allocInfo;
+        vmaGetAllocationInfo(g_hAllocator, allocations[i], &allocInfo);
+        // Expensive allocations stay in place, cheap ones are moved to the first block.
+        if(i < 8)
+            TEST(allocInfo.deviceMemory == allocInfos[i].deviceMemory && allocInfo.offset == allocInfos[i].offset);
+        else
+            TEST(allocInfo.deviceMemory == allocInfos[0].deviceMemory);
+        vmaFreeMemory(g_hAllocator, allocations[i]);
+    }
+
+    vmaDestroyPool(g_hAllocator, pool);
+}
+
+static void TestDefragmentationGpu()
+{
+    wprintf(L"Test defragmentation GPU\n");
+
+    // Create that many allocations to surely fill 3 new blocks of 256 MB.
+    const VkDeviceSize bufSizeMin = 5ull * 1024 * 1024;
+    const VkDeviceSize bufSizeMax = 10ull * 1024 * 1024;
+    const VkDeviceSize totalSize = 3ull * 256 * 1024 * 1024;
+    const size_t bufCount = (size_t)(totalSize / bufSizeMin);
+    const size_t percentToLeave = 30;
+    const size_t percentNonMovable = 3;
+    RandomNumberGenerator rand = { 234522 };
+
+    std::vector<AllocInfo> allocations;
+    allocations.reserve(bufCount);
+
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+    // Create all intended buffers.
+    for(size_t i = 0; i < bufCount; ++i)
+    {
+        bufCreateInfo.size = align_up(rand.Generate() % (bufSizeMax - bufSizeMin) + bufSizeMin, 32ull);
+
+        AllocInfo alloc;
+
+        if(rand.Generate() % 100 < percentNonMovable)
+        {
+            bufCreateInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            alloc.m_DefragmentationMovable = false;
+        }
+        else
+        {
+            // Different usage just to see different color in output from VmaDumpVis.
+            bufCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            // And in JSON dump.
+        }
+
+        alloc.CreateBuffer(bufCreateInfo, allocCreateInfo);
+        alloc.m_StartValue = rand.Generate();
+        allocations.push_back(alloc);
+    }
+
+    // Destroy some percentage of them.
+    {
+        const size_t buffersToDestroy = round_div<size_t>(bufCount * (100 - percentToLeave), 100);
+        for(size_t i = 0; i < buffersToDestroy; ++i)
+        {
+            const size_t index = rand.Generate() % allocations.size();
+            allocations[index].Destroy();
+            allocations.erase(allocations.begin() + index);
+        }
+    }
+
+    // Set data for defragmentation retrieval
+    for (auto& alloc : allocations)
+        vmaSetAllocationUserData(g_hAllocator, alloc.m_Allocation, &alloc);
+
+    // Fill them with meaningful data.
+    UploadGpuData(allocations.data(), allocations.size());
+
+    wchar_t fileName[MAX_PATH];
+    swprintf_s(fileName, L"GPU_defragmentation_A_before.json");
+    SaveAllocatorStatsToFile(fileName);
+
+    // Defragment using GPU only.
+    {
+        VmaDefragmentationInfo defragInfo = {};
+        VmaDefragmentationStats stats;
+        Defragment(defragInfo, &stats);
+        PrintDefragmentationStats(stats);
+
+        // If corruption detection is enabled, GPU defragmentation may not work on
+        // memory types that have this detection active, e.g. on Intel.
+        #if !defined(VMA_DEBUG_DETECT_CORRUPTION) || VMA_DEBUG_DETECT_CORRUPTION == 0
+            TEST(stats.allocationsMoved > 0 && stats.bytesMoved > 0);
+            TEST(stats.deviceMemoryBlocksFreed > 0 && stats.bytesFreed > 0);
+        #endif
+    }
+
+    swprintf_s(fileName, L"GPU_defragmentation_B_after.json");
+    SaveAllocatorStatsToFile(fileName);
+    ValidateGpuData(allocations.data(), allocations.size());
+
+    // Destroy all remaining buffers.
+    for(size_t i = allocations.size(); i--; )
+    {
+        allocations[i].Destroy();
+    }
+}
+
+static void TestDefragmentationGpuRecordCopies()
+{
+    wprintf(L"Test defragmentation GPU with recorded copies\n");
+
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.size = 0x10000;
+    bufCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+    VmaPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.blockSize = 16ull * 1024 * 1024;
+    VkResult res = vmaFindMemoryTypeIndexForBufferInfo(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &poolCreateInfo.memoryTypeIndex);
+    TEST(res == VK_SUCCESS);
+
+    VmaPool pool = VK_NULL_HANDLE;
+    res = vmaCreatePool(g_hAllocator, &poolCreateInfo, &pool);
+    TEST(res == VK_SUCCESS);
+
+    allocCreateInfo.pool = pool;
+    RandomNumberGenerator rand{ 6219 };
+    std::vector<AllocInfo> allocations(200);
+    for(size_t i = 0; i < allocations.size(); ++i)
+    {
+        bufCreateInfo.size = align_up<VkDeviceSize>(rand.Generate() % (512 * 1024) + 1024, 16);
+        allocations[i].CreateBuffer(bufCreateInfo, allocCreateInfo);
+        allocations[i].m_StartValue = rand.Generate();
+    }
+    for(size_t i = allocations.size(); i--; )
+    {
+        if(rand.Generate() % 2)
+        {
+            allocations[i].Destroy();
+            allocations.erase(allocations.begin() + i);
+        }
+    }
+    UploadGpuData(allocations.data(), allocations.size());
+    for(auto& alloc : allocations)
+        vmaSetAllocationUserData(g_hAllocator, alloc.m_Allocation, &alloc);
+
+    VmaDefragmentationInfo defragInfo = {};
+    defragInfo.pool = pool;
+    defragInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT;
+    defragInfo.maxBytesPerPass = 8ull * 1024 * 1024;
+
+    VmaDefragmentationContext defragCtx = nullptr;
+    res = vmaBeginDefragmentation(g_hAllocator, &defragInfo, &defragCtx);
+    TEST(res == VK_SUCCESS);
+    for(;;)
+    {
+        VmaDefragmentationPassMoveInfo pass = {};
+        res = vmaBeginDefragmentationPass(g_hAllocator, defragCtx, &pass);
+        if(res == VK_SUCCESS)
+            break;
+        TEST(res == VK_INCOMPLETE);
+
+        BeginSingleTimeCommands();
+        VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+        barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(g_hTemporaryCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+        res = vmaRecordDefragmentationPassCopies(g_hAllocator, defragCtx, &pass, g_hTemporaryCommandBuffer);
+        TEST(res == VK_SUCCESS);
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        vkCmdPipelineBarrier(g_hTemporaryCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+        EndSingleTimeCommands();
+
+        // Recreate moved buffers in the new place.
+        for(uint32_t i = 0; i < pass.moveCount; ++i)
+        {
+            VmaAllocationInfo vmaAllocInfo;
+            vmaGetAllocationInfo(g_hAllocator, pass.pMoves[i].srcAllocation, &vmaAllocInfo);
+            AllocInfo* allocInfo = (AllocInfo*)vmaAllocInfo.pUserData;
+            vkDestroyBuffer(g_hDevice, allocInfo->m_Buffer, g_Allocs);
+            res = vkCreateBuffer(g_hDevice, &allocInfo->m_BufferInfo, g_Allocs, &allocInfo->m_Buffer);
+            TEST(res == VK_SUCCESS);
+            res = vmaBindBufferMemory(g_hAllocator, pass.pMoves[i].dstTmpAllocation, allocInfo->m_Buffer);
+            TEST(res == VK_SUCCESS);
+        }
+
+        res = vmaEndDefragmentationPass(g_hAllocator, defragCtx, &pass);
+        if(res == VK_SUCCESS)
+            break;
+        TEST(res == VK_INCOMPLETE);
+    }
+    VmaDefragmentationStats defragStats = {};
+    vmaEndDefragmentation(g_hAllocator, defragCtx, &defragStats);
+    PrintDefragmentationStats(defragStats);
+    TEST(defragStats.allocationsMoved > 0);
+
+    ValidateGpuData(allocations.data(), allocations.size());
+
+    for(size_t i = allocations.size(); i--; )
+        allocations[i].Destroy();
+    vmaDestroyPool(g_hAllocator, pool);
+}
+
+static void TestDefragmentationResidency()
+{
+    wprintf(L"Test defragmentation residency\n");
+
+    const VkPhysicalDeviceMemoryProperties* memProps = nullptr;
+    vmaGetMemoryProperties(g_hAllocator, &memProps);
+
+    // Find DEVICE_LOCAL memory type and HOST_VISIBLE memory types in other heaps to evict to.
+    uint32_t deviceMemTypeIndex = UINT32_MAX;
+    uint32_t hostMemTypeBits = 0;
+    for(uint32_t i = 0; i < memProps->memoryTypeCount && deviceMemTypeIndex == UINT32_MAX; ++i)
+    {
+        if((memProps->memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == 0)
+            continue;
+        hostMemTypeBits = 0;
+        for(uint32_t j = 0; j < memProps->memoryTypeCount; ++j)
+        {
+            if(memProps->memoryTypes[j].heapIndex != memProps->memoryTypes[i].heapIndex &&
+                (memProps->memoryTypes[j].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0 &&
+                (memProps->memoryTypes[j].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == 0)
+            {
+                hostMemTypeBits |= 1u << j;
+            }
+        }
+        if(hostMemTypeBits != 0)
+            deviceMemTypeIndex = i;
+    }
+    if(deviceMemTypeIndex == UINT32_MAX)
+    {
+        wprintf(L"    Skipped: no HOST_VISIBLE heap other than DEVICE_LOCAL one.\n");
+        return;
+    }
+    const uint32_t deviceHeapIndex = memProps->memoryTypes[deviceMemTypeIndex].heapIndex;
+
+    // Small DEVICE_LOCAL heap, so its blocks are 8 MB.
+    VkDeviceSize heapSizeLimit[VK_MAX_MEMORY_HEAPS];
+    for(uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; ++i)
+        heapSizeLimit[i] = i == deviceHeapIndex ? 64ull * 1024 * 1024 : VK_WHOLE_SIZE;
+
+    VmaAllocatorCreateInfo allocatorCreateInfo = {};
+    VmaVulkanFunctions vulkanFunctions;
+    SetBasicAllocatorCreateInfo(allocatorCreateInfo, vulkanFunctions);
+    allocatorCreateInfo.pHeapSizeLimit = heapSizeLimit;
+
+    VmaAllocator hAllocator;
+    VkResult res = vmaCreateAllocator(&allocatorCreateInfo, &hAllocator);
+    TEST(res == VK_SUCCESS);
+
+    // Allocations prefer the DEVICE_LOCAL memory type, while their requirements allow the HOST_VISIBLE ones too.
+    const VkMemoryRequirements memReq = { 2ull * 1024 * 1024, 256, (1u << deviceMemTypeIndex) | hostMemTypeBits };
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_EVICTABLE_BIT;
+    allocCreateInfo.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    auto getMemoryType = [&](VmaAllocation alloc) -> uint32_t
+    {
+        VmaAllocationInfo allocInfo = {};
+        vmaGetAllocationInfo(hAllocator, alloc, &allocInfo);
+        return allocInfo.memoryType;
+    };
+
+    std::vector<VmaAllocation> allocations(20);
+    for(size_t i = 0; i < allocations.size(); ++i)
+    {
+        res = vmaAllocateMemory(hAllocator, &memReq, &allocCreateInfo, &allocations[i], nullptr);
+        TEST(res == VK_SUCCESS);
+        TEST(getMemoryType(allocations[i]) == deviceMemTypeIndex);
+    }
+
+    VmaResidencyInfo residencyInfo = {};
+    residencyInfo.evictionThreshold = 0.5f;
+    residencyInfo.restoreThreshold = 0.25f;
+    auto runResidency = [&]() -> VmaDefragmentationStats
+    {
+        VmaDefragmentationContext defragCtx = nullptr;
+        res = vmaBeginResidency(hAllocator, &residencyInfo, &defragCtx);
+        TEST(res == VK_SUCCESS);
+        for(;;)
+        {
+            // Content of the allocations doesn't matter, so nothing is copied.
+            VmaDefragmentationPassMoveInfo pass = {};
+            res = vmaBeginDefragmentationPass(hAllocator, defragCtx, &pass);
+            if(res == VK_SUCCESS)
+                break;
+            TEST(res == VK_INCOMPLETE);
+            res = vmaEndDefragmentationPass(hAllocator, defragCtx, &pass);
+            if(res == VK_SUCCESS)
+                break;
+            TEST(res == VK_INCOMPLETE);
+        }
+        VmaDefragmentationStats defragStats = {};
+        vmaEndDefragmentation(hAllocator, defragCtx, &defragStats);
+        return defragStats;
+    };
+
+    // 1. 40 MB in DEVICE_LOCAL heap is over the threshold, whole blocks are moved out of it.
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
+    vmaGetHeapBudgets(hAllocator, budgets);
+    TEST((double)budgets[deviceHeapIndex].usage > budgets[deviceHeapIndex].budget * residencyInfo.evictionThreshold);
+
+    VmaDefragmentationStats stats = runResidency();
+    PrintDefragmentationStats(stats);
+    TEST(stats.allocationsMoved > 0 && stats.allocationsMoved % 4 == 0);
+    TEST(stats.deviceMemoryBlocksFreed > 0);
+    // One emptied block may be kept for reuse.
+    vmaGetHeapBudgets(hAllocator, budgets);
+    TEST((double)budgets[deviceHeapIndex].statistics.allocationBytes <= budgets[deviceHeapIndex].budget * residencyInfo.evictionThreshold);
+
+    size_t evictedCount = 0;
+    for(VmaAllocation alloc : allocations)
+    {
+        const uint32_t memTypeIndex = getMemoryType(alloc);
+        if(memTypeIndex != deviceMemTypeIndex)
+        {
+            TEST((hostMemTypeBits & (1u << memTypeIndex)) != 0);
+            ++evictedCount;
+        }
+    }
+    TEST(evictedCount == stats.allocationsMoved);
+
+    // 2. Nothing changes while usage is between the thresholds.
+    stats = runResidency();
+    TEST(stats.allocationsMoved == 0);
+
+    // 3. Once the remaining allocations are freed, evicted ones move back to their preferred memory type.
+    for(size_t i = allocations.size(); i--; )
+    {
+        if(getMemoryType(allocations[i]) == deviceMemTypeIndex)
+        {
+            vmaFreeMemory(hAllocator, allocations[i]);
+            allocations.erase(allocations.begin() + i);
+        }
+    }
+    stats = runResidency();
+    PrintDefragmentationStats(stats);
+    TEST(stats.allocationsMoved > 0);
+    vmaGetHeapBudgets(hAllocator, budgets);
+    TEST((double)budgets[deviceHeapIndex].usage <= budgets[deviceHeapIndex].budget * residencyInfo.evictionThreshold);
+    size_t restoredCount = 0;
+    for(VmaAllocation alloc : allocations)
+        restoredCount += getMemoryType(alloc) == deviceMemTypeIndex ? 1 : 0;
+    TEST(restoredCount == stats.allocationsMoved);
+
+    vmaFreeMemoryPages(hAllocator, allocations.size(), allocations.data());
+    vmaDestroyAllocator(hAllocator);
+}
+
+static void TestDefragmentationIncrementalBasic()
+{
+    wprintf(L"Test defragmentation incremental basic\n");
+
+    std::vector<AllocInfo> allocations;
+
+    // Create that many allocations to surely fill 3 new blocks of 256 MB.
+    const std::array<uint32_t, 3> imageSizes = { 256, 512, 1024 };
+    const VkDeviceSize bufSizeMin = 5ull * 1024 * 1024;
+    const VkDeviceSize bufSizeMax = 10ull * 1024 * 1024;
+    const VkDeviceSize totalSize = 3ull * 256 * 1024 * 1024;
+    const size_t imageCount = totalSize / ((size_t)imageSizes[0] * imageSizes[0] * 4) / 2;
+    const size_t bufCount = (size_t)(totalSize / bufSizeMin) / 2;
+    const size_t percentToLeave = 30;
+    RandomNumberGenerator rand = { 234522 };
+
+    VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+    // Create all intended images.
+    for(size_t i = 0; i < imageCount; ++i)
+    {
+        const uint32_t size = imageSizes[rand.Generate() % 3];
+
+        imageInfo.extent.width = size;
+        imageInfo.extent.height = size;
+
+        AllocInfo alloc;
+        CreateImage(allocCreateInfo, imageInfo, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, alloc);
+        alloc.m_StartValue = 0;
+
+        allocations.push_back(alloc);
+    }
+
+    // And all buffers
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+
+    for(size_t i = 0; i < bufCount; ++i)
+    {
+        bufCreateInfo.size = align_up<VkDeviceSize>(bufSizeMin + rand.Generate() % (bufSizeMax - bufSizeMin), 16);
+        bufCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+        AllocInfo alloc;
+        alloc.CreateBuffer(bufCreateInfo, allocCreateInfo);
+        alloc.m_StartValue = 0;
+
+        allocations.push_back(alloc);
+    }
+
+    // Destroy some percentage of them.
+    {
+        const size_t allocationsToDestroy = round_div<size_t>((imageCount + bufCount) * (100 - percentToLeave), 100);
+        for(size_t i = 0; i < allocationsToDestroy; ++i)
+        {
+            const size_t index = rand.Generate() % allocations.size();
+            allocations[index].Destroy();
+            allocations.erase(allocations.begin() + index);
+        }
+    }
+
+    {
+        // Set our user data pointers. A real application should probably be more clever here
+        const size_t allocationCount = allocations.size();
+        for(size_t i = 0; i < allocationCount; ++i)
+        {
+            AllocInfo &alloc = allocations[i];
+            vmaSetAllocationUserData(g_hAllocator, alloc.m_Allocation, &alloc);
+        }
+    }
+
+    // Fill them with meaningful data.
+    UploadGpuData(allocations.data(), allocations.size());
+
+    wchar_t fileName[MAX_PATH];
+    swprintf_s(fileName, L"GPU_defragmentation_incremental_basic_A_before.json");
+    SaveAllocatorStatsToFile(fileName);
+
+    // Defragment using GPU only.
+    {
+        VmaDefragmentationInfo defragInfo = {};
+        VmaDefragmentationContext ctx = VK_NULL_HANDLE;
+        VkResult res = vmaBeginDefragmentation(g_hAllocator, &defragInfo, &ctx);
+        TEST(res == VK_SUCCESS);
+
+        VmaDefragmentationPassMoveInfo pass = {};
+        while ((res = vmaBeginDefragmentationPass(g_hAllocator, ctx, &pass)) == VK_INCOMPLETE)
+        {
+            wprintf(L"  Pass: moveCount=%u\n", pass.moveCount);
+
+            // Ignore data outside of test
+            for (uint32_t i = 0; i < pass.moveCount; ++i)
+            {
+                auto it = std::find_if(allocations.begin(), allocations.end(), [&](const AllocInfo& info) { return pass.pMoves[i].srcAllocation == info.m_Allocation; });
+                if (it == allocations.end())
+                    pass.pMoves[i].operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            }
+
+            BeginSingleTimeCommands();
+            ProcessDefragmentationPass(pass);
+            EndSingleTimeCommands();
+
+            // Destroy old buffers/images and replace them with new handles.
+            for (size_t i = 0; i < pass.moveCount; ++i)
+            {
                 if (pass.pMoves[i].operation != VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE)
                 {
                     VmaAllocation const alloc = pass.pMoves[i].srcAllocation;
@@ -3467,85 +4377,744 @@ static void TestVirtualBlocksAlgorithms()
             alloc.allocOffset = allocInfo.offset;
             alloc.allocationSize = allocInfo.size;
 
-            allocations.push_back(alloc);
-        }
+            allocations.push_back(alloc);
+        }
+
+        // Allocate some with extra alignment
+        for(size_t i = 0; i < 3; ++i)
+        {
+            VmaVirtualAllocationCreateInfo allocCreateInfo = {};
+            allocCreateInfo.size = calcRandomAllocSize();
+            allocCreateInfo.alignment = 16;
+            allocCreateInfo.pUserData = (void*)(uintptr_t)(allocCreateInfo.size * 10);
+
+            AllocData alloc = {};
+            alloc.requestedSize = allocCreateInfo.size;
+            res = vmaVirtualAllocate(block, &allocCreateInfo, &alloc.allocation, nullptr);
+            TEST(res == VK_SUCCESS);
+
+            VmaVirtualAllocationInfo allocInfo;
+            vmaGetVirtualAllocationInfo(block, alloc.allocation, &allocInfo);
+            TEST(allocInfo.offset % 16 == 0);
+            TEST(allocInfo.size >= allocCreateInfo.size);
+            alloc.allocOffset = allocInfo.offset;
+            alloc.allocationSize = allocInfo.size;
+
+            allocations.push_back(alloc);
+        }
+
+        // Check if the allocations don't overlap
+        std::sort(allocations.begin(), allocations.end(), [](const AllocData& lhs, const AllocData& rhs) {
+            return lhs.allocOffset < rhs.allocOffset; });
+        for(size_t i = 0; i < allocations.size() - 1; ++i)
+        {
+            TEST(allocations[i+1].allocOffset >= allocations[i].allocOffset + allocations[i].allocationSize);
+        }
+
+        // Check pUserData
+        {
+            const AllocData& alloc = allocations.back();
+            VmaVirtualAllocationInfo allocInfo = {};
+            vmaGetVirtualAllocationInfo(block, alloc.allocation, &allocInfo);
+            TEST((uintptr_t)allocInfo.pUserData == alloc.requestedSize * 10);
+
+            vmaSetVirtualAllocationUserData(block, alloc.allocation, (void*)(uintptr_t)666);
+            vmaGetVirtualAllocationInfo(block, alloc.allocation, &allocInfo);
+            TEST((uintptr_t)allocInfo.pUserData == 666);
+        }
+
+        // Calculate statistics
+        {
+            VkDeviceSize actualAllocSizeMin = VK_WHOLE_SIZE, actualAllocSizeMax = 0, actualAllocSizeSum = 0;
+            std::for_each(allocations.begin(), allocations.end(), [&](const AllocData& a) {
+                actualAllocSizeMin = std::min(actualAllocSizeMin, a.allocationSize);
+                actualAllocSizeMax = std::max(actualAllocSizeMax, a.allocationSize);
+                actualAllocSizeSum += a.allocationSize;
+            });
+
+            VmaDetailedStatistics statInfo = {};
+            vmaCalculateVirtualBlockStatistics(block, &statInfo);
+            TEST(statInfo.statistics.allocationCount == allocations.size());
+            TEST(statInfo.statistics.blockCount == 1);
+            TEST(statInfo.statistics.blockBytes == blockCreateInfo.size);
+            TEST(statInfo.allocationSizeMax == actualAllocSizeMax);
+            TEST(statInfo.allocationSizeMin == actualAllocSizeMin);
+            TEST(statInfo.statistics.allocationBytes >= actualAllocSizeSum);
+        }
+
+#if !defined(VMA_STATS_STRING_ENABLED) || VMA_STATS_STRING_ENABLED
+        // Build JSON dump string
+        {
+            char* json = nullptr;
+            vmaBuildVirtualBlockStatsString(block, &json, VK_TRUE);
+            int I = 0; // put a breakpoint here to debug
+            vmaFreeVirtualBlockStatsString(block, json);
+        }
+#endif
+
+        // Final cleanup
+        vmaClearVirtualBlock(block);
+        vmaDestroyVirtualBlock(block);
+    }
+}
+
+static void TestVirtualBlocksResize()
+{
+    wprintf(L"Test virtual blocks resize\n");
+
+    for(size_t algorithmIndex = 0; algorithmIndex < 2; ++algorithmIndex)
+    {
+        VmaVirtualBlockCreateInfo blockCreateInfo = {};
+        blockCreateInfo.pAllocationCallbacks = g_Allocs;
+        blockCreateInfo.size = 1000;
+        if(algorithmIndex == 1)
+            blockCreateInfo.flags = VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT;
+        VmaVirtualBlock block = nullptr;
+        TEST(vmaCreateVirtualBlock(&blockCreateInfo, &block) == VK_SUCCESS);
+
+        // # Fill the whole block
+
+        VmaVirtualAllocationCreateInfo allocCreateInfo = {};
+        allocCreateInfo.size = 250;
+        VmaVirtualAllocation allocs[4] = {};
+        VkDeviceSize offsets[4] = {};
+        for(size_t i = 0; i < 4; ++i)
+        {
+            allocCreateInfo.pUserData = (void*)(uintptr_t)(i + 1);
+            TEST(vmaVirtualAllocate(block, &allocCreateInfo, &allocs[i], &offsets[i]) == VK_SUCCESS);
+        }
+        VmaVirtualAllocation extraAlloc = VK_NULL_HANDLE;
+        TEST(vmaVirtualAllocate(block, &allocCreateInfo, &extraAlloc, nullptr) < 0);
+
+        // # Cannot shrink below the last allocation
+
+        TEST(vmaResizeVirtualBlock(block, 999) < 0);
+
+        // # Grow to 1 MB - existing allocations must stay intact
+
+        TEST(vmaResizeVirtualBlock(block, MEGABYTE) == VK_SUCCESS);
+        for(size_t i = 0; i < 4; ++i)
+        {
+            VmaVirtualAllocationInfo allocInfo = {};
+            vmaGetVirtualAllocationInfo(block, allocs[i], &allocInfo);
+            TEST(allocInfo.offset == offsets[i]);
+            TEST(allocInfo.size == 250);
+            TEST(allocInfo.pUserData == (void*)(uintptr_t)(i + 1));
+        }
+
+        VmaStatistics stats = {};
+        vmaGetVirtualBlockStatistics(block, &stats);
+        TEST(stats.blockBytes == MEGABYTE);
+        TEST(stats.allocationBytes == 1000);
+
+        // # New space is available for allocations
+
+        allocCreateInfo.size = 512 * KILOBYTE;
+        allocCreateInfo.pUserData = nullptr;
+        VkDeviceSize extraOffset = 0;
+        TEST(vmaVirtualAllocate(block, &allocCreateInfo, &extraAlloc, &extraOffset) == VK_SUCCESS);
+        TEST(extraOffset >= 1000 && extraOffset + allocCreateInfo.size <= MEGABYTE);
+        TEST(vmaResizeVirtualBlock(block, extraOffset + allocCreateInfo.size - 1) < 0);
+
+        // # Shrink back after the tail becomes free
+
+        vmaVirtualFree(block, extraAlloc);
+        vmaVirtualFree(block, allocs[3]);
+        TEST(vmaResizeVirtualBlock(block, 750) == VK_SUCCESS);
+        vmaGetVirtualBlockStatistics(block, &stats);
+        TEST(stats.blockBytes == 750);
+        TEST(stats.allocationBytes == 750);
+
+        allocCreateInfo.size = 1;
+        TEST(vmaVirtualAllocate(block, &allocCreateInfo, &extraAlloc, nullptr) < 0);
+
+        // # Linear block used as double stack cannot be resized
+
+        if(algorithmIndex == 1)
+        {
+            vmaVirtualFree(block, allocs[2]);
+            allocCreateInfo.size = 100;
+            allocCreateInfo.flags = VMA_VIRTUAL_ALLOCATION_CREATE_UPPER_ADDRESS_BIT;
+            TEST(vmaVirtualAllocate(block, &allocCreateInfo, &extraAlloc, nullptr) == VK_SUCCESS);
+            TEST(vmaResizeVirtualBlock(block, 2000) == VK_ERROR_FEATURE_NOT_PRESENT);
+            vmaVirtualFree(block, extraAlloc);
+            TEST(vmaResizeVirtualBlock(block, 2000) == VK_SUCCESS);
+        }
+
+        vmaClearVirtualBlock(block);
+        TEST(vmaResizeVirtualBlock(block, 1) == VK_SUCCESS);
+        vmaDestroyVirtualBlock(block);
+    }
+}
+
+static void TestVirtualBlocksMultiple()
+{
+    wprintf(L"Test virtual blocks multiple allocations\n");
+
+    RandomNumberGenerator rand{6732112};
+
+    for(size_t algorithmIndex = 0; algorithmIndex < 2; ++algorithmIndex)
+    {
+        VmaVirtualBlockCreateInfo blockCreateInfo = {};
+        blockCreateInfo.pAllocationCallbacks = g_Allocs;
+        blockCreateInfo.size = 10'000;
+        if(algorithmIndex == 1)
+            blockCreateInfo.flags = VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT;
+        VmaVirtualBlock block = nullptr;
+        TEST(vmaCreateVirtualBlock(&blockCreateInfo, &block) == VK_SUCCESS);
+
+        // # Allocate a batch that fits entirely
+
+        constexpr size_t allocCount = 100;
+        VmaVirtualAllocationCreateInfo allocCreateInfos[allocCount] = {};
+        for(size_t i = 0; i < allocCount; ++i)
+        {
+            allocCreateInfos[i].size = rand.Generate() % 50 + 1;
+            allocCreateInfos[i].alignment = (i % 3 == 0) ? 8 : 0;
+            allocCreateInfos[i].pUserData = (void*)(uintptr_t)(i + 1);
+        }
+        VmaVirtualAllocation allocs[allocCount] = {};
+        VkDeviceSize offsets[allocCount] = {};
+        TEST(vmaVirtualAllocateMultiple(block, allocCount, allocCreateInfos, allocs, offsets) == VK_SUCCESS);
+        for(size_t i = 0; i < allocCount; ++i)
+        {
+            TEST(allocs[i] != VK_NULL_HANDLE);
+            VmaVirtualAllocationInfo allocInfo = {};
+            vmaGetVirtualAllocationInfo(block, allocs[i], &allocInfo);
+            TEST(allocInfo.offset == offsets[i]);
+            TEST(allocInfo.size == allocCreateInfos[i].size);
+            TEST(allocInfo.pUserData == allocCreateInfos[i].pUserData);
+            if(allocCreateInfos[i].alignment)
+                TEST(allocInfo.offset % allocCreateInfos[i].alignment == 0);
+        }
+
+        VmaStatistics stats = {};
+        vmaGetVirtualBlockStatistics(block, &stats);
+        TEST(stats.allocationCount == allocCount);
+
+        vmaVirtualFreeMultiple(block, allocCount, allocs);
+        TEST(vmaIsVirtualBlockEmpty(block));
+
+        // # Batch with one allocation too large - only that one fails
+
+        VmaVirtualAllocationCreateInfo partialCreateInfos[3] = {};
+        partialCreateInfos[0].size = 4'000;
+        partialCreateInfos[1].size = 8'000;
+        partialCreateInfos[2].size = 4'000;
+        VmaVirtualAllocation partialAllocs[3] = {};
+        TEST(vmaVirtualAllocateMultiple(block, 3, partialCreateInfos, partialAllocs, offsets) == VK_ERROR_OUT_OF_DEVICE_MEMORY);
+        TEST(partialAllocs[0] != VK_NULL_HANDLE);
+        TEST(partialAllocs[1] == VK_NULL_HANDLE && offsets[1] == UINT64_MAX);
+        TEST(partialAllocs[2] != VK_NULL_HANDLE);
+        TEST(offsets[0] + 4'000 <= offsets[2] || offsets[2] + 4'000 <= offsets[0]);
+
+        // Null entries are skipped.
+        vmaVirtualFreeMultiple(block, 3, partialAllocs);
+        TEST(vmaIsVirtualBlockEmpty(block));
+
+        vmaDestroyVirtualBlock(block);
+    }
+}
+
+static void TestVirtualBlocksSerialization()
+{
+    wprintf(L"Test virtual blocks serialization\n");
+
+    RandomNumberGenerator rand{33051};
+
+    // 0 = TLSF, 1 = linear as ring buffer, 2 = linear as double stack
+    for(size_t testIndex = 0; testIndex < 3; ++testIndex)
+    {
+        VmaVirtualBlockCreateInfo blockCreateInfo = {};
+        blockCreateInfo.pAllocationCallbacks = g_Allocs;
+        blockCreateInfo.size = 100'000;
+        if(testIndex > 0)
+            blockCreateInfo.flags = VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT;
+        VmaVirtualBlock block = nullptr;
+        TEST(vmaCreateVirtualBlock(&blockCreateInfo, &block) == VK_SUCCESS);
+
+        std::vector<VmaVirtualAllocation> allocs;
+        for(size_t i = 0; i < 300; ++i)
+        {
+            VmaVirtualAllocationCreateInfo allocCreateInfo = {};
+            allocCreateInfo.size = rand.Generate() % 200 + 1;
+            allocCreateInfo.alignment = (i % 2 == 0) ? 16 : 0;
+            allocCreateInfo.pUserData = (void*)(uintptr_t)(i + 1);
+            if(testIndex == 2 && i % 3 == 0)
+                allocCreateInfo.flags = VMA_VIRTUAL_ALLOCATION_CREATE_UPPER_ADDRESS_BIT;
+            VmaVirtualAllocation alloc;
+            TEST(vmaVirtualAllocate(block, &allocCreateInfo, &alloc, nullptr) == VK_SUCCESS);
+            allocs.push_back(alloc);
+        }
+        if(testIndex == 1)
+        {
+            // Free from the beginning and wrap around the end of the block.
+            for(size_t i = 0; i < 200; ++i)
+                vmaVirtualFree(block, allocs[i]);
+            allocs.erase(allocs.begin(), allocs.begin() + 200);
+            VmaVirtualAllocationInfo firstInfo = {};
+            vmaGetVirtualAllocationInfo(block, allocs[0], &firstInfo);
+            VmaVirtualAllocationCreateInfo allocCreateInfo = {};
+            allocCreateInfo.size = 5'000;
+            VkDeviceSize offset = UINT64_MAX;
+            while(offset >= firstInfo.offset)
+            {
+                VmaVirtualAllocation alloc;
+                TEST(vmaVirtualAllocate(block, &allocCreateInfo, &alloc, &offset) == VK_SUCCESS);
+                allocs.push_back(alloc);
+            }
+        }
+        else
+        {
+            for(size_t i = allocs.size(); i--; )
+            {
+                if(rand.Generate() % 3 == 0)
+                {
+                    vmaVirtualFree(block, allocs[i]);
+                    allocs.erase(allocs.begin() + i);
+                }
+            }
+        }
+
+        VmaDetailedStatistics srcStats = {};
+        vmaCalculateVirtualBlockStatistics(block, &srcStats);
+
+        size_t dataSize = 0;
+        TEST(vmaSerializeVirtualBlock(block, &dataSize, nullptr) == VK_SUCCESS);
+        TEST(dataSize > 0);
+        std::vector<char> data(dataSize);
+        size_t smallDataSize = dataSize - 1;
+        TEST(vmaSerializeVirtualBlock(block, &smallDataSize, data.data()) == VK_INCOMPLETE);
+        TEST(vmaSerializeVirtualBlock(block, &dataSize, data.data()) == VK_SUCCESS);
+        TEST(dataSize == data.size());
+
+        std::vector<VmaVirtualAllocation> restoredAllocs(allocs.size());
+        VmaVirtualBlock restoredBlock = nullptr;
+        TEST(vmaDeserializeVirtualBlock(data.data(), data.size(), g_Allocs,
+            restoredAllocs.size(), restoredAllocs.data(), &restoredBlock) == VK_SUCCESS);
+
+        VmaDetailedStatistics dstStats = {};
+        vmaCalculateVirtualBlockStatistics(restoredBlock, &dstStats);
+        TEST(dstStats.statistics.allocationCount == srcStats.statistics.allocationCount);
+        TEST(dstStats.statistics.allocationBytes == srcStats.statistics.allocationBytes);
+        TEST(dstStats.statistics.blockBytes == srcStats.statistics.blockBytes);
+        TEST(dstStats.unusedRangeCount == srcStats.unusedRangeCount);
+
+        // Restored allocations are returned in order of increasing offsets.
+        std::vector<VmaVirtualAllocationInfo> srcInfos(allocs.size());
+        for(size_t i = 0; i < allocs.size(); ++i)
+            vmaGetVirtualAllocationInfo(block, allocs[i], &srcInfos[i]);
+        std::sort(srcInfos.begin(), srcInfos.end(), [](const VmaVirtualAllocationInfo& lhs, const VmaVirtualAllocationInfo& rhs)
+            {
+                return lhs.offset < rhs.offset;
+            });
+        for(size_t i = 0; i < restoredAllocs.size(); ++i)
+        {
+            VmaVirtualAllocationInfo dstInfo = {};
+            vmaGetVirtualAllocationInfo(restoredBlock, restoredAllocs[i], &dstInfo);
+            TEST(dstInfo.offset == srcInfos[i].offset);
+            TEST(dstInfo.size == srcInfos[i].size);
+            TEST(dstInfo.pUserData == srcInfos[i].pUserData);
+        }
+
+        // Restored block is fully functional.
+        VmaVirtualAllocationCreateInfo allocCreateInfo = {};
+        allocCreateInfo.size = 100;
+        VmaVirtualAllocation alloc;
+        TEST(vmaVirtualAllocate(restoredBlock, &allocCreateInfo, &alloc, nullptr) == VK_SUCCESS);
+        vmaVirtualFree(restoredBlock, alloc);
+        vmaVirtualFreeMultiple(restoredBlock, restoredAllocs.size(), restoredAllocs.data());
+        TEST(vmaIsVirtualBlockEmpty(restoredBlock));
+        vmaDestroyVirtualBlock(restoredBlock);
+
+        // Invalid data is rejected.
+        TEST(vmaDeserializeVirtualBlock(data.data(), data.size() - 1, g_Allocs,
+            restoredAllocs.size(), restoredAllocs.data(), &restoredBlock) == VK_ERROR_FORMAT_NOT_SUPPORTED);
+        TEST(restoredBlock == VK_NULL_HANDLE);
+        TEST(vmaDeserializeVirtualBlock(data.data(), data.size(), g_Allocs,
+            restoredAllocs.size() + 1, restoredAllocs.data(), &restoredBlock) == VK_ERROR_FORMAT_NOT_SUPPORTED);
+        data[0] ^= 1;
+        TEST(vmaDeserializeVirtualBlock(data.data(), data.size(), g_Allocs,
+            0, nullptr, &restoredBlock) == VK_ERROR_FORMAT_NOT_SUPPORTED);
+
+        vmaVirtualFreeMultiple(block, allocs.size(), allocs.data());
+        vmaDestroyVirtualBlock(block);
+    }
+
+    // Snapshot of TLSF block with ranges that the algorithm never produces is rejected.
+    {
+        VmaVirtualBlockCreateInfo blockCreateInfo = {};
+        blockCreateInfo.pAllocationCallbacks = g_Allocs;
+        blockCreateInfo.size = 10'000;
+        VmaVirtualBlock block = nullptr;
+        TEST(vmaCreateVirtualBlock(&blockCreateInfo, &block) == VK_SUCCESS);
+
+        // Ranges: allocation, free, allocation, allocation.
+        VmaVirtualAllocationCreateInfo allocCreateInfo = {};
+        allocCreateInfo.size = 100;
+        VmaVirtualAllocation allocs[4];
+        for(size_t i = 0; i < 4; ++i)
+            TEST(vmaVirtualAllocate(block, &allocCreateInfo, &allocs[i], nullptr) == VK_SUCCESS);
+        vmaVirtualFree(block, allocs[1]);
+
+        size_t dataSize = 0;
+        TEST(vmaSerializeVirtualBlock(block, &dataSize, nullptr) == VK_SUCCESS);
+        std::vector<char> data(dataSize);
+        TEST(vmaSerializeVirtualBlock(block, &dataSize, data.data()) == VK_SUCCESS);
+
+        // Layout of the snapshot: 48-byte header with allocation count at byte 24,
+        // followed by ranges of offset, size with free flag in the top bit, and user data.
+        const size_t headerSize = 48;
+        const size_t rangeSize = 24;
+        TEST(dataSize == headerSize + 4 * rangeSize);
+        auto markFree = [&](std::vector<char>& snapshot, size_t rangeIndex)
+        {
+            uint64_t allocCount, size;
+            memcpy(&allocCount, snapshot.data() + 24, sizeof(allocCount));
+            memcpy(&size, snapshot.data() + headerSize + rangeIndex * rangeSize + 8, sizeof(size));
+            --allocCount;
+            size |= 1ull << 63;
+            memcpy(snapshot.data() + 24, &allocCount, sizeof(allocCount));
+            memcpy(snapshot.data() + headerSize + rangeIndex * rangeSize + 8, &size, sizeof(size));
+        };
+
+        VmaVirtualAllocation restoredAllocs[4];
+        VmaVirtualBlock restoredBlock = nullptr;
+        TEST(vmaDeserializeVirtualBlock(data.data(), data.size(), g_Allocs,
+            3, restoredAllocs, &restoredBlock) == VK_SUCCESS);
+        vmaVirtualFreeMultiple(restoredBlock, 3, restoredAllocs);
+        vmaDestroyVirtualBlock(restoredBlock);
+
+        // Two adjacent free ranges.
+        std::vector<char> corrupted = data;
+        markFree(corrupted, 0);
+        TEST(vmaDeserializeVirtualBlock(corrupted.data(), corrupted.size(), g_Allocs,
+            2, restoredAllocs, &restoredBlock) == VK_ERROR_FORMAT_NOT_SUPPORTED);
+        TEST(restoredBlock == VK_NULL_HANDLE);
+
+        // Free range just before the free space at the end of the block.
+        corrupted = data;
+        markFree(corrupted, 3);
+        TEST(vmaDeserializeVirtualBlock(corrupted.data(), corrupted.size(), g_Allocs,
+            2, restoredAllocs, &restoredBlock) == VK_ERROR_FORMAT_NOT_SUPPORTED);
+        TEST(restoredBlock == VK_NULL_HANDLE);
+
+        vmaVirtualFree(block, allocs[0]);
+        vmaVirtualFree(block, allocs[2]);
+        vmaVirtualFree(block, allocs[3]);
+        vmaDestroyVirtualBlock(block);
+    }
+}
+
+static void TestVirtualBlocksDefragmentation()
+{
+    wprintf(L"Test virtual blocks defragmentation\n");
+
+    struct VirtualObject
+    {
+        size_t blockIndex;
+        VmaVirtualAllocation alloc;
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        uint8_t value;
+    };
+
+    const uint32_t algorithms[] = {
+        VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT,
+        VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT,
+        VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT,
+        VMA_DEFRAGMENTATION_FLAG_ALGORITHM_EXTENSIVE_BIT };
+    constexpr size_t blockCount = 3;
+    constexpr VkDeviceSize blockSize = 10'000;
+    constexpr VkDeviceSize alignment = 16;
+
+    RandomNumberGenerator rand{2113};
+
+    for(uint32_t algorithm : algorithms)
+    {
+        VmaVirtualBlockCreateInfo blockCreateInfo = {};
+        blockCreateInfo.pAllocationCallbacks = g_Allocs;
+        blockCreateInfo.size = blockSize;
+
+        VmaVirtualBlock blocks[blockCount] = {};
+        std::vector<uint8_t> blockData[blockCount];
+        for(size_t i = 0; i < blockCount; ++i)
+        {
+            TEST(vmaCreateVirtualBlock(&blockCreateInfo, &blocks[i]) == VK_SUCCESS);
+            blockData[i].resize((size_t)blockSize);
+        }
+
+        // Fill the blocks and free every second allocation to create fragmentation.
+        std::vector<VirtualObject*> objects;
+        for(size_t blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+        {
+            for(;;)
+            {
+                VirtualObject* obj = new VirtualObject();
+                obj->blockIndex = blockIndex;
+                obj->size = rand.Generate() % 200 + 1;
+                obj->value = (uint8_t)(objects.size() % 255 + 1);
+
+                VmaVirtualAllocationCreateInfo allocCreateInfo = {};
+                allocCreateInfo.size = obj->size;
+                allocCreateInfo.alignment = alignment;
+                allocCreateInfo.pUserData = obj;
+                if(vmaVirtualAllocate(blocks[blockIndex], &allocCreateInfo, &obj->alloc, &obj->offset) != VK_SUCCESS)
+                {
+                    delete obj;
+                    break;
+                }
+                memset(blockData[blockIndex].data() + obj->offset, obj->value, (size_t)obj->size);
+                objects.push_back(obj);
+            }
+        }
+        for(size_t i = objects.size(); i--; )
+        {
+            if(i % 2 == 1 || rand.Generate() % 3 == 0)
+            {
+                vmaVirtualFree(blocks[objects[i]->blockIndex], objects[i]->alloc);
+                delete objects[i];
+                objects.erase(objects.begin() + i);
+            }
+        }
+
+        VmaVirtualDefragmentationInfo defragInfo = {};
+        defragInfo.flags = algorithm;
+        defragInfo.blockCount = blockCount;
+        defragInfo.pBlocks = blocks;
+        defragInfo.alignment = alignment;
+        defragInfo.maxAllocationsPerPass = 10;
+
+        VmaVirtualDefragmentationContext defragCtx = nullptr;
+        TEST(vmaBeginVirtualDefragmentation(&defragInfo, &defragCtx) == VK_SUCCESS);
+
+        uint32_t moveCount = 0;
+        for(;;)
+        {
+            VmaVirtualDefragmentationPassMoveInfo pass = {};
+            VkResult res = vmaBeginVirtualDefragmentationPass(defragCtx, &pass);
+            if(res == VK_SUCCESS)
+                break;
+            TEST(res == VK_INCOMPLETE);
+            TEST(pass.moveCount > 0 && pass.moveCount <= defragInfo.maxAllocationsPerPass);
+
+            for(uint32_t i = 0; i < pass.moveCount; ++i)
+            {
+                VmaVirtualDefragmentationMove& move = pass.pMoves[i];
+                VmaVirtualAllocationInfo allocInfo = {};
+                vmaGetVirtualAllocationInfo(move.srcBlock, move.srcAllocation, &allocInfo);
+                VirtualObject* obj = (VirtualObject*)allocInfo.pUserData;
+                TEST(move.srcBlock == blocks[obj->blockIndex]);
+                TEST(move.srcOffset == obj->offset && move.size == obj->size);
+                TEST(move.dstOffset % alignment == 0);
+                TEST(move.srcBlock != move.dstBlock || move.dstOffset < move.srcOffset);
+
+                const size_t dstBlockIndex = std::find(blocks, blocks + blockCount, move.dstBlock) - blocks;
+                TEST(dstBlockIndex < blockCount);
+                memcpy(blockData[dstBlockIndex].data() + move.dstOffset,
+                    blockData[obj->blockIndex].data() + move.srcOffset, (size_t)move.size);
+                obj->blockIndex = dstBlockIndex;
+                obj->alloc = move.dstAllocation;
+                obj->offset = move.dstOffset;
+            }
+            moveCount += pass.moveCount;
+
+            if(vmaEndVirtualDefragmentationPass(defragCtx, &pass) == VK_SUCCESS)
+                break;
+        }
+
+        VmaDefragmentationStats defragStats = {};
+        vmaEndVirtualDefragmentation(defragCtx, &defragStats);
+        TEST(defragStats.allocationsMoved == moveCount);
+        TEST(moveCount > 0);
+
+        // Allocations and their contents are preserved.
+        size_t allocationCount = 0;
+        size_t emptyBlockCount = 0;
+        for(size_t i = 0; i < blockCount; ++i)
+        {
+            VmaStatistics stats = {};
+            vmaGetVirtualBlockStatistics(blocks[i], &stats);
+            allocationCount += stats.allocationCount;
+            if(vmaIsVirtualBlockEmpty(blocks[i]))
+                ++emptyBlockCount;
+        }
+        TEST(allocationCount == objects.size());
+        TEST(emptyBlockCount == defragStats.deviceMemoryBlocksFreed);
+        TEST(defragStats.bytesFreed == emptyBlockCount * blockSize);
+        for(VirtualObject* obj : objects)
+        {
+            VmaVirtualAllocationInfo allocInfo = {};
+            vmaGetVirtualAllocationInfo(blocks[obj->blockIndex], obj->alloc, &allocInfo);
+            TEST(allocInfo.offset == obj->offset && allocInfo.size == obj->size && allocInfo.pUserData == obj);
+            const uint8_t* data = blockData[obj->blockIndex].data() + obj->offset;
+            for(VkDeviceSize i = 0; i < obj->size; ++i)
+                TEST(data[i] == obj->value);
+
+            vmaVirtualFree(blocks[obj->blockIndex], obj->alloc);
+            delete obj;
+        }
+
+        for(size_t i = 0; i < blockCount; ++i)
+            vmaDestroyVirtualBlock(blocks[i]);
+    }
+
+    // Linear algorithm is not supported.
+    {
+        VmaVirtualBlockCreateInfo blockCreateInfo = {};
+        blockCreateInfo.pAllocationCallbacks = g_Allocs;
+        blockCreateInfo.size = blockSize;
+        blockCreateInfo.flags = VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT;
+        VmaVirtualBlock block = nullptr;
+        TEST(vmaCreateVirtualBlock(&blockCreateInfo, &block) == VK_SUCCESS);
+
+        VmaVirtualDefragmentationInfo defragInfo = {};
+        defragInfo.blockCount = 1;
+        defragInfo.pBlocks = &block;
+        VmaVirtualDefragmentationContext defragCtx = nullptr;
+        TEST(vmaBeginVirtualDefragmentation(&defragInfo, &defragCtx) == VK_ERROR_FEATURE_NOT_PRESENT);
+
+        vmaDestroyVirtualBlock(block);
+    }
+}
+
+static void TestVirtualBlockVector()
+{
+    wprintf(L"Test virtual block vector\n");
 
-        // Allocate some with extra alignment
-        for(size_t i = 0; i < 3; ++i)
-        {
-            VmaVirtualAllocationCreateInfo allocCreateInfo = {};
-            allocCreateInfo.size = calcRandomAllocSize();
-            allocCreateInfo.alignment = 16;
-            allocCreateInfo.pUserData = (void*)(uintptr_t)(allocCreateInfo.size * 10);
+    struct BackingBlocks
+    {
+        std::vector<bool> exist;
+        uint32_t createCount = 0;
+        uint32_t destroyCount = 0;
+        bool failCreate = false;
+    };
+    const PFN_vmaCreateVirtualBlockFunction createBlock = [](VmaVirtualBlockVector vector,
+        uint32_t blockIndex, VkDeviceSize size, void* pUserData) -> VkResult
+    {
+        BackingBlocks* backing = (BackingBlocks*)pUserData;
+        if(backing->failCreate)
+            return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+        if(blockIndex >= backing->exist.size())
+            backing->exist.resize(blockIndex + 1);
+        TEST(!backing->exist[blockIndex]);
+        backing->exist[blockIndex] = true;
+        ++backing->createCount;
+        return VK_SUCCESS;
+    };
+    const PFN_vmaDestroyVirtualBlockFunction destroyBlock = [](VmaVirtualBlockVector vector,
+        uint32_t blockIndex, void* pUserData)
+    {
+        BackingBlocks* backing = (BackingBlocks*)pUserData;
+        TEST(blockIndex < backing->exist.size() && backing->exist[blockIndex]);
+        backing->exist[blockIndex] = false;
+        ++backing->destroyCount;
+    };
 
-            AllocData alloc = {};
-            alloc.requestedSize = allocCreateInfo.size;
-            res = vmaVirtualAllocate(block, &allocCreateInfo, &alloc.allocation, nullptr);
-            TEST(res == VK_SUCCESS);
+    constexpr VkDeviceSize blockSize = 10'000;
+    BackingBlocks backing;
 
-            VmaVirtualAllocationInfo allocInfo;
-            vmaGetVirtualAllocationInfo(block, alloc.allocation, &allocInfo);
-            TEST(allocInfo.offset % 16 == 0);
-            TEST(allocInfo.size >= allocCreateInfo.size);
-            alloc.allocOffset = allocInfo.offset;
-            alloc.allocationSize = allocInfo.size;
+    VmaVirtualBlockVectorCreateInfo vectorCreateInfo = {};
+    vectorCreateInfo.blockSize = blockSize;
+    vectorCreateInfo.minBlockCount = 1;
+    vectorCreateInfo.maxBlockCount = 4;
+    vectorCreateInfo.pfnCreateBlock = createBlock;
+    vectorCreateInfo.pfnDestroyBlock = destroyBlock;
+    vectorCreateInfo.pUserData = &backing;
+    vectorCreateInfo.pAllocationCallbacks = g_Allocs;
 
-            allocations.push_back(alloc);
-        }
+    VmaVirtualBlockVector vector = nullptr;
+    TEST(vmaCreateVirtualBlockVector(&vectorCreateInfo, &vector) == VK_SUCCESS);
+    TEST(backing.createCount == 1);
 
-        // Check if the allocations don't overlap
-        std::sort(allocations.begin(), allocations.end(), [](const AllocData& lhs, const AllocData& rhs) {
-            return lhs.allocOffset < rhs.allocOffset; });
-        for(size_t i = 0; i < allocations.size() - 1; ++i)
-        {
-            TEST(allocations[i+1].allocOffset >= allocations[i].allocOffset + allocations[i].allocationSize);
-        }
+    struct Alloc
+    {
+        VmaVirtualAllocation alloc;
+        uint32_t blockIndex;
+        VkDeviceSize offset;
+    };
+    std::vector<Alloc> allocs;
 
-        // Check pUserData
-        {
-            const AllocData& alloc = allocations.back();
-            VmaVirtualAllocationInfo allocInfo = {};
-            vmaGetVirtualAllocationInfo(block, alloc.allocation, &allocInfo);
-            TEST((uintptr_t)allocInfo.pUserData == alloc.requestedSize * 10);
+    // Fill all 4 blocks with 3 allocations each.
+    VmaVirtualAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.size = 3'000;
+    for(uint32_t i = 0; i < 12; ++i)
+    {
+        Alloc a = {};
+        TEST(vmaVirtualBlockVectorAllocate(vector, &allocCreateInfo, &a.alloc, &a.blockIndex, &a.offset) == VK_SUCCESS);
+        TEST(a.blockIndex < 4 && a.offset + allocCreateInfo.size <= blockSize);
 
-            vmaSetVirtualAllocationUserData(block, alloc.allocation, (void*)(uintptr_t)666);
-            vmaGetVirtualAllocationInfo(block, alloc.allocation, &allocInfo);
-            TEST((uintptr_t)allocInfo.pUserData == 666);
-        }
+        VmaVirtualBlock block = nullptr;
+        vmaGetVirtualBlockVectorBlock(vector, a.blockIndex, &block);
+        TEST(block != nullptr);
+        VmaVirtualAllocationInfo allocInfo = {};
+        vmaGetVirtualAllocationInfo(block, a.alloc, &allocInfo);
+        TEST(allocInfo.offset == a.offset && allocInfo.size == allocCreateInfo.size);
+        allocs.push_back(a);
+    }
+    TEST(backing.createCount == 4);
 
-        // Calculate statistics
-        {
-            VkDeviceSize actualAllocSizeMin = VK_WHOLE_SIZE, actualAllocSizeMax = 0, actualAllocSizeSum = 0;
-            std::for_each(allocations.begin(), allocations.end(), [&](const AllocData& a) {
-                actualAllocSizeMin = std::min(actualAllocSizeMin, a.allocationSize);
-                actualAllocSizeMax = std::max(actualAllocSizeMax, a.allocationSize);
-                actualAllocSizeSum += a.allocationSize;
-            });
+    // Max block count reached.
+    {
+        Alloc a = {};
+        TEST(vmaVirtualBlockVectorAllocate(vector, &allocCreateInfo, &a.alloc, &a.blockIndex, &a.offset) == VK_ERROR_OUT_OF_DEVICE_MEMORY);
+        TEST(a.alloc == VK_NULL_HANDLE);
+    }
+    // Too large allocation.
+    {
+        VmaVirtualAllocationCreateInfo largeCreateInfo = {};
+        largeCreateInfo.size = blockSize + 1;
+        Alloc a = {};
+        TEST(vmaVirtualBlockVectorAllocate(vector, &largeCreateInfo, &a.alloc, &a.blockIndex, &a.offset) == VK_ERROR_OUT_OF_DEVICE_MEMORY);
+    }
 
-            VmaDetailedStatistics statInfo = {};
-            vmaCalculateVirtualBlockStatistics(block, &statInfo);
-            TEST(statInfo.statistics.allocationCount == allocations.size());
-            TEST(statInfo.statistics.blockCount == 1);
-            TEST(statInfo.statistics.blockBytes == blockCreateInfo.size);
-            TEST(statInfo.allocationSizeMax == actualAllocSizeMax);
-            TEST(statInfo.allocationSizeMin == actualAllocSizeMin);
-            TEST(statInfo.statistics.allocationBytes >= actualAllocSizeSum);
-        }
+    VmaStatistics stats = {};
+    vmaGetVirtualBlockVectorStatistics(vector, &stats);
+    TEST(stats.blockCount == 4 && stats.allocationCount == 12);
+    TEST(stats.blockBytes == 4 * blockSize && stats.allocationBytes == 12 * allocCreateInfo.size);
 
-#if !defined(VMA_STATS_STRING_ENABLED) || VMA_STATS_STRING_ENABLED
-        // Build JSON dump string
+    // Free everything from blocks 1 and 2 - only one empty block is kept.
+    for(size_t i = allocs.size(); i--; )
+    {
+        if(allocs[i].blockIndex == 1 || allocs[i].blockIndex == 2)
         {
-            char* json = nullptr;
-            vmaBuildVirtualBlockStatsString(block, &json, VK_TRUE);
-            int I = 0; // put a breakpoint here to debug
-            vmaFreeVirtualBlockStatsString(block, json);
+            vmaVirtualBlockVectorFree(vector, allocs[i].blockIndex, allocs[i].alloc);
+            allocs.erase(allocs.begin() + i);
         }
-#endif
+    }
+    vmaGetVirtualBlockVectorStatistics(vector, &stats);
+    TEST(stats.blockCount == 3 && stats.allocationCount == 6);
+    TEST(backing.destroyCount == 1);
 
-        // Final cleanup
-        vmaClearVirtualBlock(block);
-        vmaDestroyVirtualBlock(block);
+    // New allocations go to the empty block first, then a released index is reused.
+    for(uint32_t i = 0; i < 6; ++i)
+    {
+        Alloc a = {};
+        TEST(vmaVirtualBlockVectorAllocate(vector, &allocCreateInfo, &a.alloc, &a.blockIndex, &a.offset) == VK_SUCCESS);
+        TEST(a.blockIndex == 1 || a.blockIndex == 2);
+        allocs.push_back(a);
+    }
+    TEST(backing.createCount == 5);
+
+    // Failure of the create callback is returned to the caller.
+    {
+        backing.failCreate = true;
+        vectorCreateInfo.maxBlockCount = 0;
+        VmaVirtualBlockVector vector2 = nullptr;
+        TEST(vmaCreateVirtualBlockVector(&vectorCreateInfo, &vector2) == VK_ERROR_OUT_OF_DEVICE_MEMORY);
+        TEST(vector2 == nullptr);
+        backing.failCreate = false;
     }
+
+    for(const Alloc& a : allocs)
+        vmaVirtualBlockVectorFree(vector, a.blockIndex, a.alloc);
+    vmaGetVirtualBlockVectorStatistics(vector, &stats);
+    TEST(stats.blockCount >= 1 && stats.allocationCount == 0);
+
+    vmaDestroyVirtualBlockVector(vector);
+    TEST(backing.createCount == backing.destroyCount);
+    for(bool exists : backing.exist)
+        TEST(!exists);
 }
 
 static void TestAllocationVersusResourceSize()
@@ -3682,6 +5251,190 @@ static void TestPool_MinBlockCount()
     vmaDestroyPool(g_hAllocator, pool);
 }
 
+static void TestPool_MemoryLimits()
+{
+#if defined(VMA_DEBUG_MARGIN) && VMA_DEBUG_MARGIN > 0
+    return;
+#endif
+
+    wprintf(L"Test Pool MemoryLimits\n");
+    VkResult res;
+
+    static const VkDeviceSize ALLOC_SIZE = 256ull * 1024;
+    static const VkDeviceSize BLOCK_SIZE = ALLOC_SIZE * 4;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufCreateInfo.size = ALLOC_SIZE;
+
+    struct SoftLimitData
+    {
+        uint32_t callCount = 0;
+        VkDeviceSize memoryBytes = 0;
+    } softLimitData;
+
+    VmaPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.blockSize = BLOCK_SIZE;
+    poolCreateInfo.softMemoryLimit = BLOCK_SIZE * 2;
+    poolCreateInfo.hardMemoryLimit = BLOCK_SIZE * 4;
+    poolCreateInfo.pfnSoftMemoryLimit = [](VmaAllocator allocator, VmaPool pool, VkDeviceSize memoryBytes, void* pUserData)
+    {
+        SoftLimitData* data = (SoftLimitData*)pUserData;
+        ++data->callCount;
+        data->memoryBytes = memoryBytes;
+    };
+    poolCreateInfo.pSoftMemoryLimitUserData = &softLimitData;
+    res = vmaFindMemoryTypeIndexForBufferInfo(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &poolCreateInfo.memoryTypeIndex);
+    TEST(res == VK_SUCCESS);
+
+    VmaPool pool = VK_NULL_HANDLE;
+    res = vmaCreatePool(g_hAllocator, &poolCreateInfo, &pool);
+    TEST(res == VK_SUCCESS && pool != VK_NULL_HANDLE);
+
+    // Fill the pool up to the hard limit, crossing the soft limit on the third block.
+    allocCreateInfo.pool = pool;
+    std::vector<AllocInfo> allocs;
+    for(;;)
+    {
+        AllocInfo alloc;
+        res = vmaCreateBuffer(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &alloc.m_Buffer, &alloc.m_Allocation, nullptr);
+        if(res != VK_SUCCESS)
+            break;
+        allocs.push_back(alloc);
+    }
+    TEST(res == VK_ERROR_OUT_OF_DEVICE_MEMORY);
+    TEST(allocs.size() == 16);
+    TEST(softLimitData.callCount == 1 && softLimitData.memoryBytes == BLOCK_SIZE * 3);
+
+    VmaStatistics poolStats = {};
+    vmaGetPoolStatistics(g_hAllocator, pool, &poolStats);
+    TEST(poolStats.blockCount == 4 && poolStats.blockBytes == BLOCK_SIZE * 4);
+
+    // Free space in existing blocks can still be used.
+    allocs.back().Destroy();
+    allocs.pop_back();
+    AllocInfo alloc;
+    res = vmaCreateBuffer(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &alloc.m_Buffer, &alloc.m_Allocation, nullptr);
+    TEST(res == VK_SUCCESS);
+    allocs.push_back(alloc);
+
+    // After going back below the soft limit, crossing it again calls the callback again.
+    for(size_t i = allocs.size(); i-- > 4; )
+    {
+        allocs[i].Destroy();
+        allocs.pop_back();
+    }
+    vmaGetPoolStatistics(g_hAllocator, pool, &poolStats);
+    TEST(poolStats.blockBytes <= BLOCK_SIZE * 2);
+    while(allocs.size() < 12)
+    {
+        res = vmaCreateBuffer(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &alloc.m_Buffer, &alloc.m_Allocation, nullptr);
+        TEST(res == VK_SUCCESS);
+        allocs.push_back(alloc);
+    }
+    TEST(softLimitData.callCount == 2);
+
+    // Cleanup.
+    for(size_t i = allocs.size(); i--; )
+    {
+        allocs[i].Destroy();
+    }
+    vmaDestroyPool(g_hAllocator, pool);
+}
+
+static void TestPool_EmptyBlocks()
+{
+#if defined(VMA_DEBUG_MARGIN) && VMA_DEBUG_MARGIN > 0
+    return;
+#endif
+
+    wprintf(L"Test Pool EmptyBlocks\n");
+    VkResult res;
+
+    static const VkDeviceSize BLOCK_SIZE = 1024ull * 1024;
+    static const uint32_t RELEASE_FRAME_COUNT = 3;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+
+    // Every buffer takes whole block.
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufCreateInfo.size = BLOCK_SIZE;
+
+    VmaPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.blockSize = BLOCK_SIZE;
+    poolCreateInfo.maxEmptyBlockCount = 3;
+    poolCreateInfo.emptyBlockReleaseFrameCount = RELEASE_FRAME_COUNT;
+    res = vmaFindMemoryTypeIndexForBufferInfo(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &poolCreateInfo.memoryTypeIndex);
+    TEST(res == VK_SUCCESS);
+
+    VmaPool pool = VK_NULL_HANDLE;
+    res = vmaCreatePool(g_hAllocator, &poolCreateInfo, &pool);
+    TEST(res == VK_SUCCESS && pool != VK_NULL_HANDLE);
+    allocCreateInfo.pool = pool;
+
+    vmaSetCurrentFrameIndex(g_hAllocator, ++g_FrameIndex);
+
+    std::vector<AllocInfo> allocs;
+    auto createBuffers = [&](size_t count)
+    {
+        while(allocs.size() < count)
+        {
+            AllocInfo alloc;
+            res = vmaCreateBuffer(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &alloc.m_Buffer, &alloc.m_Allocation, nullptr);
+            TEST(res == VK_SUCCESS);
+            allocs.push_back(alloc);
+        }
+    };
+    auto destroyBuffers = [&](size_t count)
+    {
+        while(allocs.size() > count)
+        {
+            allocs.back().Destroy();
+            allocs.pop_back();
+        }
+    };
+
+    // Going from 6 to 2 blocks keeps 3 of them empty, freeing only one.
+    createBuffers(6);
+    destroyBuffers(2);
+    VmaStatistics poolStats = {};
+    vmaGetPoolStatistics(g_hAllocator, pool, &poolStats);
+    VmaEmptyBlockStatistics emptyStats = {};
+    vmaGetPoolEmptyBlockStatistics(g_hAllocator, pool, &emptyStats);
+    TEST(poolStats.blockCount == 5);
+    TEST(emptyStats.emptyBlockCount == 3 && emptyStats.emptyBlockBytes == BLOCK_SIZE * 3);
+    TEST(emptyStats.reusedBlockCount == 0 && emptyStats.releasedBlockCount == 0);
+
+    // Going back to 5 blocks reuses them.
+    createBuffers(5);
+    vmaGetPoolStatistics(g_hAllocator, pool, &poolStats);
+    vmaGetPoolEmptyBlockStatistics(g_hAllocator, pool, &emptyStats);
+    TEST(poolStats.blockCount == 5);
+    TEST(emptyStats.emptyBlockCount == 0 && emptyStats.reusedBlockCount == 3);
+
+    // Empty blocks are freed only after staying unused for RELEASE_FRAME_COUNT frames.
+    destroyBuffers(2);
+    for(uint32_t i = 1; i < RELEASE_FRAME_COUNT; ++i)
+    {
+        vmaSetCurrentFrameIndex(g_hAllocator, ++g_FrameIndex);
+        vmaGetPoolEmptyBlockStatistics(g_hAllocator, pool, &emptyStats);
+        TEST(emptyStats.emptyBlockCount == 3 && emptyStats.releasedBlockCount == 0);
+    }
+    vmaSetCurrentFrameIndex(g_hAllocator, ++g_FrameIndex);
+    vmaGetPoolStatistics(g_hAllocator, pool, &poolStats);
+    vmaGetPoolEmptyBlockStatistics(g_hAllocator, pool, &emptyStats);
+    TEST(poolStats.blockCount == 2);
+    TEST(emptyStats.emptyBlockCount == 0 && emptyStats.releasedBlockCount == 3);
+
+    destroyBuffers(0);
+    vmaDestroyPool(g_hAllocator, pool);
+}
+
 static void TestPool_MinAllocationAlignment()
 {
     wprintf(L"Test Pool MinAllocationAlignment\n");
@@ -3957,14 +5710,128 @@ void TestHeapSizeLimit()
         TEST(res == VK_ERROR_OUT_OF_DEVICE_MEMORY);
     }
 
-    // Destroy everything.
-    for(size_t i = items.size(); i--; )
-    {
-        vmaDestroyBuffer(hAllocator, items[i].hBuf, items[i].hAlloc);
+    // Destroy everything.
+    for(size_t i = items.size(); i--; )
+    {
+        vmaDestroyBuffer(hAllocator, items[i].hBuf, items[i].hAlloc);
+    }
+
+    vmaDestroyPool(hAllocator, hPool);
+
+    vmaDestroyAllocator(hAllocator);
+}
+
+struct MemoryPressureState
+{
+    uint32_t heapIndex;
+    uint32_t enterCount;
+    uint32_t leaveCount;
+    bool underPressure;
+};
+
+static void VKAPI_PTR MemoryPressureCallback(VmaAllocator allocator, uint32_t heapIndex, VkBool32 underPressure,
+    VkDeviceSize usage, VkDeviceSize budget, void* pUserData)
+{
+    MemoryPressureState* state = (MemoryPressureState*)pUserData;
+    if(heapIndex != state->heapIndex)
+        return;
+    // Must be called exactly once per transition.
+    TEST((underPressure != VK_FALSE) != state->underPressure);
+    state->underPressure = underPressure != VK_FALSE;
+    if(underPressure)
+    {
+        TEST(usage >= budget / 2);
+        ++state->enterCount;
+    }
+    else
+    {
+        TEST(usage < budget / 4);
+        ++state->leaveCount;
+    }
+}
+
+static void TestMemoryPressure()
+{
+    wprintf(L"Test memory pressure\n");
+
+    const VkDeviceSize HEAP_SIZE_LIMIT = 100ull * 1024 * 1024; // 100 MB
+    const VkDeviceSize BUF_SIZE        =  10ull * 1024 * 1024; // 10 MB
+
+    VkDeviceSize heapSizeLimit[VK_MAX_MEMORY_HEAPS];
+    for(uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; ++i)
+    {
+        heapSizeLimit[i] = HEAP_SIZE_LIMIT;
+    }
+
+    MemoryPressureState state = {};
+
+    VmaMemoryPressureMonitor pressureMonitor = {};
+    pressureMonitor.highWatermark = 0.5f;
+    pressureMonitor.lowWatermark = 0.25f;
+    pressureMonitor.pfnPressure = MemoryPressureCallback;
+    pressureMonitor.pUserData = &state;
+
+    // Not using VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT, so usage of the heap comes only from this allocator.
+    VmaAllocatorCreateInfo allocatorCreateInfo = {};
+    VmaVulkanFunctions vulkanFunctions;
+    SetBasicAllocatorCreateInfo(allocatorCreateInfo, vulkanFunctions);
+    allocatorCreateInfo.pHeapSizeLimit = heapSizeLimit;
+    allocatorCreateInfo.pMemoryPressureMonitor = &pressureMonitor;
+
+    VmaAllocator hAllocator;
+    VkResult res = vmaCreateAllocator(&allocatorCreateInfo, &hAllocator);
+    TEST(res == VK_SUCCESS);
+
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.size = BUF_SIZE;
+    bufCreateInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+    uint32_t memTypeIndex = UINT32_MAX;
+    res = vmaFindMemoryTypeIndexForBufferInfo(hAllocator, &bufCreateInfo, &allocCreateInfo, &memTypeIndex);
+    TEST(res == VK_SUCCESS);
+    state.heapIndex = MemoryTypeToHeap(memTypeIndex);
+    allocCreateInfo.memoryTypeBits = 1u << memTypeIndex;
+
+    struct Item
+    {
+        VkBuffer hBuf;
+        VmaAllocation hAlloc;
+    };
+    std::vector<Item> items;
+
+    // Budget is 80% of the heap size limit, so 5 buffers reach the high watermark.
+    for(uint32_t round = 0; round < 2; ++round)
+    {
+        for(size_t i = 0; i < 5; ++i)
+        {
+            Item item;
+            res = vmaCreateBuffer(hAllocator, &bufCreateInfo, &allocCreateInfo, &item.hBuf, &item.hAlloc, nullptr);
+            TEST(res == VK_SUCCESS);
+            items.push_back(item);
+        }
+        TEST(state.underPressure && state.enterCount == round + 1 && state.leaveCount == round);
+
+        // Usage between the watermarks doesn't change the state.
+        for(size_t i = 0; i < 3; ++i)
+        {
+            vmaDestroyBuffer(hAllocator, items.back().hBuf, items.back().hAlloc);
+            items.pop_back();
+        }
+        vmaSetCurrentFrameIndex(hAllocator, round + 1);
+        TEST(state.underPressure && state.enterCount == round + 1 && state.leaveCount == round);
+
+        while(!items.empty())
+        {
+            vmaDestroyBuffer(hAllocator, items.back().hBuf, items.back().hAlloc);
+            items.pop_back();
+        }
+        TEST(!state.underPressure && state.enterCount == round + 1 && state.leaveCount == round + 1);
     }
 
-    vmaDestroyPool(hAllocator, hPool);
-
     vmaDestroyAllocator(hAllocator);
 }
 
@@ -5076,6 +6943,124 @@ static void TestMemoryPriority()
     }
 }
 
+#if VMA_PAGEABLE_DEVICE_LOCAL_MEMORY
+static std::vector<std::pair<VkDeviceMemory, float>> g_SetMemoryPriorityCalls;
+
+static VKAPI_ATTR void VKAPI_CALL StubSetDeviceMemoryPriorityEXT(VkDevice device, VkDeviceMemory memory, float priority)
+{
+    g_SetMemoryPriorityCalls.push_back(std::make_pair(memory, priority));
+}
+
+static void TestMemoryPriorityDynamic()
+{
+    wprintf(L"Test memory priority dynamic\n");
+
+    assert(VK_EXT_memory_priority_enabled);
+
+    // Frame indices assume default VMA_MEMORY_PRIORITY_UPDATE_FRAME_COUNT = 16, VMA_MEMORY_PRIORITY_RECENT_FRAME_COUNT = 64.
+    static const VkDeviceSize BLOCK_SIZE = 1024ull * 1024;
+
+    VmaAllocatorCreateInfo allocatorCreateInfo = {};
+    allocatorCreateInfo.flags = VMA_ALLOCATOR_CREATE_EXT_MEMORY_PRIORITY_BIT |
+        VMA_ALLOCATOR_CREATE_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_BIT;
+    VmaVulkanFunctions vulkanFunctions;
+    SetBasicAllocatorCreateInfo(allocatorCreateInfo, vulkanFunctions);
+    // The device doesn't need to support the extension, as the function is stubbed.
+    vulkanFunctions.vkSetDeviceMemoryPriorityEXT = StubSetDeviceMemoryPriorityEXT;
+
+    VmaAllocator hAllocator;
+    VkResult res = vmaCreateAllocator(&allocatorCreateInfo, &hAllocator);
+    TEST(res == VK_SUCCESS);
+
+    // Every buffer takes whole block.
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.size = BLOCK_SIZE;
+    bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+    VmaPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.blockSize = BLOCK_SIZE;
+    poolCreateInfo.priority = 0.5f;
+    res = vmaFindMemoryTypeIndexForBufferInfo(hAllocator, &bufCreateInfo, &allocCreateInfo, &poolCreateInfo.memoryTypeIndex);
+    TEST(res == VK_SUCCESS);
+
+    VkMemoryPropertyFlags memTypeFlags = 0;
+    vmaGetMemoryTypeProperties(hAllocator, poolCreateInfo.memoryTypeIndex, &memTypeFlags);
+    if((memTypeFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == 0)
+    {
+        vmaDestroyAllocator(hAllocator);
+        return;
+    }
+
+    VmaPool pool = VK_NULL_HANDLE;
+    res = vmaCreatePool(hAllocator, &poolCreateInfo, &pool);
+    TEST(res == VK_SUCCESS);
+    allocCreateInfo.pool = pool;
+
+    // 0 is hot, 1 is cold, 2 has no hint.
+    const VmaAllocationCreateFlags hintFlags[] = {
+        VMA_ALLOCATION_CREATE_PRIORITY_HOT_BIT,
+        VMA_ALLOCATION_CREATE_PRIORITY_COLD_BIT,
+        0 };
+    BufferInfo bufInfos[3] = {};
+    VkDeviceMemory memories[3] = {};
+    for(size_t i = 0; i < 3; ++i)
+    {
+        allocCreateInfo.flags = hintFlags[i];
+        VmaAllocationInfo allocInfo = {};
+        res = vmaCreateBuffer(hAllocator, &bufCreateInfo, &allocCreateInfo, &bufInfos[i].Buffer, &bufInfos[i].Allocation, &allocInfo);
+        TEST(res == VK_SUCCESS);
+        memories[i] = allocInfo.deviceMemory;
+    }
+
+    auto findPriority = [&](VkDeviceMemory memory, float& outPriority) -> bool
+    {
+        for(size_t i = g_SetMemoryPriorityCalls.size(); i--; )
+        {
+            if(g_SetMemoryPriorityCalls[i].first == memory)
+            {
+                outPriority = g_SetMemoryPriorityCalls[i].second;
+                return true;
+            }
+        }
+        return false;
+    };
+    float priority = 0.f;
+
+    // Priorities are not updated before enough frames pass.
+    g_SetMemoryPriorityCalls.clear();
+    vmaSetCurrentFrameIndex(hAllocator, 15);
+    TEST(g_SetMemoryPriorityCalls.empty());
+
+    // Hot block goes up, cold one down, recently used one stays at pool priority.
+    vmaSetCurrentFrameIndex(hAllocator, 16);
+    TEST(g_SetMemoryPriorityCalls.size() == 2);
+    TEST(findPriority(memories[0], priority) && priority == 1.f);
+    TEST(findPriority(memories[1], priority) && priority == 0.f);
+    TEST(!findPriority(memories[2], priority));
+
+    // Block not used for long enough gets lower priority. Unchanged priorities are not set again.
+    g_SetMemoryPriorityCalls.clear();
+    vmaSetCurrentFrameIndex(hAllocator, 80);
+    TEST(g_SetMemoryPriorityCalls.size() == 1);
+    TEST(findPriority(memories[2], priority) && priority < 0.5f);
+
+    // Using it brings its priority back.
+    g_SetMemoryPriorityCalls.clear();
+    vmaNotifyAllocationUsed(hAllocator, bufInfos[2].Allocation);
+    vmaSetCurrentFrameIndex(hAllocator, 96);
+    TEST(g_SetMemoryPriorityCalls.size() == 1);
+    TEST(findPriority(memories[2], priority) && priority == 0.5f);
+
+    for(size_t i = 0; i < 3; ++i)
+        vmaDestroyBuffer(hAllocator, bufInfos[i].Buffer, bufInfos[i].Allocation);
+    vmaDestroyPool(hAllocator, pool);
+    vmaDestroyAllocator(hAllocator);
+}
+#endif // #if VMA_PAGEABLE_DEVICE_LOCAL_MEMORY
+
 static void BenchmarkAlgorithms(FILE* file)
 {
     wprintf(L"Benchmark algorithms\n");
@@ -6900,6 +8885,81 @@ static void TestStatistics()
     }
 }
 
+static void TestStatisticsMultithreaded()
+{
+    wprintf(L"Testing statistics multithreaded...\n");
+
+    constexpr uint32_t THREAD_COUNT = 8;
+    constexpr uint32_t BUF_COUNT_PER_THREAD = 256;
+
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.size = 0x1000;
+    bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+
+    VmaPoolCreateInfo poolCreateInfo = {};
+    VkResult res = vmaFindMemoryTypeIndexForBufferInfo(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &poolCreateInfo.memoryTypeIndex);
+    TEST(res == VK_SUCCESS);
+    VmaPool pool = VK_NULL_HANDLE;
+    res = vmaCreatePool(g_hAllocator, &poolCreateInfo, &pool);
+    TEST(res == VK_SUCCESS);
+    allocCreateInfo.pool = pool;
+
+    const uint32_t heapIndex = MemoryTypeToHeap(poolCreateInfo.memoryTypeIndex);
+
+    VmaBudget budgetBeg[VK_MAX_MEMORY_HEAPS] = {};
+    vmaGetHeapBudgets(g_hAllocator, budgetBeg);
+
+    // Every thread creates its buffers, then destroys buffers created by another thread.
+    std::vector<BufferInfo> bufInfos(THREAD_COUNT * BUF_COUNT_PER_THREAD);
+    std::vector<std::thread> threads;
+    for(uint32_t threadIndex = 0; threadIndex < THREAD_COUNT; ++threadIndex)
+    {
+        threads.emplace_back([&, threadIndex]() {
+            for(uint32_t i = 0; i < BUF_COUNT_PER_THREAD; ++i)
+            {
+                BufferInfo& bufInfo = bufInfos[threadIndex * BUF_COUNT_PER_THREAD + i];
+                VkResult res = vmaCreateBuffer(g_hAllocator, &bufCreateInfo, &allocCreateInfo,
+                    &bufInfo.Buffer, &bufInfo.Allocation, nullptr);
+                TEST(res == VK_SUCCESS);
+            }
+        });
+    }
+    for(std::thread& thread : threads)
+        thread.join();
+    threads.clear();
+
+    VmaBudget budgetWithBufs[VK_MAX_MEMORY_HEAPS] = {};
+    vmaGetHeapBudgets(g_hAllocator, budgetWithBufs);
+    TEST(budgetWithBufs[heapIndex].statistics.allocationCount ==
+        budgetBeg[heapIndex].statistics.allocationCount + THREAD_COUNT * BUF_COUNT_PER_THREAD);
+    TEST(budgetWithBufs[heapIndex].statistics.allocationBytes ==
+        budgetBeg[heapIndex].statistics.allocationBytes + THREAD_COUNT * BUF_COUNT_PER_THREAD * bufCreateInfo.size);
+
+    for(uint32_t threadIndex = 0; threadIndex < THREAD_COUNT; ++threadIndex)
+    {
+        threads.emplace_back([&, threadIndex]() {
+            const uint32_t srcThreadIndex = (threadIndex + 1) % THREAD_COUNT;
+            for(uint32_t i = 0; i < BUF_COUNT_PER_THREAD; ++i)
+            {
+                BufferInfo& bufInfo = bufInfos[srcThreadIndex * BUF_COUNT_PER_THREAD + i];
+                vmaDestroyBuffer(g_hAllocator, bufInfo.Buffer, bufInfo.Allocation);
+            }
+        });
+    }
+    for(std::thread& thread : threads)
+        thread.join();
+
+    VmaBudget budgetEnd[VK_MAX_MEMORY_HEAPS] = {};
+    vmaGetHeapBudgets(g_hAllocator, budgetEnd);
+    TEST(budgetEnd[heapIndex].statistics.allocationCount == budgetBeg[heapIndex].statistics.allocationCount);
+    TEST(budgetEnd[heapIndex].statistics.allocationBytes == budgetBeg[heapIndex].statistics.allocationBytes);
+
+    vmaDestroyPool(g_hAllocator, pool);
+}
+
 static void TestAliasing()
 {
     wprintf(L"Testing aliasing...\n");
@@ -7276,6 +9336,330 @@ static void TestAllocationMemoryCopy()
     }
 }
 
+static void BenchmarkMappedMemoryCopy()
+{
+    wprintf(L"Benchmark mapped memory copy\n");
+
+    constexpr size_t bufSize = 32 * MEGABYTE;
+    constexpr uint32_t iterationCount = 8;
+    std::vector<uint8_t> srcVector(bufSize + 64);
+    std::vector<uint8_t> dstVector(bufSize + 64);
+    for(size_t i = 0; i < srcVector.size(); ++i)
+        srcVector[i] = (uint8_t)(i * 13 + 7);
+
+    // memcpy between regular host memory as the reference.
+    time_point timeBegin = std::chrono::high_resolution_clock::now();
+    for(uint32_t i = 0; i < iterationCount; ++i)
+        memcpy(dstVector.data(), srcVector.data(), bufSize);
+    const float hostSeconds = ToFloatSeconds(std::chrono::high_resolution_clock::now() - timeBegin);
+    wprintf(L"    Host memory memcpy: %.2f GB/s\n", (float)bufSize * iterationCount / hostSeconds / 1e9f);
+
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.size = bufSize;
+    bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    const VmaAllocationCreateFlags allocFlags[] = {
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+    };
+    for(VmaAllocationCreateFlags flags : allocFlags)
+    {
+        VmaAllocationCreateInfo allocCreateInfo = {};
+        allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+        allocCreateInfo.flags = flags | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        VkBuffer buf = VK_NULL_HANDLE;
+        VmaAllocation alloc = VK_NULL_HANDLE;
+        VmaAllocationInfo allocInfo = {};
+        VkResult res = vmaCreateBuffer(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &buf, &alloc, &allocInfo);
+        TEST(res == VK_SUCCESS);
+        VkMemoryPropertyFlags memFlags = 0;
+        vmaGetAllocationMemoryProperties(g_hAllocator, alloc, &memFlags);
+        const bool cached = (memFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
+
+        // Writes.
+        timeBegin = std::chrono::high_resolution_clock::now();
+        for(uint32_t i = 0; i < iterationCount; ++i)
+        {
+            memcpy(allocInfo.pMappedData, srcVector.data(), bufSize);
+            TEST(vmaFlushAllocation(g_hAllocator, alloc, 0, VK_WHOLE_SIZE) == VK_SUCCESS);
+        }
+        const float memcpyWriteSeconds = ToFloatSeconds(std::chrono::high_resolution_clock::now() - timeBegin);
+        timeBegin = std::chrono::high_resolution_clock::now();
+        for(uint32_t i = 0; i < iterationCount; ++i)
+            TEST(vmaCopyMemoryToAllocation(g_hAllocator, srcVector.data(), alloc, 0, bufSize) == VK_SUCCESS);
+        const float copyWriteSeconds = ToFloatSeconds(std::chrono::high_resolution_clock::now() - timeBegin);
+
+        // Reads, with a reference kept for the data check.
+        timeBegin = std::chrono::high_resolution_clock::now();
+        for(uint32_t i = 0; i < iterationCount; ++i)
+        {
+            TEST(vmaInvalidateAllocation(g_hAllocator, alloc, 0, VK_WHOLE_SIZE) == VK_SUCCESS);
+            memcpy(dstVector.data(), allocInfo.pMappedData, bufSize);
+        }
+        const float memcpyReadSeconds = ToFloatSeconds(std::chrono::high_resolution_clock::now() - timeBegin);
+        TEST(memcmp(dstVector.data(), srcVector.data(), bufSize) == 0);
+        timeBegin = std::chrono::high_resolution_clock::now();
+        for(uint32_t i = 0; i < iterationCount; ++i)
+            TEST(vmaCopyAllocationToMemory(g_hAllocator, alloc, 0, dstVector.data(), bufSize) == VK_SUCCESS);
+        const float copyReadSeconds = ToFloatSeconds(std::chrono::high_resolution_clock::now() - timeBegin);
+        TEST(memcmp(dstVector.data(), srcVector.data(), bufSize) == 0);
+
+        const float gigabytes = (float)bufSize * iterationCount / 1e9f;
+        wprintf(L"    %s memory (%s): write memcpy %.2f GB/s, vmaCopyMemoryToAllocation %.2f GB/s, read memcpy %.2f GB/s, vmaCopyAllocationToMemory %.2f GB/s\n",
+            flags == VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT ? L"Sequential write" : L"Random access",
+            cached ? L"cached" : L"uncached",
+            gigabytes / memcpyWriteSeconds, gigabytes / copyWriteSeconds, gigabytes / memcpyReadSeconds, gigabytes / copyReadSeconds);
+
+        // Unaligned offsets and sizes, with the beginning and end copied separately from the rest.
+        for(size_t offset = 1; offset < 64; offset += 21)
+        {
+            const size_t size = 100 * KILOBYTE + offset * 3;
+            TEST(vmaCopyMemoryToAllocation(g_hAllocator, srcVector.data() + offset + 1, alloc, offset, size) == VK_SUCCESS);
+            TEST(vmaCopyAllocationToMemory(g_hAllocator, alloc, offset, dstVector.data() + offset * 2, size) == VK_SUCCESS);
+            TEST(memcmp(dstVector.data() + offset * 2, srcVector.data() + offset + 1, size) == 0);
+        }
+
+        vmaDestroyBuffer(g_hAllocator, buf, alloc);
+    }
+}
+
+static uint32_t g_FlushedRangeCount;
+static uint32_t g_FlushCallCount;
+static uint32_t g_InvalidatedRangeCount;
+static uint32_t g_InvalidateCallCount;
+
+static VKAPI_ATTR VkResult VKAPI_CALL StubFlushMappedMemoryRanges(VkDevice device, uint32_t memoryRangeCount, const VkMappedMemoryRange* pMemoryRanges)
+{
+    ++g_FlushCallCount;
+    g_FlushedRangeCount += memoryRangeCount;
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL StubInvalidateMappedMemoryRanges(VkDevice device, uint32_t memoryRangeCount, const VkMappedMemoryRange* pMemoryRanges)
+{
+    ++g_InvalidateCallCount;
+    g_InvalidatedRangeCount += memoryRangeCount;
+    return VK_SUCCESS;
+}
+
+// Reports all HOST_VISIBLE memory types as not HOST_COHERENT, so the allocator needs to flush them.
+static VKAPI_ATTR void VKAPI_CALL StubGetPhysicalDeviceMemoryProperties(VkPhysicalDevice physicalDevice, VkPhysicalDeviceMemoryProperties* pMemoryProperties)
+{
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, pMemoryProperties);
+    for(uint32_t i = 0; i < pMemoryProperties->memoryTypeCount; ++i)
+    {
+        if((pMemoryProperties->memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0)
+            pMemoryProperties->memoryTypes[i].propertyFlags &= ~VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+}
+
+// Creates allocator that sees all HOST_VISIBLE memory as not HOST_COHERENT and counts ranges of flushes and invalidations.
+static VmaAllocator CreateAllocatorWithStubbedFlush()
+{
+    // Vulkan 1.0 is used so that the allocator queries memory properties with the stubbed function.
+    VmaAllocatorCreateInfo allocatorCreateInfo = {};
+    allocatorCreateInfo.vulkanApiVersion = VK_API_VERSION_1_0;
+    VmaVulkanFunctions vulkanFunctions;
+    SetBasicAllocatorCreateInfo(allocatorCreateInfo, vulkanFunctions);
+    vulkanFunctions.vkGetPhysicalDeviceMemoryProperties = StubGetPhysicalDeviceMemoryProperties;
+    vulkanFunctions.vkGetPhysicalDeviceMemoryProperties2KHR = nullptr;
+    vulkanFunctions.vkFlushMappedMemoryRanges = StubFlushMappedMemoryRanges;
+    vulkanFunctions.vkInvalidateMappedMemoryRanges = StubInvalidateMappedMemoryRanges;
+
+    VmaAllocator hAllocator;
+    VkResult res = vmaCreateAllocator(&allocatorCreateInfo, &hAllocator);
+    TEST(res == VK_SUCCESS);
+    return hAllocator;
+}
+
+static void BenchmarkFlushAllocations()
+{
+    wprintf(L"Benchmark flush allocations\n");
+
+    VmaAllocator hAllocator = CreateAllocatorWithStubbedFlush();
+    VkResult res = VK_SUCCESS;
+
+    const uint32_t ALLOCATION_COUNT = 5000;
+    const uint32_t FLUSH_COUNT = 100;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    RandomNumberGenerator rand{ 7203 };
+    std::vector<VmaAllocation> allocations(ALLOCATION_COUNT);
+    for(uint32_t i = 0; i < ALLOCATION_COUNT; ++i)
+    {
+        const VkMemoryRequirements memReq = { (rand.Generate() % 64 + 1) * 64, 16, UINT32_MAX };
+        res = vmaAllocateMemory(hAllocator, &memReq, &allocCreateInfo, &allocations[i], nullptr);
+        TEST(res == VK_SUCCESS);
+    }
+    // Order of the allocations passed doesn't matter.
+    for(uint32_t i = ALLOCATION_COUNT; i-- > 1; )
+        std::swap(allocations[i], allocations[rand.Generate() % (i + 1)]);
+
+    g_FlushCallCount = 0;
+    g_FlushedRangeCount = 0;
+    const time_point timeBegin = std::chrono::high_resolution_clock::now();
+    for(uint32_t i = 0; i < FLUSH_COUNT; ++i)
+    {
+        res = vmaFlushAllocations(hAllocator, ALLOCATION_COUNT, allocations.data(), nullptr, nullptr);
+        TEST(res == VK_SUCCESS);
+    }
+    const duration flushDuration = std::chrono::high_resolution_clock::now() - timeBegin;
+
+    VmaTotalStatistics stats = {};
+    vmaCalculateStatistics(hAllocator, &stats);
+    const uint32_t rangeCount = g_FlushedRangeCount / FLUSH_COUNT;
+    wprintf(L"    %u allocations in %u blocks flushed as %u ranges, %.3f ms per flush\n",
+        ALLOCATION_COUNT, stats.total.statistics.blockCount, rangeCount,
+        ToFloatSeconds(flushDuration) * 1000.f / FLUSH_COUNT);
+    TEST(g_FlushCallCount == FLUSH_COUNT);
+    // Allocations made in sequence are tightly packed, so there are only a few ranges in every block.
+    TEST(rangeCount >= stats.total.statistics.blockCount && rangeCount < ALLOCATION_COUNT / 10);
+
+    vmaFreeMemoryPages(hAllocator, allocations.size(), allocations.data());
+    vmaDestroyAllocator(hAllocator);
+}
+
+static void TestDeferredFlush()
+{
+    wprintf(L"Test deferred flush\n");
+
+    VmaAllocator hAllocator = CreateAllocatorWithStubbedFlush();
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    const VkMemoryRequirements memReq = { 4096, 16, UINT32_MAX };
+    std::vector<VmaAllocation> allocations(16);
+    for(size_t i = 0; i < allocations.size(); ++i)
+    {
+        VkResult res = vmaAllocateMemory(hAllocator, &memReq, &allocCreateInfo, &allocations[i], nullptr);
+        TEST(res == VK_SUCCESS);
+    }
+
+    // 1. Many small writes to neighboring allocations end up in one call with one range per block.
+    g_FlushCallCount = g_FlushedRangeCount = 0;
+    for(uint32_t iteration = 0; iteration < 4; ++iteration)
+    {
+        for(size_t i = 0; i < allocations.size(); ++i)
+        {
+            vmaMarkDirty(hAllocator, allocations[i], iteration * 1024, 16);
+            vmaMarkDirty(hAllocator, allocations[i], iteration * 1024 + 512, VK_WHOLE_SIZE);
+        }
+    }
+    TEST(g_FlushCallCount == 0);
+    TEST(vmaFlushDirty(hAllocator) == VK_SUCCESS);
+    TEST(g_FlushCallCount == 1);
+    VmaTotalStatistics stats = {};
+    vmaCalculateStatistics(hAllocator, &stats);
+    TEST(g_FlushedRangeCount >= 1 && g_FlushedRangeCount <= stats.total.statistics.blockCount);
+
+    // 2. Ranges are flushed only once.
+    TEST(vmaFlushDirty(hAllocator) == VK_SUCCESS);
+    TEST(g_FlushCallCount == 1);
+
+    // 3. Ranges in memory freed before the flush are dropped.
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    VmaAllocation dedicatedAlloc = VK_NULL_HANDLE;
+    TEST(vmaAllocateMemory(hAllocator, &memReq, &allocCreateInfo, &dedicatedAlloc, nullptr) == VK_SUCCESS);
+    vmaMarkDirty(hAllocator, dedicatedAlloc, 0, VK_WHOLE_SIZE);
+    vmaFreeMemory(hAllocator, dedicatedAlloc);
+    TEST(vmaFlushDirty(hAllocator) == VK_SUCCESS);
+    TEST(g_FlushCallCount == 1);
+
+    // 4. Invalidation works the same way, independently of the flush.
+    g_InvalidateCallCount = g_InvalidatedRangeCount = 0;
+    vmaMarkStale(hAllocator, allocations[0], 0, VK_WHOLE_SIZE);
+    vmaMarkStale(hAllocator, allocations[0], 0, 64);
+    TEST(vmaFlushDirty(hAllocator) == VK_SUCCESS);
+    TEST(g_FlushCallCount == 1 && g_InvalidateCallCount == 0);
+    TEST(vmaInvalidateStale(hAllocator) == VK_SUCCESS);
+    TEST(g_InvalidateCallCount == 1 && g_InvalidatedRangeCount == 1);
+
+    vmaFreeMemoryPages(hAllocator, allocations.size(), allocations.data());
+    vmaDestroyAllocator(hAllocator);
+}
+
+static void TestCopyMemoryToAllocations()
+{
+    wprintf(L"Test copy memory to allocations\n");
+
+    VmaAllocator hAllocator = CreateAllocatorWithStubbedFlush();
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    const VkDeviceSize allocSize = 64 * 1024;
+    const VkMemoryRequirements memReq = { allocSize, 16, UINT32_MAX };
+    const uint32_t allocCount = 64;
+    std::vector<VmaAllocation> allocations(allocCount);
+    for(uint32_t i = 0; i < allocCount; ++i)
+    {
+        // One allocation is dedicated, to test mapping of both kinds.
+        allocCreateInfo.flags = i == allocCount / 2 ? VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT : 0;
+        TEST(vmaAllocateMemory(hAllocator, &memReq, &allocCreateInfo, &allocations[i], nullptr) == VK_SUCCESS);
+    }
+
+    // Each allocation is written in two halves, by separate copies given in reverse order.
+    const uint32_t copyCount = allocCount * 2;
+    const VkDeviceSize copySize = allocSize / 2;
+    std::vector<uint8_t> srcData((size_t)(allocSize * allocCount));
+    for(size_t i = 0; i < srcData.size(); ++i)
+        srcData[i] = (uint8_t)(i * 7 + i / 251);
+    std::vector<const void*> srcPointers(copyCount);
+    std::vector<VmaAllocation> copyAllocations(copyCount);
+    std::vector<VkDeviceSize> offsets(copyCount);
+    std::vector<VkDeviceSize> sizes(copyCount, copySize);
+    for(uint32_t i = 0; i < copyCount; ++i)
+    {
+        const uint32_t copyIndex = copyCount - 1 - i;
+        srcPointers[i] = srcData.data() + copyIndex * copySize;
+        copyAllocations[i] = allocations[copyIndex / 2];
+        offsets[i] = (copyIndex % 2) * copySize;
+    }
+
+    uint32_t dispatchedJobCount = 0;
+    const PFN_vmaDispatchJobsFunction dispatchJobs = [](void* pUserData, uint32_t jobCount, PFN_vmaJobFunction pfnJob, void* pJobData)
+    {
+        *(uint32_t*)pUserData += jobCount;
+        for(uint32_t i = 0; i < jobCount; ++i)
+            pfnJob(pJobData, i);
+    };
+
+    g_FlushCallCount = g_FlushedRangeCount = 0;
+    TEST(vmaCopyMemoryToAllocations(hAllocator, copyCount, srcPointers.data(), copyAllocations.data(),
+        offsets.data(), sizes.data(), dispatchJobs, &dispatchedJobCount) == VK_SUCCESS);
+    TEST(g_FlushCallCount == 1);
+    TEST(g_FlushedRangeCount < allocCount);
+    TEST(dispatchedJobCount >= (uint32_t)(srcData.size() / VMA_DEFRAGMENTATION_HOST_COPY_JOB_SIZE));
+
+    // Every allocation was written, and nothing is left mapped.
+    for(uint32_t i = 0; i < allocCount; ++i)
+    {
+        void* pMappedData = nullptr;
+        TEST(vmaMapMemory(hAllocator, allocations[i], &pMappedData) == VK_SUCCESS);
+        TEST(memcmp(pMappedData, srcData.data() + i * allocSize, (size_t)allocSize) == 0);
+        vmaUnmapMemory(hAllocator, allocations[i]);
+        VmaAllocationInfo allocInfo = {};
+        vmaGetAllocationInfo(hAllocator, allocations[i], &allocInfo);
+        TEST(allocInfo.pMappedData == nullptr);
+    }
+
+    // Read everything back in the other direction, whole allocations at once, without the callback.
+    std::vector<uint8_t> dstData(srcData.size());
+    std::vector<void*> dstPointers(allocCount);
+    for(uint32_t i = 0; i < allocCount; ++i)
+        dstPointers[i] = dstData.data() + i * allocSize;
+    const std::vector<VkDeviceSize> allocSizes(allocCount, allocSize);
+    g_InvalidateCallCount = 0;
+    TEST(vmaCopyAllocationsToMemory(hAllocator, allocCount, allocations.data(), nullptr,
+        dstPointers.data(), allocSizes.data(), nullptr, nullptr) == VK_SUCCESS);
+    TEST(g_InvalidateCallCount == 1);
+    TEST(dstData == srcData);
+
+    vmaFreeMemoryPages(hAllocator, allocations.size(), allocations.data());
+    vmaDestroyAllocator(hAllocator);
+}
+
 // Test CREATE_MAPPED with required DEVICE_LOCAL. There was a bug with it.
 static void TestDeviceLocalMapped()
 {
@@ -7343,6 +9727,94 @@ static void TestMaintenance5()
 #endif
 }
 
+// Many threads mapping and unmapping small allocations in the same block, which mostly takes the lock-free path.
+static void TestMappingContention()
+{
+    wprintf(L"Testing mapping contention...\n");
+
+    static const uint32_t threadCount = 8;
+    static const uint32_t iterationCount = 100000;
+    static const VkDeviceSize allocSize = 256;
+
+    VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufCreateInfo.size = allocSize;
+    bufCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+    VmaPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.blockSize = MEGABYTE;
+    poolCreateInfo.minBlockCount = poolCreateInfo.maxBlockCount = 1;
+    TEST(vmaFindMemoryTypeIndexForBufferInfo(g_hAllocator,
+        &bufCreateInfo, &allocCreateInfo, &poolCreateInfo.memoryTypeIndex) == VK_SUCCESS);
+    VmaPool pool = nullptr;
+    TEST(vmaCreatePool(g_hAllocator, &poolCreateInfo, &pool) == VK_SUCCESS);
+    allocCreateInfo.pool = pool;
+
+    // One allocation stays mapped, so the block never gets unmapped, like a persistently mapped ring buffer.
+    BufferInfo mappedBuf;
+    VmaAllocationCreateInfo mappedAllocCreateInfo = allocCreateInfo;
+    mappedAllocCreateInfo.flags |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    TEST(vmaCreateBuffer(g_hAllocator, &bufCreateInfo, &mappedAllocCreateInfo, &mappedBuf.Buffer, &mappedBuf.Allocation, nullptr) == VK_SUCCESS);
+
+    std::vector<BufferInfo> bufs(threadCount);
+    for(BufferInfo& buf : bufs)
+        TEST(vmaCreateBuffer(g_hAllocator, &bufCreateInfo, &allocCreateInfo, &buf.Buffer, &buf.Allocation, nullptr) == VK_SUCCESS);
+
+    for(uint32_t keepMapped = 2; keepMapped--; )
+    {
+        if(keepMapped == 0)
+        {
+            vmaDestroyBuffer(g_hAllocator, mappedBuf.Buffer, mappedBuf.Allocation);
+            mappedBuf = {};
+        }
+
+        const time_point timeBeg = std::chrono::high_resolution_clock::now();
+        std::thread threads[threadCount];
+        for(uint32_t threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+        {
+            threads[threadIndex] = std::thread([&bufs, threadIndex]()
+            {
+                const VmaAllocation alloc = bufs[threadIndex].Allocation;
+                for(uint32_t i = 0; i < iterationCount; ++i)
+                {
+                    uint32_t* data = nullptr;
+                    TEST(vmaMapMemory(g_hAllocator, alloc, (void**)&data) == VK_SUCCESS && data != nullptr);
+                    data[i % (allocSize / sizeof(uint32_t))] = threadIndex * iterationCount + i;
+                    vmaUnmapMemory(g_hAllocator, alloc);
+                }
+            });
+        }
+        for(uint32_t threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+            threads[threadIndex].join();
+        const duration mapDuration = std::chrono::high_resolution_clock::now() - timeBeg;
+
+        // Every thread saw its own data through the shared mapping, and nothing is left mapped.
+        for(uint32_t threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+        {
+            uint32_t* data = nullptr;
+            TEST(vmaMapMemory(g_hAllocator, bufs[threadIndex].Allocation, (void**)&data) == VK_SUCCESS);
+            const uint32_t lastIndex = iterationCount - 1;
+            TEST(data[lastIndex % (allocSize / sizeof(uint32_t))] == threadIndex * iterationCount + lastIndex);
+            vmaUnmapMemory(g_hAllocator, bufs[threadIndex].Allocation);
+
+            VmaAllocationInfo allocInfo;
+            vmaGetAllocationInfo(g_hAllocator, bufs[threadIndex].Allocation, &allocInfo);
+            TEST(allocInfo.pMappedData == nullptr);
+        }
+
+        wprintf(L"    %u threads, %u map+unmap each, %s: %.2f ns per pair\n", threadCount, iterationCount,
+            keepMapped ? L"block kept mapped" : L"block mapped on demand",
+            ToFloatSeconds(mapDuration) * 1e9f / (float)(threadCount * iterationCount));
+    }
+
+    for(BufferInfo& buf : bufs)
+        vmaDestroyBuffer(g_hAllocator, buf.Buffer, buf.Allocation);
+    vmaDestroyPool(g_hAllocator, pool);
+}
+
 static void TestMappingMultithreaded()
 {
     wprintf(L"Testing mapping multithreaded...\n");
@@ -8862,14 +11334,22 @@ void Test()
     TestBasics();
     TestVirtualBlocks();
     TestVirtualBlocksAlgorithms();
+    TestVirtualBlocksResize();
+    TestVirtualBlocksMultiple();
+    TestVirtualBlocksSerialization();
+    TestVirtualBlocksDefragmentation();
+    TestVirtualBlockVector();
     TestVirtualBlocksAlgorithmsBenchmark();
     TestAllocationVersusResourceSize();
     //TestGpuData(); // Not calling this because it's just testing the testing environment.
     TestPool_SameSize();
     TestPool_MinBlockCount();
+    TestPool_MemoryLimits();
+    TestPool_EmptyBlocks();
     TestPool_MinAllocationAlignment();
     TestPoolsAndAllocationParameters();
     TestHeapSizeLimit();
+    TestMemoryPressure();
 #if VMA_DEBUG_INITIALIZE_ALLOCATIONS
     TestAllocationsInitialization();
 #endif
@@ -8880,16 +11360,22 @@ void Test()
     TestAdvancedDataUploading();
     TestDeviceCoherentMemory();
     TestStatistics();
+    TestStatisticsMultithreaded();
     TestAliasing();
     TestAllocationAliasing();
     TestMapping();
     TestAllocationMemoryCopy();
+    BenchmarkMappedMemoryCopy();
+    BenchmarkFlushAllocations();
+    TestDeferredFlush();
+    TestCopyMemoryToAllocations();
     TestMappingHysteresis();
     TestDeviceLocalMapped();
     TestMaintenance5();
     TestWin32HandlesExport();
     TestWin32HandlesImport();
     TestMappingMultithreaded();
+    TestMappingContention();
     TestLinearAllocator();
     ManuallyTestLinearAllocator();
     TestLinearAllocatorMultiBlock();
@@ -8901,7 +11387,12 @@ void Test()
     if (VK_KHR_buffer_device_address_enabled)
         TestBufferDeviceAddress();
     if (VK_EXT_memory_priority_enabled)
+    {
         TestMemoryPriority();
+#if VMA_PAGEABLE_DEVICE_LOCAL_MEMORY
+        TestMemoryPriorityDynamic();
+#endif
+    }
 
     {
         FILE* file;
@@ -8917,7 +11408,15 @@ void Test()
     {
         TestDefragmentationAlgorithms();
         TestDefragmentationFull();
+        TestDefragmentationParallel();
+        TestDefragmentationTimeBudget();
+        TestDefragmentationMonitor();
+        TestDefragmentationPromoteDedicated();
+        TestDefragmentationOnHost();
+        TestDefragmentationMoveHints();
         TestDefragmentationGpu();
+        TestDefragmentationGpuRecordCopies();
+        TestDefragmentationResidency();
         TestDefragmentationIncrementalBasic();
         TestDefragmentationIncrementalComplex();
     }